@@ -0,0 +1,186 @@
+#include "stdafx.h"
+#include "ArmatureDelta.h"
+#include "ReportWriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+const char kSnapshotMagic[8] = { 'H', 'N', 'R', 'X', 'A', 'S', 'N', '2' };
+const uint64_t kFnvOffset = 14695981039346656037ull;
+const uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t FnvBytes(uint64_t h, const void* p, size_t n)
+{
+    const unsigned char* b = static_cast<const unsigned char*>(p);
+    for (size_t i = 0; i < n; ++i)
+    {
+        h ^= b[i];
+        h *= kFnvPrime;
+    }
+    return h;
+}
+
+int64_t Quantize(double v)
+{
+    return (int64_t)std::llround(v / kArmatureDeltaQuantum);
+}
+} // namespace
+
+uint64_t HashString(const std::wstring& s)
+{
+    return FnvBytes(kFnvOffset, s.c_str(), s.size() * sizeof(wchar_t));
+}
+
+uint64_t ArmatureRowHash(const std::wstring& kksPart, const std::wstring& className,
+    double x, double y, double z, bool isDummy)
+{
+    // Длины входят в хеш, чтобы ("AB","C") и ("A","BC") различались
+    uint64_t h = kFnvOffset;
+    uint32_t len = (uint32_t)kksPart.size();
+    h = FnvBytes(h, &len, sizeof(len));
+    h = FnvBytes(h, kksPart.c_str(), kksPart.size() * sizeof(wchar_t));
+    len = (uint32_t)className.size();
+    h = FnvBytes(h, &len, sizeof(len));
+    h = FnvBytes(h, className.c_str(), className.size() * sizeof(wchar_t));
+    int64_t q[3] = { Quantize(x), Quantize(y), Quantize(z) };
+    h = FnvBytes(h, q, sizeof(q));
+    unsigned char d = isDummy ? 1 : 0;
+    return FnvBytes(h, &d, 1);
+}
+
+void SortSnapshot(ArmatureSnapshot& snap)
+{
+    std::sort(snap.rows.begin(), snap.rows.end(),
+        [](const ArmatureSnapshot::Row& a, const ArmatureSnapshot::Row& b) { return a.handle < b.handle; });
+}
+
+bool LoadArmatureSnapshot(const std::wstring& path, ArmatureSnapshot& snap)
+{
+    snap.drawingKey = 0;
+    snap.generation = 0;
+    snap.rows.clear();
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    auto readAll = [hFile](void* dst, size_t n)
+    {
+        char* p = static_cast<char*>(dst);
+        while (n > 0)
+        {
+            DWORD chunk = n > 0x40000000u ? 0x40000000u : (DWORD)n;
+            DWORD done = 0;
+            if (!ReadFile(hFile, p, chunk, &done, nullptr) || done == 0)
+                return false;
+            p += done;
+            n -= done;
+        }
+        return true;
+    };
+
+    char magic[8] = { 0 };
+    uint64_t count = 0;
+    bool ok = readAll(magic, sizeof(magic)) && memcmp(magic, kSnapshotMagic, sizeof(magic)) == 0 &&
+        readAll(&snap.drawingKey, sizeof(snap.drawingKey)) &&
+        readAll(&snap.generation, sizeof(snap.generation)) &&
+        readAll(&count, sizeof(count)) && count < (1ull << 32);
+    if (ok)
+    {
+        snap.rows.resize((size_t)count);
+        ok = count == 0 || readAll(snap.rows.data(), snap.rows.size() * sizeof(ArmatureSnapshot::Row));
+    }
+    CloseHandle(hFile);
+
+    if (!ok)
+    {
+        snap.drawingKey = 0;
+        snap.generation = 0;
+        snap.rows.clear();
+    }
+    return ok;
+}
+
+bool SaveArmatureSnapshot(const std::wstring& path, const ArmatureSnapshot& snap)
+{
+    CReportWriter out;
+    if (!out.Open(path))
+        return false;
+    uint64_t count = snap.rows.size();
+    out.Raw(kSnapshotMagic, sizeof(kSnapshotMagic));
+    out.Raw(reinterpret_cast<const char*>(&snap.drawingKey), sizeof(snap.drawingKey));
+    out.Raw(reinterpret_cast<const char*>(&snap.generation), sizeof(snap.generation));
+    out.Raw(reinterpret_cast<const char*>(&count), sizeof(count));
+    if (count)
+        out.Raw(reinterpret_cast<const char*>(snap.rows.data()), snap.rows.size() * sizeof(ArmatureSnapshot::Row));
+    return out.Close();
+}
+
+void DiffArmatureSnapshots(const ArmatureSnapshot& prev, const ArmatureSnapshot& cur, ArmatureDelta& delta)
+{
+    delta.added.clear();
+    delta.changed.clear();
+    delta.removed.clear();
+
+    size_t i = 0, j = 0;
+    while (i < prev.rows.size() || j < cur.rows.size())
+    {
+        if (j >= cur.rows.size() || (i < prev.rows.size() && prev.rows[i].handle < cur.rows[j].handle))
+        {
+            delta.removed.push_back(prev.rows[i++].handle);
+        }
+        else if (i >= prev.rows.size() || cur.rows[j].handle < prev.rows[i].handle)
+        {
+            delta.added.push_back(cur.rows[j++].handle);
+        }
+        else
+        {
+            if (prev.rows[i].hash != cur.rows[j].hash)
+                delta.changed.push_back(cur.rows[j].handle);
+            ++i;
+            ++j;
+        }
+    }
+}
+
+void ApplyArmatureUpdates(const ArmatureSnapshot& prev, std::vector<ArmatureRowUpdate>& updates,
+    ArmatureSnapshot& cur, ArmatureDelta& delta)
+{
+    delta.added.clear();
+    delta.changed.clear();
+    delta.removed.clear();
+
+    // Одна запись на handle (последняя)
+    std::stable_sort(updates.begin(), updates.end(),
+        [](const ArmatureRowUpdate& a, const ArmatureRowUpdate& b) { return a.handle < b.handle; });
+    cur.rows.clear();
+    cur.rows.reserve(prev.rows.size() + updates.size());
+    auto from = prev.rows.begin();
+    for (size_t u = 0; u < updates.size(); ++u)
+    {
+        if (u + 1 < updates.size() && updates[u + 1].handle == updates[u].handle)
+            continue;
+        const ArmatureRowUpdate& up = updates[u];
+        auto at = std::lower_bound(from, prev.rows.end(), up.handle,
+            [](const ArmatureSnapshot::Row& r, uint64_t h) { return r.handle < h; });
+        cur.rows.insert(cur.rows.end(), from, at);
+        const bool had = at != prev.rows.end() && at->handle == up.handle;
+        if (up.present)
+        {
+            if (!had)
+                delta.added.push_back(up.handle);
+            else if (at->hash != up.hash)
+                delta.changed.push_back(up.handle);
+            cur.rows.push_back({ up.handle, up.hash });
+        }
+        else if (had)
+        {
+            delta.removed.push_back(up.handle);
+        }
+        from = had ? at + 1 : at;
+    }
+    cur.rows.insert(cur.rows.end(), from, prev.rows.end());
+}
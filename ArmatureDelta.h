@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Снимок последней выгрузки арматуры для дельта-экспорта:
+// handle объекта -> хеш (KKS_PART, класс, квантованная позиция, dummy).
+// Хранится компактно (16 байт на строку) рядом с CSV.
+struct ArmatureSnapshot
+{
+    uint64_t drawingKey = 0;        // хеш ключа чертежа и фильтра: снимок другого чертежа не используется
+    uint64_t generation = 0;        // метка записи; журнал изменений индекса ведётся от неё
+    struct Row
+    {
+        uint64_t handle;
+        uint64_t hash;
+    };
+    std::vector<Row> rows;          // отсортированы по handle
+};
+
+// Результат сравнения снимков (handle'ы)
+struct ArmatureDelta
+{
+    std::vector<uint64_t> added;
+    std::vector<uint64_t> changed;
+    std::vector<uint64_t> removed;
+
+    bool IsEmpty() const { return added.empty() && changed.empty() && removed.empty(); }
+};
+
+// Шаг квантования позиции (единицы чертежа, мм): дрожание меньше шага не считается изменением
+const double kArmatureDeltaQuantum = 1e-3;
+
+// Хеш строки таблицы арматуры (FNV-1a 64)
+uint64_t ArmatureRowHash(const std::wstring& kksPart, const std::wstring& className,
+    double x, double y, double z, bool isDummy);
+
+// Хеш произвольной строки (ключ чертежа)
+uint64_t HashString(const std::wstring& s);
+
+// Упорядочить строки снимка по handle
+void SortSnapshot(ArmatureSnapshot& snap);
+
+// Загрузка/сохранение снимка. Load возвращает false, если файла нет или он повреждён.
+bool LoadArmatureSnapshot(const std::wstring& path, ArmatureSnapshot& snap);
+bool SaveArmatureSnapshot(const std::wstring& path, const ArmatureSnapshot& snap);
+
+// Слияние двух отсортированных снимков за один проход
+void DiffArmatureSnapshots(const ArmatureSnapshot& prev, const ArmatureSnapshot& cur, ArmatureDelta& delta);
+
+// Строка, изменившаяся после прошлого снимка: новый хеш или present = false (строки больше нет)
+struct ArmatureRowUpdate
+{
+    uint64_t handle;
+    uint64_t hash;
+    bool present;
+};
+
+// Снимок по прошлому и изменившимся строкам: хешируются и сортируются только updates,
+// остальные строки prev копируются диапазонами. В delta — только реальные отличия.
+void ApplyArmatureUpdates(const ArmatureSnapshot& prev, std::vector<ArmatureRowUpdate>& updates,
+    ArmatureSnapshot& cur, ArmatureDelta& delta);
@@ -0,0 +1,435 @@
+#include "stdafx.h"
+#include "ArrowWriter.h"
+#include "ReportWriter.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+namespace
+{
+// --------- Минимальный сериализатор FlatBuffers ---------
+// Пишет "спереди назад": родитель раньше детей, поэтому все uoffset указывают вперёд,
+// как требует формат. Достаточно для метаданных Arrow (Schema/RecordBatch/Footer).
+struct FbNode
+{
+    enum class Kind { Table, TableVector, StructVector, String };
+
+    struct Field
+    {
+        int id = 0;
+        std::vector<uint8_t> scalar;       // инлайн-значение (если нет child)
+        std::unique_ptr<FbNode> child;     // ссылка на таблицу/вектор/строку
+    };
+
+    Kind kind = Kind::Table;
+    std::vector<Field> fields;                      // Table
+    std::vector<std::unique_ptr<FbNode>> items;     // TableVector
+    std::vector<uint8_t> bytes;                     // StructVector (элементы подряд) / String
+    uint32_t count = 0;                             // StructVector
+};
+
+typedef std::unique_ptr<FbNode> FbPtr;
+
+FbPtr FbTable()
+{
+    FbPtr n(new FbNode);
+    n->kind = FbNode::Kind::Table;
+    return n;
+}
+
+template <class T>
+void FbScalar(FbNode& table, int id, T value)
+{
+    FbNode::Field f;
+    f.id = id;
+    f.scalar.resize(sizeof(T));
+    memcpy(f.scalar.data(), &value, sizeof(T));
+    table.fields.push_back(std::move(f));
+}
+
+void FbChild(FbNode& table, int id, FbPtr child)
+{
+    FbNode::Field f;
+    f.id = id;
+    f.child = std::move(child);
+    table.fields.push_back(std::move(f));
+}
+
+FbPtr FbString(const std::string& s)
+{
+    FbPtr n(new FbNode);
+    n->kind = FbNode::Kind::String;
+    n->bytes.assign(s.begin(), s.end());
+    return n;
+}
+
+FbPtr FbTableVector(std::vector<FbPtr> items)
+{
+    FbPtr n(new FbNode);
+    n->kind = FbNode::Kind::TableVector;
+    n->items = std::move(items);
+    return n;
+}
+
+// Вектор структур с выравниванием элементов на 8 байт
+FbPtr FbStructVector(const std::vector<uint8_t>& bytes, uint32_t count)
+{
+    FbPtr n(new FbNode);
+    n->kind = FbNode::Kind::StructVector;
+    n->bytes = bytes;
+    n->count = count;
+    return n;
+}
+
+class FbBuilder
+{
+public:
+    // Сериализовать корневую таблицу; результат дополнен до кратности 8
+    std::vector<uint8_t> Finish(const FbNode& root)
+    {
+        m_buf.assign(4, 0);
+        size_t rootPos = Write(root);
+        PatchU32(0, (uint32_t)rootPos);
+        Align(8);
+        return std::move(m_buf);
+    }
+
+private:
+    size_t Pos() const { return m_buf.size(); }
+
+    void Align(size_t a)
+    {
+        while (m_buf.size() % a)
+            m_buf.push_back(0);
+    }
+
+    void Put(const void* p, size_t n)
+    {
+        const uint8_t* b = static_cast<const uint8_t*>(p);
+        m_buf.insert(m_buf.end(), b, b + n);
+    }
+
+    template <class T>
+    void PutT(T v) { Put(&v, sizeof(T)); }
+
+    void PatchU32(size_t at, uint32_t v) { memcpy(&m_buf[at], &v, 4); }
+    void PatchU16(size_t at, uint16_t v) { memcpy(&m_buf[at], &v, 2); }
+
+    size_t Write(const FbNode& n)
+    {
+        switch (n.kind)
+        {
+        case FbNode::Kind::Table:
+            return WriteTable(n);
+        case FbNode::Kind::TableVector:
+        {
+            Align(4);
+            size_t pos = Pos();
+            PutT<uint32_t>((uint32_t)n.items.size());
+            size_t slots = Pos();
+            m_buf.resize(m_buf.size() + 4 * n.items.size(), 0);
+            for (size_t i = 0; i < n.items.size(); ++i)
+            {
+                size_t child = Write(*n.items[i]);
+                size_t slot = slots + 4 * i;
+                PatchU32(slot, (uint32_t)(child - slot));
+            }
+            return pos;
+        }
+        case FbNode::Kind::StructVector:
+        {
+            // Длина (4 байта) стоит так, чтобы элементы начинались с кратного 8
+            Align(4);
+            if ((Pos() + 4) % 8)
+                PutT<uint32_t>(0);
+            size_t pos = Pos();
+            PutT<uint32_t>(n.count);
+            Put(n.bytes.data(), n.bytes.size());
+            return pos;
+        }
+        case FbNode::Kind::String:
+        default:
+        {
+            Align(4);
+            size_t pos = Pos();
+            PutT<uint32_t>((uint32_t)n.bytes.size());
+            Put(n.bytes.data(), n.bytes.size());
+            m_buf.push_back(0);
+            return pos;
+        }
+        }
+    }
+
+    size_t WriteTable(const FbNode& n)
+    {
+        int numFields = 0;
+        for (const auto& f : n.fields)
+            numFields = std::max(numFields, f.id + 1);
+
+        // vtable: размер vtable, размер таблицы, смещения полей
+        Align(2);
+        size_t vt = Pos();
+        m_buf.resize(m_buf.size() + 2 * (2 + numFields), 0);
+
+        Align(8);
+        size_t table = Pos();
+        PutT<int32_t>((int32_t)(table - vt));
+
+        // Скаляры — по убыванию размера (выравнивание равно размеру), затем ссылки
+        std::vector<const FbNode::Field*> order;
+        for (const auto& f : n.fields)
+            order.push_back(&f);
+        std::stable_sort(order.begin(), order.end(), [](const FbNode::Field* a, const FbNode::Field* b)
+        {
+            size_t sa = a->child ? 0 : a->scalar.size();
+            size_t sb = b->child ? 0 : b->scalar.size();
+            return sa > sb;
+        });
+
+        std::vector<std::pair<size_t, const FbNode*>> refs;
+        for (const FbNode::Field* f : order)
+        {
+            if (f->child)
+            {
+                Align(4);
+                PatchU16(vt + 2 * (2 + f->id), (uint16_t)(Pos() - table));
+                refs.push_back(std::make_pair(Pos(), f->child.get()));
+                PutT<uint32_t>(0);
+            }
+            else
+            {
+                Align(f->scalar.size());
+                PatchU16(vt + 2 * (2 + f->id), (uint16_t)(Pos() - table));
+                Put(f->scalar.data(), f->scalar.size());
+            }
+        }
+        PatchU16(vt, (uint16_t)(2 * (2 + numFields)));
+        PatchU16(vt + 2, (uint16_t)(Pos() - table));
+
+        for (const auto& r : refs)
+        {
+            size_t child = Write(*r.second);
+            PatchU32(r.first, (uint32_t)(child - r.first));
+        }
+        return table;
+    }
+
+    std::vector<uint8_t> m_buf;
+};
+
+// --------- Метаданные Arrow (Schema.fbs / Message.fbs / File.fbs) ---------
+const int16_t kMetadataV5 = 4;
+const uint8_t kHeaderSchema = 1;
+const uint8_t kHeaderRecordBatch = 3;
+const uint8_t kTypeInt = 2;
+const uint8_t kTypeFloatingPoint = 3;
+const uint8_t kTypeUtf8 = 5;
+const uint8_t kTypeBool = 6;
+const int16_t kPrecisionDouble = 2;
+
+std::string ToUtf8(const std::wstring& s)
+{
+    std::string out(s.size() * 3, '\0');
+    out.resize(Utf16ToUtf8(s.c_str(), s.size(), &out[0]));
+    return out;
+}
+
+template <class T>
+void AppendRaw(std::vector<uint8_t>& v, T value)
+{
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(&value);
+    v.insert(v.end(), b, b + sizeof(T));
+}
+
+size_t Pad8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+} // namespace
+
+int CArrowTableWriter::AddColumn(const std::wstring& name, ColumnType type)
+{
+    Column c;
+    c.name = name;
+    c.type = type;
+    if (type == ColumnType::Utf8)
+        c.offsets.push_back(0);
+    m_columns.push_back(std::move(c));
+    return (int)m_columns.size() - 1;
+}
+
+void CArrowTableWriter::AppendUtf8(int col, const wchar_t* s, size_t n)
+{
+    Column& c = m_columns[col];
+    size_t old = c.data.size();
+    c.data.resize(old + n * 3 + 8);
+    size_t written = Utf16ToUtf8(s, n, reinterpret_cast<char*>(c.data.data() + old));
+    c.data.resize(old + written);
+    c.offsets.push_back((int32_t)c.data.size());
+    ++c.length;
+}
+
+void CArrowTableWriter::AppendDouble(int col, double v)
+{
+    Column& c = m_columns[col];
+    AppendRaw(c.data, v);
+    ++c.length;
+}
+
+void CArrowTableWriter::AppendBool(int col, bool v)
+{
+    Column& c = m_columns[col];
+    if (c.length % 8 == 0)
+        c.data.push_back(0);
+    if (v)
+        c.data[c.length / 8] |= (uint8_t)(1u << (c.length % 8));
+    ++c.length;
+}
+
+void CArrowTableWriter::AppendUInt64(int col, uint64_t v)
+{
+    Column& c = m_columns[col];
+    AppendRaw(c.data, v);
+    ++c.length;
+}
+
+size_t CArrowTableWriter::GetRowCount() const
+{
+    return m_columns.empty() ? 0 : m_columns[0].length;
+}
+
+bool CArrowTableWriter::Write(const std::wstring& path) const
+{
+    const int64_t rows = (int64_t)GetRowCount();
+
+    // Схема (используется и в сообщении Schema, и в Footer)
+    auto makeSchema = [this]()
+    {
+        std::vector<FbPtr> fields;
+        for (const Column& c : m_columns)
+        {
+            FbPtr field = FbTable();
+            FbChild(*field, 0, FbString(ToUtf8(c.name)));
+            FbScalar<uint8_t>(*field, 1, 0); // nullable = false
+            FbPtr type = FbTable();
+            uint8_t typeId = kTypeUtf8;
+            switch (c.type)
+            {
+            case ColumnType::Float64:
+                typeId = kTypeFloatingPoint;
+                FbScalar<int16_t>(*type, 0, kPrecisionDouble);
+                break;
+            case ColumnType::Bool:
+                typeId = kTypeBool;
+                break;
+            case ColumnType::UInt64:
+                typeId = kTypeInt;
+                FbScalar<int32_t>(*type, 0, 64);
+                FbScalar<uint8_t>(*type, 1, 0);
+                break;
+            case ColumnType::Utf8:
+            default:
+                break;
+            }
+            FbScalar<uint8_t>(*field, 2, typeId);
+            FbChild(*field, 3, std::move(type));
+            FbChild(*field, 5, FbTableVector(std::vector<FbPtr>()));
+            fields.push_back(std::move(field));
+        }
+        FbPtr schema = FbTable();
+        FbScalar<int16_t>(*schema, 0, 0); // Little endian
+        FbChild(*schema, 1, FbTableVector(std::move(fields)));
+        return schema;
+    };
+
+    // Тело record batch: буферы колонок подряд, каждый с выравниванием 8
+    std::vector<uint8_t> nodes, buffers;
+    std::vector<std::pair<const uint8_t*, size_t>> parts;
+    size_t bodyLen = 0;
+    auto addBuffer = [&](const void* p, size_t n)
+    {
+        AppendRaw<int64_t>(buffers, (int64_t)bodyLen);
+        AppendRaw<int64_t>(buffers, (int64_t)n);
+        parts.push_back(std::make_pair(static_cast<const uint8_t*>(p), n));
+        bodyLen += Pad8(n);
+    };
+    for (const Column& c : m_columns)
+    {
+        AppendRaw<int64_t>(nodes, (int64_t)c.length);
+        AppendRaw<int64_t>(nodes, 0); // null_count
+        addBuffer(nullptr, 0);        // validity: нет null-значений
+        if (c.type == ColumnType::Utf8)
+            addBuffer(c.offsets.data(), c.offsets.size() * sizeof(int32_t));
+        addBuffer(c.data.data(), c.data.size());
+    }
+
+    FbPtr batch = FbTable();
+    FbScalar<int64_t>(*batch, 0, rows);
+    FbChild(*batch, 1, FbStructVector(nodes, (uint32_t)m_columns.size()));
+    FbChild(*batch, 2, FbStructVector(buffers, (uint32_t)parts.size()));
+
+    FbPtr schemaMsg = FbTable();
+    FbScalar<int16_t>(*schemaMsg, 0, kMetadataV5);
+    FbScalar<uint8_t>(*schemaMsg, 1, kHeaderSchema);
+    FbChild(*schemaMsg, 2, makeSchema());
+    FbScalar<int64_t>(*schemaMsg, 3, 0);
+
+    FbPtr batchMsg = FbTable();
+    FbScalar<int16_t>(*batchMsg, 0, kMetadataV5);
+    FbScalar<uint8_t>(*batchMsg, 1, kHeaderRecordBatch);
+    FbChild(*batchMsg, 2, std::move(batch));
+    FbScalar<int64_t>(*batchMsg, 3, (int64_t)bodyLen);
+
+    std::vector<uint8_t> schemaFb = FbBuilder().Finish(*schemaMsg);
+    std::vector<uint8_t> batchFb = FbBuilder().Finish(*batchMsg);
+
+    CReportWriter out;
+    if (!out.Open(path))
+        return false;
+
+    static const char kZeros[8] = { 0 };
+    const uint32_t kContinuation = 0xFFFFFFFFu;
+    auto writeMessageHeader = [&](const std::vector<uint8_t>& fb)
+    {
+        int32_t len = (int32_t)fb.size();
+        out.Raw(reinterpret_cast<const char*>(&kContinuation), 4);
+        out.Raw(reinterpret_cast<const char*>(&len), 4);
+        out.Raw(reinterpret_cast<const char*>(fb.data()), fb.size());
+    };
+
+    out.Raw("ARROW1\0\0", 8);
+    writeMessageHeader(schemaFb);
+
+    int64_t batchOffset = (int64_t)out.GetBytesWritten();
+    writeMessageHeader(batchFb);
+    for (const auto& part : parts)
+    {
+        if (part.second)
+            out.Raw(reinterpret_cast<const char*>(part.first), part.second);
+        out.Raw(kZeros, Pad8(part.second) - part.second);
+    }
+
+    // Конец потока
+    const uint32_t kEos[2] = { kContinuation, 0 };
+    out.Raw(reinterpret_cast<const char*>(kEos), sizeof(kEos));
+
+    // Footer: схема и положение record batch для произвольного доступа
+    std::vector<uint8_t> blocks;
+    AppendRaw<int64_t>(blocks, batchOffset);
+    AppendRaw<int32_t>(blocks, (int32_t)(8 + batchFb.size()));
+    AppendRaw<int32_t>(blocks, 0);
+    AppendRaw<int64_t>(blocks, (int64_t)bodyLen);
+
+    FbPtr footer = FbTable();
+    FbScalar<int16_t>(*footer, 0, kMetadataV5);
+    FbChild(*footer, 1, makeSchema());
+    FbChild(*footer, 2, FbStructVector(std::vector<uint8_t>(), 0));
+    FbChild(*footer, 3, FbStructVector(blocks, 1));
+    std::vector<uint8_t> footerFb = FbBuilder().Finish(*footer);
+
+    int32_t footerLen = (int32_t)footerFb.size();
+    out.Raw(reinterpret_cast<const char*>(footerFb.data()), footerFb.size());
+    out.Raw(reinterpret_cast<const char*>(&footerLen), 4);
+    out.Raw("ARROW1", 6);
+    return out.Close();
+}
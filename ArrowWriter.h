@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Колоночная таблица в формате Arrow IPC File (".arrow", версия метаданных V5).
+// Файл самоописываемый (схема внутри), все буферы выровнены на 8 байт, поэтому
+// потребители (pyarrow, загрузчики БД KKS) читают его через memory-map без разбора текста:
+//   pyarrow.ipc.open_file(pyarrow.memory_map(path)).read_all()
+// Данные копятся в памяти колонками и пишутся одним record batch при Write().
+class CArrowTableWriter
+{
+public:
+    enum class ColumnType
+    {
+        Utf8,
+        Float64,
+        Bool,
+        UInt64
+    };
+
+    // Добавить колонку; возвращает её индекс
+    int AddColumn(const std::wstring& name, ColumnType type);
+
+    // Значения добавляются по строкам: по одному вызову на каждую колонку
+    void AppendUtf8(int col, const wchar_t* s, size_t n);
+    void AppendUtf8(int col, const std::wstring& s) { AppendUtf8(col, s.c_str(), s.size()); }
+    void AppendDouble(int col, double v);
+    void AppendBool(int col, bool v);
+    void AppendUInt64(int col, uint64_t v);
+
+    // Число строк (по первой колонке)
+    size_t GetRowCount() const;
+
+    // Записать файл целиком
+    bool Write(const std::wstring& path) const;
+
+private:
+    struct Column
+    {
+        std::wstring name;
+        ColumnType type;
+        size_t length = 0;
+        std::vector<int32_t> offsets;   // Utf8: смещения строк (length + 1)
+        std::vector<uint8_t> data;      // значения / байты строк / битовая маска Bool
+    };
+
+    std::vector<Column> m_columns;
+};
@@ -0,0 +1,682 @@
+#include "stdafx.h"
+#include "BlockInput.h"
+#include <cstring>
+#include <cstdlib>
+
+#if defined(__has_include)
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define BLOCKINPUT_HAVE_ZLIB 1
+#endif
+#if __has_include(<zstd.h>)
+#include <zstd.h>
+#define BLOCKINPUT_HAVE_ZSTD 1
+#endif
+#endif
+
+namespace
+{
+// Сжатые данные читаются из файла такими порциями
+const size_t kRawBlockSize = 1 << 18;
+} // namespace
+
+const wchar_t* InputCodecName(InputCodec codec)
+{
+    switch (codec)
+    {
+    case InputCodec::Plain: return L"plain";
+    case InputCodec::Gzip: return L"gzip";
+    case InputCodec::Zstd: return L"zstd";
+    }
+    return L"?";
+}
+
+bool IsInputCodecAvailable(InputCodec codec)
+{
+    switch (codec)
+    {
+    case InputCodec::Plain:
+        return true;
+    case InputCodec::Gzip:
+#ifdef BLOCKINPUT_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    case InputCodec::Zstd:
+#ifdef BLOCKINPUT_HAVE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+// Распаковка в блок; работает только в потоке чтения
+class CBlockInput::CDecoder
+{
+public:
+    CDecoder(FILE* file, InputCodec codec) : m_file(file), m_codec(codec) {}
+    ~CDecoder();
+
+    bool Init(std::string& error);
+    // Заполнить out не больше capacity байт; true — данные кончились (или ошибка в error)
+    bool Fill(char* out, size_t capacity, size_t& size, std::string& error);
+
+    uint64_t GetInputBytes() const { return m_inputBytes; }
+    uint64_t GetOutputBytes() const { return m_outputBytes; }
+
+private:
+    bool FillPlain(char* out, size_t capacity, size_t& size);
+    bool FillGzip(char* out, size_t capacity, size_t& size, std::string& error);
+    bool FillZstd(char* out, size_t capacity, size_t& size, std::string& error);
+    // Дочитать сжатые данные, если порция израсходована; false — конец файла
+    bool ReadRaw();
+    // После конца члена gzip: дальше следующий член (1F 8B)? Хвост иного вида не читается
+    bool NextGzipMember();
+
+    FILE* m_file;
+    InputCodec m_codec;
+    std::vector<char> m_raw;
+    size_t m_rawPos = 0;
+    size_t m_rawSize = 0;
+    bool m_eof = false;
+    bool m_streamEnd = false;   // последний сжатый поток дочитан до конца
+    uint64_t m_inputBytes = 0;
+    uint64_t m_outputBytes = 0;
+#ifdef BLOCKINPUT_HAVE_ZLIB
+    z_stream m_z;
+    bool m_zInit = false;
+#endif
+#ifdef BLOCKINPUT_HAVE_ZSTD
+    ZSTD_DStream* m_zstd = nullptr;
+#endif
+};
+
+CBlockInput::CDecoder::~CDecoder()
+{
+#ifdef BLOCKINPUT_HAVE_ZLIB
+    if (m_zInit)
+        inflateEnd(&m_z);
+#endif
+#ifdef BLOCKINPUT_HAVE_ZSTD
+    if (m_zstd)
+        ZSTD_freeDStream(m_zstd);
+#endif
+}
+
+bool CBlockInput::CDecoder::Init(std::string& error)
+{
+    if (m_codec == InputCodec::Plain)
+        return true;
+    m_raw.resize(kRawBlockSize);
+#ifdef BLOCKINPUT_HAVE_ZLIB
+    if (m_codec == InputCodec::Gzip)
+    {
+        std::memset(&m_z, 0, sizeof(m_z));
+        // 15 + 32: окно 32 КБ, заголовок gzip или zlib определяется сам
+        if (inflateInit2(&m_z, 15 + 32) != Z_OK)
+        {
+            error = "inflateInit2 failed";
+            return false;
+        }
+        m_zInit = true;
+        return true;
+    }
+#endif
+#ifdef BLOCKINPUT_HAVE_ZSTD
+    if (m_codec == InputCodec::Zstd)
+    {
+        m_zstd = ZSTD_createDStream();
+        if (!m_zstd || ZSTD_isError(ZSTD_initDStream(m_zstd)))
+        {
+            error = "ZSTD_initDStream failed";
+            return false;
+        }
+        return true;
+    }
+#endif
+    error = "codec not available";
+    return false;
+}
+
+bool CBlockInput::CDecoder::ReadRaw()
+{
+    if (m_rawPos < m_rawSize)
+        return true;
+    if (m_eof)
+        return false;
+    m_rawPos = 0;
+    m_rawSize = std::fread(m_raw.data(), 1, m_raw.size(), m_file);
+    m_inputBytes += m_rawSize;
+    if (m_rawSize < m_raw.size())
+        m_eof = true;
+    return m_rawSize > 0;
+}
+
+bool CBlockInput::CDecoder::NextGzipMember()
+{
+    // Сигнатура может разойтись по двум порциям: остаток переносится в начало
+    const size_t left = m_rawSize - m_rawPos;
+    if (left < 2 && !m_eof)
+    {
+        std::memmove(m_raw.data(), m_raw.data() + m_rawPos, left);
+        const size_t got = std::fread(m_raw.data() + left, 1, m_raw.size() - left, m_file);
+        m_inputBytes += got;
+        m_rawPos = 0;
+        m_rawSize = left + got;
+        if (got < m_raw.size() - left)
+            m_eof = true;
+    }
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(m_raw.data() + m_rawPos);
+    return m_rawSize - m_rawPos >= 2 && p[0] == 0x1F && p[1] == 0x8B;
+}
+
+bool CBlockInput::CDecoder::Fill(char* out, size_t capacity, size_t& size, std::string& error)
+{
+    size = 0;
+    bool end = false;
+    switch (m_codec)
+    {
+    case InputCodec::Plain:
+        end = FillPlain(out, capacity, size);
+        break;
+    case InputCodec::Gzip:
+        end = FillGzip(out, capacity, size, error);
+        break;
+    case InputCodec::Zstd:
+        end = FillZstd(out, capacity, size, error);
+        break;
+    }
+    m_outputBytes += size;
+    return end;
+}
+
+bool CBlockInput::CDecoder::FillPlain(char* out, size_t capacity, size_t& size)
+{
+    size = std::fread(out, 1, capacity, m_file);
+    m_inputBytes += size;
+    return size < capacity;
+}
+
+bool CBlockInput::CDecoder::FillGzip(char* out, size_t capacity, size_t& size, std::string& error)
+{
+#ifdef BLOCKINPUT_HAVE_ZLIB
+    while (size < capacity)
+    {
+        if (!ReadRaw())
+        {
+            // Файл кончился посреди потока — архив обрезан
+            if (!m_streamEnd)
+                error = "gzip stream truncated";
+            return true;
+        }
+        m_z.next_in = reinterpret_cast<Bytef*>(m_raw.data() + m_rawPos);
+        m_z.avail_in = (uInt)(m_rawSize - m_rawPos);
+        m_z.next_out = reinterpret_cast<Bytef*>(out + size);
+        m_z.avail_out = (uInt)(capacity - size);
+        const int rc = inflate(&m_z, Z_NO_FLUSH);
+        m_rawPos = m_rawSize - m_z.avail_in;
+        size = capacity - m_z.avail_out;
+        if (rc == Z_STREAM_END)
+        {
+            // Склеенные gzip-файлы: следующий член с того же места. Хвост после
+            // последнего члена (нули выравнивания, мусор) не ошибка — как у gzip -d
+            m_streamEnd = true;
+            if (!NextGzipMember())
+                return true;
+            inflateReset(&m_z);
+        }
+        else if (rc == Z_OK || rc == Z_BUF_ERROR)
+        {
+            m_streamEnd = false;
+        }
+        else
+        {
+            error = m_z.msg ? m_z.msg : "inflate failed";
+            return true;
+        }
+    }
+    return false;
+#else
+    (void)out;
+    (void)capacity;
+    (void)size;
+    error = "gzip support not built in";
+    return true;
+#endif
+}
+
+bool CBlockInput::CDecoder::FillZstd(char* out, size_t capacity, size_t& size, std::string& error)
+{
+#ifdef BLOCKINPUT_HAVE_ZSTD
+    while (size < capacity)
+    {
+        if (!ReadRaw())
+        {
+            if (!m_streamEnd)
+                error = "zstd stream truncated";
+            return true;
+        }
+        ZSTD_inBuffer in = { m_raw.data(), m_rawSize, m_rawPos };
+        ZSTD_outBuffer dst = { out, capacity, size };
+        // 0 — кадр закончен; следующий кадр распаковывается тем же потоком
+        const size_t rc = ZSTD_decompressStream(m_zstd, &dst, &in);
+        if (ZSTD_isError(rc))
+        {
+            error = ZSTD_getErrorName(rc);
+            return true;
+        }
+        m_rawPos = in.pos;
+        size = dst.pos;
+        m_streamEnd = rc == 0;
+    }
+    return false;
+#else
+    (void)out;
+    (void)capacity;
+    (void)size;
+    error = "zstd support not built in";
+    return true;
+#endif
+}
+
+CBlockInput::CBlockInput(size_t blockSize)
+    : m_blockSize(blockSize > 0 ? blockSize : kDefaultBlockSize)
+{
+}
+
+CBlockInput::~CBlockInput()
+{
+    Close();
+}
+
+bool CBlockInput::Open(const std::wstring& path)
+{
+    Close();
+    m_error.clear();
+    m_inputBytes = 0;
+    m_outputBytes = 0;
+
+#ifdef _WIN32
+    if (_wfopen_s(&m_file, path.c_str(), L"rb") != 0)
+        m_file = nullptr;
+#else
+    std::string narrow(path.size() * 4 + 1, '\0');
+    const size_t n = std::wcstombs(&narrow[0], path.c_str(), narrow.size());
+    if (n != (size_t)-1)
+    {
+        narrow.resize(n);
+        m_file = std::fopen(narrow.c_str(), "rb");
+    }
+#endif
+    if (!m_file)
+    {
+        m_error = "cannot open file";
+        return false;
+    }
+
+    // Формат — по сигнатуре в начале файла
+    unsigned char magic[4] = { 0, 0, 0, 0 };
+    const size_t got = std::fread(magic, 1, sizeof(magic), m_file);
+    std::fseek(m_file, 0, SEEK_SET);
+    m_codec = InputCodec::Plain;
+    if (got >= 2 && magic[0] == 0x1F && magic[1] == 0x8B)
+        m_codec = InputCodec::Gzip;
+    else if (got == 4 && magic[0] == 0x28 && magic[1] == 0xB5 && magic[2] == 0x2F && magic[3] == 0xFD)
+        m_codec = InputCodec::Zstd;
+    if (!IsInputCodecAvailable(m_codec))
+    {
+        m_error = m_codec == InputCodec::Gzip ? "gzip support not built in" : "zstd support not built in";
+        Close();
+        return false;
+    }
+
+    m_decoder.reset(new CDecoder(m_file, m_codec));
+    if (!m_decoder->Init(m_error))
+    {
+        Close();
+        return false;
+    }
+
+    for (Block& b : m_blocks)
+    {
+        b.data.resize(m_blockSize);
+        b.size = 0;
+        b.filled = false;
+        b.last = false;
+        b.error.clear();
+    }
+    m_stop = false;
+    m_current = nullptr;
+    m_next = 0;
+    m_pos = 0;
+    m_finished = false;
+    m_carry.clear();
+    m_worker = std::thread(&CBlockInput::Produce, this);
+    return true;
+}
+
+void CBlockInput::Close()
+{
+    if (m_worker.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_all();
+        m_worker.join();
+    }
+    if (m_decoder)
+    {
+        m_inputBytes = m_decoder->GetInputBytes();
+        m_outputBytes = m_decoder->GetOutputBytes();
+        m_decoder.reset();
+    }
+    if (m_file)
+    {
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+    m_current = nullptr;
+    m_finished = true;
+    m_carry.clear();
+}
+
+// Поток чтения: блоки 0, 1, 0, ... по мере освобождения разборщиком
+void CBlockInput::Produce()
+{
+    size_t index = 0;
+    for (;;)
+    {
+        Block& b = m_blocks[index];
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [&]() { return m_stop || !b.filled; });
+            if (m_stop)
+                return;
+        }
+
+        // Блок свободен: разборщик его не читает, заполняется без блокировки
+        bool last = true;
+        try
+        {
+            b.error.clear();
+            last = m_decoder->Fill(b.data.data(), b.data.size(), b.size, b.error);
+        }
+        catch (...)
+        {
+            b.size = 0;
+            b.error = "read failed";
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            b.last = last;
+            b.filled = true;
+        }
+        m_cv.notify_all();
+        if (last)
+            return;
+        index ^= 1;
+    }
+}
+
+bool CBlockInput::NextBlock()
+{
+    if (m_finished)
+        return false;
+    Block& b = m_blocks[m_next];
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [&]() { return b.filled; });
+    }
+    if (!b.error.empty())
+    {
+        // Данные блока с ошибкой не выдаются: последняя строка могла быть оборвана
+        m_error = b.error;
+        m_finished = true;
+        return false;
+    }
+    m_current = &b;
+    m_pos = 0;
+    return true;
+}
+
+void CBlockInput::ReleaseBlock()
+{
+    const bool last = m_current->last;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_current->filled = false;
+    }
+    m_cv.notify_all();
+    m_current = nullptr;
+    m_next ^= 1;
+    if (last)
+    {
+        // Поток чтения уже завершил запись счётчиков
+        m_finished = true;
+        m_inputBytes = m_decoder->GetInputBytes();
+        m_outputBytes = m_decoder->GetOutputBytes();
+    }
+}
+
+bool CBlockInput::ReadLine(std::string_view& line)
+{
+    m_carry.clear();
+    bool carried = false;
+    for (;;)
+    {
+        if (!m_current && !NextBlock())
+        {
+            // Последняя строка без перевода строки
+            if (!carried || !m_error.empty())
+                return false;
+            line = m_carry;
+            break;
+        }
+        const char* data = m_current->data.data();
+        const char* begin = data + m_pos;
+        const char* end = data + m_current->size;
+        const char* nl = static_cast<const char*>(std::memchr(begin, '\n', (size_t)(end - begin)));
+        if (nl)
+        {
+            m_pos = (size_t)(nl - data) + 1;
+            if (carried)
+            {
+                m_carry.append(begin, nl);
+                line = m_carry;
+            }
+            else
+            {
+                line = std::string_view(begin, (size_t)(nl - begin));
+            }
+            break;
+        }
+        // Строка продолжается в следующем блоке
+        m_carry.append(begin, end);
+        carried = carried || begin != end;
+        ReleaseBlock();
+    }
+    if (!line.empty() && line.back() == '\r')
+        line.remove_suffix(1);
+    return true;
+}
+
+#ifdef BLOCKINPUT_MAIN
+#include <chrono>
+#include <random>
+
+namespace
+{
+// Разбор-заглушка: токены по пробелам и хеш строк (проверка совпадения содержимого)
+struct LineStats
+{
+    size_t lines = 0;
+    size_t tokens = 0;
+    uint64_t hash = 1469598103934665603ull;
+};
+
+bool ReadAll(const std::wstring& path, LineStats& stats, CBlockInput& input)
+{
+    stats = LineStats();
+    if (!input.Open(path))
+        return false;
+    std::string_view line;
+    while (input.ReadLine(line))
+    {
+        ++stats.lines;
+        bool inToken = false;
+        for (char c : line)
+        {
+            const bool space = c == ' ' || c == '\t';
+            if (!space && !inToken)
+                ++stats.tokens;
+            inToken = !space;
+            stats.hash = (stats.hash ^ (unsigned char)c) * 1099511628211ull;
+        }
+        stats.hash = (stats.hash ^ '\n') * 1099511628211ull;
+    }
+    input.Close();
+    return input.GetError().empty();
+}
+
+std::wstring Widen(const std::string& s)
+{
+    return std::wstring(s.begin(), s.end());
+}
+} // namespace
+
+// Синтетический NTL, его gzip (и zstd) копия; чтение обычного и сжатого файла,
+// мелкие блоки (строки через границу), обрезанный архив
+int main(int argc, char** argv)
+{
+    const size_t segments = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+    const std::string plainPath = "blockinput_test.ntl";
+    std::string text;
+    {
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<double> unit(0.0, 10000.0);
+        char buf[256];
+        for (size_t i = 0; i < segments; ++i)
+        {
+            std::snprintf(buf, sizeof(buf), "SEG S%zu BR%zu %.3f %.3f %.3f\r\nPIPE P%zu 219.1 8.0\r\nRUN R%zu %.3f %.3f %.3f\r\n",
+                i, i / 200, unit(rng), unit(rng), unit(rng), i, i, unit(rng), unit(rng), unit(rng));
+            text += buf;
+        }
+        text += "SEG LAST BR0 1 2 3";   // без перевода строки в конце
+        FILE* f = std::fopen(plainPath.c_str(), "wb");
+        std::fwrite(text.data(), 1, text.size(), f);
+        std::fclose(f);
+    }
+
+    bool ok = true;
+    CBlockInput input;
+    LineStats plain;
+    auto t0 = std::chrono::steady_clock::now();
+    ok = ReadAll(Widen(plainPath), plain, input) && ok;
+    auto t1 = std::chrono::steady_clock::now();
+    std::printf("plain: %zu lines, %zu tokens, %.1f MB, %.0f ms\n", plain.lines, plain.tokens, text.size() / 1048576.0,
+        std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+    // Строки через границы блоков
+    {
+        CBlockInput small(4093);
+        LineStats s;
+        ok = ReadAll(Widen(plainPath), s, small) && ok;
+        const bool same = s.lines == plain.lines && s.hash == plain.hash;
+        std::printf("small blocks: %s\n", same ? "same" : "MISMATCH");
+        ok = ok && same;
+    }
+
+#ifdef BLOCKINPUT_HAVE_ZLIB
+    {
+        const std::string gzPath = plainPath + ".gz";
+        gzFile gz = gzopen(gzPath.c_str(), "wb6");
+        // Два склеенных потока, как после cat a.gz b.gz
+        const size_t half = text.size() / 2;
+        gzwrite(gz, text.data(), (unsigned)half);
+        gzclose(gz);
+        gz = gzopen(gzPath.c_str(), "ab6");
+        gzwrite(gz, text.data() + half, (unsigned)(text.size() - half));
+        gzclose(gz);
+
+        LineStats s;
+        auto g0 = std::chrono::steady_clock::now();
+        ok = ReadAll(Widen(gzPath), s, input) && ok;
+        auto g1 = std::chrono::steady_clock::now();
+        const bool same = s.lines == plain.lines && s.hash == plain.hash && input.GetCodec() == InputCodec::Gzip;
+        std::printf("gzip: %.1f MB -> %.1f MB (%.1fx), %.0f ms, %s\n", input.GetInputBytes() / 1048576.0,
+            input.GetOutputBytes() / 1048576.0, (double)input.GetOutputBytes() / (double)input.GetInputBytes(),
+            std::chrono::duration<double, std::milli>(g1 - g0).count(), same ? "same" : "MISMATCH");
+        ok = ok && same;
+
+        // Обрезанный архив — ошибка, а не тихий неполный разбор
+        FILE* f = std::fopen(gzPath.c_str(), "rb");
+        std::fseek(f, 0, SEEK_END);
+        const long size = std::ftell(f);
+        std::fseek(f, 0, SEEK_SET);
+        std::string gzData((size_t)size, '\0');
+        std::fread(&gzData[0], 1, gzData.size(), f);
+        std::fclose(f);
+
+        // Хвост после последнего члена (нули выравнивания, не-gzip данные) — конец данных, не ошибка
+        const std::string tailPath = plainPath + ".tail.gz";
+        const std::string tails[] = { std::string(512, '\0'), std::string("trailing garbage\n"), std::string(1, '\x1F') };
+        for (const std::string& tail : tails)
+        {
+            f = std::fopen(tailPath.c_str(), "wb");
+            std::fwrite(gzData.data(), 1, gzData.size(), f);
+            std::fwrite(tail.data(), 1, tail.size(), f);
+            std::fclose(f);
+            const bool tailOk = ReadAll(Widen(tailPath), s, input) && s.lines == plain.lines && s.hash == plain.hash;
+            std::printf("gzip + %zu trailing bytes: %s (%s)\n", tail.size(), tailOk ? "same" : "MISMATCH",
+                input.GetError().c_str());
+            ok = ok && tailOk;
+        }
+        std::remove(tailPath.c_str());
+
+        const std::string cutPath = plainPath + ".cut.gz";
+        f = std::fopen(cutPath.c_str(), "wb");
+        std::fwrite(gzData.data(), 1, gzData.size() / 3, f);
+        std::fclose(f);
+        const bool cutFails = !ReadAll(Widen(cutPath), s, input) && !input.GetError().empty();
+        std::printf("truncated gzip: %s (%s)\n", cutFails ? "error" : "NO ERROR", input.GetError().c_str());
+        ok = ok && cutFails;
+        std::remove(cutPath.c_str());
+        std::remove(gzPath.c_str());
+    }
+#else
+    std::printf("gzip: zlib.h not found, skipped\n");
+#endif
+
+#ifdef BLOCKINPUT_HAVE_ZSTD
+    {
+        const std::string zstPath = plainPath + ".zst";
+        std::vector<char> packed(ZSTD_compressBound(text.size()));
+        const size_t n = ZSTD_compress(packed.data(), packed.size(), text.data(), text.size(), 3);
+        FILE* f = std::fopen(zstPath.c_str(), "wb");
+        std::fwrite(packed.data(), 1, n, f);
+        std::fclose(f);
+        LineStats s;
+        auto z0 = std::chrono::steady_clock::now();
+        ok = ReadAll(Widen(zstPath), s, input) && ok;
+        auto z1 = std::chrono::steady_clock::now();
+        const bool same = s.lines == plain.lines && s.hash == plain.hash && input.GetCodec() == InputCodec::Zstd;
+        std::printf("zstd: %.1f MB, %.0f ms, %s\n", n / 1048576.0,
+            std::chrono::duration<double, std::milli>(z1 - z0).count(), same ? "same" : "MISMATCH");
+        ok = ok && same;
+        std::remove(zstPath.c_str());
+    }
+#else
+    std::printf("zstd: zstd.h not found, skipped\n");
+#endif
+
+    std::remove(plainPath.c_str());
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+// Построчное чтение файла импорта с прозрачной распаковкой (без зависимости от SDK).
+// Формат определяется по первым байтам, а не по расширению: 1F 8B — gzip (в том
+// числе несколько склеенных членов; хвост после последнего не читается),
+// 28 B5 2F FD — zstd, остальное — обычный текст.
+// Чтение и распаковка идут в отдельном потоке в два блока по очереди: пока разборщик
+// режет строки одного блока, второй заполняется. Строка, перешедшая границу блока,
+// собирается в отдельном буфере.
+//
+// gzip — через zlib, zstd — через libzstd (зависимости проекта, ZlibDir/ZstdDir
+// в HelloNRX.vcxproj). Без заголовка (__has_include) сжатый файл не открывается (GetError).
+//
+// Проверка без nanoCAD — -DBLOCKINPUT_MAIN (README, «Проверки без nanoCAD»).
+
+enum class InputCodec : uint8_t
+{
+    Plain,
+    Gzip,
+    Zstd
+};
+
+const wchar_t* InputCodecName(InputCodec codec);
+
+// Поддерживается ли формат этой сборкой
+bool IsInputCodecAvailable(InputCodec codec);
+
+class CBlockInput
+{
+public:
+    static const size_t kDefaultBlockSize = 1 << 20;
+
+    explicit CBlockInput(size_t blockSize = kDefaultBlockSize);
+    ~CBlockInput();
+
+    CBlockInput(const CBlockInput&) = delete;
+    CBlockInput& operator=(const CBlockInput&) = delete;
+
+    // false — файл не открыт или формат без библиотеки (GetError)
+    bool Open(const std::wstring& path);
+    void Close();
+
+    // Следующая строка без \n и \r в конце; данные действительны до следующего вызова.
+    // false — конец файла или ошибка распаковки (GetError не пуст).
+    bool ReadLine(std::string_view& line);
+
+    InputCodec GetCodec() const { return m_codec; }
+    const std::string& GetError() const { return m_error; }
+    // Прочитано из файла и выдано после распаковки, байт (после Close или конца файла)
+    uint64_t GetInputBytes() const { return m_inputBytes; }
+    uint64_t GetOutputBytes() const { return m_outputBytes; }
+
+private:
+    struct Block
+    {
+        std::vector<char> data;
+        size_t size = 0;
+        bool filled = false;    // заполнен и ждёт разборщика
+        bool last = false;      // последний блок файла
+        std::string error;
+    };
+
+    class CDecoder;
+
+    void Produce();
+    bool NextBlock();
+    void ReleaseBlock();
+
+    size_t m_blockSize;
+    FILE* m_file = nullptr;
+    InputCodec m_codec = InputCodec::Plain;
+    std::unique_ptr<CDecoder> m_decoder;
+
+    Block m_blocks[2];
+    std::thread m_worker;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+
+    // Состояние разборщика
+    Block* m_current = nullptr;
+    size_t m_next = 0;          // блок, который ждём следующим
+    size_t m_pos = 0;           // позиция в текущем блоке
+    bool m_finished = false;
+    std::string m_carry;        // строка на границе блоков
+
+    std::string m_error;
+    uint64_t m_inputBytes = 0;
+    uint64_t m_outputBytes = 0;
+};
@@ -0,0 +1,307 @@
+#include "stdafx.h"
+#include "CompactGeometry.h"
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <stdexcept>
+
+namespace
+{
+// Предел шагов от начала ветки: целое и произведение k * quantum точны в double
+const int64_t kMaxSteps = (int64_t)1 << 52;
+
+uint64_t ZigZag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+int64_t UnZigZag(uint64_t v)
+{
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+int64_t GetVarint(const uint8_t* stream, size_t& pos)
+{
+    uint64_t v = 0;
+    int shift = 0;
+    uint8_t b;
+    do
+    {
+        b = stream[pos++];
+        v |= (uint64_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return UnZigZag(v);
+}
+} // namespace
+
+CCompactGeometry::CCompactGeometry(double quantum)
+    : m_quantum(quantum > 0.0 ? quantum : kDefaultGeometryQuantum)
+{
+}
+
+void CCompactGeometry::SetQuantum(double quantum)
+{
+    if (m_segmentCount == 0 && quantum > 0.0)
+        m_quantum = quantum;
+}
+
+void CCompactGeometry::Clear()
+{
+    m_branches.clear();
+    m_runs.clear();
+    m_stream.clear();
+    m_segmentCount = 0;
+    m_lastQ[0] = m_lastQ[1] = m_lastQ[2] = 0;
+    m_lastTag = 0;
+    m_maxError = 0.0;
+    m_maxMagnitude = 0.0;
+}
+
+void CCompactGeometry::ShrinkToFit()
+{
+    m_branches.shrink_to_fit();
+    m_runs.shrink_to_fit();
+    m_stream.shrink_to_fit();
+}
+
+int64_t CCompactGeometry::Quantize(const Branch& branch, int axis, double v)
+{
+    const double steps = std::nearbyint((v - branch.origin[axis]) / m_quantum);
+    if (!(std::fabs(steps) < (double)kMaxSteps))
+        throw std::out_of_range("CCompactGeometry: coordinate out of range");
+    const int64_t q = (int64_t)steps;
+    // Погрешность — той же арифметикой, что и при декодировании
+    const double err = std::fabs(Dequantize(branch, axis, q) - v);
+    if (err > m_maxError)
+        m_maxError = err;
+    const double magnitude = std::fabs(v) + std::fabs(branch.origin[axis]);
+    if (magnitude > m_maxMagnitude)
+        m_maxMagnitude = magnitude;
+    return q;
+}
+
+double CCompactGeometry::Dequantize(const Branch& branch, int axis, int64_t q) const
+{
+    return branch.origin[axis] + (double)q * m_quantum;
+}
+
+void CCompactGeometry::PutVarint(int64_t v)
+{
+    uint64_t u = ZigZag(v);
+    while (u >= 0x80)
+    {
+        m_stream.push_back((uint8_t)(u | 0x80));
+        u >>= 7;
+    }
+    m_stream.push_back((uint8_t)u);
+}
+
+void CCompactGeometry::Append(uint32_t branch, const double start[3], const double end[3], uint32_t tag)
+{
+    if (branch >= m_branches.size())
+        m_branches.resize((size_t)branch + 1);
+    Branch& b = m_branches[branch];
+    if (!b.defined)
+    {
+        b.origin[0] = start[0];
+        b.origin[1] = start[1];
+        b.origin[2] = start[2];
+        b.defined = true;
+    }
+
+    int64_t qs[3];
+    int64_t qe[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        qs[k] = Quantize(b, k, start[k]);
+        qe[k] = Quantize(b, k, end[k]);
+    }
+
+    // Серия продолжается, если начало совпадает с концом предыдущего сегмента той же ветки
+    bool extend = !m_runs.empty();
+    if (extend)
+    {
+        const Run& run = m_runs.back();
+        extend = run.branch == branch && run.count < kMaxRunLength &&
+            qs[0] == m_lastQ[0] && qs[1] == m_lastQ[1] && qs[2] == m_lastQ[2];
+    }
+    if (!extend)
+    {
+        Run run;
+        run.offset = m_stream.size();
+        run.firstSegment = (uint32_t)m_segmentCount;
+        run.branch = branch;
+        run.firstTag = tag;
+        run.count = 0;
+        m_runs.push_back(run);
+        for (int k = 0; k < 3; ++k)
+            PutVarint(qs[k]);
+        m_lastTag = tag;
+    }
+
+    PutVarint((int64_t)tag - (int64_t)m_lastTag);
+    for (int k = 0; k < 3; ++k)
+    {
+        PutVarint(qe[k] - qs[k]);
+        m_lastQ[k] = qe[k];
+    }
+    m_lastTag = tag;
+    ++m_runs.back().count;
+    ++m_segmentCount;
+}
+
+size_t CCompactGeometry::GetEncodedBytes() const
+{
+    return m_stream.size() + m_runs.size() * sizeof(Run) + m_branches.size() * sizeof(Branch);
+}
+
+double CCompactGeometry::GetErrorBound() const
+{
+    // Половина шага плюс округление разности, деления, произведения и суммы
+    return m_quantum * 0.5 + 4.0 * DBL_EPSILON * (m_maxMagnitude + m_quantum);
+}
+
+size_t CCompactGeometry::FindRun(size_t index) const
+{
+    auto it = std::upper_bound(m_runs.begin(), m_runs.end(), index,
+        [](size_t i, const Run& run) { return i < run.firstSegment; });
+    return (size_t)(it - m_runs.begin()) - 1;
+}
+
+CompactSegment CCompactGeometry::Get(size_t index) const
+{
+    CCursor cursor(*this, index);
+    return cursor.Get();
+}
+
+CCompactGeometry::CCursor::CCursor(const CCompactGeometry& geometry, size_t index)
+    : m_geometry(&geometry)
+    , m_index(index)
+    , m_run(0)
+    , m_inRun(0)
+    , m_pos(0)
+    , m_current()
+{
+    if (!IsValid())
+        return;
+    EnterRun(geometry.FindRun(index));
+    const uint32_t target = (uint32_t)(index - geometry.m_runs[m_run].firstSegment);
+    for (;;)
+    {
+        DecodeSegment();
+        if (m_inRun == target)
+            break;
+        ++m_inRun;
+    }
+}
+
+void CCompactGeometry::CCursor::EnterRun(size_t run)
+{
+    const Run& r = m_geometry->m_runs[run];
+    m_run = run;
+    m_inRun = 0;
+    m_pos = (size_t)r.offset;
+    const uint8_t* stream = m_geometry->m_stream.data();
+    for (int k = 0; k < 3; ++k)
+        m_q[k] = GetVarint(stream, m_pos);
+    m_current.branch = r.branch;
+    m_current.tag = r.firstTag;
+}
+
+void CCompactGeometry::CCursor::DecodeSegment()
+{
+    const Branch& b = m_geometry->m_branches[m_current.branch];
+    const uint8_t* stream = m_geometry->m_stream.data();
+    m_current.tag = (uint32_t)((int64_t)m_current.tag + GetVarint(stream, m_pos));
+    for (int k = 0; k < 3; ++k)
+    {
+        m_current.start[k] = m_geometry->Dequantize(b, k, m_q[k]);
+        m_q[k] += GetVarint(stream, m_pos);
+        m_current.end[k] = m_geometry->Dequantize(b, k, m_q[k]);
+    }
+}
+
+void CCompactGeometry::CCursor::Next()
+{
+    ++m_index;
+    if (!IsValid())
+        return;
+    if (m_inRun + 1 < m_geometry->m_runs[m_run].count)
+        ++m_inRun;
+    else
+        EnterRun(m_run + 1);
+    DecodeSegment();
+}
+
+#ifdef COMPACTGEOM_MAIN
+#include <cstdio>
+#include <chrono>
+#include <random>
+
+// Ветки по 200 сегментов с приращениями кратными 0,001 мм и 30% поворотов,
+// как в STRESSPIPES; проверка декодирования и погрешности
+int main(int argc, char** argv)
+{
+    const size_t segments = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 10000000;
+    const size_t branchLength = 200;
+    CCompactGeometry geometry;
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+
+    auto t0 = std::chrono::steady_clock::now();
+    double p[3] = { 0.0, 0.0, 0.0 };
+    double d[3] = { 1.0, 0.0, 0.0 };
+    for (size_t i = 0; i < segments; ++i)
+    {
+        if (i % branchLength == 0 || share(rng) >= 0.7)
+        {
+            d[0] = unit(rng);
+            d[1] = unit(rng);
+            d[2] = unit(rng) * 0.2;
+        }
+        double len = 100.0 + 900.0 * share(rng);
+        double l = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + 1e-9;
+        double s[3] = { p[0], p[1], p[2] };
+        for (int k = 0; k < 3; ++k)
+            p[k] = std::round((p[k] + d[k] / l * len) * 1000.0) / 1000.0;
+        geometry.Append((uint32_t)(i / branchLength), s, p, (uint32_t)(i / 4));
+    }
+    geometry.ShrinkToFit();
+    auto t1 = std::chrono::steady_clock::now();
+
+    double length = 0.0;
+    size_t broken = 0;
+    double prevEnd[3] = { 0.0, 0.0, 0.0 };
+    for (CCompactGeometry::CCursor c(geometry, 0); c.IsValid(); c.Next())
+    {
+        const CompactSegment& s = c.Get();
+        if (c.GetIndex() % branchLength != 0 &&
+            (s.start[0] != prevEnd[0] || s.start[1] != prevEnd[1] || s.start[2] != prevEnd[2]))
+            ++broken;
+        if (s.tag != (uint32_t)(c.GetIndex() / 4))
+            ++broken;
+        length += std::sqrt((s.end[0] - s.start[0]) * (s.end[0] - s.start[0]) +
+            (s.end[1] - s.start[1]) * (s.end[1] - s.start[1]) + (s.end[2] - s.start[2]) * (s.end[2] - s.start[2]));
+        prevEnd[0] = s.end[0];
+        prevEnd[1] = s.end[1];
+        prevEnd[2] = s.end[2];
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    const CompactSegment last = geometry.Get(segments - 1);
+    const bool lastOk = std::fabs(last.end[0] - p[0]) <= geometry.GetErrorBound() &&
+        std::fabs(last.end[1] - p[1]) <= geometry.GetErrorBound() &&
+        std::fabs(last.end[2] - p[2]) <= geometry.GetErrorBound();
+
+    const double bytes = (double)geometry.GetEncodedBytes();
+    std::printf("segments %zu  runs %zu  vertices %zu\n", geometry.GetSegmentCount(), geometry.GetRunCount(),
+        geometry.GetVertexCount());
+    std::printf("encoded %.1f MB  %.2f B/seg (AcGePoint3d pair: 48 B/seg)\n", bytes / 1048576.0, bytes / segments);
+    std::printf("max error %.3g  bound %.3g\n", geometry.GetMaxError(), geometry.GetErrorBound());
+    std::printf("encode %.0f ms  decode %.0f ms  length %.0f  broken %zu  last %s\n",
+        std::chrono::duration<double, std::milli>(t1 - t0).count(),
+        std::chrono::duration<double, std::milli>(t2 - t1).count(), length, broken, lastOk ? "ok" : "MISMATCH");
+    return broken == 0 && lastOk && geometry.GetMaxError() <= geometry.GetErrorBound() ? 0 : 1;
+}
+#endif
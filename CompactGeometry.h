@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "MemAccounting.h"
+
+// Компактная геометрия разобранной модели (без зависимости от SDK).
+// Координаты хранятся целыми шагами quantum (по умолчанию 0,001 мм — разрешение
+// NTL) относительно начала ветки — первой точки ветки. Подряд идущие сегменты
+// ветки с общим концом образуют серию: общая вершина хранится один раз, серия
+// пишется в поток байт как начальная вершина и приращения концов (zigzag + varint).
+// Серия не длиннее kMaxRunLength, поэтому произвольный доступ декодирует
+// не больше одной серии; последовательный обход декодирует на лету.
+//
+// Погрешность: декодированная координата равна origin + k * quantum, где
+// k = round((v - origin) / quantum). Отклонение не больше quantum / 2 плюс
+// округление double (GetErrorBound); фактический максимум по модели считается
+// при записи той же арифметикой, что и декодирование (GetMaxError).
+//
+// Проверка без nanoCAD — -DCOMPACTGEOM_MAIN (README, «Проверки без nanoCAD»).
+
+const double kDefaultGeometryQuantum = 1e-3;
+
+// Декодированный сегмент
+struct CompactSegment
+{
+    double start[3];
+    double end[3];
+    uint32_t branch;    // ветка (номер у владельца)
+    uint32_t tag;       // атрибуты сегмента (номер у владельца)
+};
+
+class CCompactGeometry
+{
+public:
+    static const uint32_t kMaxRunLength = 256;
+
+    explicit CCompactGeometry(double quantum = kDefaultGeometryQuantum);
+
+    // Шаг меняется только у пустой геометрии
+    void SetQuantum(double quantum);
+    double GetQuantum() const { return m_quantum; }
+
+    void Clear();
+    void ShrinkToFit();
+
+    // Добавить сегмент. Начало ветки — первая точка первого сегмента ветки.
+    // Координата дальше 2^52 шагов от начала ветки — std::out_of_range.
+    void Append(uint32_t branch, const double start[3], const double end[3], uint32_t tag);
+
+    size_t GetSegmentCount() const { return m_segmentCount; }
+    size_t GetVertexCount() const { return m_segmentCount + m_runs.size(); }
+    size_t GetRunCount() const { return m_runs.size(); }
+    // Байт потока, серий и начал веток
+    size_t GetEncodedBytes() const;
+
+    double GetErrorBound() const;
+    double GetMaxError() const { return m_maxError; }
+
+    // Произвольный доступ: поиск серии и декодирование до index
+    CompactSegment Get(size_t index) const;
+
+    // Последовательный обход с декодированием на лету
+    class CCursor
+    {
+    public:
+        CCursor(const CCompactGeometry& geometry, size_t index);
+
+        bool IsValid() const { return m_index < m_geometry->m_segmentCount; }
+        size_t GetIndex() const { return m_index; }
+        const CompactSegment& Get() const { return m_current; }
+        void Next();
+
+    private:
+        void EnterRun(size_t run);
+        void DecodeSegment();
+
+        const CCompactGeometry* m_geometry;
+        size_t m_index;
+        size_t m_run;
+        uint32_t m_inRun;           // номер сегмента в серии
+        size_t m_pos;               // позиция в потоке
+        int64_t m_q[3];             // текущая вершина в шагах
+        CompactSegment m_current;
+    };
+
+private:
+    struct Branch
+    {
+        double origin[3];
+        bool defined = false;
+    };
+
+    struct Run
+    {
+        uint64_t offset;            // начало серии в потоке
+        uint32_t firstSegment;
+        uint32_t branch;
+        uint32_t firstTag;          // теги в серии — приращения от него
+        uint32_t count;
+    };
+
+    int64_t Quantize(const Branch& branch, int axis, double v);
+    double Dequantize(const Branch& branch, int axis, int64_t q) const;
+    void PutVarint(int64_t v);
+    size_t FindRun(size_t index) const;
+
+    double m_quantum;
+    CountedVector<Branch> m_branches;
+    CountedVector<Run> m_runs;
+    CountedVector<uint8_t> m_stream;
+    size_t m_segmentCount = 0;
+
+    // Состояние записи: конец последнего сегмента и его тег
+    int64_t m_lastQ[3] = { 0, 0, 0 };
+    uint32_t m_lastTag = 0;
+
+    double m_maxError = 0.0;
+    double m_maxMagnitude = 0.0;    // для оценки округления double
+};
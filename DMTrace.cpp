@@ -0,0 +1,385 @@
+#include "stdafx.h"
+#include "DMTrace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+const char kMagic[4] = { 'D', 'M', 'T', 'R' };
+const uint32_t kVersion = 1;
+const size_t kRecordBytes = 11;
+
+template <typename T>
+void Put(std::vector<char>& buf, T v)
+{
+    const char* p = reinterpret_cast<const char*>(&v);
+    buf.insert(buf.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+T Get(const char*& p)
+{
+    T v;
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return v;
+}
+} // namespace
+
+const wchar_t* DMOpName(DMOp op)
+{
+    switch (op)
+    {
+    case DMOp::CreatePipe: return L"CreatePipe";
+    case DMOp::Start: return L"Start";
+    case DMOp::GetAxis: return L"GetAxis";
+    case DMOp::GetSeg: return L"GetSeg";
+    case DMOp::AddSupport: return L"AddSupport";
+    case DMOp::AddInLine: return L"AddInLine";
+    case DMOp::EditableAxisAdd: return L"EditableAxisAdd";
+    case DMOp::Recalculate: return L"Recalculate";
+    case DMOp::End: return L"End";
+    case DMOp::Clear: return L"Clear";
+    case DMOp::CheckForErase: return L"CheckForErase";
+    case DMOp::UpdateDBEnt: return L"UpdateDBEnt";
+    case DMOp::SetView: return L"SetView";
+    case DMOp::EraseAxis: return L"EraseAxis";
+    default: return L"?";
+    }
+}
+
+bool CDMTrace::Save(const std::wstring& path) const
+{
+    std::vector<char> buf;
+    buf.reserve(16 + records.size() * kRecordBytes + args.size() * sizeof(double));
+    buf.insert(buf.end(), kMagic, kMagic + 4);
+    Put<uint32_t>(buf, kVersion);
+    Put<uint32_t>(buf, (uint32_t)records.size());
+    Put<uint32_t>(buf, (uint32_t)args.size());
+    for (const DMTraceRecord& r : records)
+    {
+        Put<uint8_t>(buf, (uint8_t)r.op);
+        Put<uint16_t>(buf, r.argCount);
+        Put<int32_t>(buf, r.result);
+        Put<uint32_t>(buf, r.durationUs);
+    }
+    const char* a = reinterpret_cast<const char*>(args.data());
+    buf.insert(buf.end(), a, a + args.size() * sizeof(double));
+
+    std::ofstream out(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(buf.data(), (std::streamsize)buf.size());
+    return (bool)out;
+}
+
+bool CDMTrace::Load(const std::wstring& path)
+{
+    Clear();
+    std::ifstream in(std::filesystem::path(path), std::ios::binary);
+    if (!in)
+        return false;
+    std::vector<char> buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (buf.size() < 16 || std::memcmp(buf.data(), kMagic, 4) != 0)
+        return false;
+
+    const char* p = buf.data() + 4;
+    if (Get<uint32_t>(p) != kVersion)
+        return false;
+    const uint32_t recordCount = Get<uint32_t>(p);
+    const uint32_t argCount = Get<uint32_t>(p);
+    if (buf.size() != 16 + (size_t)recordCount * kRecordBytes + (size_t)argCount * sizeof(double))
+        return false;
+
+    records.resize(recordCount);
+    uint32_t firstArg = 0;
+    for (DMTraceRecord& r : records)
+    {
+        r.op = (DMOp)Get<uint8_t>(p);
+        r.argCount = Get<uint16_t>(p);
+        r.result = Get<int32_t>(p);
+        r.durationUs = Get<uint32_t>(p);
+        r.firstArg = firstArg;
+        firstArg += r.argCount;
+    }
+    if (firstArg != argCount)
+    {
+        Clear();
+        return false;
+    }
+    args.resize(argCount);
+    std::memcpy(args.data(), p, argCount * sizeof(double));
+    return true;
+}
+
+CDMTraceRecorder& CDMTraceRecorder::Instance()
+{
+    static CDMTraceRecorder recorder;
+    return recorder;
+}
+
+void CDMTraceRecorder::Start()
+{
+    m_trace.Clear();
+    m_axisKeys.clear();
+    m_active = true;
+}
+
+int CDMTraceRecorder::AxisKey(int64_t key)
+{
+    auto it = m_axisKeys.emplace(key, (int)m_axisKeys.size()).first;
+    return it->second;
+}
+
+void CDMTraceRecorder::Record(DMOp op, int32_t result, std::chrono::steady_clock::duration elapsed,
+    const double* args, size_t argCount)
+{
+    if (!m_active)
+        return;
+    if (argCount > UINT16_MAX)
+        argCount = 0;
+    long long us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    DMTraceRecord r;
+    r.op = op;
+    r.argCount = (uint16_t)argCount;
+    r.result = result;
+    r.durationUs = (uint32_t)std::min<long long>(std::max<long long>(us, 0), UINT32_MAX);
+    r.firstArg = (uint32_t)m_trace.args.size();
+    m_trace.records.push_back(r);
+    if (argCount > 0)
+        m_trace.args.insert(m_trace.args.end(), args, args + argCount);
+}
+
+int CDMStandIn::CreatePipe(double od, double dn, const double* xyz, size_t pointCount)
+{
+    if (pointCount < 2 || od <= 0.0)
+        return -1;
+    Axis axis;
+    axis.od = od;
+    axis.dn = dn;
+    axis.segs.resize(pointCount - 1);
+    for (size_t i = 0; i + 1 < pointCount; ++i)
+    {
+        const double* a = xyz + i * 3;
+        const double* b = a + 3;
+        axis.segs[i].length = std::sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) +
+            (b[2] - a[2]) * (b[2] - a[2]));
+    }
+    m_axes.push_back(std::move(axis));
+    return (int)m_axes.size() - 1;
+}
+
+void CDMStandIn::Start(int axis)
+{
+    m_axis = axis >= 0 && axis < (int)m_axes.size() ? axis : -1;
+    m_seg = -1;
+}
+
+int CDMStandIn::GetAxis(int axis)
+{
+    if (axis < 0 || axis >= (int)m_axes.size())
+        return -1;
+    m_axis = axis;
+    return (int)m_axes[axis].segs.size();
+}
+
+bool CDMStandIn::GetSeg(int index)
+{
+    m_seg = -1;
+    if (m_axis < 0 || index < 0 || index >= (int)m_axes[m_axis].segs.size())
+        return false;
+    m_seg = index;
+    return true;
+}
+
+bool CDMStandIn::AddSupport(double offset)
+{
+    return AddInLine(offset, -1);
+}
+
+bool CDMStandIn::AddInLine(double offset, int type)
+{
+    if (m_axis < 0 || m_seg < 0)
+        return false;
+    Seg& seg = m_axes[m_axis].segs[m_seg];
+    if (offset < 0.0 || offset > seg.length)
+        return false;
+    seg.items.push_back(Item{ offset, type });
+    return true;
+}
+
+void CDMStandIn::EditableAxisAdd()
+{
+    if (m_axis >= 0 && std::find(m_editable.begin(), m_editable.end(), m_axis) == m_editable.end())
+        m_editable.push_back(m_axis);
+}
+
+int CDMStandIn::Recalculate()
+{
+    // Элементы по порядку вдоль сегмента, как их расставляет пересчёт
+    for (int a : m_editable)
+    {
+        for (Seg& seg : m_axes[a].segs)
+        {
+            std::stable_sort(seg.items.begin(), seg.items.end(),
+                [](const Item& x, const Item& y) { return x.offset < y.offset; });
+        }
+    }
+    return 0;
+}
+
+void CDMStandIn::End()
+{
+    m_editable.clear();
+    m_axis = -1;
+    m_seg = -1;
+}
+
+void CDMStandIn::Clear()
+{
+    End();
+}
+
+void CDMStandIn::EraseAxis(int axis)
+{
+    // Номера осей не сдвигаются: удалённая ось остаётся пустой
+    if (axis >= 0 && axis < (int)m_axes.size())
+        m_axes[axis].segs.clear();
+}
+
+size_t CDMStandIn::GetItemCount() const
+{
+    size_t count = 0;
+    for (const Axis& axis : m_axes)
+    {
+        for (const Seg& seg : axis.segs)
+            count += seg.items.size();
+    }
+    return count;
+}
+
+DMReplayStats ReplayDMTrace(const CDMTrace& trace, IDMReplayTarget& target)
+{
+    DMReplayStats stats;
+    std::vector<int> axisMap;     // номер оси в трассе -> номер в модели
+    auto mapAxis = [&](double traceAxis)
+    {
+        int a = (int)traceAxis;
+        return a >= 0 && a < (int)axisMap.size() ? axisMap[a] : -1;
+    };
+
+    for (const DMTraceRecord& r : trace.records)
+    {
+        if (r.op == DMOp(0) || r.op >= DMOp::Count)
+            continue;
+        const double* args = trace.Args(r);
+        auto t = std::chrono::steady_clock::now();
+        bool match = true;
+        switch (r.op)
+        {
+        case DMOp::CreatePipe:
+        {
+            int axis = r.argCount >= 2 ?
+                target.CreatePipe(args[0], args[1], args + 2, (r.argCount - 2) / 3) : -1;
+            match = (axis >= 0) == (r.result >= 0);
+            if (r.result >= 0)
+            {
+                if ((int)axisMap.size() <= r.result)
+                    axisMap.resize(r.result + 1, -1);
+                axisMap[r.result] = axis;
+            }
+            break;
+        }
+        case DMOp::Start:
+            target.Start(r.argCount > 0 ? mapAxis(args[0]) : -1);
+            break;
+        case DMOp::GetAxis:
+            match = target.GetAxis(r.argCount > 0 ? mapAxis(args[0]) : -1) == r.result;
+            break;
+        case DMOp::GetSeg:
+            match = target.GetSeg(r.argCount > 0 ? (int)args[0] : -1) == (r.result != 0);
+            break;
+        case DMOp::AddSupport:
+            match = target.AddSupport(r.argCount > 0 ? args[0] : -1.0) == (r.result != 0);
+            break;
+        case DMOp::AddInLine:
+            match = target.AddInLine(r.argCount > 0 ? args[0] : -1.0, r.argCount > 1 ? (int)args[1] : 0) ==
+                (r.result != 0);
+            break;
+        case DMOp::EditableAxisAdd:
+            target.EditableAxisAdd();
+            break;
+        case DMOp::Recalculate:
+            match = (target.Recalculate() == 0) == (r.result == 0);
+            break;
+        case DMOp::End:
+            target.End();
+            break;
+        case DMOp::Clear:
+            target.Clear();
+            break;
+        case DMOp::CheckForErase:
+            target.CheckForErase();
+            break;
+        case DMOp::UpdateDBEnt:
+            target.UpdateDBEnt();
+            break;
+        case DMOp::SetView:
+            match = target.SetView() == (r.result != 0);
+            break;
+        case DMOp::EraseAxis:
+            // Оси прежнего импорта в трассе нет — результат не сравнивается
+            target.EraseAxis(r.argCount > 0 ? mapAxis(args[0]) : -1);
+            break;
+        default:
+            break;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+
+        DMReplayStats::Op& op = stats.ops[(size_t)r.op];
+        ++op.calls;
+        op.recordedMs += r.durationUs / 1000.0;
+        op.replayMs += ms;
+        stats.recordedMs += r.durationUs / 1000.0;
+        stats.replayMs += ms;
+        if (!match)
+            ++stats.mismatches;
+    }
+    return stats;
+}
+
+#ifdef DMTRACE_REPLAY_MAIN
+#include <cstdio>
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::printf("usage: dmreplay <trace.bin>\n");
+        return 2;
+    }
+    CDMTrace trace;
+    if (!trace.Load(std::filesystem::path(argv[1]).wstring()))
+    {
+        std::printf("cannot read trace: %s\n", argv[1]);
+        return 1;
+    }
+    CDMStandIn dm;
+    DMReplayStats stats = ReplayDMTrace(trace, dm);
+    std::printf("%-16s %10s %12s %12s\n", "op", "calls", "recorded ms", "replay ms");
+    for (size_t i = 1; i < (size_t)DMOp::Count; ++i)
+    {
+        const DMReplayStats::Op& op = stats.ops[i];
+        if (op.calls == 0)
+            continue;
+        std::printf("%-16ls %10zu %12.1f %12.3f\n", DMOpName((DMOp)i), op.calls, op.recordedMs, op.replayMs);
+    }
+    std::printf("records %zu, axes %zu, items %zu, mismatches %zu, recorded %.1f ms, replay %.3f ms\n",
+        trace.records.size(), dm.GetAxisCount(), dm.GetItemCount(), stats.mismatches, stats.recordedMs,
+        stats.replayMs);
+    return 0;
+}
+#endif
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+// Трасса вызовов DragManager при импорте (без зависимости от SDK).
+// Импорт записывает каждый вызов vCSDragManager / vCS_DM_Axis / vCS_DM_Seg:
+// операцию, аргументы, результат и длительность. Трасса проигрывается на модели
+// DragManager без nanoCAD — для замеров накладных расходов плагина, сравнения
+// числа вызовов между версиями и воспроизведения импорта без чертежа заказчика.
+//
+// Оси в трассе — порядковые номера по первому появлению, а не id объектов:
+// трасса не зависит от базы, в которой записана. Ось и сегмент задаются
+// вызовами Start/GetSeg, последующие AddSupport/AddInLine относятся к ним —
+// так же, как pSeg в коде импорта. Создание трубы (CalculateAndConnect с поиском
+// оси через getCalculatedAxis/GetOIdNewAxises) записывается одной операцией.
+//
+// Проигрыватель без nanoCAD — -DDMTRACE_REPLAY_MAIN (README, «Проверки без nanoCAD»).
+
+enum class DMOp : uint8_t
+{
+    CreatePipe = 1,     // args: od, dn, x0, y0, z0, x1, ...; result: ось или -1
+    Start,              // args: ось
+    GetAxis,            // args: ось; result: число сегментов или -1
+    GetSeg,             // args: индекс сегмента; result: 1/0
+    AddSupport,         // args: смещение; result: 1/0
+    AddInLine,          // args: смещение, тип (0 — арматура, 1 — переход, 2 — тройник); result: 1/0
+    EditableAxisAdd,
+    Recalculate,        // result: Acad::ErrorStatus
+    End,
+    Clear,
+    CheckForErase,
+    UpdateDBEnt,
+    SetView,            // result: 1/0
+    EraseAxis,          // args: ось; result: число удалённых элементов или -1
+
+    Count
+};
+
+const wchar_t* DMOpName(DMOp op);
+
+struct DMTraceRecord
+{
+    DMOp op;
+    uint16_t argCount;
+    int32_t result;
+    uint32_t durationUs;
+    uint32_t firstArg;      // индекс в CDMTrace::args
+};
+
+struct CDMTrace
+{
+    std::vector<DMTraceRecord> records;
+    std::vector<double> args;
+
+    void Clear() { records.clear(); args.clear(); }
+    const double* Args(const DMTraceRecord& r) const { return args.data() + r.firstArg; }
+
+    // Двоичный файл: заголовок "DMTR", версия, число записей и аргументов,
+    // затем записи по 11 байт (op, argc, result, durationUs) и аргументы подряд
+    bool Save(const std::wstring& path) const;
+    bool Load(const std::wstring& path);
+};
+
+// Запись трассы. Пока не запущена, Active() == false и обёртки вызовов
+// не тратят время ни на что, кроме проверки флага.
+class CDMTraceRecorder
+{
+public:
+    static CDMTraceRecorder& Instance();
+
+    void Start();
+    void Stop() { m_active = false; }
+    bool Active() const { return m_active; }
+
+    // Порядковый номер оси по ключу (id объекта); новые ключи получают следующий номер
+    int AxisKey(int64_t key);
+
+    void Record(DMOp op, int32_t result, std::chrono::steady_clock::duration elapsed,
+        const double* args = nullptr, size_t argCount = 0);
+
+    const CDMTrace& Trace() const { return m_trace; }
+
+private:
+    CDMTrace m_trace;
+    std::unordered_map<int64_t, int> m_axisKeys;
+    bool m_active = false;
+};
+
+// DragManager для проигрывания. Ось и сегмент — текущие после Start/GetSeg.
+class IDMReplayTarget
+{
+public:
+    virtual ~IDMReplayTarget() {}
+
+    virtual int CreatePipe(double od, double dn, const double* xyz, size_t pointCount) = 0;
+    virtual void Start(int axis) = 0;
+    virtual int GetAxis(int axis) = 0;
+    virtual bool GetSeg(int index) = 0;
+    virtual bool AddSupport(double offset) = 0;
+    virtual bool AddInLine(double offset, int type) = 0;
+    virtual void EditableAxisAdd() = 0;
+    virtual int Recalculate() = 0;
+    virtual void End() = 0;
+    virtual void Clear() = 0;
+    virtual void CheckForErase() = 0;
+    virtual void UpdateDBEnt() = 0;
+    virtual bool SetView() = 0;
+    // Удалить ось с сегментами и элементами (ось, которой нет в модели, пропускается)
+    virtual void EraseAxis(int axis) = 0;
+};
+
+// Модель DragManager в памяти: оси с сегментами по точкам, элементы по сегментам.
+// Пересчёт упорядочивает элементы редактируемых осей; геометрия тел не строится,
+// поэтому время проигрывания — нижняя граница, а разница с записанным — доля nanoCAD.
+class CDMStandIn : public IDMReplayTarget
+{
+public:
+    int CreatePipe(double od, double dn, const double* xyz, size_t pointCount) override;
+    void Start(int axis) override;
+    int GetAxis(int axis) override;
+    bool GetSeg(int index) override;
+    bool AddSupport(double offset) override;
+    bool AddInLine(double offset, int type) override;
+    void EditableAxisAdd() override;
+    int Recalculate() override;
+    void End() override;
+    void Clear() override;
+    void CheckForErase() override {}
+    void UpdateDBEnt() override {}
+    bool SetView() override { return true; }
+    void EraseAxis(int axis) override;
+
+    size_t GetAxisCount() const { return m_axes.size(); }
+    size_t GetItemCount() const;
+
+private:
+    struct Item
+    {
+        double offset;
+        int type;           // -1 — опора, иначе тип инлайна
+    };
+    struct Seg
+    {
+        double length;
+        std::vector<Item> items;
+    };
+    struct Axis
+    {
+        double od;
+        double dn;
+        std::vector<Seg> segs;
+    };
+
+    std::vector<Axis> m_axes;
+    std::vector<int> m_editable;
+    int m_axis = -1;
+    int m_seg = -1;
+};
+
+struct DMReplayStats
+{
+    struct Op
+    {
+        size_t calls = 0;
+        double recordedMs = 0.0;    // по трассе (в nanoCAD)
+        double replayMs = 0.0;      // на модели
+    };
+    Op ops[(size_t)DMOp::Count];
+    size_t mismatches = 0;          // результат модели не совпал с записанным
+    double recordedMs = 0.0;
+    double replayMs = 0.0;
+};
+
+// Проиграть трассу на target. Результаты сравниваются с записанными;
+// ось в аргументах Start/GetAxis — номер из трассы, он переводится в номер модели.
+DMReplayStats ReplayDMTrace(const CDMTrace& trace, IDMReplayTarget& target);
@@ -25,13 +25,19 @@
 #include "rxregsvc.h"
 #include "acgi.h"
 #include "aced.h"
+#include "acutmem.h"
 #include "dbxutil.h"
+#include "dbtrans.h"
 #include "ursUtils.h"
 
 #include <vector>
+#include <set>
+#include <map>
 #include <algorithm>
+#include <chrono>
 #include <cwctype>
 #include <cwchar>
+#include <cfloat>
 
 // ViperCS / Model Studio SDK - для создания трубы
 #include "vCSCreatePipe.h"
@@ -51,6 +57,27 @@
 
 // Парсер NTL формата
 #include "NTLParser.h"
+#include "PointWeld.h"
+#include "SegmentMerge.h"
+#include "PolylineSimplify.h"
+#include "NTLStagedImport.h"
+#include "ImportProgress.h"
+#include "StressGen.h"
+#include "DMTrace.h"
+#include "MemAccounting.h"
+#include "MemBudget.h"
+// Индекс трубопроводных сущностей модели
+#include "PipingUtils.h"
+#include "PipingIndex.h"
+#include "ReportWriter.h"
+#include "ArrowWriter.h"
+#include "ArmatureDelta.h"
+#include "KKSIndex.h"
+#include "KKSAssign.h"
+#include "ModelScanner.h"
+#include "ModelReports.h"
+#include "NTLReconcile.h"
+#include "NTLChainTag.h"
 
 namespace
 {
@@ -118,33 +145,6 @@ std::wstring PointToStr(const AcGePoint3d& pt)
     return ss.str();
 }
 
-bool ContainsNoCase(const std::wstring& haystack, const std::wstring& needle)
-{
-    if (needle.empty())
-        return true;
-    auto toLower = [](wchar_t c) { return (wchar_t)std::towlower(c); };
-    std::wstring h, n;
-    h.resize(haystack.size());
-    n.resize(needle.size());
-    std::transform(haystack.begin(), haystack.end(), h.begin(), toLower);
-    std::transform(needle.begin(), needle.end(), n.begin(), toLower);
-    return h.find(n) != std::wstring::npos;
-}
-
-// Определяем, похоже ли имя класса на dummy (ссылочный объект)
-bool IsDummyClass(const std::wstring& className)
-{
-    return ContainsNoCase(className, L"dummy");
-}
-
-// Определяем, похоже ли на арматуру (inline/valve/armatur)
-bool IsArmatureClass(const std::wstring& className)
-{
-    return ContainsNoCase(className, L"inline") ||
-        ContainsNoCase(className, L"valve") ||
-        ContainsNoCase(className, L"armatur");
-}
-
 std::wstring ExtractPartNameFromRb(resbuf* prb)
 {
     for (resbuf* p = prb; p; p = p->rbnext)
@@ -170,51 +170,329 @@ std::wstring ExtractPartNameFromRb(resbuf* prb)
     return L"";
 }
 
-// Пытаемся достать параметр KKS_PART через параметры объекта.
-// hasParam = true, если параметр существует (может быть пустым).
-std::wstring GetKKSPart(AcDbEntity* pEnt, bool& hasParam)
+// Путь к файлу отчёта в %TEMP%
+std::wstring GetTempFilePath(const wchar_t* name)
+{
+    wchar_t tempPath[MAX_PATH] = { 0 };
+    GetTempPathW(MAX_PATH, tempPath);
+    std::wstring path(tempPath);
+    if (!path.empty() && path.back() != L'\\')
+        path.push_back(L'\\');
+    path += name;
+    return path;
+}
+
+// Индекс трубопроводных сущностей рабочей БД, актуализированный на текущий момент.
+// Строится один раз на документ, дальше перечитываются только изменённые объекты.
+CPipingIndex* GetUpdatedPipingIndex(AcDbDatabase* pDb, const wchar_t* caller)
+{
+    CPipingIndex* pIndex = CPipingIndex::ForDatabase(pDb);
+    bool wasBuilt = pIndex && pIndex->IsBuilt();
+    int refreshed = 0;
+    if (!pIndex || !pIndex->Update(&refreshed))
+    {
+        acutPrintf(L"\nERROR: Cannot read model space.");
+        LogMessage(L"%s: index update fail", caller);
+        return nullptr;
+    }
+    LogMessage(L"%s: index %s, entries=%d, refreshed=%d", caller,
+        wasBuilt ? L"reused" : L"built", (int)pIndex->GetEntries().size(), refreshed);
+    return pIndex;
+}
+
+// Настройки EXPORTARMATURE (меняются командой ARMEXPORTOPTIONS)
+struct ArmatureExportOptions
 {
-    hasParam = false;
-    if (!pEnt)
-        return L"";
-
-    CElement params;
-    if (!ursGetObjectParameters(pEnt->objectId(), params))
-        return L"";
-
-    CString kks;
-    hasParam = params.GetValue(L"KKS_PART", kks);
-    if (!hasParam)
-        return L"";
-    return std::wstring(kks.GetString());
+    bool writeCsv = true;       // %TEMP%\ArmatureTable.csv
+    bool writeArrow = false;    // %TEMP%\ArmatureTable.arrow (Arrow IPC, колонки + Handle)
+    bool writeDelta = false;    // %TEMP%\ArmatureTable.delta.csv относительно прошлой выгрузки
+    bool deltaOnly = false;     // только дельта, полные таблицы не пишутся
+    std::wstring kksPrefix;     // выгружать только арматуру с этим префиксом KKS (нормализован)
+
+    // Область выгрузки: прямоугольник или многоугольник в плане плюс диапазон отметок
+    enum class Area { None, Box, Polygon };
+    Area area = Area::None;
+    AcGePoint2d areaMin, areaMax;           // Box: экстенты объекта пересекают прямоугольник
+    std::vector<AcGePoint2d> polygon;       // Polygon: центр объекта внутри многоугольника
+    double zMin = -DBL_MAX;
+    double zMax = DBL_MAX;
+};
+
+// Точка внутри многоугольника (чётность пересечений луча)
+bool PointInPolygon(const std::vector<AcGePoint2d>& poly, double x, double y)
+{
+    bool inside = false;
+    for (size_t i = 0, j = poly.size() - 1; i < poly.size(); j = i++)
+    {
+        const AcGePoint2d& a = poly[i];
+        const AcGePoint2d& b = poly[j];
+        if ((a.y > y) != (b.y > y) && x < (b.x - a.x) * (y - a.y) / (b.y - a.y) + a.x)
+            inside = !inside;
+    }
+    return inside;
 }
 
-// Получаем центр геометрических экстентов в WCS
-AcGePoint3d GetEntityCenter(AcDbEntity* pEnt, bool& ok)
+ArmatureExportOptions& GetArmatureExportOptions()
 {
-    ok = false;
-    if (!pEnt)
-        return AcGePoint3d::kOrigin;
-    AcDbExtents ext;
-    if (pEnt->getGeomExtents(ext) != Acad::eOk)
-        return AcGePoint3d::kOrigin;
-    ok = true;
-    return AcGePoint3d(
-        (ext.minPoint().x + ext.maxPoint().x) * 0.5,
-        (ext.minPoint().y + ext.maxPoint().y) * 0.5,
-        (ext.minPoint().z + ext.maxPoint().z) * 0.5);
+    static ArmatureExportOptions options;
+    return options;
 }
 
-struct ArmatureInfo
+// Настройки IMPORTNTL (меняются командой NTLIMPORTOPTIONS)
+struct NTLImportOptions
 {
-    AcDbObjectId id;
-    std::wstring className;
-    std::wstring kksPart;
-    AcGePoint3d pos;
-    bool isDummy;
+    double weldTolerance = kDefaultWeldTolerance;   // допуск склейки концов сегментов, мм
+    double simplifyAngleDeg = 0.0;                  // убирать изломы не больше угла, град (0 — только прямые)
+    int previewBudget = 20000;                      // PREVIEWNTL: вершин на все полилинии предпросмотра
+    bool staged = false;                            // сначала только оси, опоры и инлайны — NTLFITTINGS
+    int fittingChunk = 200;                         // опор/инлайнов на один пересчёт оси
+    int timeSliceMs = 500;                          // порция работы с DM не дольше, мс (0 — без ограничения)
+    bool incremental = false;                       // пересоздавать только изменённые цепочки (метки осей)
 };
 
-// Экспорт таблицы арматуры в %TEMP%\ArmatureTable.csv
+NTLImportOptions& GetNTLImportOptions()
+{
+    static NTLImportOptions options;
+    return options;
+}
+
+// Arrow IPC: те же колонки без потери точности плюс Handle объекта
+bool WriteArmatureArrow(const std::wstring& path, const std::vector<const PipingEntry*>& rows)
+{
+    typedef CArrowTableWriter::ColumnType ColumnType;
+    CArrowTableWriter table;
+    int colKks = table.AddColumn(L"KKS_PART", ColumnType::Utf8);
+    int colX = table.AddColumn(L"X", ColumnType::Float64);
+    int colY = table.AddColumn(L"Y", ColumnType::Float64);
+    int colZ = table.AddColumn(L"Z", ColumnType::Float64);
+    int colCls = table.AddColumn(L"ClassName", ColumnType::Utf8);
+    int colDummy = table.AddColumn(L"Dummy", ColumnType::Bool);
+    int colHandle = table.AddColumn(L"Handle", ColumnType::UInt64);
+    for (const auto* a : rows)
+    {
+        table.AppendUtf8(colKks, a->kksPart);
+        table.AppendDouble(colX, a->center.x);
+        table.AppendDouble(colY, a->center.y);
+        table.AppendDouble(colZ, a->center.z);
+        table.AppendUtf8(colCls, a->className);
+        table.AppendBool(colDummy, a->isDummy);
+        table.AppendUInt64(colHandle, HandleToUInt64(a->id.handle()));
+    }
+    return table.Write(path);
+}
+
+// Ключ базы данных для снимка дельты: GUID отпечатка чертежа (хранится в DWG и уникален
+// для каждого нового чертежа, в том числе не сохранённого) плюс имя файла — копии одного
+// DWG с общим GUID ведут разные снимки
+std::wstring GetDatabaseKey(AcDbDatabase* pDb)
+{
+    std::wstring key;
+    ACHAR* guid = nullptr;
+    if (pDb->getFingerprintGuid(guid) == Acad::eOk && guid)
+    {
+        key = guid;
+        acutDelString(guid);
+    }
+    else
+    {
+        wchar_t buf[32] = { 0 };
+        swprintf_s(buf, L"db%p", (void*)pDb);
+        key = buf;
+    }
+    const ACHAR* fileName = nullptr;
+    pDb->getFilename(fileName);
+    key += L"|";
+    key += fileName ? fileName : L"";
+    return key;
+}
+
+// Метка записи снимка: время записи, строго возрастающая в пределах сеанса
+uint64_t NextSnapshotGeneration()
+{
+    static uint64_t last = 0;
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    uint64_t now = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    last = now > last ? now : last + 1;
+    return last;
+}
+
+// Прямоугольник запроса к R-дереву для фильтра по области
+SpatialBox ArmatureAreaBox(const ArmatureExportOptions& opt)
+{
+    if (opt.area == ArmatureExportOptions::Area::Box)
+        return SpatialBox{ { opt.areaMin.x, opt.areaMin.y, opt.zMin }, { opt.areaMax.x, opt.areaMax.y, opt.zMax } };
+
+    SpatialBox box{ { DBL_MAX, DBL_MAX, opt.zMin }, { -DBL_MAX, -DBL_MAX, opt.zMax } };
+    for (const AcGePoint2d& p : opt.polygon)
+    {
+        box.min[0] = std::min(box.min[0], p.x);
+        box.min[1] = std::min(box.min[1], p.y);
+        box.max[0] = std::max(box.max[0], p.x);
+        box.max[1] = std::max(box.max[1], p.y);
+    }
+    return box;
+}
+
+// Запись проходит фильтр выгрузки (вид, KKS_PART, префикс, область); правило dummy — отдельно
+bool MatchesArmatureFilter(const PipingEntry& e, const ArmatureExportOptions& opt)
+{
+    if (e.kind != PipingKind::Armature || !e.hasKks)
+        return false; // параметра нет совсем — пропускаем
+    if (!opt.kksPrefix.empty() && NormalizeKKS(e.kksPart).compare(0, opt.kksPrefix.size(), opt.kksPrefix) != 0)
+        return false;
+    // Те же условия, что дают QueryBox(ArmatureAreaBox) и проверка центра: центр внутри
+    // многоугольника уже означает пересечение его прямоугольника в плане
+    if (opt.area == ArmatureExportOptions::Area::None)
+        return true;
+    if (e.extMax.z < opt.zMin || e.extMin.z > opt.zMax)
+        return false;
+    if (opt.area == ArmatureExportOptions::Area::Box)
+        return e.extMin.x <= opt.areaMax.x && opt.areaMin.x <= e.extMax.x &&
+            e.extMin.y <= opt.areaMax.y && opt.areaMin.y <= e.extMax.y;
+    return PointInPolygon(opt.polygon, e.center.x, e.center.y);
+}
+
+// Дельта относительно прошлой выгрузки: снимок (handle -> хеш строки) хранится в .snapshot,
+// в .delta.csv попадают только добавленные (A), изменённые (C) и удалённые (R) строки.
+// Если снимок записан этим же сеансом, хешируются только объекты из журнала изменений
+// индекса; иначе (первая выгрузка, другой чертёж или фильтр) — полный проход по rows.
+bool WriteArmatureDelta(const std::wstring& basePath, AcDbDatabase* pDb, CPipingIndex* pIndex,
+    const std::vector<const PipingEntry*>& rows, bool hasDummy, ArmatureDelta& delta)
+{
+    // Выгрузка с фильтром по префиксу KKS или по области ведёт свой снимок
+    std::wstring drawingKey = GetDatabaseKey(pDb);
+    const ArmatureExportOptions& opt = GetArmatureExportOptions();
+    if (!opt.kksPrefix.empty())
+        drawingKey += L"|" + opt.kksPrefix;
+    if (opt.area != ArmatureExportOptions::Area::None)
+    {
+        std::wstringstream area;
+        area << L"|area";
+        if (opt.area == ArmatureExportOptions::Area::Box)
+            area << L"," << opt.areaMin.x << L"," << opt.areaMin.y << L"," << opt.areaMax.x << L"," << opt.areaMax.y;
+        for (const AcGePoint2d& p : opt.polygon)
+            area << L"," << p.x << L"," << p.y;
+        area << L"," << opt.zMin << L"," << opt.zMax;
+        drawingKey += area.str();
+    }
+    // Появление/исчезновение dummy меняет состав всей выборки — это другой снимок
+    if (hasDummy)
+        drawingKey += L"|dummy";
+
+    struct Keyed
+    {
+        uint64_t handle;
+        const PipingEntry* entry;
+    };
+    std::vector<Keyed> keyed;     // записи строк A/C, по handle
+
+    const std::wstring snapshotPath = basePath + L".snapshot";
+    ArmatureSnapshot prev;
+    ArmatureSnapshot cur;
+    cur.drawingKey = HashString(drawingKey);
+    bool havePrev = LoadArmatureSnapshot(snapshotPath, prev) && prev.drawingKey == cur.drawingKey;
+    std::vector<AcDbObjectId> journal;
+    if (havePrev && pIndex->GetChangeJournal(prev.generation, journal))
+    {
+        const auto& entries = pIndex->GetEntries();
+        std::vector<ArmatureRowUpdate> updates;
+        updates.reserve(journal.size());
+        for (const AcDbObjectId& id : journal)
+        {
+            uint64_t handle = HandleToUInt64(id.handle());
+            auto it = entries.find(id);
+            const PipingEntry* a = it != entries.end() ? &it->second : nullptr;
+            if (a && MatchesArmatureFilter(*a, opt) && (!hasDummy || a->isDummy))
+            {
+                updates.push_back({ handle,
+                    ArmatureRowHash(a->kksPart, a->className, a->center.x, a->center.y, a->center.z, a->isDummy), true });
+                keyed.push_back({ handle, a });
+            }
+            else
+            {
+                updates.push_back({ handle, 0, false });
+            }
+        }
+        ApplyArmatureUpdates(prev, updates, cur, delta);
+        LogMessage(L"exportArmatureTable: delta incremental, %d changed objects of %d rows",
+            (int)journal.size(), (int)cur.rows.size());
+    }
+    else
+    {
+        if (!havePrev)
+        {
+            LogMessage(L"exportArmatureTable: no snapshot for this drawing, delta = full table");
+            prev.rows.clear();
+        }
+        keyed.reserve(rows.size());
+        for (const auto* a : rows)
+            keyed.push_back({ HandleToUInt64(a->id.handle()), a });
+        cur.rows.reserve(keyed.size());
+        for (const Keyed& k : keyed)
+        {
+            const PipingEntry* a = k.entry;
+            cur.rows.push_back({ k.handle,
+                ArmatureRowHash(a->kksPart, a->className, a->center.x, a->center.y, a->center.z, a->isDummy) });
+        }
+        SortSnapshot(cur);
+        DiffArmatureSnapshots(prev, cur, delta);
+        LogMessage(L"exportArmatureTable: delta full pass, %d rows", (int)cur.rows.size());
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const Keyed& l, const Keyed& r) { return l.handle < r.handle; });
+
+    auto findEntry = [&keyed](uint64_t handle)
+    {
+        auto it = std::lower_bound(keyed.begin(), keyed.end(), handle,
+            [](const Keyed& k, uint64_t h) { return k.handle < h; });
+        return it != keyed.end() && it->handle == handle ? it->entry : nullptr;
+    };
+
+    CReportWriter out(1 << 16);
+    if (!out.Open(basePath + L".delta.csv"))
+        return false;
+    out.Bom();
+    out.Raw("Op;Handle;KKS_PART;X;Y;Z;ClassName;Dummy\n");
+    auto writeRow = [&out](char op, uint64_t handle, const PipingEntry* a)
+    {
+        out.Char(op);
+        out.Char(';');
+        out.Hex(handle);
+        if (!a)
+        {
+            out.Raw(";;;;;;\n");
+            return;
+        }
+        out.Char(';');
+        out.CsvField(a->kksPart);
+        out.Char(';');
+        out.Double(a->center.x);
+        out.Char(';');
+        out.Double(a->center.y);
+        out.Char(';');
+        out.Double(a->center.z);
+        out.Char(';');
+        out.CsvField(a->className);
+        out.Raw(a->isDummy ? ";1\n" : ";0\n", 3);
+    };
+    for (uint64_t h : delta.added)
+        writeRow('A', h, findEntry(h));
+    for (uint64_t h : delta.changed)
+        writeRow('C', h, findEntry(h));
+    for (uint64_t h : delta.removed)
+        writeRow('R', h, nullptr);
+    if (!out.Close())
+        return false;
+
+    // Снимок обновляем только после успешной записи дельты; журнал индекса ведётся от него
+    cur.generation = NextSnapshotGeneration();
+    if (!SaveArmatureSnapshot(snapshotPath, cur))
+        return false;
+    pIndex->StartChangeJournal(cur.generation);
+    return true;
+}
+
+// Экспорт таблицы арматуры в %TEMP%\ArmatureTable.csv (и/или .arrow)
 void exportArmatureTable()
 {
     LogMessage(L"BEGIN exportArmatureTable");
@@ -228,95 +506,58 @@ void exportArmatureTable()
             return;
         }
 
-        AcDbBlockTable* pBT = nullptr;
-        if (pDb->getBlockTable(pBT, AcDb::kForRead) != Acad::eOk || !pBT)
-        {
-            acutPrintf(L"\nERROR: Cannot get block table.");
-            LogMessage(L"exportArmatureTable: BT fail");
+        CPipingIndex* pIndex = GetUpdatedPipingIndex(pDb, L"exportArmatureTable");
+        if (!pIndex)
             return;
-        }
 
-        AcDbBlockTableRecord* pMS = nullptr;
-        if (pBT->getAt(ACDB_MODEL_SPACE, pMS, AcDb::kForRead) != Acad::eOk || !pMS)
+        const ArmatureExportOptions& opt = GetArmatureExportOptions();
+        std::vector<const PipingEntry*> candidates;
+        if (opt.area == ArmatureExportOptions::Area::None)
         {
-            acutPrintf(L"\nERROR: Cannot get model space.");
-            LogMessage(L"exportArmatureTable: MS fail");
-            pBT->close();
-            return;
+            candidates.reserve(pIndex->GetEntries().size());
+            for (const auto& kv : pIndex->GetEntries())
+                candidates.push_back(&kv.second);
         }
-
-        std::vector<ArmatureInfo> allArm;
-        AcDbBlockTableRecordIterator* pIter = nullptr;
-        if (pMS->newIterator(pIter) == Acad::eOk && pIter)
+        else
         {
-            for (pIter->start(); !pIter->done(); pIter->step())
-            {
-                AcDbEntity* pEnt = nullptr;
-                if (pIter->getEntity(pEnt, AcDb::kForRead) != Acad::eOk || !pEnt)
-                    continue;
-
-                std::wstring cls = pEnt->isA() ? pEnt->isA()->name() : L"";
-                bool isDummy = IsDummyClass(cls);
-                bool isArm = IsArmatureClass(cls);
-
-                if (!isArm)
-                {
-                    pEnt->close();
-                    continue;
-                }
-
-                bool ok = false;
-                AcGePoint3d center = GetEntityCenter(pEnt, ok);
-                if (!ok)
-                {
-                    pEnt->close();
-                    continue;
-                }
-
-                bool hasKks = false;
-                std::wstring kksPart = GetKKSPart(pEnt, hasKks);
-                if (!hasKks)
-                {
-                    pEnt->close();
-                    continue; // параметра нет совсем — пропускаем
-                }
-
-                ArmatureInfo info;
-                info.id = pEnt->objectId();
-                info.className = cls;
-                info.kksPart = kksPart;
-                info.pos = center;
-                info.isDummy = isDummy;
-                allArm.push_back(info);
-
-                pEnt->close();
-            }
-            delete pIter;
+            // Кандидаты — из R-дерева по экстентам, остальная модель не просматривается
+            pIndex->QueryBox(ArmatureAreaBox(opt), candidates);
+            // Порядок строк — как без фильтра
+            std::sort(candidates.begin(), candidates.end(),
+                [](const PipingEntry* a, const PipingEntry* b) { return a->id < b->id; });
+            LogMessage(L"exportArmatureTable: area query -> %d candidates", (int)candidates.size());
         }
 
-        pMS->close();
-        pBT->close();
+        std::vector<const PipingEntry*> allArm;
+        for (const PipingEntry* pEntry : candidates)
+        {
+            if (MatchesArmatureFilter(*pEntry, opt))
+                allArm.push_back(pEntry);
+        }
 
         if (allArm.empty())
         {
-            acutPrintf(L"\nWARNING: No armature-like objects found.");
-            LogMessage(L"exportArmatureTable: none found");
+            if (!opt.kksPrefix.empty() || opt.area != ArmatureExportOptions::Area::None)
+                acutPrintf(L"\nWARNING: No armature-like objects match the KKS prefix/area filter.");
+            else
+                acutPrintf(L"\nWARNING: No armature-like objects found.");
+            LogMessage(L"exportArmatureTable: none found, prefix='%s'", opt.kksPrefix.c_str());
             return;
         }
 
         // Если есть dummy, используем только их; иначе все
-        bool hasDummy = std::any_of(allArm.begin(), allArm.end(), [](const ArmatureInfo& i) { return i.isDummy; });
-        std::vector<const ArmatureInfo*> selected;
-        for (const auto& a : allArm)
+        bool hasDummy = std::any_of(allArm.begin(), allArm.end(), [](const PipingEntry* i) { return i->isDummy; });
+        std::vector<const PipingEntry*> selected;
+        for (const auto* a : allArm)
         {
             if (hasDummy)
             {
-                if (a.isDummy)
-                    selected.push_back(&a);
+                if (a->isDummy)
+                    selected.push_back(a);
             }
             else
             {
-                selected.push_back(&a);
+                selected.push_back(a);
             }
         }
 
@@ -327,53 +568,46 @@ void exportArmatureTable()
             return;
         }
 
-        // Готовим файл
-        wchar_t tempPath[MAX_PATH] = { 0 };
-        GetTempPathW(MAX_PATH, tempPath);
-        std::wstring csvPath(tempPath);
-        if (!csvPath.empty() && csvPath.back() != L'\\')
-            csvPath.push_back(L'\\');
-        csvPath += L"ArmatureTable.csv";
-
-        std::ofstream out8(csvPath, std::ios::out | std::ios::binary | std::ios::trunc);
-        if (!out8)
+        // Готовим файлы
+        const std::wstring basePath = GetTempFilePath(L"ArmatureTable");
+        if (opt.writeCsv && !(opt.writeDelta && opt.deltaOnly))
         {
-            acutPrintf(L"\nERROR: Cannot reopen file: %s", csvPath.c_str());
-            LogMessage(L"exportArmatureTable: reopen fail %s", csvPath.c_str());
-            return;
+            std::wstring csvPath = basePath + L".csv";
+            if (!WriteArmatureCsv(csvPath, selected))
+            {
+                acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+                LogMessage(L"exportArmatureTable: csv write fail %s", csvPath.c_str());
+                return;
+            }
+            acutPrintf(L"\nOK: Exported %d armature items to %s", (int)selected.size(), csvPath.c_str());
+            LogMessage(L"exportArmatureTable: exported %d items to %s", (int)selected.size(), csvPath.c_str());
         }
-        // UTF-8 BOM
-        unsigned char bom[] = { 0xEF, 0xBB, 0xBF };
-        out8.write(reinterpret_cast<const char*>(bom), sizeof(bom));
-
-        auto toUtf8 = [](const std::wstring& ws) {
-            if (ws.empty()) return std::string();
-            int size = WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), nullptr, 0, nullptr, nullptr);
-            std::string res;
-            res.resize(size);
-            if (size > 0)
+        if (opt.writeArrow && !(opt.writeDelta && opt.deltaOnly))
+        {
+            std::wstring arrowPath = basePath + L".arrow";
+            if (!WriteArmatureArrow(arrowPath, selected))
             {
-                WideCharToMultiByte(CP_UTF8, 0, ws.c_str(), (int)ws.size(), &res[0], size, nullptr, nullptr);
+                acutPrintf(L"\nERROR: Cannot write file: %s", arrowPath.c_str());
+                LogMessage(L"exportArmatureTable: arrow write fail %s", arrowPath.c_str());
+                return;
             }
-            return res;
-        };
-
-        out8 << "KKS_PART;X;Y;Z;ClassName;Dummy\n";
-        for (const auto* a : selected)
+            acutPrintf(L"\nOK: Exported %d armature items to %s", (int)selected.size(), arrowPath.c_str());
+            LogMessage(L"exportArmatureTable: exported %d items to %s", (int)selected.size(), arrowPath.c_str());
+        }
+        if (opt.writeDelta)
         {
-            std::string part = toUtf8(a->kksPart);
-            std::string cls = toUtf8(a->className);
-            out8 << part << ";"
-                << a->pos.x << ";"
-                << a->pos.y << ";"
-                << a->pos.z << ";"
-                << cls << ";"
-                << (a->isDummy ? "1" : "0") << "\n";
+            ArmatureDelta delta;
+            if (!WriteArmatureDelta(basePath, pDb, pIndex, selected, hasDummy, delta))
+            {
+                acutPrintf(L"\nERROR: Cannot write delta: %s.delta.csv", basePath.c_str());
+                LogMessage(L"exportArmatureTable: delta write fail %s", basePath.c_str());
+                return;
+            }
+            acutPrintf(L"\nOK: Delta: added %d, changed %d, removed %d -> %s.delta.csv",
+                (int)delta.added.size(), (int)delta.changed.size(), (int)delta.removed.size(), basePath.c_str());
+            LogMessage(L"exportArmatureTable: delta added=%d changed=%d removed=%d",
+                (int)delta.added.size(), (int)delta.changed.size(), (int)delta.removed.size());
         }
-        out8.close();
-
-        acutPrintf(L"\nOK: Exported %d armature items to %s", (int)selected.size(), csvPath.c_str());
-        LogMessage(L"exportArmatureTable: exported %d items to %s", (int)selected.size(), csvPath.c_str());
     }
     catch (const std::exception& ex)
     {
@@ -389,6 +623,387 @@ void exportArmatureTable()
 
 } // namespace
 
+// Настройка формата EXPORTARMATURE
+void armatureExportOptions()
+{
+    ArmatureExportOptions& opt = GetArmatureExportOptions();
+    const wchar_t* current = (opt.writeCsv && opt.writeArrow) ? L"Both" : (opt.writeArrow ? L"Arrow" : L"Csv");
+
+    wchar_t prompt[128] = { 0 };
+    swprintf_s(prompt, L"\nExport format [Csv/Arrow/Both] <%s>: ", current);
+    acedInitGet(0, L"Csv Arrow Both");
+    wchar_t kw[32] = { 0 };
+    int res = acedGetKword(prompt, kw);
+    if (res == RTNORM)
+    {
+        opt.writeCsv = wcscmp(kw, L"Arrow") != 0;
+        opt.writeArrow = wcscmp(kw, L"Csv") != 0;
+    }
+    else if (res != RTNONE)
+    {
+        return;
+    }
+
+    // Only — пишется только дельта, без полных таблиц
+    const wchar_t* currentDelta = !opt.writeDelta ? L"Off" : (opt.deltaOnly ? L"Only" : L"On");
+    swprintf_s(prompt, L"\nDelta export [On/Off/Only] <%s>: ", currentDelta);
+    acedInitGet(0, L"On Off Only");
+    res = acedGetKword(prompt, kw);
+    if (res == RTNORM)
+    {
+        opt.writeDelta = wcscmp(kw, L"Off") != 0;
+        opt.deltaOnly = wcscmp(kw, L"Only") == 0;
+    }
+    else if (res != RTNONE)
+    {
+        return;
+    }
+
+    // Фильтр по префиксу KKS: Enter — оставить, "." — снять
+    swprintf_s(prompt, L"\nKKS prefix filter (. = none) <%s>: ", opt.kksPrefix.empty() ? L"none" : opt.kksPrefix.c_str());
+    wchar_t prefix[134] = { 0 };
+    res = acedGetString(0, prompt, prefix);
+    if (res == RTNORM && prefix[0] != L'\0')
+    {
+        opt.kksPrefix = wcscmp(prefix, L".") == 0 ? std::wstring() : NormalizeKKS(prefix);
+    }
+    else if (res != RTNORM && res != RTNONE)
+    {
+        return;
+    }
+
+    // Область: прямоугольник/многоугольник в плане + диапазон отметок
+    typedef ArmatureExportOptions::Area Area;
+    const wchar_t* currentArea = opt.area == Area::Box ? L"Box" : (opt.area == Area::Polygon ? L"Polygon" : L"None");
+    swprintf_s(prompt, L"\nArea filter [None/Box/Polygon] <%s>: ", currentArea);
+    acedInitGet(0, L"None Box Polygon");
+    res = acedGetKword(prompt, kw);
+    if (res == RTNORM && wcscmp(kw, L"None") == 0)
+    {
+        opt.area = Area::None;
+        opt.polygon.clear();
+    }
+    else if (res == RTNORM)
+    {
+        ads_point p1, p2;
+        if (wcscmp(kw, L"Box") == 0)
+        {
+            if (acedGetPoint(nullptr, L"\nFirst corner: ", p1) != RTNORM ||
+                acedGetCorner(p1, L"\nOpposite corner: ", p2) != RTNORM)
+                return;
+            opt.area = Area::Box;
+            opt.areaMin.set(std::min(p1[X], p2[X]), std::min(p1[Y], p2[Y]));
+            opt.areaMax.set(std::max(p1[X], p2[X]), std::max(p1[Y], p2[Y]));
+            opt.polygon.clear();
+        }
+        else
+        {
+            std::vector<AcGePoint2d> poly;
+            if (acedGetPoint(nullptr, L"\nFirst polygon vertex: ", p1) != RTNORM)
+                return;
+            poly.push_back(AcGePoint2d(p1[X], p1[Y]));
+            for (;;)
+            {
+                res = acedGetPoint(p1, L"\nNext vertex <close>: ", p2);
+                if (res == RTNONE)
+                    break;
+                if (res != RTNORM)
+                    return;
+                poly.push_back(AcGePoint2d(p2[X], p2[Y]));
+                memcpy(p1, p2, sizeof(ads_point));
+            }
+            if (poly.size() < 3)
+            {
+                acutPrintf(L"\nERROR: Polygon needs at least 3 vertices.");
+                return;
+            }
+            opt.area = Area::Polygon;
+            opt.polygon.swap(poly);
+        }
+
+        // Отметки: Enter — без ограничения
+        ads_real z = 0.0;
+        acedInitGet(0, nullptr);
+        res = acedGetReal(L"\nMinimum elevation <no limit>: ", &z);
+        opt.zMin = res == RTNORM ? z : -DBL_MAX;
+        res = acedGetReal(L"\nMaximum elevation <no limit>: ", &z);
+        opt.zMax = res == RTNORM ? z : DBL_MAX;
+        if (opt.zMin > opt.zMax)
+            std::swap(opt.zMin, opt.zMax);
+    }
+    else if (res != RTNONE)
+    {
+        return;
+    }
+
+    acutPrintf(L"\nEXPORTARMATURE: csv=%s arrow=%s delta=%s kks=%s area=%s", opt.writeCsv ? L"on" : L"off",
+        opt.writeArrow ? L"on" : L"off", !opt.writeDelta ? L"off" : (opt.deltaOnly ? L"only" : L"on"),
+        opt.kksPrefix.empty() ? L"*" : opt.kksPrefix.c_str(),
+        opt.area == Area::Box ? L"box" : (opt.area == Area::Polygon ? L"polygon" : L"all"));
+    LogMessage(L"armatureExportOptions: csv=%d arrow=%d delta=%d only=%d kks='%s' area=%d z=[%g,%g]",
+        opt.writeCsv ? 1 : 0, opt.writeArrow ? 1 : 0, opt.writeDelta ? 1 : 0, opt.deltaOnly ? 1 : 0,
+        opt.kksPrefix.c_str(), (int)opt.area, opt.zMin, opt.zMax);
+}
+
+// Настройка импорта NTL
+void ntlImportOptions()
+{
+    NTLImportOptions& opt = GetNTLImportOptions();
+
+    // Допуск склейки: концы ближе допуска считаются одной вершиной
+    wchar_t prompt[128] = { 0 };
+    swprintf_s(prompt, L"\nEndpoint weld tolerance, mm <%g>: ", opt.weldTolerance);
+    acedInitGet(RSG_NONEG | RSG_NOZERO, nullptr);
+    double tol = opt.weldTolerance;
+    int res = acedGetReal(prompt, &tol);
+    if (res == RTNORM)
+        opt.weldTolerance = tol;
+    else if (res != RTNONE)
+        return;
+
+    // Упрощение: соседние сегменты с изломом не больше угла сливаются в один
+    swprintf_s(prompt, L"\nSimplify angle, deg (0 = straight runs only) <%g>: ", opt.simplifyAngleDeg);
+    acedInitGet(RSG_NONEG, nullptr);
+    double angle = opt.simplifyAngleDeg;
+    res = acedGetReal(prompt, &angle);
+    if (res == RTNORM)
+        opt.simplifyAngleDeg = angle < 89.0 ? angle : 89.0;
+    else if (res != RTNONE)
+        return;
+
+    // Бюджет вершин PREVIEWNTL на все полилинии
+    swprintf_s(prompt, L"\nPreview vertex budget <%d>: ", opt.previewBudget);
+    acedInitGet(RSG_NONEG | RSG_NOZERO, nullptr);
+    int budget = opt.previewBudget;
+    res = acedGetInt(prompt, &budget);
+    if (res == RTNORM)
+        opt.previewBudget = budget;
+    else if (res != RTNONE)
+        return;
+
+    // Поэтапный импорт: IMPORTNTL создаёт только оси, опоры и инлайны добавляет NTLFITTINGS
+    swprintf_s(prompt, L"\nStaged import (axes first, fittings by NTLFITTINGS) [On/Off] <%s>: ", opt.staged ? L"On" : L"Off");
+    acedInitGet(0, L"On Off");
+    wchar_t kw[32] = { 0 };
+    res = acedGetKword(prompt, kw);
+    if (res == RTNORM)
+        opt.staged = wcscmp(kw, L"On") == 0;
+    else if (res != RTNONE)
+        return;
+
+    swprintf_s(prompt, L"\nSupports/inlines per recalculation <%d>: ", opt.fittingChunk);
+    acedInitGet(RSG_NONEG | RSG_NOZERO, nullptr);
+    int chunk = opt.fittingChunk;
+    res = acedGetInt(prompt, &chunk);
+    if (res == RTNORM)
+        opt.fittingChunk = chunk;
+    else if (res != RTNONE)
+        return;
+
+    // Квант работы с DM: после него порция пересчитывается и проверяется Esc
+    swprintf_s(prompt, L"\nDM time slice, ms (0 = no limit) <%d>: ", opt.timeSliceMs);
+    acedInitGet(RSG_NONEG, nullptr);
+    int slice = opt.timeSliceMs;
+    res = acedGetInt(prompt, &slice);
+    if (res == RTNORM)
+        opt.timeSliceMs = slice;
+    else if (res != RTNONE)
+        return;
+
+    // Повторный импорт: цепочки с тем же отпечатком на оси не пересоздаются
+    swprintf_s(prompt, L"\nIncremental re-import (changed chains only) [On/Off] <%s>: ", opt.incremental ? L"On" : L"Off");
+    acedInitGet(0, L"On Off");
+    res = acedGetKword(prompt, kw);
+    if (res == RTNORM)
+        opt.incremental = wcscmp(kw, L"On") == 0;
+    else if (res != RTNONE)
+        return;
+
+    acutPrintf(L"\nIMPORTNTL: weld tolerance=%g, simplify angle=%g, preview budget=%d, staged=%s, chunk=%d, slice=%d ms, incremental=%s",
+        opt.weldTolerance, opt.simplifyAngleDeg, opt.previewBudget, opt.staged ? L"on" : L"off", opt.fittingChunk,
+        opt.timeSliceMs, opt.incremental ? L"on" : L"off");
+    LogMessage(L"ntlImportOptions: weldTolerance=%g simplifyAngleDeg=%g previewBudget=%d staged=%d chunk=%d slice=%d incremental=%d",
+        opt.weldTolerance, opt.simplifyAngleDeg, opt.previewBudget, opt.staged ? 1 : 0, opt.fittingChunk,
+        opt.timeSliceMs, opt.incremental ? 1 : 0);
+}
+
+// Замер склейки сегментов на синтетическом входе в миллион сегментов
+void ntlMergeBenchmark()
+{
+    try
+    {
+        const size_t count = 1000000;
+        const double angles[] = { 0.0, GetNTLImportOptions().simplifyAngleDeg };
+        for (int k = 0; k < 2; ++k)
+        {
+            if (k == 1 && angles[1] <= 0.0)
+                break;
+            SegmentMergeBenchmark r = RunSegmentMergeBenchmark(count, 200, 0.7, angles[k]);
+            acutPrintf(L"\nNTLMERGEBENCH: segments=%d angle=%g legacy=%.1f ms (%d runs), soa=%.1f ms, threads=%u %.1f ms (%d runs)",
+                (int)r.segments, angles[k], r.scalarMs, (int)r.runsScalar, r.singleThreadMs, r.threads,
+                r.parallelMs, (int)r.runsMerged);
+            LogMessage(L"ntlMergeBenchmark: segments=%d angle=%g legacy=%.1f soa=%.1f parallel(%u)=%.1f runs=%d/%d",
+                (int)r.segments, angles[k], r.scalarMs, r.singleThreadMs, r.threads, r.parallelMs,
+                (int)r.runsScalar, (int)r.runsMerged);
+        }
+
+        // Память склейки на том же объёме: пик по фазам против бюджета на сегмент
+        MemBudgetResult mem = RunMemoryBudget(count);
+        if (!mem.parsed)
+        {
+            acutPrintf(L"\nNTLMERGEBENCH memory: temporary NTL file not written or not parsed");
+            LogMessage(L"ntlMergeBenchmark memory: temporary NTL file not written or not parsed");
+        }
+        for (const MemBudgetPhase& ph : mem.phases)
+        {
+            acutPrintf(L"\nNTLMERGEBENCH memory: %s peak %.1f B/seg (budget %.1f), %d allocations%s",
+                MemPhaseName(ph.phase), ph.bytesPerSegment, ph.budgetPerSegment, (int)ph.stats.allocCount,
+                ph.ok ? L"" : L" OVER BUDGET");
+            LogMessage(L"ntlMergeBenchmark memory: phase=%s alloc=%llu count=%llu peak/seg=%.1f budget=%.1f",
+                MemPhaseName(ph.phase), ph.stats.allocBytes, ph.stats.allocCount, ph.bytesPerSegment,
+                ph.budgetPerSegment);
+        }
+        acutPrintf(L"\nNTLMERGEBENCH memory: total peak %.1f B/seg %s", mem.peakPerSegment,
+            mem.ok ? L"OK" : L"OVER BUDGET");
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"ntlMergeBenchmark exception: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"ntlMergeBenchmark unknown error");
+        acutPrintf(L"\nERROR: Unknown error in ntlMergeBenchmark.");
+    }
+}
+
+// Сводка по кодам KKS арматуры и опор: число кодов по префиксу, по системам и агрегатам, дубликаты.
+// Консоль + %TEMP%\KKSReport.csv (Section;KKS;Count;Handles)
+void kksReport()
+{
+    LogMessage(L"BEGIN kksReport");
+    try
+    {
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        if (!pDb)
+        {
+            acutPrintf(L"\nERROR: No active database.");
+            LogMessage(L"kksReport: no DB");
+            return;
+        }
+
+        wchar_t prefixBuf[134] = { 0 };
+        int res = acedGetString(0, L"\nKKS prefix <all>: ", prefixBuf);
+        if (res != RTNORM && res != RTNONE)
+            return;
+        const std::wstring prefix = NormalizeKKS(prefixBuf);
+
+        CPipingIndex* pIndex = GetUpdatedPipingIndex(pDb, L"kksReport");
+        if (!pIndex)
+            return;
+
+        // Дерево строится за один проход по индексу; value — номер записи в tagged
+        std::vector<const PipingEntry*> tagged;
+        CKKSTrie trie;
+        int unparsed = 0;
+        for (const auto& kv : pIndex->GetEntries())
+        {
+            const PipingEntry& e = kv.second;
+            if (!e.hasKks || e.kksPart.empty())
+                continue;
+            KKSCode code;
+            if (!ParseKKS(e.kksPart, code))
+                ++unparsed; // в дерево попадает всё равно — префиксный поиск работает и по ним
+            trie.Insert(code, (uint32_t)tagged.size());
+            tagged.push_back(&e);
+        }
+
+        const size_t matched = trie.CountPrefix(prefix);
+        acutPrintf(L"\nKKS codes: %d total, %d not in KKS format, %d under prefix '%s'",
+            (int)trie.GetCodeCount(), unparsed, (int)matched, prefix.empty() ? L"*" : prefix.c_str());
+        LogMessage(L"kksReport: codes=%d unparsed=%d matched=%d nodes=%d prefix='%s'", (int)trie.GetCodeCount(),
+            unparsed, (int)matched, (int)trie.GetNodeCount(), prefix.c_str());
+        if (matched == 0)
+            return;
+
+        std::vector<std::pair<std::wstring, size_t>> systems, aggregates;
+        trie.LevelCounts(1, prefix, systems);
+        trie.LevelCounts(2, prefix, aggregates);
+        std::vector<std::pair<std::wstring, std::vector<uint32_t>>> duplicates;
+        trie.Duplicates(prefix, duplicates);
+
+        // В консоль — только начало списков, полностью — в файл
+        const size_t kMaxConsoleRows = 30;
+        acutPrintf(L"\nSystems: %d", (int)systems.size());
+        for (size_t i = 0; i < systems.size() && i < kMaxConsoleRows; ++i)
+            acutPrintf(L"\n  %s: %d", systems[i].first.c_str(), (int)systems[i].second);
+        acutPrintf(L"\nAggregates: %d", (int)aggregates.size());
+        acutPrintf(L"\nDuplicate codes: %d", (int)duplicates.size());
+        for (size_t i = 0; i < duplicates.size() && i < kMaxConsoleRows; ++i)
+            acutPrintf(L"\n  %s x%d", duplicates[i].first.c_str(), (int)duplicates[i].second.size());
+
+        const std::wstring csvPath = GetTempFilePath(L"KKSReport.csv");
+        CReportWriter out(1 << 16);
+        if (!out.Open(csvPath))
+        {
+            acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+            LogMessage(L"kksReport: write fail %s", csvPath.c_str());
+            return;
+        }
+        out.Bom();
+        out.Raw("Section;KKS;Count;Handles\n");
+        auto writeCounts = [&out](const char* section, const std::vector<std::pair<std::wstring, size_t>>& rows)
+        {
+            for (const auto& r : rows)
+            {
+                out.Raw(section);
+                out.Char(';');
+                out.CsvField(r.first);
+                out.Char(';');
+                out.Int((long long)r.second);
+                out.Raw(";\n");
+            }
+        };
+        writeCounts("System", systems);
+        writeCounts("Aggregate", aggregates);
+        for (const auto& d : duplicates)
+        {
+            out.Raw("Duplicate;");
+            out.CsvField(d.first);
+            out.Char(';');
+            out.Int((long long)d.second.size());
+            out.Char(';');
+            for (size_t i = 0; i < d.second.size(); ++i)
+            {
+                if (i)
+                    out.Char(' ');
+                out.Hex(HandleToUInt64(tagged[d.second[i]]->id.handle()));
+            }
+            out.Char('\n');
+        }
+        if (!out.Close())
+        {
+            acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+            LogMessage(L"kksReport: write fail %s", csvPath.c_str());
+            return;
+        }
+        acutPrintf(L"\nOK: KKS report written to %s", csvPath.c_str());
+        LogMessage(L"END kksReport: systems=%d aggregates=%d duplicates=%d", (int)systems.size(),
+            (int)aggregates.size(), (int)duplicates.size());
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"kksReport std::exception: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"kksReport unknown error");
+        acutPrintf(L"\nERROR: Unknown error in kksReport.");
+    }
+}
+
 /**
  * Автоматическая функция для создания тестовой круглой трубы по 3 точкам с опорой и арматурой
  */
@@ -491,50 +1106,18 @@ void createTestPipe()
             {
                 try
                 {
-                    AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
-                    if (pDb)
+                    // Ищем последний созданный сегмент (он скорее всего наш);
+                    // прочие сущности отсеиваются по классу без открытия
+                    CPipeAxisReport axes;
+                    CModelScanner scanner;
+                    scanner.AddVisitor(&axes);
+                    scanner.Run(acdbHostApplicationServices()->workingDatabase());
+                    AcDbObjectId lastSegAxisId = axes.GetLastAxisId();
+
+                    if (!lastSegAxisId.isNull())
                     {
-                        AcDbBlockTable* pBlockTable = nullptr;
-                        if (pDb->getBlockTable(pBlockTable, AcDb::kForRead) == Acad::eOk)
-                        {
-                            AcDbBlockTableRecord* pModelSpace = nullptr;
-                            if (pBlockTable->getAt(ACDB_MODEL_SPACE, pModelSpace, AcDb::kForRead) == Acad::eOk)
-                            {
-                                AcDbBlockTableRecordIterator* pIter = nullptr;
-                                if (pModelSpace->newIterator(pIter) == Acad::eOk)
-                                {
-                                    // Ищем последний созданный сегмент (он скорее всего наш)
-                                    AcDbObjectId lastSegAxisId = AcDbObjectId::kNull;
-                                    for (pIter->start(); !pIter->done(); pIter->step())
-                                    {
-                                        AcDbEntity* pEnt = nullptr;
-                                        if (pIter->getEntity(pEnt, AcDb::kForRead) == Acad::eOk)
-                                        {
-                                            // Пробуем привести к vCSSegment2
-                                            vCSSegment2* pSeg = vCSSegment2::cast(pEnt);
-                                            if (pSeg)
-                                            {
-                                                AcDbObjectId segAxisId = pSeg->GetOIdAxis();
-                                                if (!segAxisId.isNull())
-                                                {
-                                                    lastSegAxisId = segAxisId;
-                                                }
-                                            }
-                                            pEnt->close();
-                                        }
-                                    }
-                                    delete pIter;
-                                    
-                                    if (!lastSegAxisId.isNull())
-                                    {
-                                        pipeAxisId = lastSegAxisId;
-                                        LogMessage(L"Found axis ID from last segment in database: %ld", pipeAxisId.asOldId());
-                                    }
-                                }
-                                pModelSpace->close();
-                            }
-                            pBlockTable->close();
-                        }
+                        pipeAxisId = lastSegAxisId;
+                        LogMessage(L"Found axis ID from last segment in database: %ld", pipeAxisId.asOldId());
                     }
                 }
                 catch (...)
@@ -739,28 +1322,25 @@ void createTestPipe()
     }
 }
 
-/**
- * Функция импорта трубы из NTL файла
- */
-void importFromNTL()
+namespace
+{
+// Выбор NTL-файла в диалоге; false — отмена или ошибка (сообщение уже выведено)
+bool SelectNTLFile(const wchar_t* caller, CString& filePath)
 {
-    LogMessage(L"BEGIN importFromNTL");
     try
     {
-        acutPrintf(L"\n=== Import pipe from NTL file ===\n");
-
         // Запрашиваем путь к NTL файлу
         struct resbuf resultBuf;
         memset(&resultBuf, 0, sizeof(resultBuf));
 
-        LogMessage(L"importFromNTL: before file dialog");
+        LogMessage(L"%s: before file dialog", caller);
         int result = acedGetFileD(
             _T("Select NTL file to import"), // title
             nullptr,                         // default name
-            _T("ntl"),                       // extension
+            _T("ntl;gz;zst"),                // extensions (.ntl.gz / .ntl.zst распаковываются при чтении)
             0,                               // flags
             &resultBuf);
-        LogMessage(L"importFromNTL: after file dialog, result=%d, restype=%d", result, resultBuf.restype);
+        LogMessage(L"%s: after file dialog, result=%d, restype=%d", caller, result, resultBuf.restype);
 
         bool hasString = (resultBuf.restype == RTSTR && resultBuf.resval.rstring != nullptr);
 
@@ -770,7 +1350,7 @@ void importFromNTL()
             LogMessage(L"Import cancelled or no file selected (result=%d, restype=%d)", result, resultBuf.restype);
             if (hasString)
                 acutRelRb(&resultBuf);
-            return;
+            return false;
         }
 
         // Копируем путь из resbuf в локальный буфер с проверками
@@ -779,7 +1359,7 @@ void importFromNTL()
             acutPrintf(L"\nERROR: Invalid file path from dialog.");
             LogMessage(L"ERROR: resultBuf.resval.rstring is null");
             acutRelRb(&resultBuf);
-            return;
+            return false;
         }
 
         wchar_t pathBufLocal[MAX_PATH * 4] = { 0 };
@@ -789,26 +1369,46 @@ void importFromNTL()
             acutPrintf(L"\nERROR: Empty file path from dialog.");
             LogMessage(L"ERROR: Empty file path after copy");
             acutRelRb(&resultBuf);
-            return;
+            return false;
         }
 
-        CString filePath(pathBufLocal);
-        LogMessage(L"importFromNTL: selected path='%s'", filePath.GetString());
+        filePath = pathBufLocal;
+        LogMessage(L"%s: selected path='%s'", caller, filePath.GetString());
         // Не вызываем acutRelRb здесь, чтобы исключить потенциальный краш в диалоге
 
         // Проверяем существование файла
         int accessRes = _waccess(filePath, 0);
-        LogMessage(L"importFromNTL: _waccess result=%d", accessRes);
+        LogMessage(L"%s: _waccess result=%d", caller, accessRes);
         if (accessRes != 0)
         {
             acutPrintf(L"\nERROR: File does not exist: %s", filePath.GetString());
             LogMessage(L"ERROR: File does not exist: %s", filePath.GetString());
-            return;
+            return false;
         }
 
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in %s: %hs", caller, ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in %s", caller);
+        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+    }
+    return false;
+}
+
+// Чтение NTL-файла парсером
+bool ReadNTLFile(const wchar_t* caller, const CString& filePath, CNTLParser& parser)
+{
+    try
+    {
         // Создаем парсер и читаем файл
-        CNTLParser parser;
-        LogMessage(L"importFromNTL: before parser.ReadFile");
+        LogMessage(L"%s: before parser.ReadFile", caller);
+        CMemScope memScope(MemPhase::Parse);
         bool parseOk = false;
         try
         {
@@ -816,552 +1416,2319 @@ void importFromNTL()
         }
         catch (const std::exception& ex)
         {
-            LogMessage(L"importFromNTL: exception in parser.ReadFile: %hs", ex.what());
+            LogMessage(L"%s: exception in parser.ReadFile: %hs", caller, ex.what());
             parseOk = false;
         }
         catch (...)
         {
-            LogMessage(L"importFromNTL: unknown exception in parser.ReadFile");
+            LogMessage(L"%s: unknown exception in parser.ReadFile", caller);
             parseOk = false;
         }
         if (!parseOk)
         {
             acutPrintf(L"\nERROR: Failed to read NTL file: %s", filePath.GetString());
             LogMessage(L"ERROR: Failed to read NTL file: %s", filePath.GetString());
-            return;
+            if (!parser.GetInputError().empty())
+            {
+                acutPrintf(L"\nERROR: %s input: %hs", InputCodecName(parser.GetInputCodec()), parser.GetInputError().c_str());
+                LogMessage(L"%s: %s input error: %hs", caller, InputCodecName(parser.GetInputCodec()),
+                    parser.GetInputError().c_str());
+            }
+            return false;
         }
-        LogMessage(L"importFromNTL: parser.ReadFile OK");
-
+        LogMessage(L"%s: parser.ReadFile OK, arena=%zu bytes, pooled chunks=%zu", caller,
+            parser.GetArenaBytes(), CParseArena::GetPooledChunks());
+        if (parser.GetInputCodec() != InputCodec::Plain)
+        {
+            acutPrintf(L"\nInput: %s, %.1f MB unpacked to %.1f MB", InputCodecName(parser.GetInputCodec()),
+                parser.GetInputBytes() / 1048576.0, parser.GetOutputBytes() / 1048576.0);
+            LogMessage(L"%s: %s input, %llu bytes unpacked to %llu", caller, InputCodecName(parser.GetInputCodec()),
+                parser.GetInputBytes(), parser.GetOutputBytes());
+        }
+        const CCompactGeometry& geometry = parser.GetSegments().GetGeometry();
+        LogMessage(L"%s: %zu segments in %zu runs, encoded %zu bytes, max error=%g (bound %g)", caller,
+            geometry.GetSegmentCount(), geometry.GetRunCount(), parser.GetSegments().GetEncodedBytes(),
+            geometry.GetMaxError(), geometry.GetErrorBound());
+        if (parser.GetMalformedRecordCount() > 0)
+        {
+            acutPrintf(L"\nWARNING: %d malformed NTL records skipped (see log)", (int)parser.GetMalformedRecordCount());
+            LogMessage(L"WARNING: %s: %d malformed NTL records skipped (non-numeric SPRG coordinates)", caller,
+                (int)parser.GetMalformedRecordCount());
+        }
+
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in %s: %hs", caller, ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in %s", caller);
+        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+    }
+    return false;
+}
+
+// Склейка концов и коллинеарных сегментов, группировка в цепочки
+bool PrepareNTLChains(const CNTLParser& parser, NTLPrepared& prepared)
+{
+    try
+    {
         // Получаем сегменты из парсера
-        const std::vector<NTLSegment>& segmentsParsed = parser.GetSegments();
+        const CCompactNTLSegments& segmentsParsed = parser.GetSegments();
         if (segmentsParsed.empty())
         {
+            prepared.segments.clear();
+            prepared.chains.clear();
             acutPrintf(L"\nWARNING: No segments found in NTL file.");
             LogMessage(L"WARNING: No segments found");
+            return false;
+        }
+
+        const NTLImportOptions& opt = GetNTLImportOptions();
+        NTLPrepareStats stats;
+        BuildNTLChains(segmentsParsed, opt.weldTolerance, opt.simplifyAngleDeg, prepared, stats);
+        const CPreparedNTLSegments& segments = prepared.segments;
+        const CountedVector<NTLChain>& chains = prepared.chains;
+
+        LogMessage(L"Welded %d endpoints into %d vertices, tolerance=%g",
+            (int)stats.endpoints, (int)stats.vertices, opt.weldTolerance);
+        if (stats.zeroLength > 0)
+            LogMessage(L"Skipped %d zero-length segments", (int)stats.zeroLength);
+        LogMessage(L"Merged %d collinear segments, simplify angle=%g",
+            (int)stats.merged, opt.simplifyAngleDeg);
+
+        acutPrintf(L"\nFound %d segments in NTL file (merged %d -> %d)", (int)segmentsParsed.size(), (int)segmentsParsed.size(), (int)segments.size());
+        LogMessage(L"Found %d segments raw, after merge %d (%d vertices, %zu bytes)", (int)segmentsParsed.size(),
+            (int)segments.size(), (int)segments.GetVertexCount(), segments.GetEncodedBytes());
+
+        acutPrintf(L"\nGrouped into %d continuous pipes", (int)chains.size());
+        LogMessage(L"Grouped into %d chains", (int)chains.size());
+        return true;
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in PrepareNTLChains: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in PrepareNTLChains");
+        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+    }
+    return false;
+}
+
+// Вызовы DragManager импорта. При записи трассы (DMTRACE Start) каждый вызов
+// попадает в CDMTraceRecorder с аргументами, результатом и длительностью;
+// без записи обёртки сводятся к прямому вызову.
+class CTracedDM
+{
+public:
+    explicit CTracedDM(vCSDragManager* pDM) : m_pDM(pDM) {}
+
+    // Труба по точкам; ось — через getCalculatedAxis, иначе последняя из GetOIdNewAxises
+    AcDbObjectId CreatePipe(const AcGePoint3dArray& path, double od, double dn, Acad::ErrorStatus& es)
+    {
+        AcDbObjectId axisId = AcDbObjectId::kNull;
+        auto t = std::chrono::steady_clock::now();
+        vCSProfilePtr pProfile = new vCSProfileCircle(true, od, dn);
+        AcDbObjectId idStart = AcDbObjectId::kNull;
+        AcDbObjectId idEnd = AcDbObjectId::kNull;
+        CreatePipeOnPointsWithProfiles cpop(path, pProfile, pProfile, pProfile);
+        es = cpop.CalculateAndConnect(idStart, idEnd);
+        if (es == Acad::eOk)
+        {
+            if (auto* dmAxis = cpop.getCalculatedAxis())
+                axisId = dmAxis->OID();
+            if (axisId.isNull())
+            {
+                AcDbObjectIdArray arr;
+                m_pDM->GetOIdNewAxises(arr);
+                if (arr.length() > 0)
+                    axisId = arr[arr.length() - 1];
+            }
+        }
+
+        CDMTraceRecorder& rec = CDMTraceRecorder::Instance();
+        if (rec.Active())
+        {
+            std::vector<double> args;
+            args.reserve(2 + path.length() * 3);
+            args.push_back(od);
+            args.push_back(dn);
+            for (int i = 0; i < path.length(); ++i)
+                args.insert(args.end(), { path[i].x, path[i].y, path[i].z });
+            rec.Record(DMOp::CreatePipe, axisId.isNull() ? -1 : AxisKey(axisId), std::chrono::steady_clock::now() - t,
+                args.data(), args.size());
+        }
+        return axisId;
+    }
+
+    bool SetView()
+    {
+        return Call(DMOp::SetView, [&] { return m_pDM->setAcGsViewForViewPort(true) ? 1 : 0; }) != 0;
+    }
+
+    void Start(const AcDbObjectId& axisId)
+    {
+        Call(DMOp::Start, [&] { m_pDM->Start(axisId); return 0; }, AxisArg(axisId));
+    }
+
+    vCS_DM_Axis* GetAxis(const AcDbObjectId& axisId)
+    {
+        vCS_DM_Axis* pAxis = nullptr;
+        Call(DMOp::GetAxis, [&]
+        {
+            pAxis = m_pDM->GetAxis(axisId);
+            return pAxis ? pAxis->GetSegCount() : -1;
+        }, AxisArg(axisId));
+        return pAxis;
+    }
+
+    vCS_DM_Seg* GetSeg(vCS_DM_Axis* pAxis, int index)
+    {
+        vCS_DM_Seg* pSeg = nullptr;
+        double arg = index;
+        Call(DMOp::GetSeg, [&] { pSeg = pAxis->GetSeg(index); return pSeg ? 1 : 0; }, &arg, 1);
+        return pSeg;
+    }
+
+    vCS_DM_Support* AddSupport(vCS_DM_Seg* pSeg, double local)
+    {
+        vCS_DM_Support* pSupport = nullptr;
+        Call(DMOp::AddSupport, [&] { pSupport = pSeg->AddSupport(local, st_Support); return pSupport ? 1 : 0; },
+            &local, 1);
+        return pSupport;
+    }
+
+    // traceType: 0 — арматура, 1 — переход, 2 — тройник (как в DMOp::AddInLine)
+    vCS_DM_InLine* AddInLine(vCS_DM_Seg* pSeg, double local, unsigned int type, int traceType)
+    {
+        vCS_DM_InLine* pIL = nullptr;
+        double args[2] = { local, (double)traceType };
+        Call(DMOp::AddInLine, [&] { pIL = pSeg->AddInLine(local, type); return pIL ? 1 : 0; }, args, 2);
+        return pIL;
+    }
+
+    void EditableAxisAdd(vCS_DM_Axis* pAxis)
+    {
+        Call(DMOp::EditableAxisAdd, [&] { m_pDM->ArrPtrEditableAxis_Add(pAxis); return 0; });
+    }
+
+    Acad::ErrorStatus Recalculate()
+    {
+        return (Acad::ErrorStatus)Call(DMOp::Recalculate, [&]
+        {
+            m_pDM->SetDragType(vCS::eReCalculate);
+            return (int)m_pDM->ReCalculateModelMain();
+        });
+    }
+
+    // Ось, которой принадлежит сущность (сегмент, опора, инлайн) по данным DragManager.
+    // Только запрос, в трассу не пишется.
+    AcDbObjectId GetAxisOf(const AcDbObjectId& entityId)
+    {
+        return m_pDM->GetIdAxisByEntityId(entityId);
+    }
+
+    // Удаление оси: элементы itemIds, сегменты и сама ось помечаются в DragManager,
+    // CheckForErase/UpdateDBEnt убирают их из базы вместе со связями DM.
+    // Возвращает число удалённых элементов, -1 — ось недоступна.
+    int EraseAxis(const AcDbObjectId& axisId, const AcDbObjectIdArray& itemIds)
+    {
+        return Call(DMOp::EraseAxis, [&]
+        {
+            m_pDM->Start(axisId);
+            vCS_DM_Axis* pAxis = m_pDM->GetAxis(axisId);
+            if (!pAxis)
+            {
+                m_pDM->End();
+                return -1;
+            }
+            int erased = 0;
+            for (int i = 0; i < itemIds.length(); ++i)
+            {
+                if (vCS_DM_Support* pSupport = m_pDM->GetSupport(itemIds[i]))
+                {
+                    pSupport->SetErased(true);
+                    ++erased;
+                }
+                else if (vCS_DM_InLine* pIL = m_pDM->GetInLine(itemIds[i]))
+                {
+                    pIL->SetErased(true);
+                    ++erased;
+                }
+            }
+            for (int i = 0; i < pAxis->GetSegCount(); ++i)
+            {
+                if (vCS_DM_Seg* pSeg = pAxis->GetSeg(i))
+                    pSeg->SetErased(true);
+            }
+            pAxis->SetErased(true);
+            m_pDM->End();
+            m_pDM->CheckForErase();
+            m_pDM->UpdateDBEnt();
+            m_pDM->Clear();
+            return erased;
+        }, AxisArg(axisId));
+    }
+
+    void End() { Call(DMOp::End, [&] { m_pDM->End(); return 0; }); }
+    void Clear() { Call(DMOp::Clear, [&] { m_pDM->Clear(); return 0; }); }
+    void CheckForErase() { Call(DMOp::CheckForErase, [&] { m_pDM->CheckForErase(); return 0; }); }
+    void UpdateDBEnt() { Call(DMOp::UpdateDBEnt, [&] { m_pDM->UpdateDBEnt(); return 0; }); }
+
+private:
+    static int AxisKey(const AcDbObjectId& id)
+    {
+        return CDMTraceRecorder::Instance().AxisKey((int64_t)id.asOldId());
+    }
+
+    // Номер оси считается только при записи
+    static double AxisArg(const AcDbObjectId& id)
+    {
+        return CDMTraceRecorder::Instance().Active() ? (double)AxisKey(id) : -1.0;
+    }
+
+    template <typename F>
+    int Call(DMOp op, F f, const double* args = nullptr, size_t argCount = 0)
+    {
+        CDMTraceRecorder& rec = CDMTraceRecorder::Instance();
+        if (!rec.Active())
+            return f();
+        auto t = std::chrono::steady_clock::now();
+        int result = f();
+        rec.Record(op, result, std::chrono::steady_clock::now() - t, args, argCount);
+        return result;
+    }
+
+    template <typename F>
+    int Call(DMOp op, F f, double arg)
+    {
+        return Call(op, f, &arg, 1);
+    }
+
+    vCSDragManager* m_pDM;
+};
+
+// Удалить объекты (временные объекты предпросмотра и сверки, устаревшие оси)
+void EraseEntities(const AcDbObjectIdArray& ids)
+{
+    for (int i = 0; i < ids.length(); ++i)
+    {
+        AcDbEntity* pEnt = nullptr;
+        if (acdbOpenObject(pEnt, ids[i], AcDb::kForWrite) == Acad::eOk && pEnt)
+        {
+            pEnt->erase();
+            pEnt->close();
+        }
+    }
+}
+
+// Сторона NTL для сверки: цепочки (ломаная как у CreateNTLAxes, имя — ветка, OD/WT),
+// опоры и инлайны разбора. Цепочка c модели — prepared.chains[c].
+void BuildNTLReconcileModel(const CNTLParser& parser, const NTLPrepared& prepared, ReconcileModel& model)
+{
+    model.Clear();
+    const CNTLBranchIndex& branches = parser.GetBranches();
+    model.chains.reserve(prepared.chains.size());
+    model.segments.reserve(prepared.segments.size());
+    for (const NTLChain& ch : prepared.chains)
+    {
+        const NTLSegment front = ch.segs.empty() ? NTLSegment() : ch.segs.front();
+        const NTLSegment* first = ch.segs.empty() ? nullptr : &front;
+        model.BeginChain(ch.branch != kNoBranch ? branches.GetName(ch.branch).GetString() : L"", 0,
+            first ? first->diameter : 0.0, first ? first->wallThickness : 0.0);
+        for (const NTLSegment& s : ch.segs)
+        {
+            const double a[3] = { s.startPoint.x, s.startPoint.y, s.startPoint.z };
+            const double b[3] = { s.endPoint.x, s.endPoint.y, s.endPoint.z };
+            model.AddSegment(a, b);
+        }
+    }
+
+    model.items.reserve(parser.GetSupports().size() + parser.GetInlines().size());
+    for (const NTLSupport& sup : parser.GetSupports())
+    {
+        const double pos[3] = { sup.position.x, sup.position.y, sup.position.z };
+        model.AddItem(ReconcileItemKind::Support, sup.name.GetString(), 0, pos);
+    }
+    for (const NTLInline& il : parser.GetInlines())
+    {
+        ReconcileItemKind kind = ReconcileItemKind::Inline;
+        if (il.type == NTLInline::Type::Reducer)
+            kind = ReconcileItemKind::Reducer;
+        else if (il.type == NTLInline::Type::Tee)
+            kind = ReconcileItemKind::Tee;
+        const double pos[3] = { il.position.x, il.position.y, il.position.z };
+        model.AddItem(kind, il.name.GetString(), 0, pos);
+    }
+}
+
+// Стадия 1: оси труб по цепочкам. axisIds[c] — ось цепочки c или kNull. Возвращает число созданных.
+// selected[c] = 0 — цепочка не создаётся (повторный импорт, ось уже есть).
+// Esc прерывает между цепочками (cancelled): созданные оси остаются целыми.
+int CreateNTLAxes(CTracedDM& dm, const NTLPrepared& prepared, const std::vector<uint8_t>& selected,
+    std::vector<AcDbObjectId>& axisIds, CImportProgress& progress, bool& cancelled)
+{
+    CMemScope memScope(MemPhase::PipeCreation);
+    const CountedVector<NTLChain>& chains = prepared.chains;
+    axisIds.assign(chains.size(), AcDbObjectId::kNull);
+    int successCount = 0;
+    cancelled = false;
+
+    // Создаем трубы по цепочкам
+    progress.BeginPhase(L"pipes", (int)std::count(selected.begin(), selected.end(), (uint8_t)1));
+    for (size_t c = 0; c < chains.size(); ++c)
+    {
+        if (!selected[c])
+            continue;
+        if (progress.IsCancelled())
+        {
+            cancelled = true;
+            LogMessage(L"CreateNTLAxes: cancelled at chain %d of %d", (int)c, (int)chains.size());
+            break;
+        }
+        progress.Step();
+        const NTLChain& ch = chains[c];
+        if (ch.segs.empty())
+            continue;
+        const NTLSegment& first = ch.segs.front();
+        double od = first.diameter;
+        double wt = first.wallThickness;
+        if (od <= 0.0)
+        {
+            LogMessage(L"WARNING: Chain %d invalid od, skip", (int)c);
+            continue;
+        }
+        double dn = od - 2.0 * wt;
+        if (dn <= 0.0)
+            dn = od * 0.9;
+
+        AcGePoint3dArray path;
+        path.append(first.startPoint);
+        int lastVertex = first.startVertex;
+        for (const NTLSegment& s : ch.segs)
+        {
+            if (s.endVertex != lastVertex)
+                path.append(s.endPoint);
+            lastVertex = s.endVertex;
+        }
+        if (path.length() < 2)
+            continue;
+
+        Acad::ErrorStatus es = Acad::eOk;
+        AcDbObjectId axisId = dm.CreatePipe(path, od, dn, es);
+        if (es != Acad::eOk)
+        {
+            LogMessage(L"ERROR: chain %d create pipe es=%d", (int)c, es);
+            continue;
+        }
+        if (axisId.isNull())
+        {
+            LogMessage(L"WARNING: chain %d axis null", (int)c);
+            continue;
+        }
+        axisIds[c] = axisId;
+        successCount++;
+        LogMessage(L"Chain %d: pipe created, axis=%ld, od=%.3f, wt=%.3f, pts=%d",
+            (int)c, axisId.asOldId(), od, wt, (int)path.length());
+        acutPrintf(L"\nOK: Pipe created (chain %d) od=%.3f wt=%.3f pts=%d",
+            (int)c, od, wt, (int)path.length());
+    }
+
+    progress.EndPhase();
+
+    // Пересчитываем модель после создания труб
+    dm.End();
+    dm.CheckForErase();
+    dm.UpdateDBEnt();
+    return successCount;
+}
+
+// План опор и инлайнов цепочки по данным NTL: сегмент оси и смещение на нём.
+// Обращений к DragManager нет — план строится сразу после осей и хранится до расстановки.
+void PlanChainPlacements(const NTLChain& ch, size_t ci, const CNTLParser& parser,
+    CountedVector<NTLPlacement>& items)
+{
+    items.clear();
+    if (ch.segs.empty())
+        return;
+
+    struct SegAccum { double len; };
+    std::vector<SegAccum> acc;
+    double total = 0.0;
+    for (const NTLSegment& s : ch.segs)
+    {
+        total += s.length;
+        acc.push_back({ total });
+    }
+    if (total < 1e-6)
+        return;
+
+    // Лог по цепочке
+    const NTLSegment front = ch.segs.front();
+    const NTLSegment back = ch.segs.back();
+    const NTLSegment* firstSeg = &front;
+    const NTLSegment* lastSeg = &back;
+    LogMessage(L"Chain %d summary: segId=%s pipe=%s od=%.3f wt=%.3f pts=%d start(%.3f,%.3f,%.3f) end(%.3f,%.3f,%.3f)",
+        (int)ci,
+        firstSeg->segmentId.GetString(),
+        firstSeg->pipeName.GetString(),
+        firstSeg->diameter,
+        firstSeg->wallThickness,
+        (int)ch.segs.size() + 1,
+        firstSeg->startPoint.x, firstSeg->startPoint.y, firstSeg->startPoint.z,
+        lastSeg->endPoint.x, lastSeg->endPoint.y, lastSeg->endPoint.z);
+
+    auto findSegAndOffset = [&](double dist, size_t& segIdx, double& localOffset)
+    {
+        segIdx = 0;
+        double prev = 0.0;
+        for (; segIdx < acc.size(); ++segIdx)
+        {
+            if (dist <= acc[segIdx].len + 1e-9)
+                break;
+            prev = acc[segIdx].len;
+        }
+        if (segIdx >= acc.size())
+        {
+            segIdx = acc.size() - 1;
+            prev = (segIdx > 0) ? acc[segIdx - 1].len : 0.0;
+        }
+        localOffset = dist - prev;
+    };
+
+    // Полилиния оси для проекции
+    std::vector<AcGePoint3d> pts;
+    pts.reserve(ch.segs.size() + 1);
+    pts.push_back(ch.segs.front().startPoint);
+    for (const NTLSegment& s : ch.segs)
+        pts.push_back(s.endPoint);
+    auto projectOnChain = [&](const AcGePoint3d& p, double& outDist)
+    {
+        outDist = 0.0;
+        double best = 1e300;
+        double accLen = 0.0;
+        for (size_t i = 0; i + 1 < pts.size(); ++i)
+        {
+            AcGePoint3d a = pts[i];
+            AcGePoint3d b = pts[i + 1];
+            AcGeVector3d ab = b - a;
+            double len = ab.length();
+            if (len < 1e-9)
+                continue;
+            AcGeVector3d ap = p - a;
+            double t = ap.dotProduct(ab) / (len * len);
+            if (t < 0.0) t = 0.0;
+            if (t > 1.0) t = 1.0;
+            AcGePoint3d proj = a + ab * t;
+            double d2 = (proj - p).lengthSqrd();
+            if (d2 < best)
+            {
+                best = d2;
+                outDist = accLen + t * len;
+            }
+            accLen += len;
+        }
+    };
+
+    // Дубли — по сегменту и смещению на нём, отдельно для опор и для инлайнов
+    auto isDuplicate = [&items](bool support, size_t segIdx, double local)
+    {
+        for (const NTLPlacement& p : items)
+        {
+            if (p.support == support && p.segIndex == (int)segIdx && fabs(p.offset - local) < 1e-3)
+                return true;
+        }
+        return false;
+    };
+
+    // Опоры — по диапазонам веток индекса: веток цепочки и веток без сегментов
+    // (такую опору не к чему привязать, кроме как проекцией на каждую цепочку)
+    const CNTLBranchIndex& branches = parser.GetBranches();
+    for (uint32_t b = 0; b < (uint32_t)branches.GetBranchCount(); ++b)
+    {
+        const bool own = b >= ch.branch && b <= ch.lastBranch;
+        if (!own && branches.GetEnd(CNTLBranchIndex::Segments, b) > branches.GetBegin(CNTLBranchIndex::Segments, b))
+            continue;
+        for (const auto& sup : parser.GetBranchSupports(b))
+        {
+            double dist = sup.distance;
+            // Если расстояние некорректно — проецируем позицию
+            if (dist <= 0.0 || dist > total)
+            {
+                projectOnChain(sup.position, dist);
+                LogMessage(L"Support %s on chain %d: use projected dist=%.3f (pos)", sup.name.GetString(), (int)ci, dist);
+            }
+            if (dist <= 0.0 || dist > total)
+            {
+                LogMessage(L"Skip support %s on chain %d: invalid dist=%.3f (total=%.3f)", sup.name.GetString(), (int)ci, dist, total);
+                continue;
+            }
+            size_t segIdx = 0;
+            double local = 0.0;
+            findSegAndOffset(dist, segIdx, local);
+            if (isDuplicate(true, segIdx, local))
+            {
+                LogMessage(L"Skip support %s on chain %d: duplicate offset=%.3f", sup.name.GetString(), (int)ci, local);
+                continue;
+            }
+            NTLPlacement p;
+            p.support = true;
+            p.name = sup.name.GetString();
+            p.segIndex = (int)segIdx;
+            p.offset = local;
+            items.push_back(p);
+        }
+    }
+
+    // Инлайны — так же, как опоры: ветки цепочки и ветки без сегментов. Инлайн
+    // ветки с сегментами ставится только на цепочки своей ветки
+    for (uint32_t b = 0; b < (uint32_t)branches.GetBranchCount(); ++b)
+    {
+        const bool own = b >= ch.branch && b <= ch.lastBranch;
+        if (!own && branches.GetEnd(CNTLBranchIndex::Segments, b) > branches.GetBegin(CNTLBranchIndex::Segments, b))
+            continue;
+        for (const auto& il : parser.GetBranchInlines(b))
+        {
+            if (!own && !il.segmentId.IsEmpty())
+                LogMessage(L"Inline %s on chain %d: branch %s has no segments, placing by projection", il.name.GetString(), (int)ci, il.segmentId.GetString());
+
+            double dist = il.distance;
+            // Если расстояние некорректно — проецируем позицию
+            if (dist <= 0.0 || dist > total)
+            {
+                projectOnChain(il.position, dist);
+                LogMessage(L"Inline %s on chain %d: use projected dist=%.3f (pos) type=%d", il.name.GetString(), (int)ci, dist, (int)il.type);
+            }
+            if (dist <= 0.0 || dist > total)
+            {
+                LogMessage(L"Skip inline %s on chain %d: invalid dist=%.3f (total=%.3f)", il.name.GetString(), (int)ci, dist, total);
+                continue;
+            }
+            size_t segIdx = 0;
+            double local = 0.0;
+            findSegAndOffset(dist, segIdx, local);
+            if (isDuplicate(false, segIdx, local))
+            {
+                LogMessage(L"Skip inline %s on chain %d: duplicate offset=%.3f", il.name.GetString(), (int)ci, local);
+                continue;
+            }
+            NTLPlacement p;
+            p.support = false;
+            p.inlineType = il.type;
+            p.name = il.name.GetString();
+            p.segIndex = (int)segIdx;
+            p.offset = local;
+            items.push_back(p);
+        }
+    }
+}
+
+// Элемент порции, созданный в DragManager; id объекта появляется после UpdateDBEnt
+struct NTLCreatedItem
+{
+    vCS_DM_Support* pSupport = nullptr;
+    vCS_DM_InLine* pInline = nullptr;
+    size_t item = 0;            // индекс в плане цепочки
+};
+
+// Опора или инлайн на сегменте оси (смещение item.offset уже проверено); base — точка вставки
+bool AddPlacementToSegment(CTracedDM& dm, vCS_DM_Axis* pAxis, vCS_DM_Seg* pSeg, const NTLPlacement& item,
+    AcGePoint3d& base, NTLCreatedItem& created)
+{
+    double local = item.offset;
+    AcGeVector3d dir = (pSeg->GetEndPoint() - pSeg->GetStartPoint()).normal();
+    base = pSeg->GetStartPoint() + dir * local;
+
+    if (item.support)
+    {
+        vCS_DM_Support* pSupport = dm.AddSupport(pSeg, local);
+        if (!pSupport)
+            return false;
+        pSupport->SetDMAxis(pAxis);
+        pSupport->SetSeg(pSeg);
+        pSupport->SetBasePoint(base);
+        created.pSupport = pSupport;
+        return true;
+    }
+
+    vCS_DM_InLine* pIL = nullptr;
+    switch (item.inlineType)
+    {
+    case NTLInline::Type::Reducer:
+        pIL = dm.AddInLine(pSeg, local, (unsigned int)vCSILBase::til_reducer, 1);
+        if (pIL) pIL->SetIsReducer(true);
+        break;
+    case NTLInline::Type::Tee:
+        pIL = dm.AddInLine(pSeg, local, (unsigned int)vCSILBase::til_tee, 2);
+        if (pIL) pIL->SetIsTee(true);
+        break;
+    case NTLInline::Type::Inline:
+    default:
+        pIL = dm.AddInLine(pSeg, local, (unsigned int)vCSILBase::til_inline, 0);
+        break;
+    }
+    if (!pIL)
+        return false;
+    pIL->SetDMAxis(pAxis);
+    pIL->SetSeg(pSeg);
+    pIL->SetBasePoint(base);
+    created.pInline = pIL;
+    return true;
+}
+
+// Стадия 2: следующие maxItems элементов плана цепочки на оси, один пересчёт на порцию.
+// Порция заканчивается раньше, если истёк квант времени timeSliceMs.
+// Возвращает false, если ось недоступна (цепочка помечается failed).
+bool ApplyChainPlacements(CTracedDM& dm, NTLChainPlan& plan, size_t maxItems, DWORD timeSliceMs,
+    CImportProgress& progress, int& totalSupports, int& totalInlines)
+{
+    if (plan.IsComplete())
+        return true;
+
+    dm.End();
+    dm.Clear();
+    if (!dm.SetView())
+        return false;
+    dm.Start(plan.axisId);
+    vCS_DM_Axis* pAxis = dm.GetAxis(plan.axisId);
+    if (!pAxis || pAxis->GetSegCount() == 0)
+    {
+        dm.End();
+        plan.failed = true;
+        LogMessage(L"Chain %d: axis %ld unavailable, %d items skipped", (int)plan.chain, plan.axisId.asOldId(),
+            (int)(plan.items.size() - plan.done));
+        return false;
+    }
+
+    const size_t start = plan.done;
+    const size_t end = std::min(plan.items.size(), plan.done + maxItems);
+    CTimeSlice slice(timeSliceMs);
+    int created = 0;
+    std::vector<NTLCreatedItem> createdItems;
+    for (; plan.done < end; ++plan.done)
+    {
+        if (plan.done > start && slice.Expired())
+            break;
+        const NTLPlacement& item = plan.items[plan.done];
+        int dmSegIdx = item.segIndex;
+        if (dmSegIdx >= pAxis->GetSegCount())
+            dmSegIdx = pAxis->GetSegCount() - 1;
+        const wchar_t* what = item.support ? L"support" : L"inline";
+        vCS_DM_Seg* pSeg = dm.GetSeg(pAxis, dmSegIdx);
+        if (!pSeg)
+        {
+            LogMessage(L"Skip %s %s on chain %d: pSeg null", what, item.name.GetString(), (int)plan.chain);
+            continue;
+        }
+        double local = item.offset;
+        double dmSegLen = pSeg->GetStartPoint().distanceTo(pSeg->GetEndPoint());
+        if (dmSegLen < 1e-6 || local < 0.0 || local > dmSegLen)
+        {
+            LogMessage(L"Skip %s %s on chain %d: segLen=%.3f local=%.3f", what, item.name.GetString(), (int)plan.chain, dmSegLen, local);
+            continue;
+        }
+        AcGePoint3d base;
+        NTLCreatedItem createdItem;
+        createdItem.item = plan.done;
+        bool ok = AddPlacementToSegment(dm, pAxis, pSeg, item, base, createdItem);
+        if (ok)
+        {
+            created++;
+            createdItems.push_back(createdItem);
+        }
+        if (item.support)
+        {
+            if (ok)
+            {
+                totalSupports++;
+                LogMessage(L"Support %s created on chain %d seg=%d offset=%.3f base(%.3f,%.3f,%.3f)",
+                    item.name.GetString(), (int)plan.chain, dmSegIdx, local, base.x, base.y, base.z);
+            }
+            else
+            {
+                LogMessage(L"Support %s FAILED create on chain %d seg=%d offset=%.3f", item.name.GetString(), (int)plan.chain, dmSegIdx, local);
+            }
+        }
+        else if (ok)
+        {
+            totalInlines++;
+            LogMessage(L"Inline %s created on chain %d seg=%d offset=%.3f type=%d base(%.3f,%.3f,%.3f)",
+                item.name.GetString(), (int)plan.chain, dmSegIdx, local, (int)item.inlineType, base.x, base.y, base.z);
+        }
+        else
+        {
+            LogMessage(L"Inline %s FAILED create on chain %d seg=%d offset=%.3f type=%d", item.name.GetString(), (int)plan.chain, dmSegIdx, local, (int)item.inlineType);
+        }
+    }
+
+    progress.Step((int)(plan.done - start));
+
+    // Один пересчёт на порцию
+    if (created > 0)
+    {
+        dm.EditableAxisAdd(pAxis);
+        Acad::ErrorStatus calcStatus = dm.Recalculate();
+        if (calcStatus == Acad::eOk)
+        {
+            dm.End();
+            dm.CheckForErase();
+            dm.UpdateDBEnt();
+
+            // Метка на созданных элементах: повторный импорт удалит их вместе с осью
+            int untagged = 0;
+            for (const NTLCreatedItem& ci : createdItems)
+            {
+                AcDbObjectId id = ci.pSupport ? ci.pSupport->OID() : ci.pInline->OID();
+                if (id.isNull() || !WriteNTLItemTag(id, plan.items[ci.item].name.GetString(), plan.tagSource.GetString()))
+                    ++untagged;
+            }
+            if (untagged > 0)
+                LogMessage(L"WARNING: chain %d: %d supports/inlines not tagged", (int)plan.chain, untagged);
+        }
+        else
+        {
+            LogMessage(L"Chain %d: recalculation error %d", (int)plan.chain, calcStatus);
+            dm.End();
+        }
+    }
+    else
+    {
+        dm.End();
+    }
+    return true;
+}
+
+// Выполнить план: все цепочки порциями по chunkSize элементов.
+// false — прервано Esc между порциями; выполненное учтено в плане.
+bool ApplyPlacementPlan(CTracedDM& dm, std::vector<NTLChainPlan>& chains, size_t chunkSize,
+    DWORD timeSliceMs, CImportProgress& progress, int& totalSupports, int& totalInlines)
+{
+    int pending = 0;
+    for (const NTLChainPlan& chain : chains)
+    {
+        if (!chain.IsComplete())
+            pending += (int)(chain.items.size() - chain.done);
+    }
+    progress.BeginPhase(L"supports/inlines", pending);
+    for (size_t ci = 0; ci < chains.size(); ++ci)
+    {
+        while (!chains[ci].IsComplete())
+        {
+            if (progress.IsCancelled())
+            {
+                progress.EndPhase();
+                LogMessage(L"ApplyPlacementPlan: cancelled at chain %d", (int)chains[ci].chain);
+                return false;
+            }
+            if (!ApplyChainPlacements(dm, chains[ci], chunkSize, timeSliceMs, progress, totalSupports, totalInlines))
+                break;
+        }
+    }
+    progress.EndPhase();
+    return true;
+}
+
+// Невыполненный остаток плана — в план документа, чтобы NTLFITTINGS мог его продолжить.
+// Невыполненный план прежнего импорта не теряется: новый дописывается за ним.
+size_t KeepPendingPlan(std::vector<NTLChainPlan>& plans, const CString& sourceFile)
+{
+    CNTLStagedImport* pStaged = CNTLStagedImport::ForDatabase(acdbHostApplicationServices()->workingDatabase(), true);
+    if (!pStaged)
+        return 0;
+    const size_t previous = pStaged->GetPendingItems();
+    if (previous > 0)
+    {
+        acutPrintf(L"\nWARNING: %d supports/inlines of the previous import are still pending (%s); the new plan is appended.",
+            (int)previous, pStaged->GetSourceFile().GetString());
+        LogMessage(L"KeepPendingPlan: appending to pending plan, previous items=%d source=%s", (int)previous,
+            pStaged->GetSourceFile().GetString());
+    }
+    pStaged->Append(plans, sourceFile);
+    return pStaged->GetPendingItems();
+}
+
+// Метка «план выполнен» на осях, чьи опоры и инлайны расставлены полностью
+void TagCompleteChains(std::vector<NTLChainPlan>& plans)
+{
+    int tagged = 0;
+    for (NTLChainPlan& plan : plans)
+    {
+        if (plan.tagged || plan.failed || plan.fingerprint == 0 || !plan.IsComplete())
+            continue;
+        plan.tagged = WriteNTLChainTag(plan.axisId, plan.tagName.GetString(), plan.tagSource.GetString(),
+            plan.fingerprint, true);
+        if (plan.tagged)
+            ++tagged;
+    }
+    if (tagged > 0)
+        LogMessage(L"TagCompleteChains: %d axes tagged complete", tagged);
+}
+
+// Повторный импорт источника source: какие цепочки NTL создавать. Оси с тем же отпечатком
+// остаются, устаревшие оси этого источника удаляются через DragManager вместе с сегментами
+// и размеченными опорами и инлайнами на них.
+// selected[c] = 1 — цепочку создать. false — чертёж не прочитан (создаются все).
+bool SelectChangedChains(CTracedDM& dm, const std::wstring& source, const std::vector<uint64_t>& fingerprints,
+    std::vector<uint8_t>& selected)
+{
+    selected.assign(fingerprints.size(), 1);
+    AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+    if (!pDb)
+        return false;
+
+    DWORD t0 = GetTickCount();
+    ReconcileModel drawing;
+    CReconcileCollector collector(drawing);
+    CModelScanner scanner;
+    scanner.AddVisitor(&collector);
+    if (CPipingIndex* pIndex = CPipingIndex::ForDatabase(pDb))
+        scanner.SetParamCache(&pIndex->GetParamCache());
+    if (!scanner.Run(pDb))
+    {
+        LogMessage(L"SelectChangedChains: scan fail");
+        return false;
+    }
+
+    std::vector<uint32_t> keep;
+    std::vector<uint32_t> stale;
+    MatchChainFingerprints(drawing, source, fingerprints, keep, stale);
+    int kept = 0;
+    for (size_t c = 0; c < keep.size(); ++c)
+    {
+        if (keep[c] != kReconcileNone)
+        {
+            selected[c] = 0;
+            ++kept;
+        }
+    }
+
+    // Опоры и инлайны устаревших осей: только размеченные импортом этого источника
+    // и стоящие на сегментах этой же оси (принадлежность — по данным DragManager)
+    int staleItems = 0;
+    int erasedAxes = 0;
+    if (!stale.empty())
+    {
+        std::map<uint64_t, AcDbObjectIdArray> itemsOf;     // handle оси -> её элементы
+        for (uint32_t d : stale)
+            itemsOf[drawing.chains[d].handle];
+        for (const ReconcileItem& item : drawing.items)
+        {
+            AcDbObjectId id;
+            if (item.source.empty() || item.source != source ||
+                pDb->getAcDbObjectId(id, false, UInt64ToHandle(item.handle)) != Acad::eOk)
+                continue;
+            auto it = itemsOf.find(HandleToUInt64(dm.GetAxisOf(id).handle()));
+            if (it != itemsOf.end())
+                it->second.append(id);
+        }
+        for (uint32_t d : stale)
+        {
+            const uint64_t handle = drawing.chains[d].handle;
+            AcDbObjectId axisId;
+            if (pDb->getAcDbObjectId(axisId, false, UInt64ToHandle(handle)) != Acad::eOk)
+                continue;
+            const int erased = dm.EraseAxis(axisId, itemsOf[handle]);
+            if (erased < 0)
+            {
+                LogMessage(L"SelectChangedChains: axis %ld unavailable, not erased", axisId.asOldId());
+                continue;
+            }
+            ++erasedAxes;
+            staleItems += erased;
+        }
+    }
+
+    const int create = (int)std::count(selected.begin(), selected.end(), (uint8_t)1);
+    DWORD ms = GetTickCount() - t0;
+    acutPrintf(L"\nIncremental: %d chains unchanged, %d stale axes erased (%d supports/inlines), %d chains to create (%lu ms)",
+        kept, erasedAxes, staleItems, create, ms);
+    LogMessage(L"SelectChangedChains: source=%s drawing chains=%d kept=%d stale=%d erased=%d staleItems=%d create=%d ms=%lu",
+        source.c_str(), (int)drawing.chains.size(), kept, (int)stale.size(), erasedAxes, staleItems, create, ms);
+    return true;
+}
+
+// Создание труб по цепочкам, затем опоры и инлайны из того же разбора.
+// При поэтапном импорте опоры и инлайны откладываются в план документа (NTLFITTINGS).
+// Созданная ось получает метку с отпечатком цепочки; при повторном импорте
+// (NTLImportOptions::incremental) цепочки с неизменным отпечатком не пересоздаются.
+void ImportPreparedNTL(const CNTLParser& parser, const NTLPrepared& prepared, const CString& sourceFile)
+{
+    try
+    {
+        const CountedVector<NTLChain>& chains = prepared.chains;
+
+        // Убеждаемся, что используется круглый профиль
+        vCSDragManager* pDM = vCSDragManager::DM();
+        if (!pDM)
+        {
+            acutPrintf(L"\nERROR: DragManager is null. Cannot proceed.");
+            LogMessage(L"ERROR: vCSDragManager::DM() returned nullptr");
+            return;
+        }
+        if (pDM->getSettingsTracing() && pDM->getSettingsTracing()->IsRectProfile())
+        {
+            pDM->getSettingsTracing()->m_bRectProfile = false;
+            LogMessage(L"Settings: switched to round profile");
+        }
+
+        // План опор и инлайнов по цепочкам и отпечатки цепочек — до создания осей
+        const NTLImportOptions& opt = GetNTLImportOptions();
+        const NTLSupportList& supports = parser.GetSupports();
+        const NTLInlineList& inlines = parser.GetInlines();
+        acutPrintf(L"\nSupports parsed: %d, inlines parsed: %d", (int)supports.size(), (int)inlines.size());
+        LogMessage(L"Parsed supports=%d, inlines=%d, branches=%d", (int)supports.size(), (int)inlines.size(),
+            (int)parser.GetBranches().GetBranchCount());
+        std::vector<NTLChainPlan> chainPlans(chains.size());
+        std::vector<uint64_t> fingerprints(chains.size(), 0);
+        const std::wstring source = NTLChainTagSource(sourceFile.GetString());
+        {
+            CMemScope memScope(MemPhase::Placement);
+            ReconcileModel model;
+            BuildNTLReconcileModel(parser, prepared, model);
+            const double quantum = ReconcileOptions().quantum;
+            for (size_t ci = 0; ci < chains.size(); ++ci)
+            {
+                NTLChainPlan& plan = chainPlans[ci];
+                PlanChainPlacements(chains[ci], ci, parser, plan.items);
+                const ReconcileChain& rc = model.chains[ci];
+                ReconcileShape shape;
+                ComputeReconcileShape(model, rc, quantum, shape);
+                CChainFingerprint fingerprint(shape, rc.od, rc.wt);
+                for (const NTLPlacement& item : plan.items)
+                    fingerprint.AddItem(item.support, (int)item.inlineType, item.segIndex, item.offset);
+                plan.fingerprint = fingerprints[ci] = fingerprint.Get();
+                plan.tagName = rc.name.c_str();
+                plan.tagSource = source.c_str();
+            }
+        }
+
+        CTracedDM dm(pDM);
+        std::vector<uint8_t> selected(chains.size(), 1);
+        if (opt.incremental)
+            SelectChangedChains(dm, source, fingerprints, selected);
+        const int selectedCount = (int)std::count(selected.begin(), selected.end(), (uint8_t)1);
+
+        CImportProgress progress(L"IMPORTNTL");
+        std::vector<AcDbObjectId> axisIds;
+        bool cancelled = false;
+        int successCount = CreateNTLAxes(dm, prepared, selected, axisIds, progress, cancelled);
+
+        // Метка на созданных осях; цепочка без опор и инлайнов сразу «выполнена»
+        CMemScope memScope(MemPhase::Placement);
+        std::vector<NTLChainPlan> plans;
+        plans.reserve(successCount);
+        for (size_t ci = 0; ci < chains.size(); ++ci)
+        {
+            if (axisIds[ci].isNull())
+                continue;
+            NTLChainPlan& plan = chainPlans[ci];
+            plan.axisId = axisIds[ci];
+            plan.chain = (uint32_t)ci;
+            const bool complete = plan.items.empty();
+            if (!WriteNTLChainTag(plan.axisId, plan.tagName.GetString(), plan.tagSource.GetString(), plan.fingerprint,
+                complete))
+                LogMessage(L"WARNING: chain %d tag not written", (int)ci);
+            else
+                plan.tagged = complete;
+            plans.push_back(std::move(plan));
+        }
+        chainPlans.clear();
+
+        // Поэтапный импорт или отмена на осях: план созданных осей остаётся для NTLFITTINGS
+        if (opt.staged || cancelled)
+        {
+            size_t pending = KeepPendingPlan(plans, sourceFile);
+            dm.Clear();
+            if (cancelled)
+                acutPrintf(L"\nCANCELLED: Created %d pipes of %d chains; remaining chains not imported.",
+                    successCount, selectedCount);
+            else
+                acutPrintf(L"\nOK: Axes created: %d pipes from %d chains.", successCount, selectedCount);
+            if (pending > 0)
+                acutPrintf(L"\nRun NTLFITTINGS to add %d supports/inlines on created pipes.", (int)pending);
+            LogMessage(L"ImportPreparedNTL: %s, created %d pipes, pending items=%d",
+                cancelled ? L"cancelled" : L"staged", successCount, (int)pending);
+            return;
+        }
+
+        int totalSupports = 0;
+        int totalInlines = 0;
+        bool complete = ApplyPlacementPlan(dm, plans, (size_t)opt.fittingChunk, (DWORD)opt.timeSliceMs, progress,
+            totalSupports, totalInlines);
+        TagCompleteChains(plans);
+
+        if (totalSupports > 0)
+            acutPrintf(L"\nOK: Added %d supports", totalSupports);
+        if (totalInlines > 0)
+            acutPrintf(L"\nOK: Added %d inlines (valves/reducers/tees)", totalInlines);
+
+        dm.Clear();
+
+        if (!complete)
+        {
+            // Каждая порция пересчитана — модель согласована, остаток плана можно продолжить
+            size_t pending = KeepPendingPlan(plans, sourceFile);
+            acutPrintf(L"\nCANCELLED: Created %d pipes from %d chains; %d supports/inlines not added, run NTLFITTINGS to resume.",
+                successCount, selectedCount, (int)pending);
+            LogMessage(L"ImportPreparedNTL: cancelled on fittings, created %d pipes, pending items=%d", successCount, (int)pending);
+            return;
+        }
+
+        acutPrintf(L"\nOK: Import completed. Created %d pipes from %d chains.", successCount, selectedCount);
+        LogMessage(L"ImportPreparedNTL: created %d pipes", successCount);
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in ImportPreparedNTL: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in ImportPreparedNTL");
+        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+    }
+}
+
+// Память импорта по фазам: консоль, журнал и %TEMP%\ImportMemory.csv.
+// Live — учтённое и ещё занятое к концу команды, Process — прирост закрытой памяти процесса
+// (вместе с объектами nanoCAD).
+void ReportImportMemory(const wchar_t* caller)
+{
+    const std::wstring csvPath = GetTempFilePath(L"ImportMemory.csv");
+    CReportWriter out(1 << 12);
+    bool csv = out.Open(csvPath);
+    if (csv)
+    {
+        out.Bom();
+        out.Raw("Command;Phase;AllocBytes;AllocCount;PeakLiveBytes;LiveBytes;ProcessDeltaBytes;ProcessPeakBytes\n");
+    }
+    acutPrintf(L"\nMemory by phase (KB): alloc / count / peak live / live / process delta");
+    for (size_t i = 0; i < (size_t)MemPhase::Count; ++i)
+    {
+        const MemPhase phase = (MemPhase)i;
+        const MemPhaseStats s = CMemAccounting::Get(phase);
+        if (s.allocCount == 0 && s.processDelta == 0 && s.liveBytes == 0)
+            continue;
+        acutPrintf(L"\n  %-10s %10.0f %9d %10.0f %10.0f %10.0f", MemPhaseName(phase), s.allocBytes / 1024.0,
+            (int)s.allocCount, s.peakLiveBytes / 1024.0, s.liveBytes / 1024.0, s.processDelta / 1024.0);
+        LogMessage(L"%s memory: phase=%s alloc=%llu count=%llu peakLive=%lld live=%lld processDelta=%lld processPeak=%llu",
+            caller, MemPhaseName(phase), s.allocBytes, s.allocCount, s.peakLiveBytes, s.liveBytes, s.processDelta,
+            s.processPeak);
+        if (csv)
+        {
+            out.Utf8(std::wstring(caller));
+            out.Char(';');
+            out.Utf8(std::wstring(MemPhaseName(phase)));
+            out.Char(';');
+            out.Int((long long)s.allocBytes);
+            out.Char(';');
+            out.Int((long long)s.allocCount);
+            out.Char(';');
+            out.Int(s.peakLiveBytes);
+            out.Char(';');
+            out.Int(s.liveBytes);
+            out.Char(';');
+            out.Int(s.processDelta);
+            out.Char(';');
+            out.Int((long long)s.processPeak);
+            out.Char('\n');
+        }
+    }
+    acutPrintf(L"\n  peak live (all phases): %.0f KB", CMemAccounting::GetPeakLiveBytes() / 1024.0);
+    LogMessage(L"%s memory: peakLive=%lld", caller, CMemAccounting::GetPeakLiveBytes());
+    if (csv && !out.Close())
+        acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+}
+
+// Предпросмотр: цепочки, упрощённые Дугласом–Пекером под бюджет вершин, —
+// 3D-полилинии в пространстве модели, цвет по OD. ids — созданные полилинии.
+bool DrawNTLPreview(AcDbDatabase* pDb, const NTLPrepared& prepared, size_t vertexBudget,
+    AcDbObjectIdArray& ids, size_t& vertexCount)
+{
+    vertexCount = 0;
+    const CountedVector<NTLChain>& chains = prepared.chains;
+
+    std::vector<double> xyz;
+    std::vector<uint32_t> offsets;
+    xyz.reserve((prepared.segments.size() + chains.size()) * 3);
+    offsets.reserve(chains.size() + 1);
+    offsets.push_back(0);
+    auto addPoint = [&xyz](const AcGePoint3d& p)
+    {
+        xyz.push_back(p.x);
+        xyz.push_back(p.y);
+        xyz.push_back(p.z);
+    };
+    for (const NTLChain& ch : chains)
+    {
+        if (!ch.segs.empty())
+        {
+            addPoint(ch.segs.front().startPoint);
+            for (const NTLSegment& s : ch.segs)
+                addPoint(s.endPoint);
+        }
+        offsets.push_back((uint32_t)(xyz.size() / 3));
+    }
+    std::vector<uint8_t> keep;
+    vertexCount = SimplifyPolylines(xyz, offsets, vertexBudget, 0.0, keep);
+
+    // Цвет по OD: различные диаметры по возрастанию получают цвета палитры по кругу
+    static const Adesk::UInt16 kPalette[] = { 1, 2, 3, 4, 5, 6, 30, 40, 140, 200, 210, 220 };
+    const size_t paletteSize = sizeof(kPalette) / sizeof(kPalette[0]);
+    std::vector<double> ods;
+    for (const NTLChain& ch : chains)
+    {
+        if (!ch.segs.empty())
+            ods.push_back(floor(ch.segs.front().diameter * 10.0 + 0.5) / 10.0);
+    }
+    std::sort(ods.begin(), ods.end());
+    ods.erase(std::unique(ods.begin(), ods.end()), ods.end());
+    auto colorOf = [&](double od)
+    {
+        od = floor(od * 10.0 + 0.5) / 10.0;
+        size_t i = std::lower_bound(ods.begin(), ods.end(), od) - ods.begin();
+        return kPalette[i % paletteSize];
+    };
+
+    AcDbBlockTable* pBT = nullptr;
+    if (pDb->getBlockTable(pBT, AcDb::kForRead) != Acad::eOk || !pBT)
+        return false;
+    AcDbBlockTableRecord* pMS = nullptr;
+    Acad::ErrorStatus es = pBT->getAt(ACDB_MODEL_SPACE, pMS, AcDb::kForWrite);
+    pBT->close();
+    if (es != Acad::eOk || !pMS)
+        return false;
+
+    for (size_t k = 0; k < chains.size(); ++k)
+    {
+        AcGePoint3dArray pts;
+        for (uint32_t i = offsets[k]; i < offsets[k + 1]; ++i)
+        {
+            if (keep[i])
+                pts.append(AcGePoint3d(xyz[i * 3], xyz[i * 3 + 1], xyz[i * 3 + 2]));
+        }
+        if (pts.length() < 2)
+            continue;
+        AcDb3dPolyline* pPoly = new AcDb3dPolyline(AcDb::k3dSimplePoly, pts, Adesk::kFalse);
+        pPoly->setColorIndex(colorOf(chains[k].segs.front().diameter));
+        AcDbObjectId id;
+        if (pMS->appendAcDbEntity(id, pPoly) == Acad::eOk)
+        {
+            ids.append(id);
+            pPoly->close();
+        }
+        else
+        {
+            delete pPoly;
+        }
+    }
+    pMS->close();
+
+    for (size_t i = 0; i < ods.size(); ++i)
+        acutPrintf(L"\n  OD %.1f: color %d", ods[i], (int)kPalette[i % paletteSize]);
+    return true;
+}
+
+
+// Подсветка расхождений временными объектами: цепочки — отрезками (новые — зелёные,
+// изменённые по форме — жёлтые, по профилю — голубые, удалённые — красные, по чертежу),
+// элементы — окружностями радиуса допуска, сдвиг — отрезком от старого места к новому.
+bool DrawReconcileOverlay(AcDbDatabase* pDb, const ReconcileModel& drawing, const ReconcileModel& ntl,
+    const ReconcileResult& result, double itemRadius, AcDbObjectIdArray& ids)
+{
+    static const Adesk::UInt16 kStatusColor[] = { 0, 2, 4, 3, 1 };  // по ReconcileStatus
+
+    AcDbBlockTable* pBT = nullptr;
+    if (pDb->getBlockTable(pBT, AcDb::kForRead) != Acad::eOk || !pBT)
+        return false;
+    AcDbBlockTableRecord* pMS = nullptr;
+    Acad::ErrorStatus es = pBT->getAt(ACDB_MODEL_SPACE, pMS, AcDb::kForWrite);
+    pBT->close();
+    if (es != Acad::eOk || !pMS)
+        return false;
+
+    auto append = [&](AcDbEntity* pEnt, ReconcileStatus status)
+    {
+        pEnt->setColorIndex(kStatusColor[(size_t)status]);
+        AcDbObjectId id;
+        if (pMS->appendAcDbEntity(id, pEnt) == Acad::eOk)
+        {
+            ids.append(id);
+            pEnt->close();
+        }
+        else
+        {
+            delete pEnt;
+        }
+    };
+    auto point = [](const double p[3]) { return AcGePoint3d(p[0], p[1], p[2]); };
+
+    for (const ReconcileMatch& m : result.chains)
+    {
+        if (m.status == ReconcileStatus::Unchanged)
+            continue;
+        const bool removed = m.status == ReconcileStatus::Removed;
+        const ReconcileModel& model = removed ? drawing : ntl;
+        const ReconcileChain& ch = model.chains[removed ? m.drawing : m.ntl];
+        for (uint32_t i = 0; i < ch.segmentCount; ++i)
+        {
+            const ReconcileSegment& s = model.segments[ch.firstSegment + i];
+            append(new AcDbLine(point(s.start), point(s.end)), m.status);
+        }
+    }
+
+    for (const ReconcileMatch& m : result.items)
+    {
+        if (m.status == ReconcileStatus::Unchanged)
+            continue;
+        const bool removed = m.status == ReconcileStatus::Removed;
+        const ReconcileItem& item = removed ? drawing.items[m.drawing] : ntl.items[m.ntl];
+        append(new AcDbCircle(point(item.pos), AcGeVector3d::kZAxis, itemRadius), m.status);
+        if (m.status == ReconcileStatus::Moved)
+            append(new AcDbLine(point(drawing.items[m.drawing].pos), point(item.pos)), m.status);
+    }
+    pMS->close();
+    return true;
+}
+
+// Отчёт сверки: строки всех статусов, кроме Unchanged.
+// Kind;Status;Name;Handle;NtlIndex;OldOD;NewOD;X;Y;Z;Shift — положение по NTL, у удалённых — по чертежу.
+bool WriteReconcileReport(const std::wstring& path, const ReconcileModel& drawing, const ReconcileModel& ntl,
+    const ReconcileResult& result)
+{
+    CReportWriter out(1 << 16);
+    if (!out.Open(path))
+        return false;
+    out.Bom();
+    out.Raw("Kind;Status;Name;Handle;NtlIndex;OldOD;NewOD;X;Y;Z;Shift\n");
+    auto head = [&out](const wchar_t* kind, const ReconcileMatch& m, const std::wstring& name, uint64_t handle)
+    {
+        out.Utf8(std::wstring(kind));
+        out.Char(';');
+        out.Utf8(std::wstring(ReconcileStatusName(m.status)));
+        out.Char(';');
+        out.CsvField(name);
+        out.Char(';');
+        if (m.drawing != kReconcileNone)
+            out.Hex(handle);
+        out.Char(';');
+        if (m.ntl != kReconcileNone)
+            out.Int((long long)m.ntl);
+        out.Char(';');
+    };
+    auto xyz = [&out](const double p[3])
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            out.Double(p[k]);
+            out.Char(';');
+        }
+    };
+
+    for (const ReconcileMatch& m : result.chains)
+    {
+        if (m.status == ReconcileStatus::Unchanged)
+            continue;
+        const ReconcileChain* dc = m.drawing != kReconcileNone ? &drawing.chains[m.drawing] : nullptr;
+        const ReconcileChain* nc = m.ntl != kReconcileNone ? &ntl.chains[m.ntl] : nullptr;
+        head(L"Chain", m, nc ? nc->name : dc->name, dc ? dc->handle : 0);
+        if (dc && dc->od > 0.0)
+            out.Double(dc->od);
+        out.Char(';');
+        if (nc)
+            out.Double(nc->od);
+        out.Char(';');
+        const ReconcileModel& model = nc ? ntl : drawing;
+        const ReconcileChain& ch = nc ? *nc : *dc;
+        if (ch.segmentCount > 0)
+            xyz(model.segments[ch.firstSegment].start);
+        else
+            out.Raw(";;;");
+        out.Char('\n');
+    }
+
+    for (const ReconcileMatch& m : result.items)
+    {
+        if (m.status == ReconcileStatus::Unchanged)
+            continue;
+        const ReconcileItem* di = m.drawing != kReconcileNone ? &drawing.items[m.drawing] : nullptr;
+        const ReconcileItem* ni = m.ntl != kReconcileNone ? &ntl.items[m.ntl] : nullptr;
+        const ReconcileItem& item = ni ? *ni : *di;
+        head(ReconcileItemKindName(item.kind), m, item.name.empty() && di ? di->name : item.name, di ? di->handle : 0);
+        out.Raw(";;");
+        xyz(item.pos);
+        if (di && ni)
+        {
+            const double dx = ni->pos[0] - di->pos[0];
+            const double dy = ni->pos[1] - di->pos[1];
+            const double dz = ni->pos[2] - di->pos[2];
+            out.Double(sqrt(dx * dx + dy * dy + dz * dz));
+        }
+        out.Char('\n');
+    }
+    return out.Close();
+}
+} // namespace
+
+/**
+ * Функция импорта трубы из NTL файла
+ */
+void importFromNTL()
+{
+    LogMessage(L"BEGIN importFromNTL");
+    try
+    {
+        acutPrintf(L"\n=== Import pipe from NTL file ===\n");
+
+        CString filePath;
+        if (!SelectNTLFile(L"importFromNTL", filePath))
+            return;
+
+        CMemAccounting::Reset();
+        CNTLParser parser;
+        if (!ReadNTLFile(L"importFromNTL", filePath, parser))
+            return;
+
+        NTLPrepared prepared;
+        if (!PrepareNTLChains(parser, prepared))
+            return;
+
+        ImportPreparedNTL(parser, prepared, filePath);
+        ReportImportMemory(L"IMPORTNTL");
+        LogMessage(L"END importFromNTL");
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in importFromNTL: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in importFromNTL");
+        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+    }
+}
+
+/**
+ * Вторая стадия поэтапного импорта: опоры и инлайны по сохранённому плану документа,
+ * порциями с одним пересчётом оси на порцию. Прерванное выполнение продолжается повторным запуском.
+ */
+void ntlFittings()
+{
+    LogMessage(L"BEGIN ntlFittings");
+    try
+    {
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        CNTLStagedImport* pStaged = CNTLStagedImport::ForDatabase(pDb, false);
+        if (!pStaged || pStaged->GetPendingItems() == 0)
+        {
+            acutPrintf(L"\nNo pending staged NTL import in this drawing.");
+            LogMessage(L"ntlFittings: nothing pending");
+            CNTLStagedImport::Release(pDb);
+            return;
+        }
+
+        vCSDragManager* pDM = vCSDragManager::DM();
+        if (!pDM)
+        {
+            acutPrintf(L"\nERROR: DragManager is null. Cannot proceed.");
+            LogMessage(L"ERROR: vCSDragManager::DM() returned nullptr");
+            return;
+        }
+
+        CMemAccounting::Reset();
+        acutPrintf(L"\nAdding %d supports/inlines on %d chains (%s)", (int)pStaged->GetPendingItems(),
+            (int)pStaged->GetPendingChains(), pStaged->GetSourceFile().GetString());
+        DWORD t0 = GetTickCount();
+        int totalSupports = 0;
+        int totalInlines = 0;
+        CTracedDM dm(pDM);
+        CImportProgress progress(L"NTLFITTINGS");
+        const NTLImportOptions& opt = GetNTLImportOptions();
+        bool complete = false;
+        {
+            CMemScope memScope(MemPhase::Placement);
+            complete = ApplyPlacementPlan(dm, pStaged->GetChains(), (size_t)opt.fittingChunk, (DWORD)opt.timeSliceMs,
+                progress, totalSupports, totalInlines);
+            TagCompleteChains(pStaged->GetChains());
+            dm.Clear();
+        }
+        DWORD ms = GetTickCount() - t0;
+        if (!complete)
+            acutPrintf(L"\nCANCELLED by user.");
+
+        int failedChains = 0;
+        for (const NTLChainPlan& chain : pStaged->GetChains())
+        {
+            if (chain.failed)
+                ++failedChains;
+        }
+        size_t pending = pStaged->GetPendingItems();
+        acutPrintf(L"\nOK: Added %d supports, %d inlines in %lu ms", totalSupports, totalInlines, ms);
+        if (failedChains > 0)
+            acutPrintf(L"\nWARNING: %d chains skipped (axis unavailable)", failedChains);
+        LogMessage(L"ntlFittings: supports=%d inlines=%d failedChains=%d pending=%d ms=%lu",
+            totalSupports, totalInlines, failedChains, (int)pending, ms);
+        ReportImportMemory(L"NTLFITTINGS");
+        if (pending > 0)
+        {
+            acutPrintf(L"\n%d items pending on %d chains, run NTLFITTINGS again to resume.",
+                (int)pending, (int)pStaged->GetPendingChains());
+            return;
+        }
+        CNTLStagedImport::Release(pDb);
+        LogMessage(L"END ntlFittings - complete");
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in ntlFittings: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs (run NTLFITTINGS again to resume)", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in ntlFittings");
+        acutPrintf(L"\nERROR: Unknown error in ntlFittings (run NTLFITTINGS again to resume).");
+    }
+}
+
+/**
+ * Быстрый предпросмотр NTL: упрощённые полилинии цепочек, цвет по OD.
+ * После подтверждения импорт выполняется по тому же разбору, без повторного чтения файла.
+ */
+void previewNTL()
+{
+    LogMessage(L"BEGIN previewNTL");
+    AcDbObjectIdArray previewIds;
+    try
+    {
+        CString filePath;
+        if (!SelectNTLFile(L"previewNTL", filePath))
+            return;
+
+        DWORD t0 = GetTickCount();
+        CMemAccounting::Reset();
+        CNTLParser parser;
+        if (!ReadNTLFile(L"previewNTL", filePath, parser))
+            return;
+
+        NTLPrepared prepared;
+        if (!PrepareNTLChains(parser, prepared))
+            return;
+
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        size_t vertexCount = 0;
+        if (!pDb || !DrawNTLPreview(pDb, prepared, (size_t)GetNTLImportOptions().previewBudget, previewIds, vertexCount))
+        {
+            acutPrintf(L"\nERROR: Cannot write model space.");
+            LogMessage(L"previewNTL: draw fail");
+            EraseEntities(previewIds);
+            return;
+        }
+        acedUpdateDisplay();
+        DWORD ms = GetTickCount() - t0;
+        acutPrintf(L"\nPreview: %d chains, %d of %d segments as %d vertices, %lu ms",
+            (int)prepared.chains.size(), (int)prepared.segments.size(), (int)parser.GetSegments().size(),
+            (int)vertexCount, ms);
+        LogMessage(L"previewNTL: chains=%d segments=%d vertices=%d ms=%lu",
+            (int)prepared.chains.size(), (int)prepared.segments.size(), (int)vertexCount, ms);
+
+        acedInitGet(0, L"Yes No");
+        wchar_t kw[32] = { 0 };
+        int res = acedGetKword(L"\nImport [Yes/No] <No>: ", kw);
+        EraseEntities(previewIds);
+        previewIds.setLogicalLength(0);
+        if (res != RTNORM || wcscmp(kw, L"Yes") != 0)
+        {
+            acutPrintf(L"\nImport cancelled.");
+            LogMessage(L"END previewNTL - cancelled");
+            return;
+        }
+
+        ImportPreparedNTL(parser, prepared, filePath);
+        ReportImportMemory(L"PREVIEWNTL");
+        LogMessage(L"END previewNTL - imported");
+    }
+    catch (const std::exception& ex)
+    {
+        EraseEntities(previewIds);
+        LogMessage(L"std::exception in previewNTL: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        EraseEntities(previewIds);
+        LogMessage(L"Unknown error in previewNTL");
+        acutPrintf(L"\nERROR: Unknown error in previewNTL.");
+    }
+}
+
+/**
+ * Сверка NTL с чертежом: оси, опоры и инлайны модели против нового разбора.
+ * Пары ищутся хеш-соединением (NTLReconcile.h), расхождения пишутся в отчёт и подсвечиваются.
+ */
+void reconcileNTL()
+{
+    LogMessage(L"BEGIN reconcileNTL");
+    AcDbObjectIdArray overlayIds;
+    try
+    {
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        if (!pDb)
+        {
+            acutPrintf(L"\nERROR: No active database.");
+            LogMessage(L"reconcileNTL: no DB");
+            return;
+        }
+
+        CString filePath;
+        if (!SelectNTLFile(L"reconcileNTL", filePath))
+            return;
+
+        DWORD t0 = GetTickCount();
+        CMemAccounting::Reset();
+        CNTLParser parser;
+        if (!ReadNTLFile(L"reconcileNTL", filePath, parser))
+            return;
+        NTLPrepared prepared;
+        if (!PrepareNTLChains(parser, prepared))
+            return;
+        ReconcileModel ntl;
+        BuildNTLReconcileModel(parser, prepared, ntl);
+        DWORD tParse = GetTickCount();
+
+        ReconcileModel drawing;
+        CReconcileCollector collector(drawing);
+        CModelScanner scanner;
+        scanner.AddVisitor(&collector);
+        if (CPipingIndex* pIndex = CPipingIndex::ForDatabase(pDb))
+            scanner.SetParamCache(&pIndex->GetParamCache());
+        if (!scanner.Run(pDb))
+        {
+            acutPrintf(L"\nERROR: Cannot read model space.");
+            LogMessage(L"reconcileNTL: scan fail");
+            return;
+        }
+        DWORD tScan = GetTickCount();
+
+        ReconcileOptions options;
+        ReconcileResult result;
+        ReconcileModels(drawing, ntl, options, result);
+        DWORD tJoin = GetTickCount();
+
+        const std::wstring csvPath = GetTempFilePath(L"NTLReconcile.csv");
+        if (!WriteReconcileReport(csvPath, drawing, ntl, result))
+            acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+
+        acutPrintf(L"\nDrawing: %d axes, %d supports/inlines; NTL: %d chains, %d supports/inlines",
+            (int)drawing.chains.size(), (int)drawing.items.size(), (int)ntl.chains.size(), (int)ntl.items.size());
+        acutPrintf(L"\n  %-10s %8s %8s", L"", L"chains", L"items");
+        for (size_t i = 0; i < (size_t)ReconcileStatus::Count; ++i)
+        {
+            acutPrintf(L"\n  %-10s %8d %8d", ReconcileStatusName((ReconcileStatus)i),
+                (int)result.chainCounts[i], (int)result.itemCounts[i]);
+            LogMessage(L"reconcileNTL: %s chains=%d items=%d", ReconcileStatusName((ReconcileStatus)i),
+                (int)result.chainCounts[i], (int)result.itemCounts[i]);
+        }
+        acutPrintf(L"\nReport: %s", csvPath.c_str());
+        acutPrintf(L"\nTime: parse %lu ms, scan %lu ms (%d opened), join %lu ms",
+            tParse - t0, tScan - tParse, scanner.GetOpenedCount(), tJoin - tScan);
+        LogMessage(L"reconcileNTL: parse=%lu scan=%lu join=%lu ms", tParse - t0, tScan - tParse, tJoin - tScan);
+
+        const size_t unchanged = (size_t)ReconcileStatus::Unchanged;
+        if (result.chains.size() == result.chainCounts[unchanged] && result.items.size() == result.itemCounts[unchanged])
+        {
+            acutPrintf(L"\nNo differences.");
+            LogMessage(L"END reconcileNTL - no differences");
+            return;
+        }
+
+        if (!DrawReconcileOverlay(pDb, drawing, ntl, result, options.itemTolerance * 0.5, overlayIds))
+        {
+            acutPrintf(L"\nERROR: Cannot write model space.");
+            LogMessage(L"reconcileNTL: overlay fail");
+            EraseEntities(overlayIds);
+            return;
+        }
+        acedUpdateDisplay();
+        acutPrintf(L"\nHighlight: green - added, yellow - moved, cyan - resized, red - removed.");
+
+        acedInitGet(0, L"Yes No");
+        wchar_t kw[32] = { 0 };
+        int res = acedGetKword(L"\nKeep highlight [Yes/No] <No>: ", kw);
+        if (res != RTNORM || wcscmp(kw, L"Yes") != 0)
+            EraseEntities(overlayIds);
+        LogMessage(L"END reconcileNTL");
+    }
+    catch (const std::exception& ex)
+    {
+        EraseEntities(overlayIds);
+        LogMessage(L"std::exception in reconcileNTL: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        EraseEntities(overlayIds);
+        LogMessage(L"Unknown error in reconcileNTL");
+        acutPrintf(L"\nERROR: Unknown error in reconcileNTL.");
+    }
+}
+
+namespace
+{
+// Параметры STRESSPIPES (последние введённые)
+StressParams& GetStressParams()
+{
+    static StressParams params;
+    return params;
+}
+
+// Запрос целого/вещественного с текущим значением по умолчанию; false — отмена
+bool PromptInt(const wchar_t* label, int& value, int flags)
+{
+    wchar_t prompt[128] = { 0 };
+    swprintf_s(prompt, L"\n%s <%d>: ", label, value);
+    acedInitGet(flags, nullptr);
+    int v = value;
+    int res = acedGetInt(prompt, &v);
+    if (res == RTNORM)
+        value = v;
+    return res == RTNORM || res == RTNONE;
+}
+
+bool PromptReal(const wchar_t* label, double& value, int flags)
+{
+    wchar_t prompt[128] = { 0 };
+    swprintf_s(prompt, L"\n%s <%g>: ", label, value);
+    acedInitGet(flags, nullptr);
+    double v = value;
+    int res = acedGetReal(prompt, &v);
+    if (res == RTNORM)
+        value = v;
+    return res == RTNORM || res == RTNONE;
+}
+
+double MsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+/**
+ * Нагрузочная модель: много труб с опорами и инлайнами через тот же путь, что IMPORTNTL
+ * (CreatePipeOnPointsWithProfiles, AddSupport/AddInLine, пересчёт на трубу).
+ * Время по фазам и на элемент — в консоль, по трубам — в %TEMP%\StressPipes.csv.
+ */
+void stressPipes()
+{
+    LogMessage(L"BEGIN stressPipes");
+    try
+    {
+        acutPrintf(L"\n=== Stress model: pipes with supports and inlines ===\n");
+
+        StressParams& prm = GetStressParams();
+        int seed = (int)prm.seed;
+        if (!PromptInt(L"Number of pipes", prm.pipes, RSG_NONEG | RSG_NOZERO) ||
+            !PromptInt(L"Vertices per pipe", prm.verticesPerPipe, RSG_NONEG | RSG_NOZERO) ||
+            !PromptReal(L"Supports per meter", prm.supportsPerMeter, RSG_NONEG) ||
+            !PromptReal(L"Inlines per meter", prm.inlinesPerMeter, RSG_NONEG) ||
+            !PromptReal(L"Reducer share of inlines (0..1)", prm.reducerShare, RSG_NONEG) ||
+            !PromptReal(L"Tee share of inlines (0..1)", prm.teeShare, RSG_NONEG) ||
+            !PromptInt(L"Random seed", seed, RSG_NONEG))
+        {
+            acutPrintf(L"\nCancelled.");
+            return;
+        }
+        prm.seed = (unsigned)seed;
+        if (prm.verticesPerPipe < 2)
+            prm.verticesPerPipe = 2;
+
+        vCSDragManager* pDM = vCSDragManager::DM();
+        if (!pDM)
+        {
+            acutPrintf(L"\nERROR: DragManager is null. Cannot proceed.");
+            LogMessage(L"ERROR: vCSDragManager::DM() returned nullptr");
+            return;
+        }
+        if (pDM->getSettingsTracing() && pDM->getSettingsTracing()->IsRectProfile())
+        {
+            pDM->getSettingsTracing()->m_bRectProfile = false;
+            LogMessage(L"Settings: switched to round profile");
+        }
+
+        auto t = std::chrono::steady_clock::now();
+        std::vector<StressPipe> pipes;
+        GenerateStressModel(prm, pipes);
+        const double generateMs = MsSince(t);
+        size_t plannedItems = 0;
+        for (const StressPipe& pipe : pipes)
+            plannedItems += pipe.items.size();
+        LogMessage(L"stressPipes: pipes=%d vertices=%d supports/m=%g inlines/m=%g reducers=%g tees=%g seed=%u items=%d",
+            prm.pipes, prm.verticesPerPipe, prm.supportsPerMeter, prm.inlinesPerMeter, prm.reducerShare,
+            prm.teeShare, prm.seed, (int)plannedItems);
+
+        // По трубам: время создания, расстановки и пересчёта
+        struct PipeStat
+        {
+            AcDbObjectId axisId;
+            double createMs = 0.0;
+            double placeMs = 0.0;
+            double recalcMs = 0.0;
+            int created = 0;
+        };
+        std::vector<PipeStat> stats(pipes.size());
+        CTracedDM dm(pDM);
+        CImportProgress progress(L"STRESSPIPES");
+        bool cancelled = false;
+
+        // Фаза 1: трубы
+        t = std::chrono::steady_clock::now();
+        progress.BeginPhase(L"pipes", (int)pipes.size());
+        int pipeCount = 0;
+        for (size_t p = 0; p < pipes.size(); ++p)
+        {
+            if (progress.IsCancelled())
+            {
+                cancelled = true;
+                break;
+            }
+            progress.Step();
+            const StressPipe& pipe = pipes[p];
+            AcGePoint3dArray path;
+            for (size_t i = 0; i + 2 < pipe.xyz.size(); i += 3)
+                path.append(AcGePoint3d(pipe.xyz[i], pipe.xyz[i + 1], pipe.xyz[i + 2]));
+
+            auto tp = std::chrono::steady_clock::now();
+            Acad::ErrorStatus es = Acad::eOk;
+            stats[p].axisId = dm.CreatePipe(path, pipe.od, pipe.dn, es);
+            stats[p].createMs = MsSince(tp);
+            if (stats[p].axisId.isNull())
+                LogMessage(L"stressPipes: pipe %d create failed es=%d", (int)p, es);
+            else
+                ++pipeCount;
+        }
+        progress.EndPhase();
+        auto tc = std::chrono::steady_clock::now();
+        dm.End();
+        dm.CheckForErase();
+        dm.UpdateDBEnt();
+        const double commitMs = MsSince(tc);
+        const double pipesMs = MsSince(t);
+
+        // Фаза 2: опоры и инлайны, один пересчёт на трубу
+        t = std::chrono::steady_clock::now();
+        progress.BeginPhase(L"supports/inlines", (int)plannedItems);
+        double placeMs = 0.0, recalcMs = 0.0;
+        int supportCount = 0, inlineCount = 0;
+        for (size_t p = 0; p < pipes.size() && !cancelled; ++p)
+        {
+            if (progress.IsCancelled())
+            {
+                cancelled = true;
+                break;
+            }
+            PipeStat& st = stats[p];
+            const StressPipe& pipe = pipes[p];
+            progress.Step((int)pipe.items.size());
+            if (st.axisId.isNull() || pipe.items.empty())
+                continue;
+
+            dm.End();
+            dm.Clear();
+            if (!dm.SetView())
+                continue;
+            dm.Start(st.axisId);
+            vCS_DM_Axis* pAxis = dm.GetAxis(st.axisId);
+            if (!pAxis || pAxis->GetSegCount() == 0)
+            {
+                dm.End();
+                continue;
+            }
+
+            auto tp = std::chrono::steady_clock::now();
+            for (const StressItem& si : pipe.items)
+            {
+                if (si.segIndex >= pAxis->GetSegCount())
+                    continue;
+                vCS_DM_Seg* pSeg = dm.GetSeg(pAxis, si.segIndex);
+                if (!pSeg || si.offset > pSeg->GetStartPoint().distanceTo(pSeg->GetEndPoint()))
+                    continue;
+                NTLPlacement item;
+                item.support = si.kind == StressItem::Kind::Support;
+                item.inlineType = si.kind == StressItem::Kind::Reducer ? NTLInline::Type::Reducer :
+                    (si.kind == StressItem::Kind::Tee ? NTLInline::Type::Tee : NTLInline::Type::Inline);
+                item.segIndex = si.segIndex;
+                item.offset = si.offset;
+                AcGePoint3d base;
+                if (!AddPlacementToSegment(dm, pAxis, pSeg, item, base))
+                    continue;
+                ++st.created;
+                if (item.support)
+                    ++supportCount;
+                else
+                    ++inlineCount;
+            }
+            st.placeMs = MsSince(tp);
+
+            tp = std::chrono::steady_clock::now();
+            if (st.created > 0)
+            {
+                dm.EditableAxisAdd(pAxis);
+                Acad::ErrorStatus calcStatus = dm.Recalculate();
+                dm.End();
+                if (calcStatus == Acad::eOk)
+                {
+                    dm.CheckForErase();
+                    dm.UpdateDBEnt();
+                }
+                else
+                {
+                    LogMessage(L"stressPipes: pipe %d recalculation error %d", (int)p, calcStatus);
+                }
+            }
+            else
+            {
+                dm.End();
+            }
+            st.recalcMs = MsSince(tp);
+            placeMs += st.placeMs;
+            recalcMs += st.recalcMs;
+        }
+        progress.EndPhase();
+        dm.Clear();
+        const double itemsMs = MsSince(t);
+
+        // По трубам — в CSV: по росту RecalcMs от Items видно, где пересчёт становится нелинейным
+        const std::wstring csvPath = GetTempFilePath(L"StressPipes.csv");
+        CReportWriter out(1 << 16);
+        if (out.Open(csvPath))
+        {
+            out.Bom();
+            out.Raw("Pipe;Segments;Items;Created;CreateMs;PlaceMs;RecalcMs;RecalcUsPerItem\n");
+            for (size_t p = 0; p < pipes.size(); ++p)
+            {
+                const PipeStat& st = stats[p];
+                out.Int((long long)p);
+                out.Char(';');
+                out.Int((long long)(pipes[p].xyz.size() / 3 - 1));
+                out.Char(';');
+                out.Int((long long)pipes[p].items.size());
+                out.Char(';');
+                out.Int(st.created);
+                out.Char(';');
+                out.Double(st.createMs);
+                out.Char(';');
+                out.Double(st.placeMs);
+                out.Char(';');
+                out.Double(st.recalcMs);
+                out.Char(';');
+                out.Double(st.created > 0 ? st.recalcMs * 1000.0 / st.created : 0.0);
+                out.Char('\n');
+            }
+            if (!out.Close())
+                acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+        }
+        else
+        {
+            acutPrintf(L"\nERROR: Cannot write file: %s", csvPath.c_str());
+        }
+
+        const int items = supportCount + inlineCount;
+        acutPrintf(L"\n%s Pipes %d/%d, supports %d, inlines %d (planned %d)", cancelled ? L"CANCELLED:" : L"OK:",
+            pipeCount, (int)pipes.size(), supportCount, inlineCount, (int)plannedItems);
+        acutPrintf(L"\n  generate:   %.1f ms", generateMs);
+        acutPrintf(L"\n  pipes:      %.1f ms (%.2f ms/pipe, commit %.1f ms)", pipesMs,
+            pipeCount > 0 ? (pipesMs - commitMs) / pipeCount : 0.0, commitMs);
+        acutPrintf(L"\n  placement:  %.1f ms (%.1f us/item)", placeMs, items > 0 ? placeMs * 1000.0 / items : 0.0);
+        acutPrintf(L"\n  recalc:     %.1f ms (%.1f us/item)", recalcMs, items > 0 ? recalcMs * 1000.0 / items : 0.0);
+        acutPrintf(L"\n  items phase: %.1f ms total", itemsMs);
+        acutPrintf(L"\n  per pipe:   %s", csvPath.c_str());
+        LogMessage(L"END stressPipes: pipes=%d items=%d generate=%.1f pipes=%.1f place=%.1f recalc=%.1f cancelled=%d",
+            pipeCount, items, generateMs, pipesMs, placeMs, recalcMs, cancelled ? 1 : 0);
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in stressPipes: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in stressPipes");
+        acutPrintf(L"\nERROR: Unknown error in stressPipes.");
+    }
+}
+
+/**
+ * Трасса вызовов DragManager: Start — начать запись, Stop — сохранить в %TEMP%\DMTrace.bin,
+ * Replay — проиграть трассу на модели DragManager (CDMStandIn) и вывести время по операциям.
+ */
+void dmTrace()
+{
+    LogMessage(L"BEGIN dmTrace");
+    try
+    {
+        CDMTraceRecorder& rec = CDMTraceRecorder::Instance();
+        wchar_t prompt[128] = { 0 };
+        swprintf_s(prompt, L"\nDM trace (%s) [Start/Stop/Replay] <%s>: ", rec.Active() ? L"recording" : L"off",
+            rec.Active() ? L"Stop" : L"Start");
+        acedInitGet(0, L"Start Stop Replay");
+        wchar_t kw[32] = { 0 };
+        int res = acedGetKword(prompt, kw);
+        if (res == RTNONE)
+            wcscpy_s(kw, rec.Active() ? L"Stop" : L"Start");
+        else if (res != RTNORM)
             return;
-        }
 
-        // Предобработка: удаляем нулевые и склеиваем коллинеарные последовательные отрезки с одинаковым OD/WT/pipe/segmentId
-        std::vector<NTLSegment> segments;
-        segments.reserve(segmentsParsed.size());
-        auto sameDir = [](const AcGeVector3d& a, const AcGeVector3d& b)
+        const std::wstring tracePath = GetTempFilePath(L"DMTrace.bin");
+        if (wcscmp(kw, L"Start") == 0)
         {
-            double la = a.length(); double lb = b.length();
-            if (la < 1e-6 || lb < 1e-6) return false;
-            AcGeVector3d na = a / la; AcGeVector3d nb = b / lb;
-            double dot = na.dotProduct(nb);
-            return fabs(dot - 1.0) < 1e-3; // почти параллельны
-        };
-        for (const auto& s : segmentsParsed)
+            rec.Start();
+            acutPrintf(L"\nRecording DM calls. Run IMPORTNTL, NTLFITTINGS or STRESSPIPES, then DMTRACE Stop.");
+            LogMessage(L"dmTrace: recording started");
+            return;
+        }
+        if (wcscmp(kw, L"Stop") == 0)
         {
-            double len = s.startPoint.distanceTo(s.endPoint);
-            if (len < 1e-6)
-            {
-                LogMessage(L"Skip zero-length segment %s", s.name.GetString());
-                continue;
-            }
-            if (!segments.empty())
+            rec.Stop();
+            const CDMTrace& trace = rec.Trace();
+            if (!trace.Save(tracePath))
             {
-                NTLSegment& last = segments.back();
-                bool sameMeta =
-                    last.segmentId.CompareNoCase(s.segmentId) == 0 &&
-                    fabs(last.diameter - s.diameter) < 1e-6 &&
-                    fabs(last.wallThickness - s.wallThickness) < 1e-6 &&
-                    last.endPoint.distanceTo(s.startPoint) < 1e-3;
-                if (sameMeta)
-                {
-                    AcGeVector3d d1 = last.endPoint - last.startPoint;
-                    AcGeVector3d d2 = s.endPoint - s.startPoint;
-                    if (sameDir(d1, d2))
-                    {
-                        last.endPoint = s.endPoint;
-                        last.length += len;
-                        LogMessage(L"Merged collinear segment %s into %s, new len=%.3f", s.name.GetString(), last.name.GetString(), last.length);
-                        continue;
-                    }
-                }
+                acutPrintf(L"\nERROR: Cannot write file: %s", tracePath.c_str());
+                return;
             }
-            segments.push_back(s);
+            acutPrintf(L"\nOK: %d DM calls saved to %s", (int)trace.records.size(), tracePath.c_str());
+            LogMessage(L"dmTrace: stopped, records=%d, file=%s", (int)trace.records.size(), tracePath.c_str());
+            return;
         }
 
-        acutPrintf(L"\nFound %d segments in NTL file (merged %d -> %d)", (int)segmentsParsed.size(), (int)segmentsParsed.size(), (int)segments.size());
-        LogMessage(L"Found %d segments raw, after merge %d", (int)segmentsParsed.size(), (int)segments.size());
-
-        // Убеждаемся, что используется круглый профиль
-        vCSDragManager* pDM = vCSDragManager::DM();
-        if (!pDM)
+        CDMTrace trace;
+        if (!trace.Load(tracePath))
         {
-            acutPrintf(L"\nERROR: DragManager is null. Cannot proceed.");
-            LogMessage(L"ERROR: vCSDragManager::DM() returned nullptr");
+            acutPrintf(L"\nERROR: Cannot read trace: %s", tracePath.c_str());
             return;
         }
-        if (pDM->getSettingsTracing() && pDM->getSettingsTracing()->IsRectProfile())
+        CDMStandIn standIn;
+        DMReplayStats stats = ReplayDMTrace(trace, standIn);
+        acutPrintf(L"\n%-16s %10s %12s %12s", L"Operation", L"Calls", L"Recorded ms", L"Replay ms");
+        for (size_t i = 1; i < (size_t)DMOp::Count; ++i)
         {
-            pDM->getSettingsTracing()->m_bRectProfile = false;
-            LogMessage(L"Settings: switched to round profile");
+            const DMReplayStats::Op& op = stats.ops[i];
+            if (op.calls == 0)
+                continue;
+            acutPrintf(L"\n%-16s %10d %12.1f %12.3f", DMOpName((DMOp)i), (int)op.calls, op.recordedMs, op.replayMs);
         }
+        acutPrintf(L"\nOK: %d calls, %d axes, %d items, %d mismatches; recorded %.1f ms, replay %.3f ms",
+            (int)trace.records.size(), (int)standIn.GetAxisCount(), (int)standIn.GetItemCount(),
+            (int)stats.mismatches, stats.recordedMs, stats.replayMs);
+        LogMessage(L"dmTrace: replay records=%d mismatches=%d recorded=%.1f replay=%.3f",
+            (int)trace.records.size(), (int)stats.mismatches, stats.recordedMs, stats.replayMs);
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"std::exception in dmTrace: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"Unknown error in dmTrace");
+        acutPrintf(L"\nERROR: Unknown error in dmTrace.");
+    }
+}
 
-        // Группируем непрерывные отрезки с одинаковыми OD/WT/pipeName в цепочки
-        struct Chain
-        {
-            std::vector<const NTLSegment*> segs;
-            double totalLen = 0.0;
-        };
-
-        auto samePipe = [](const NTLSegment& a, const NTLSegment& b)
+/**
+ * Массовое присвоение KKS_PART арматуре, фасонным деталям и опорам без кода.
+ * Коды: система + шаблон агрегата по виду объекта (%TEMP%\KKSTemplates.txt или умолчания),
+ * уникальность — по хеш-множеству кодов, собранному из индекса модели за один проход.
+ */
+void kksAssign()
+{
+    LogMessage(L"BEGIN kksAssign");
+    try
+    {
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        if (!pDb)
         {
-            return fabs(a.diameter - b.diameter) < 1e-6 &&
-                fabs(a.wallThickness - b.wallThickness) < 1e-6 &&
-                a.pipeName == b.pipeName;
-        };
+            acutPrintf(L"\nERROR: No active database.");
+            LogMessage(L"kksAssign: no DB");
+            return;
+        }
 
-        std::vector<Chain> chains;
-        if (!segments.empty())
+        // Система (уровень 1 KKS), к которой относятся объекты
+        static std::wstring lastSystem;
+        wchar_t prompt[160] = { 0 };
+        wchar_t buf[134] = { 0 };
+        swprintf_s(prompt, L"\nSystem KKS code <%s>: ", lastSystem.empty() ? L"10LBA10" : lastSystem.c_str());
+        int res = acedGetString(0, prompt, buf);
+        if (res != RTNORM && res != RTNONE)
+            return;
+        std::wstring system = buf[0] ? NormalizeKKS(buf) : (lastSystem.empty() ? L"10LBA10" : lastSystem);
+        KKSCode sysCode;
+        if (!ParseKKS(system, sysCode) || sysCode.levelCount != 2 || sysCode.Prefix(1) != system)
         {
-            Chain cur;
-            cur.segs.push_back(&segments[0]);
-            cur.totalLen = segments[0].length;
-            for (size_t i = 1; i < segments.size(); ++i)
-            {
-                const NTLSegment& prev = *cur.segs.back();
-                const NTLSegment& seg = segments[i];
-                bool contiguous = prev.endPoint.distanceTo(seg.startPoint) < 1e-3;
-                if (contiguous && samePipe(prev, seg))
-                {
-                    cur.segs.push_back(&seg);
-                    cur.totalLen += seg.length;
-                }
-                else
-                {
-                    chains.push_back(cur);
-                    cur = Chain{};
-                    cur.segs.push_back(&seg);
-                    cur.totalLen = seg.length;
-                }
-            }
-            chains.push_back(cur);
+            acutPrintf(L"\nERROR: '%s' is not a KKS system code (e.g. 10LBA10).", system.c_str());
+            LogMessage(L"kksAssign: bad system '%s'", system.c_str());
+            return;
         }
+        lastSystem = system;
 
-        acutPrintf(L"\nGrouped into %d continuous pipes", (int)chains.size());
-        LogMessage(L"Grouped into %d chains", (int)chains.size());
-
-        int successCount = 0;
-        std::vector<AcDbObjectId> createdAxisIds; // ID осей по цепочкам
-
-        // Создаем трубы по цепочкам
-        for (size_t c = 0; c < chains.size(); ++c)
+        // Область: выбранные объекты или все объекты без кода
+        acedInitGet(0, L"Selection Unassigned");
+        wchar_t kw[32] = { 0 };
+        res = acedGetKword(L"\nScope [Selection/Unassigned] <Unassigned>: ", kw);
+        if (res != RTNORM && res != RTNONE)
+            return;
+        bool bySelection = res == RTNORM && wcscmp(kw, L"Selection") == 0;
+        std::set<AcDbObjectId> selected;
+        if (bySelection)
         {
-            const Chain& ch = chains[c];
-            if (ch.segs.empty())
-                continue;
-            const NTLSegment* first = ch.segs.front();
-            double od = first->diameter;
-            double wt = first->wallThickness;
-            if (od <= 0.0)
-            {
-                LogMessage(L"WARNING: Chain %d invalid od, skip", (int)c);
-                continue;
-            }
-            double dn = od - 2.0 * wt;
-            if (dn <= 0.0)
-                dn = od * 0.9;
-
-            AcGePoint3dArray path;
-            path.append(first->startPoint);
-            for (const auto* s : ch.segs)
-            {
-                if (path.isEmpty() || path.last() != s->endPoint)
-                    path.append(s->endPoint);
-            }
-            if (path.length() < 2)
-                continue;
-
-            vCSProfilePtr pProfile = new vCSProfileCircle(true, od, dn);
-            if (!pProfile)
+            ads_name ss;
+            if (acedSSGet(nullptr, nullptr, nullptr, nullptr, ss) != RTNORM)
             {
-                LogMessage(L"ERROR: profile null, chain %d", (int)c);
-                continue;
+                acutPrintf(L"\nNothing selected.");
+                return;
             }
-
-            AcDbObjectId idStart = AcDbObjectId::kNull;
-            AcDbObjectId idEnd = AcDbObjectId::kNull;
-            CreatePipeOnPointsWithProfiles cpop(path, pProfile, pProfile, pProfile);
-            Acad::ErrorStatus es = cpop.CalculateAndConnect(idStart, idEnd);
-            if (es != Acad::eOk)
+            Adesk::Int32 len = 0;
+            acedSSLength(ss, &len);
+            for (Adesk::Int32 i = 0; i < len; ++i)
             {
-                LogMessage(L"ERROR: chain %d create pipe es=%d", (int)c, es);
-                continue;
+                ads_name ent;
+                AcDbObjectId id;
+                if (acedSSName(ss, i, ent) == RTNORM && acdbGetObjectId(id, ent) == Acad::eOk)
+                    selected.insert(id);
             }
+            acedSSFree(ss);
+        }
 
-            AcDbObjectId axisId = AcDbObjectId::kNull;
-            if (auto* dmAxis = cpop.getCalculatedAxis())
-                axisId = dmAxis->OID();
-            if (axisId.isNull())
-            {
-                AcDbObjectIdArray arr;
-                pDM->GetOIdNewAxises(arr);
-                if (arr.length() > 0)
-                    axisId = arr[arr.length() - 1];
-            }
-            if (axisId.isNull())
+        // Правила генерации
+        CKKSTemplateSet templates;
+        const std::wstring templatesPath = GetTempFilePath(L"KKSTemplates.txt");
+        if (GetFileAttributesW(templatesPath.c_str()) != INVALID_FILE_ATTRIBUTES)
+        {
+            std::wstring error;
+            if (!templates.LoadFile(templatesPath, error))
             {
-                LogMessage(L"WARNING: chain %d axis null", (int)c);
-                continue;
+                acutPrintf(L"\nERROR: %s", error.c_str());
+                LogMessage(L"kksAssign: templates: %s", error.c_str());
+                return;
             }
-            createdAxisIds.push_back(axisId);
-            successCount++;
-            LogMessage(L"Chain %d: pipe created, axis=%ld, od=%.3f, wt=%.3f, pts=%d",
-                (int)c, axisId.asOldId(), od, wt, (int)path.length());
-            acutPrintf(L"\nOK: Pipe created (chain %d) od=%.3f wt=%.3f pts=%d",
-                (int)c, od, wt, (int)path.length());
+            LogMessage(L"kksAssign: %d rules from %s", (int)templates.GetRuleCount(), templatesPath.c_str());
         }
 
-        // Пересчитываем модель после создания труб
-        pDM->End();
-        pDM->CheckForErase();
-        pDM->UpdateDBEnt();
-        // Добавляем опоры и инлайны по цепочкам, один пересчёт на цепочку
-        const std::vector<NTLSupport>& supports = parser.GetSupports();
-        const std::vector<NTLInline>& inlines = parser.GetInlines();
-        acutPrintf(L"\nSupports parsed: %d, inlines parsed: %d", (int)supports.size(), (int)inlines.size());
-        LogMessage(L"Parsed supports=%d, inlines=%d", (int)supports.size(), (int)inlines.size());
-        int totalSupports = 0;
-        int totalInlines = 0;
+        CPipingIndex* pIndex = GetUpdatedPipingIndex(pDb, L"kksAssign");
+        if (!pIndex)
+            return;
 
-        for (size_t ci = 0; ci < chains.size() && ci < createdAxisIds.size(); ++ci)
+        // Занятые коды — со всех сущностей модели (один проход, параметры из кэша документа)
+        CKKSCodeAllocator allocator;
+        CKKSCodeCollector codes(allocator);
+        CModelScanner scanner;
+        scanner.AddVisitor(&codes);
+        scanner.SetParamCache(&pIndex->GetParamCache());
+        if (!scanner.Run(pDb))
         {
-            const Chain& ch = chains[ci];
-            if (ch.segs.empty())
-                continue;
+            acutPrintf(L"\nERROR: Cannot read model space.");
+            LogMessage(L"kksAssign: scan fail");
+            return;
+        }
+        LogMessage(L"kksAssign: %d codes on %d entities, %d distinct", codes.GetCodeCount(),
+            scanner.GetOpenedCount(), (int)allocator.GetUsedCount());
 
-            struct SegAccum { double len; const NTLSegment* seg; };
-            std::vector<SegAccum> acc;
-            double total = 0.0;
-            for (auto* s : ch.segs)
-            {
-                total += s->length;
-                acc.push_back({ total, s });
-            }
-            if (total < 1e-6)
+        // Кандидаты на присвоение — по индексу трубопроводных объектов
+        std::vector<const PipingEntry*> targets;
+        int noParam = 0;
+        for (const auto& kv : pIndex->GetEntries())
+        {
+            const PipingEntry& e = kv.second;
+            if (!e.kksPart.empty())
                 continue;
-
-            // Лог по цепочке
-            if (!ch.segs.empty())
-            {
-                const auto* firstSeg = ch.segs.front();
-                const auto* lastSeg = ch.segs.back();
-                LogMessage(L"Chain %d summary: segId=%s pipe=%s od=%.3f wt=%.3f pts=%d start(%.3f,%.3f,%.3f) end(%.3f,%.3f,%.3f)",
-                    (int)ci,
-                    firstSeg->segmentId.GetString(),
-                    firstSeg->pipeName.GetString(),
-                    firstSeg->diameter,
-                    firstSeg->wallThickness,
-                    (int)ch.segs.size() + 1,
-                    firstSeg->startPoint.x, firstSeg->startPoint.y, firstSeg->startPoint.z,
-                    lastSeg->endPoint.x, lastSeg->endPoint.y, lastSeg->endPoint.z);
-            }
-
-            auto findSegAndOffset = [&](double dist, size_t& segIdx, double& localOffset)
-            {
-                segIdx = 0;
-                double prev = 0.0;
-                for (; segIdx < acc.size(); ++segIdx)
-                {
-                    if (dist <= acc[segIdx].len + 1e-9)
-                        break;
-                    prev = acc[segIdx].len;
-                }
-                if (segIdx >= acc.size())
-                {
-                    segIdx = acc.size() - 1;
-                    prev = (segIdx > 0) ? acc[segIdx - 1].len : 0.0;
-                }
-                localOffset = dist - prev;
-            };
-
-            AcDbObjectId axisId = createdAxisIds[ci];
-            pDM->End();
-            pDM->Clear();
-            if (!pDM->setAcGsViewForViewPort(true))
+            if (e.isDummy || (bySelection && selected.find(e.id) == selected.end()))
                 continue;
-            pDM->Start(axisId);
-            vCS_DM_Axis* pAxis = pDM->GetAxis(axisId);
-            if (!pAxis || pAxis->GetSegCount() == 0)
+            if (!e.hasKks)
             {
-                pDM->End();
+                ++noParam; // параметра нет — записывать некуда
                 continue;
             }
+            targets.push_back(&e);
+        }
 
-            std::vector<double> usedSupportOffsets;
-            std::vector<double> usedInlineOffsets;
+        if (targets.empty())
+        {
+            acutPrintf(L"\nNo objects without KKS_PART found (%d without the parameter).", noParam);
+            LogMessage(L"kksAssign: nothing to assign, noParam=%d", noParam);
+            return;
+        }
 
-            // Полилиния оси для проекции
-            std::vector<AcGePoint3d> pts;
-            pts.reserve(ch.segs.size() + 1);
-            pts.push_back(ch.segs.front()->startPoint);
-            for (auto* s : ch.segs)
-                pts.push_back(s->endPoint);
-            auto projectOnChain = [&](const AcGePoint3d& p, double& outDist, size_t& segIdx, double& localOffset)
-            {
-                outDist = 0.0;
-                double best = 1e300;
-                double accLen = 0.0;
-                segIdx = 0;
-                localOffset = 0.0;
-                for (size_t i = 0; i + 1 < pts.size(); ++i)
-                {
-                    AcGePoint3d a = pts[i];
-                    AcGePoint3d b = pts[i + 1];
-                    AcGeVector3d ab = b - a;
-                    double len = ab.length();
-                    if (len < 1e-9)
-                        continue;
-                    AcGeVector3d ap = p - a;
-                    double t = ap.dotProduct(ab) / (len * len);
-                    if (t < 0.0) t = 0.0;
-                    if (t > 1.0) t = 1.0;
-                    AcGePoint3d proj = a + ab * t;
-                    double d2 = (proj - p).lengthSqrd();
-                    if (d2 < best)
-                    {
-                        best = d2;
-                        segIdx = i;
-                        localOffset = t * len;
-                        outDist = accLen + localOffset;
-                    }
-                    accLen += len;
-                }
-            };
+        // Порядок нумерации — порядок создания (handle), импортированные объекты идут подряд
+        std::sort(targets.begin(), targets.end(), [](const PipingEntry* a, const PipingEntry* b)
+            { return HandleToUInt64(a->id.handle()) < HandleToUInt64(b->id.handle()); });
 
-            // Опоры
-            for (const auto& sup : supports)
+        struct Assignment
+        {
+            const PipingEntry* entry;
+            KKSItemKind kind;
+            std::wstring code;
+        };
+        std::vector<Assignment> plan;
+        plan.reserve(targets.size());
+        int exhausted = 0;
+        for (const PipingEntry* e : targets)
+        {
+            KKSItemKind kind = e->kind == PipingKind::Support ? KKSItemKind::Support :
+                (IsFittingClass(e->className) ? KKSItemKind::Fitting : KKSItemKind::Valve);
+            const KKSTemplateRule* rule = templates.Find(system, kind);
+            std::wstring code = rule ? allocator.Allocate(system, *rule) : std::wstring();
+            if (code.empty())
             {
-                double dist = sup.distance;
-                bool segMatch = false;
-                // Пробуем по segmentId, если заполнен
-                if (!sup.name.IsEmpty())
-                {
-                    for (auto* s : ch.segs)
-                    {
-                        if (!s->segmentId.IsEmpty() && sup.name.Find(s->segmentId) >= 0)
-                        {
-                            segMatch = true;
-                            break;
-                        }
-                    }
-                }
-                // Если segmentId не помог — считаем, что опора принадлежит ближайшей цепи
-                if (!segMatch)
-                    segMatch = true;
-
-                // Если расстояние некорректно — проецируем позицию
-                if (dist <= 0.0 || dist > total)
-                {
-                    double projDist = 0.0, localOff = 0.0; size_t segProj = 0;
-                    projectOnChain(sup.position, projDist, segProj, localOff);
-                    dist = projDist;
-                    LogMessage(L"Support %s on chain %d: use projected dist=%.3f (pos)", sup.name.GetString(), (int)ci, dist);
-                }
-                if (dist <= 0.0 || dist > total)
-                {
-                    LogMessage(L"Skip support %s on chain %d: invalid dist=%.3f (total=%.3f)", sup.name.GetString(), (int)ci, dist, total);
-                    continue;
-                }
-                size_t segIdx = 0;
-                double local = 0.0;
-                findSegAndOffset(dist, segIdx, local);
-                int dmSegIdx = (int)segIdx;
-                if (dmSegIdx >= pAxis->GetSegCount())
-                    dmSegIdx = pAxis->GetSegCount() - 1;
-                vCS_DM_Seg* pSeg = pAxis->GetSeg(dmSegIdx);
-                if (!pSeg)
-                {
-                    LogMessage(L"Skip support %s on chain %d: pSeg null", sup.name.GetString(), (int)ci);
-                    continue;
-                }
-                double dmSegLen = pSeg->GetStartPoint().distanceTo(pSeg->GetEndPoint());
-                if (dmSegLen < 1e-6 || local < 0.0 || local > dmSegLen)
-                {
-                    LogMessage(L"Skip support %s on chain %d: segLen=%.3f local=%.3f", sup.name.GetString(), (int)ci, dmSegLen, local);
-                    continue;
-                }
-
-                // Пропускаем дубли по смещению
-                bool dupSup = false;
-                for (double used : usedSupportOffsets)
-                    if (fabs(used - local) < 1e-3) { dupSup = true; break; }
-                if (dupSup)
-                {
-                    LogMessage(L"Skip support %s on chain %d: duplicate offset=%.3f", sup.name.GetString(), (int)ci, local);
-                    continue;
-                }
-
-                vCS_DM_Support* pSupport = pSeg->AddSupport(local, st_Support);
-                if (pSupport)
-                {
-                    pSupport->SetDMAxis(pAxis);
-                    pSupport->SetSeg(pSeg);
-                    AcGeVector3d dir = (pSeg->GetEndPoint() - pSeg->GetStartPoint()).normal();
-                    AcGePoint3d base = pSeg->GetStartPoint() + dir * local;
-                    pSupport->SetBasePoint(base);
-                    usedSupportOffsets.push_back(local);
-                    totalSupports++;
-                    LogMessage(L"Support %s created on chain %d seg=%d offset=%.3f base(%.3f,%.3f,%.3f)",
-                        sup.name.GetString(), (int)ci, dmSegIdx, local, base.x, base.y, base.z);
-                }
-                else
-                {
-                    LogMessage(L"Support %s FAILED create on chain %d seg=%d offset=%.3f", sup.name.GetString(), (int)ci, dmSegIdx, local);
-                }
+                ++exhausted;
+                continue;
             }
+            plan.push_back({ e, kind, code });
+        }
 
-            // Инлайны
-            for (const auto& il : inlines)
+        // План пишется всегда, чтобы его можно было проверить до применения
+        const std::wstring planPath = GetTempFilePath(L"KKSAssign.csv");
+        {
+            CReportWriter out(1 << 16);
+            if (out.Open(planPath))
             {
-                // Фильтр по segmentId, если задан: если совпадает — отлично, если нет — пробуем по вхождению имени
-                if (!il.segmentId.IsEmpty())
-                {
-                    bool segMatch = false;
-                    for (auto* s : ch.segs)
-                    {
-                        if (il.segmentId.CompareNoCase(s->segmentId) == 0 || il.segmentId.Find(s->segmentId) >= 0 || s->segmentId.Find(il.segmentId) >= 0)
-                        {
-                            segMatch = true;
-                            break;
-                        }
-                    }
-                    if (!segMatch)
-                    {
-                        // допускаем, но логируем
-                        LogMessage(L"Inline %s on chain %d: segmentId mismatch (%s), placing by projection", il.name.GetString(), (int)ci, il.segmentId.GetString());
-                    }
-                }
-
-                double dist = il.distance;
-                // Если расстояние некорректно — проецируем позицию
-                if (dist <= 0.0 || dist > total)
-                {
-                    double projDist = 0.0, localOff = 0.0; size_t segProj = 0;
-                    projectOnChain(il.position, projDist, segProj, localOff);
-                    dist = projDist;
-                    LogMessage(L"Inline %s on chain %d: use projected dist=%.3f (pos) type=%d", il.name.GetString(), (int)ci, dist, (int)il.type);
-                }
-                if (dist <= 0.0 || dist > total)
-                {
-                    LogMessage(L"Skip inline %s on chain %d: invalid dist=%.3f (total=%.3f)", il.name.GetString(), (int)ci, dist, total);
-                    continue;
-                }
-                size_t segIdx = 0;
-                double local = 0.0;
-                findSegAndOffset(dist, segIdx, local);
-                int dmSegIdx = (int)segIdx;
-                if (dmSegIdx >= pAxis->GetSegCount())
-                    dmSegIdx = pAxis->GetSegCount() - 1;
-                vCS_DM_Seg* pSeg = pAxis->GetSeg(dmSegIdx);
-                if (!pSeg)
-                {
-                    LogMessage(L"Skip inline %s on chain %d: pSeg null", il.name.GetString(), (int)ci);
-                    continue;
-                }
-                double dmSegLen = pSeg->GetStartPoint().distanceTo(pSeg->GetEndPoint());
-                if (dmSegLen < 1e-6 || local < 0.0 || local > dmSegLen)
-                {
-                    LogMessage(L"Skip inline %s on chain %d: segLen=%.3f local=%.3f", il.name.GetString(), (int)ci, dmSegLen, local);
-                    continue;
-                }
-
-                // Убираем дубль инлайна в одной точке
-                bool dupInline = false;
-                for (double used : usedInlineOffsets)
-                {
-                    if (fabs(used - local) < 1e-3)
-                    {
-                        dupInline = true;
-                        break;
-                    }
-                }
-                if (dupInline)
-                {
-                    LogMessage(L"Skip inline %s on chain %d: duplicate offset=%.3f", il.name.GetString(), (int)ci, local);
-                    continue;
-                }
-
-                vCS_DM_InLine* pIL = nullptr;
-                switch (il.type)
-                {
-                case NTLInline::Type::Reducer:
-                    pIL = pSeg->AddInLine(local, (unsigned int)vCSILBase::til_reducer);
-                    if (pIL) pIL->SetIsReducer(true);
-                    break;
-                case NTLInline::Type::Tee:
-                    pIL = pSeg->AddInLine(local, (unsigned int)vCSILBase::til_tee);
-                    if (pIL) pIL->SetIsTee(true);
-                    break;
-                case NTLInline::Type::Inline:
-                default:
-                    pIL = pSeg->AddInLine(local, (unsigned int)vCSILBase::til_inline);
-                    break;
-                }
-                if (pIL)
+                out.Bom();
+                out.Raw("Handle;ClassName;Kind;KKS_PART\n");
+                for (const Assignment& a : plan)
                 {
-                    pIL->SetDMAxis(pAxis);
-                    pIL->SetSeg(pSeg);
-                    AcGeVector3d dir = (pSeg->GetEndPoint() - pSeg->GetStartPoint()).normal();
-                    AcGePoint3d base = pSeg->GetStartPoint() + dir * local;
-                    pIL->SetBasePoint(base);
-                    usedInlineOffsets.push_back(local);
-                    totalInlines++;
-                    LogMessage(L"Inline %s created on chain %d seg=%d offset=%.3f type=%d base(%.3f,%.3f,%.3f)",
-                        il.name.GetString(), (int)ci, dmSegIdx, local, (int)il.type, base.x, base.y, base.z);
-                }
-                else
-                {
-                    LogMessage(L"Inline %s FAILED create on chain %d seg=%d offset=%.3f type=%d", il.name.GetString(), (int)ci, dmSegIdx, local, (int)il.type);
+                    out.Hex(HandleToUInt64(a.entry->id.handle()));
+                    out.Char(';');
+                    out.CsvField(a.entry->className);
+                    out.Char(';');
+                    out.Utf8(KKSItemKindName(a.kind));
+                    out.Char(';');
+                    out.CsvField(a.code);
+                    out.Char('\n');
                 }
+                out.Close();
             }
+        }
+        acutPrintf(L"\n%d codes planned for system %s (%d without free number) -> %s",
+            (int)plan.size(), system.c_str(), exhausted, planPath.c_str());
+        LogMessage(L"kksAssign: planned=%d exhausted=%d used=%d", (int)plan.size(), exhausted,
+            (int)allocator.GetUsedCount());
+
+        acedInitGet(0, L"Yes Preview");
+        res = acedGetKword(L"\nApply [Yes/Preview] <Yes>: ", kw);
+        if (res == RTNORM && wcscmp(kw, L"Preview") == 0)
+            return;
+        if (res != RTNORM && res != RTNONE)
+            return;
 
-            // Один пересчёт на цепочку
-            if (totalSupports > 0 || totalInlines > 0)
+        // Запись пачками: одна транзакция на пачку вместо отдельной на каждый объект
+        const size_t kBatch = 256;
+        int written = 0, failed = 0;
+        for (size_t first = 0; first < plan.size(); first += kBatch)
+        {
+            size_t last = std::min(first + kBatch, plan.size());
+            acdbTransactionManager->startTransaction();
+            for (size_t i = first; i < last; ++i)
             {
-                pDM->ArrPtrEditableAxis_Add(pAxis);
-                pDM->SetDragType(vCS::eReCalculate);
-                Acad::ErrorStatus calcStatus = pDM->ReCalculateModelMain();
-                if (calcStatus == Acad::eOk)
+                if (SetKKSPart(plan[i].entry->id, plan[i].code))
                 {
-                    pDM->End();
-                    pDM->CheckForErase();
-                    pDM->UpdateDBEnt();
+                    ++written;
                 }
                 else
                 {
-                    pDM->End();
+                    ++failed;
+                    LogMessage(L"kksAssign: write fail handle=%llX code=%s",
+                        HandleToUInt64(plan[i].entry->id.handle()), plan[i].code.c_str());
                 }
             }
-            else
-            {
-                pDM->End();
-            }
+            acdbTransactionManager->endTransaction();
         }
 
-        if (totalSupports > 0)
-            acutPrintf(L"\nOK: Added %d supports", totalSupports);
-        if (totalInlines > 0)
-            acutPrintf(L"\nOK: Added %d inlines (valves/reducers/tees)", totalInlines);
+        acutPrintf(L"\nOK: KKS_PART assigned to %d objects, %d failed.", written, failed);
+        LogMessage(L"END kksAssign: written=%d failed=%d", written, failed);
+    }
+    catch (const std::exception& ex)
+    {
+        LogMessage(L"kksAssign std::exception: %hs", ex.what());
+        acutPrintf(L"\nERROR: %hs", ex.what());
+    }
+    catch (...)
+    {
+        LogMessage(L"kksAssign unknown error");
+        acutPrintf(L"\nERROR: Unknown error in kksAssign.");
+    }
+}
 
-        pDM->Clear();
+/**
+ * Несколько отчётов за один проход по модели: таблица арматуры, опоры, оси труб.
+ * Каждая сущность открывается один раз, KKS_PART и экстенты читаются один раз на все отчёты.
+ */
+void modelReports()
+{
+    LogMessage(L"BEGIN modelReports");
+    try
+    {
+        AcDbDatabase* pDb = acdbHostApplicationServices()->workingDatabase();
+        if (!pDb)
+        {
+            acutPrintf(L"\nERROR: No active database.");
+            LogMessage(L"modelReports: no DB");
+            return;
+        }
 
-        acutPrintf(L"\nOK: Import completed. Created %d pipes from %d chains.", successCount, (int)chains.size());
-        LogMessage(L"END importFromNTL - success: created %d pipes", successCount);
+        const std::wstring armaturePath = GetTempFilePath(L"ArmatureTable.csv");
+        const std::wstring supportsPath = GetTempFilePath(L"SupportsTable.csv");
+        const std::wstring axesPath = GetTempFilePath(L"PipeAxes.csv");
+        CArmatureReport armature(armaturePath);
+        CSupportsReport supports(supportsPath);
+        CPipeAxisReport axes(axesPath);
+
+        CModelScanner scanner;
+        scanner.AddVisitor(&armature);
+        scanner.AddVisitor(&supports);
+        scanner.AddVisitor(&axes);
+        // Параметры — через кэш документа: повторный запуск читает только изменённые объекты
+        if (CPipingIndex* pIndex = CPipingIndex::ForDatabase(pDb))
+            scanner.SetParamCache(&pIndex->GetParamCache());
+
+        std::vector<int> failed;
+        DWORD t0 = GetTickCount();
+        if (!scanner.Run(pDb, &failed))
+        {
+            acutPrintf(L"\nERROR: Cannot read model space.");
+            LogMessage(L"modelReports: scan fail");
+            return;
+        }
+        DWORD ms = GetTickCount() - t0;
+
+        const wchar_t* paths[] = { armaturePath.c_str(), supportsPath.c_str(), axesPath.c_str() };
+        for (int idx : failed)
+        {
+            acutPrintf(L"\nERROR: Cannot write file: %s", paths[idx]);
+            LogMessage(L"modelReports: write fail %s", paths[idx]);
+        }
+
+        acutPrintf(L"\n%s: %d entities opened once in %u ms", failed.empty() ? L"OK" : L"WARNING",
+            scanner.GetOpenedCount(), (unsigned)ms);
+        acutPrintf(L"\n  armature: %d -> %s", armature.GetExportedCount(), armaturePath.c_str());
+        acutPrintf(L"\n  supports: %d -> %s", supports.GetCount(), supportsPath.c_str());
+        acutPrintf(L"\n  pipe axes: %d -> %s", (int)axes.GetAxisCount(), axesPath.c_str());
+        LogMessage(L"END modelReports: opened=%d armature=%d supports=%d axes=%d failed=%d ms=%u",
+            scanner.GetOpenedCount(), armature.GetExportedCount(), supports.GetCount(),
+            (int)axes.GetAxisCount(), (int)failed.size(), (unsigned)ms);
     }
     catch (const std::exception& ex)
     {
-        LogMessage(L"std::exception in importFromNTL: %hs", ex.what());
+        LogMessage(L"modelReports std::exception: %hs", ex.what());
         acutPrintf(L"\nERROR: %hs", ex.what());
     }
     catch (...)
     {
-        LogMessage(L"Unknown error in importFromNTL");
-        acutPrintf(L"\nERROR: Unknown error occurred during import.");
+        LogMessage(L"modelReports unknown error");
+        acutPrintf(L"\nERROR: Unknown error in modelReports.");
     }
 }
 
@@ -1379,19 +3746,76 @@ extern "C" __declspec(dllexport) AcRx::AppRetCode ncrxEntryPoint(AcRx::AppMsgCod
             L"_CREATETESTPIPE", L"CREATETESTPIPE",
             ACRX_CMD_MODAL, createTestPipe);
 
+        // Регистрируем команду нагрузочной модели
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_STRESSPIPES", L"STRESSPIPES",
+            ACRX_CMD_MODAL, stressPipes);
+
+        // Регистрируем команду записи и проигрывания трассы DragManager
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_DMTRACE", L"DMTRACE",
+            ACRX_CMD_MODAL, dmTrace);
+
         // Регистрируем команду для импорта из NTL файла
         acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
             L"_IMPORTNTL", L"IMPORTNTL",
             ACRX_CMD_MODAL, importFromNTL);
 
+        // Регистрируем команду предпросмотра NTL перед импортом
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_PREVIEWNTL", L"PREVIEWNTL",
+            ACRX_CMD_MODAL, previewNTL);
+
+        // Регистрируем вторую стадию поэтапного импорта NTL
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_NTLFITTINGS", L"NTLFITTINGS",
+            ACRX_CMD_MODAL, ntlFittings);
+
+        // Регистрируем команду настройки импорта NTL
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_NTLIMPORTOPTIONS", L"NTLIMPORTOPTIONS",
+            ACRX_CMD_MODAL, ntlImportOptions);
+
+        // Регистрируем замер склейки сегментов импорта
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_NTLMERGEBENCH", L"NTLMERGEBENCH",
+            ACRX_CMD_MODAL, ntlMergeBenchmark);
+
         // Регистрируем команду для экспорта арматуры в CSV
         acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
             L"_EXPORTARMATURE", L"EXPORTARMATURE",
             ACRX_CMD_MODAL, exportArmatureTable);
+
+        // Регистрируем команду настройки формата экспорта арматуры
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_ARMEXPORTOPTIONS", L"ARMEXPORTOPTIONS",
+            ACRX_CMD_MODAL, armatureExportOptions);
+
+        // Регистрируем команду сводки по кодам KKS
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_KKSREPORT", L"KKSREPORT",
+            ACRX_CMD_MODAL, kksReport);
+
+        // Регистрируем команду массового присвоения KKS
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_KKSASSIGN", L"KKSASSIGN",
+            ACRX_CMD_MODAL, kksAssign);
+
+        // Регистрируем команду отчётов по модели за один проход
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_MODELREPORTS", L"MODELREPORTS",
+            ACRX_CMD_MODAL, modelReports);
+
+        // Регистрируем команду сверки NTL с чертежом
+        acedRegCmds->addCommand(L"PIPE_TEST_GROUP",
+            L"_NTLRECONCILE", L"NTLRECONCILE",
+            ACRX_CMD_MODAL, reconcileNTL);
         break;
 
     case AcRx::kUnloadAppMsg:
         acedRegCmds->removeGroup(L"PIPE_TEST_GROUP");
+        CPipingIndex::ReleaseAll();
+        CNTLStagedImport::ReleaseAll();
         break;
     }
     return AcRx::kRetOK;
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+#include "ImportProgress.h"
+#include "aced.h"
+
+namespace
+{
+const DWORD kDrawIntervalMs = 100;
+const DWORD kPollIntervalMs = 50;
+} // namespace
+
+CImportProgress::CImportProgress(const wchar_t* operation)
+    : m_operation(operation ? operation : L"")
+{
+}
+
+CImportProgress::~CImportProgress()
+{
+    EndPhase();
+}
+
+void CImportProgress::BeginPhase(const wchar_t* phase, int total)
+{
+    EndPhase();
+    m_total = total > 0 ? total : 0;
+    m_pos = 0;
+    std::wstring label = m_operation + L": " + (phase ? phase : L"");
+    m_meter = acedSetStatusBarProgressMeter(label.c_str(), 0, m_total > 0 ? m_total : 1) == 0;
+    m_lastDraw = GetTickCount();
+}
+
+void CImportProgress::Step(int count)
+{
+    m_pos += count;
+    if (!m_meter)
+        return;
+    DWORD now = GetTickCount();
+    if (now - m_lastDraw < kDrawIntervalMs && m_pos < m_total)
+        return;
+    m_lastDraw = now;
+    acedSetStatusBarProgressMeterPos(m_pos < m_total ? m_pos : m_total);
+}
+
+void CImportProgress::EndPhase()
+{
+    if (!m_meter)
+        return;
+    acedRestoreStatusBar();
+    m_meter = false;
+}
+
+bool CImportProgress::IsCancelled()
+{
+    if (m_cancelled)
+        return true;
+    DWORD now = GetTickCount();
+    if (now - m_lastPoll < kPollIntervalMs)
+        return false;
+    m_lastPoll = now;
+    m_cancelled = acedUsrBrk() != 0;
+    return m_cancelled;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+// Прогресс длинной операции по фазам: индикатор в строке состояния и опрос Esc.
+// Индикатор и клавиатура опрашиваются не чаще заданных интервалов, поэтому Step()
+// и IsCancelled() можно вызывать на каждом элементе.
+class CImportProgress
+{
+public:
+    explicit CImportProgress(const wchar_t* operation);
+    ~CImportProgress();     // восстанавливает строку состояния
+
+    void BeginPhase(const wchar_t* phase, int total);
+    void Step(int count = 1);
+    void EndPhase();
+
+    // Esc нажат; после первого «да» результат запоминается
+    bool IsCancelled();
+
+private:
+    std::wstring m_operation;
+    int m_total = 0;
+    int m_pos = 0;
+    bool m_meter = false;
+    bool m_cancelled = false;
+    DWORD m_lastDraw = 0;
+    DWORD m_lastPoll = 0;
+};
+
+// Квант времени для работы с DragManager: порция прерывается по истечении кванта,
+// чтобы пересчёт и опрос Esc происходили регулярно. 0 — без ограничения.
+class CTimeSlice
+{
+public:
+    explicit CTimeSlice(DWORD ms) : m_ms(ms), m_start(GetTickCount()) {}
+
+    bool Expired() const { return m_ms != 0 && GetTickCount() - m_start >= m_ms; }
+
+private:
+    DWORD m_ms;
+    DWORD m_start;
+};
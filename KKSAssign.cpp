@@ -0,0 +1,240 @@
+#include "stdafx.h"
+#include "KKSAssign.h"
+#include "KKSIndex.h"
+#include <fstream>
+#include <cwchar>
+#include <cwctype>
+
+namespace
+{
+std::wstring Trim(const std::wstring& s)
+{
+    size_t b = 0, e = s.size();
+    while (b < e && iswspace(s[b]))
+        ++b;
+    while (e > b && iswspace(s[e - 1]))
+        --e;
+    return s.substr(b, e - b);
+}
+
+bool ParseKind(const std::wstring& s, KKSItemKind& kind)
+{
+    if (_wcsicmp(s.c_str(), L"Valve") == 0)
+        kind = KKSItemKind::Valve;
+    else if (_wcsicmp(s.c_str(), L"Fitting") == 0)
+        kind = KKSItemKind::Fitting;
+    else if (_wcsicmp(s.c_str(), L"Support") == 0)
+        kind = KKSItemKind::Support;
+    else
+        return false;
+    return true;
+}
+
+bool ParseUnsigned(const std::wstring& s, unsigned& value)
+{
+    if (s.empty())
+        return false;
+    wchar_t* end = nullptr;
+    unsigned long v = wcstoul(s.c_str(), &end, 10);
+    if (!end || *end != L'\0')
+        return false;
+    value = (unsigned)v;
+    return true;
+}
+
+// Длина совпадения маски с системой: -1 — не подходит
+int MatchSystemMask(const std::wstring& mask, const std::wstring& system)
+{
+    if (mask == L"*")
+        return 0;
+    if (!mask.empty() && mask.back() == L'*')
+    {
+        size_t n = mask.size() - 1;
+        return system.compare(0, n, mask, 0, n) == 0 ? (int)n : -1;
+    }
+    return mask == system ? (int)mask.size() + 1 : -1; // точное совпадение сильнее префикса той же длины
+}
+} // namespace
+
+const wchar_t* KKSItemKindName(KKSItemKind kind)
+{
+    switch (kind)
+    {
+    case KKSItemKind::Fitting:
+        return L"Fitting";
+    case KKSItemKind::Support:
+        return L"Support";
+    case KKSItemKind::Valve:
+    default:
+        return L"Valve";
+    }
+}
+
+CKKSTemplateSet::CKKSTemplateSet()
+{
+    AddDefaults();
+}
+
+void CKKSTemplateSet::AddDefaults()
+{
+    KKSTemplateRule rule;
+    rule.systemMask = L"*";
+    rule.kind = KKSItemKind::Valve;
+    rule.pattern = L"AA{N:3}";
+    AddRule(rule);
+    rule.kind = KKSItemKind::Fitting;
+    rule.pattern = L"BR{N:3}";
+    AddRule(rule);
+    rule.kind = KKSItemKind::Support;
+    rule.pattern = L"BQ{N:3}";
+    AddRule(rule);
+}
+
+bool CKKSTemplateSet::LoadFile(const std::wstring& path, std::wstring& error)
+{
+    error.clear();
+    std::wifstream in(path);
+    if (!in)
+    {
+        error = L"cannot open " + path;
+        return false;
+    }
+
+    std::vector<KKSTemplateRule> rules;
+    std::wstring line;
+    int lineNo = 0;
+    while (std::getline(in, line))
+    {
+        ++lineNo;
+        size_t hash = line.find(L'#');
+        if (hash != std::wstring::npos)
+            line.erase(hash);
+        line = Trim(line);
+        if (line.empty())
+            continue;
+
+        std::vector<std::wstring> fields;
+        size_t pos = 0;
+        for (;;)
+        {
+            size_t sep = line.find(L';', pos);
+            fields.push_back(Trim(line.substr(pos, sep == std::wstring::npos ? std::wstring::npos : sep - pos)));
+            if (sep == std::wstring::npos)
+                break;
+            pos = sep + 1;
+        }
+
+        KKSTemplateRule rule;
+        bool ok = fields.size() >= 3 && fields.size() <= 5 && ParseKind(fields[1], rule.kind);
+        if (ok)
+        {
+            // Шаблон обязан содержать счётчик, иначе все объекты получили бы один код
+            rule.pattern = NormalizeKKS(fields[2]);
+            ok = !rule.pattern.empty() && ExpandKKSPattern(rule.pattern, 0) != rule.pattern;
+        }
+        if (ok && fields.size() >= 4)
+            ok = ParseUnsigned(fields[3], rule.start);
+        if (ok && fields.size() == 5)
+            ok = ParseUnsigned(fields[4], rule.step) && rule.step > 0;
+        if (!ok)
+        {
+            error = path + L"(" + std::to_wstring(lineNo) + L"): bad rule '" + line + L"'";
+            return false;
+        }
+        rule.systemMask = fields[0] == L"*" ? fields[0] : NormalizeKKS(fields[0]);
+        if (!fields[0].empty() && fields[0].back() == L'*' && rule.systemMask.back() != L'*')
+            rule.systemMask.push_back(L'*');
+        rules.push_back(rule);
+    }
+
+    if (rules.empty())
+    {
+        error = path + L": no rules";
+        return false;
+    }
+    m_rules.insert(m_rules.end(), rules.begin(), rules.end());
+    return true;
+}
+
+const KKSTemplateRule* CKKSTemplateSet::Find(const std::wstring& system, KKSItemKind kind) const
+{
+    const KKSTemplateRule* best = nullptr;
+    int bestLen = -1;
+    for (const KKSTemplateRule& r : m_rules)
+    {
+        if (r.kind != kind)
+            continue;
+        int len = MatchSystemMask(r.systemMask, system);
+        if (len >= bestLen) // при равной маске побеждает правило, добавленное позже
+        {
+            best = &r;
+            bestLen = len;
+        }
+    }
+    return best;
+}
+
+std::wstring ExpandKKSPattern(const std::wstring& pattern, unsigned counter)
+{
+    std::wstring out;
+    out.reserve(pattern.size() + 4);
+    size_t pos = 0;
+    while (pos < pattern.size())
+    {
+        size_t open = pattern.find(L"{N", pos);
+        if (open == std::wstring::npos)
+            break;
+        size_t close = pattern.find(L'}', open);
+        if (close == std::wstring::npos)
+            break;
+        out.append(pattern, pos, open - pos);
+
+        unsigned width = 0;
+        if (pattern[open + 2] == L':')
+            width = (unsigned)_wtoi(pattern.c_str() + open + 3);
+        std::wstring digits = std::to_wstring(counter);
+        if (width > 0 && digits.size() > width)
+            return std::wstring(); // не помещается в поле
+        if (digits.size() < width)
+            out.append(width - digits.size(), L'0');
+        out += digits;
+        pos = close + 1;
+    }
+    out.append(pattern, pos, std::wstring::npos);
+    return out;
+}
+
+void CKKSCodeAllocator::AddExisting(const std::wstring& code)
+{
+    std::wstring n = NormalizeKKS(code);
+    if (!n.empty())
+        m_used.insert(std::move(n));
+}
+
+bool CKKSCodeAllocator::IsUsed(const std::wstring& code) const
+{
+    return m_used.count(NormalizeKKS(code)) != 0;
+}
+
+std::wstring CKKSCodeAllocator::Allocate(const std::wstring& system, const KKSTemplateRule& rule)
+{
+    const std::wstring key = system + L"|" + rule.pattern;
+    auto it = m_next.find(key);
+    if (it == m_next.end())
+        it = m_next.emplace(key, rule.start).first;
+
+    // Занятые номера пропускаются; каждая проверка — поиск в хеш-множестве
+    for (unsigned counter = it->second; counter >= it->second; counter += rule.step)
+    {
+        std::wstring aggregate = ExpandKKSPattern(rule.pattern, counter);
+        if (aggregate.empty())
+            break;
+        std::wstring code = system + aggregate;
+        if (m_used.insert(code).second)
+        {
+            it->second = counter + rule.step;
+            return code;
+        }
+    }
+    return std::wstring();
+}
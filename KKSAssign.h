@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+
+// Вид объекта для выбора шаблона кода
+enum class KKSItemKind
+{
+    Valve,      // арматура
+    Fitting,    // переходы, тройники, отводы
+    Support     // опоры
+};
+
+const wchar_t* KKSItemKindName(KKSItemKind kind);
+
+// Правило генерации: код = система + шаблон агрегата.
+// В шаблоне {N:k} — счётчик, дополненный нулями до k знаков, {N} — без дополнения.
+struct KKSTemplateRule
+{
+    std::wstring systemMask;    // "10LBA10", "10LB*" или "*"
+    KKSItemKind kind = KKSItemKind::Valve;
+    std::wstring pattern;       // например, "AA{N:3}"
+    unsigned start = 1;         // первое значение счётчика
+    unsigned step = 1;          // шаг счётчика
+};
+
+// Набор правил по системам. Файл правил — текст, по правилу в строке:
+//   маска_системы;Valve|Fitting|Support;шаблон[;начало[;шаг]]
+// '#' — комментарий. Правила по умолчанию:
+//   *;Valve;AA{N:3}   *;Fitting;BR{N:3}   *;Support;BQ{N:3}
+// Правила из файла добавляются после них и при равной маске имеют приоритет.
+class CKKSTemplateSet
+{
+public:
+    CKKSTemplateSet();
+
+    void Clear() { m_rules.clear(); }
+    void AddRule(const KKSTemplateRule& rule) { m_rules.push_back(rule); }
+    void AddDefaults();
+
+    // Загрузить правила из файла. false — файла нет или в нём ошибка (правила не меняются);
+    // error — описание первой ошибки.
+    bool LoadFile(const std::wstring& path, std::wstring& error);
+
+    // Правило для системы и вида объекта: побеждает самая длинная подходящая маска
+    const KKSTemplateRule* Find(const std::wstring& system, KKSItemKind kind) const;
+
+    size_t GetRuleCount() const { return m_rules.size(); }
+
+private:
+    std::vector<KKSTemplateRule> m_rules;
+};
+
+// Подстановка счётчика в шаблон; пусто, если значение не помещается в {N:k}
+std::wstring ExpandKKSPattern(const std::wstring& pattern, unsigned counter);
+
+// Раздача уникальных кодов. Занятые коды собираются в хеш-множество одним проходом
+// по модели (AddExisting), дальше проверка уникальности — O(1) на код без повторного
+// сканирования чертежа. Счётчики ведутся по паре (система, шаблон).
+class CKKSCodeAllocator
+{
+public:
+    void AddExisting(const std::wstring& code);
+    bool IsUsed(const std::wstring& code) const;
+    size_t GetUsedCount() const { return m_used.size(); }
+
+    // Следующий свободный код системы по правилу; пусто, если счётчик исчерпан
+    std::wstring Allocate(const std::wstring& system, const KKSTemplateRule& rule);
+
+private:
+    std::unordered_set<std::wstring> m_used;             // нормализованные коды
+    std::unordered_map<std::wstring, unsigned> m_next;   // система + шаблон -> следующее значение
+};
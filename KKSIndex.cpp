@@ -0,0 +1,360 @@
+#include "stdafx.h"
+#include "KKSIndex.h"
+#include <algorithm>
+#include <cwctype>
+
+namespace
+{
+bool IsKksDigit(wchar_t c)
+{
+    return c >= L'0' && c <= L'9';
+}
+
+bool IsKksLetter(wchar_t c)
+{
+    return c >= L'A' && c <= L'Z';
+}
+
+// Длина серии символов, удовлетворяющих pred, начиная с pos (не больше maxLen)
+template <class Pred>
+size_t RunLength(const std::wstring& s, size_t pos, size_t maxLen, Pred pred)
+{
+    size_t n = 0;
+    while (pos + n < s.size() && n < maxLen && pred(s[pos + n]))
+        ++n;
+    return n;
+}
+} // namespace
+
+std::wstring NormalizeKKS(const std::wstring& raw)
+{
+    std::wstring out;
+    out.reserve(raw.size());
+    for (wchar_t c : raw)
+    {
+        if (c == L' ' || c == L'\t' || c == L'.' || c == L'-' || c == L'_')
+            continue;
+        if (c == L'=' && out.empty())
+            continue; // префикс технологического обозначения
+        out.push_back((wchar_t)towupper(c));
+    }
+    return out;
+}
+
+bool ParseKKS(const std::wstring& raw, KKSCode& out)
+{
+    out.normalized = NormalizeKKS(raw);
+    out.levelCount = 0;
+    std::fill(out.levelEnd, out.levelEnd + KKSCode::kLevels, (size_t)0);
+
+    const std::wstring& s = out.normalized;
+    if (s.empty())
+        return false;
+
+    // Уровень 0: цифры блока; последняя цифра перед буквами — F0 системного кода
+    size_t pos = RunLength(s, 0, s.size(), IsKksDigit);
+    out.levelEnd[0] = pos > 0 ? pos - 1 : 0;
+
+    // Уровень 1: F1F2F3 (3 буквы) + FN (2 цифры)
+    size_t letters = RunLength(s, pos, 3, IsKksLetter);
+    size_t digits = letters == 3 ? RunLength(s, pos + 3, 2, IsKksDigit) : 0;
+    if (letters != 3 || digits != 2)
+        return false;
+    pos += 5;
+    out.levelEnd[1] = pos;
+    out.levelCount = 2;
+
+    // Уровень 2: A1A2 (2 буквы) + AN (3 цифры) [+ A3]
+    letters = RunLength(s, pos, 2, IsKksLetter);
+    digits = letters == 2 ? RunLength(s, pos + 2, 3, IsKksDigit) : 0;
+    if (letters != 2 || digits != 3)
+        return true;
+    pos += 5;
+    // A3 есть, если за номером идёт 1 буква (конец кода) или 3 буквы (A3 + B1B2)
+    size_t tail = RunLength(s, pos, 4, IsKksLetter);
+    if (tail == 1 || tail == 3)
+        ++pos;
+    out.levelEnd[2] = pos;
+    out.levelCount = 3;
+
+    // Уровень 3: B1B2 (2 буквы) + BN (2 цифры)
+    letters = RunLength(s, pos, 2, IsKksLetter);
+    digits = letters == 2 ? RunLength(s, pos + 2, 2, IsKksDigit) : 0;
+    if (letters != 2 || digits != 2)
+        return true;
+    out.levelEnd[3] = pos + 4;
+    out.levelCount = 4;
+    return true;
+}
+
+CKKSTrie::CKKSTrie()
+{
+    Clear();
+}
+
+void CKKSTrie::Clear()
+{
+    m_nodes.clear();
+    m_pool.clear();
+    m_values.clear();
+    m_valueNext.clear();
+    m_nodes.push_back(Node()); // корень
+}
+
+uint32_t CKKSTrie::NewNode(uint32_t labelOff, uint32_t labelLen)
+{
+    Node n;
+    n.labelOff = labelOff;
+    n.labelLen = labelLen;
+    m_nodes.push_back(n);
+    return (uint32_t)(m_nodes.size() - 1);
+}
+
+uint32_t CKKSTrie::FindChild(uint32_t node, wchar_t c) const
+{
+    for (uint32_t ch = m_nodes[node].firstChild; ch != kNone; ch = m_nodes[ch].nextSibling)
+    {
+        wchar_t first = m_pool[m_nodes[ch].labelOff];
+        if (first == c)
+            return ch;
+        if (first > c)
+            break; // дети упорядочены по первому символу
+    }
+    return kNone;
+}
+
+void CKKSTrie::AddChild(uint32_t parent, uint32_t child)
+{
+    wchar_t c = m_pool[m_nodes[child].labelOff];
+    uint32_t* link = &m_nodes[parent].firstChild;
+    while (*link != kNone && m_pool[m_nodes[*link].labelOff] < c)
+        link = &m_nodes[*link].nextSibling;
+    m_nodes[child].nextSibling = *link;
+    *link = child;
+}
+
+uint32_t CKKSTrie::SplitEdge(uint32_t parent, uint32_t node, uint32_t first)
+{
+    uint32_t mid = NewNode(m_nodes[node].labelOff, first);
+    Node& m = m_nodes[mid];
+    Node& n = m_nodes[node];
+    m.count = n.count;
+    m.firstChild = node;
+    m.nextSibling = n.nextSibling;
+    n.nextSibling = kNone;
+    n.labelOff += first;
+    n.labelLen -= first;
+
+    // Промежуточный узел занимает место node в списке детей родителя
+    uint32_t* link = &m_nodes[parent].firstChild;
+    while (*link != node)
+        link = &m_nodes[*link].nextSibling;
+    *link = mid;
+    return mid;
+}
+
+void CKKSTrie::Insert(const KKSCode& code, uint32_t value)
+{
+    const std::wstring& s = code.normalized;
+    if (s.empty())
+        return;
+
+    // Метки рёбер ссылаются на копию кода в общем пуле
+    const uint32_t off = (uint32_t)m_pool.size();
+    m_pool.insert(m_pool.end(), s.begin(), s.end());
+    const uint32_t len = (uint32_t)s.size();
+
+    // Границы уровней: в этих точках обязательно будет узел
+    uint32_t bounds[KKSCode::kLevels + 1];
+    int boundLevel[KKSCode::kLevels + 1];
+    int boundCount = 0;
+    for (int l = 0; l < code.levelCount; ++l)
+    {
+        if (code.levelEnd[l] > 0 && (boundCount == 0 || bounds[boundCount - 1] < code.levelEnd[l]))
+        {
+            bounds[boundCount] = (uint32_t)code.levelEnd[l];
+            boundLevel[boundCount++] = l;
+        }
+    }
+    bounds[boundCount] = len;
+    boundLevel[boundCount] = -1;
+
+    uint32_t node = 0;
+    uint32_t pos = 0;
+    int nextBound = 0;
+    m_nodes[0].count++;
+    while (pos < len)
+    {
+        while (bounds[nextBound] <= pos)
+            ++nextBound;
+        const uint32_t stop = bounds[nextBound];
+
+        uint32_t child = FindChild(node, s[pos]);
+        if (child == kNone)
+        {
+            child = NewNode(off + pos, stop - pos);
+            AddChild(node, child);
+            pos = stop;
+        }
+        else
+        {
+            const Node& c = m_nodes[child];
+            uint32_t limit = std::min(c.labelLen, stop - pos);
+            uint32_t k = 1;
+            while (k < limit && m_pool[c.labelOff + k] == s[pos + k])
+                ++k;
+            if (k < c.labelLen)
+                child = SplitEdge(node, child, k);
+            pos += k;
+        }
+        node = child;
+        m_nodes[node].count++;
+        if (pos == bounds[nextBound] && boundLevel[nextBound] >= 0)
+            m_nodes[node].levelMask |= (uint8_t)(1u << boundLevel[nextBound]);
+    }
+
+    m_values.push_back(value);
+    m_valueNext.push_back(m_nodes[node].firstValue);
+    m_nodes[node].firstValue = (uint32_t)(m_values.size() - 1);
+}
+
+uint32_t CKKSTrie::Locate(const std::wstring& prefix, std::wstring& path) const
+{
+    const std::wstring p = NormalizeKKS(prefix);
+    path.clear();
+    uint32_t node = 0;
+    size_t pos = 0;
+    while (pos < p.size())
+    {
+        uint32_t child = FindChild(node, p[pos]);
+        if (child == kNone)
+            return kNone;
+        const Node& c = m_nodes[child];
+        size_t limit = std::min((size_t)c.labelLen, p.size() - pos);
+        for (size_t k = 1; k < limit; ++k)
+        {
+            if (m_pool[c.labelOff + k] != p[pos + k])
+                return kNone;
+        }
+        path.append(&m_pool[c.labelOff], c.labelLen);
+        pos += limit;
+        node = child;
+    }
+    return node;
+}
+
+void CKKSTrie::Collect(uint32_t node, std::vector<uint32_t>& out) const
+{
+    std::vector<uint32_t> stack(1, node);
+    while (!stack.empty())
+    {
+        uint32_t n = stack.back();
+        stack.pop_back();
+        for (uint32_t v = m_nodes[n].firstValue; v != kNone; v = m_valueNext[v])
+            out.push_back(m_values[v]);
+        for (uint32_t ch = m_nodes[n].firstChild; ch != kNone; ch = m_nodes[ch].nextSibling)
+            stack.push_back(ch);
+    }
+}
+
+size_t CKKSTrie::CountPrefix(const std::wstring& prefix) const
+{
+    std::wstring path;
+    uint32_t node = Locate(prefix, path);
+    return node == kNone ? 0 : m_nodes[node].count;
+}
+
+void CKKSTrie::FindPrefix(const std::wstring& prefix, std::vector<uint32_t>& out) const
+{
+    std::wstring path;
+    uint32_t node = Locate(prefix, path);
+    if (node != kNone)
+        Collect(node, out);
+}
+
+void CKKSTrie::LevelCounts(int level, const std::wstring& prefix,
+    std::vector<std::pair<std::wstring, size_t>>& out) const
+{
+    std::wstring path;
+    uint32_t start = Locate(prefix, path);
+    if (start == kNone || level < 0 || level >= KKSCode::kLevels)
+        return;
+
+    // Обход в глубину в лексикографическом порядке; path — строка до текущего узла
+    struct Item
+    {
+        uint32_t node;
+        size_t depth;
+    };
+    const uint8_t bit = (uint8_t)(1u << level);
+    std::vector<Item> stack(1, Item{ start, path.size() });
+    std::vector<uint32_t> children;
+    bool first = true;
+    while (!stack.empty())
+    {
+        Item it = stack.back();
+        stack.pop_back();
+        const Node& n = m_nodes[it.node];
+        if (!first)
+        {
+            path.resize(it.depth);
+            path.append(&m_pool[n.labelOff], n.labelLen);
+        }
+        first = false;
+
+        if (n.levelMask & bit)
+        {
+            out.emplace_back(path, n.count);
+            continue; // глубже — уже следующие уровни
+        }
+        children.clear();
+        for (uint32_t ch = n.firstChild; ch != kNone; ch = m_nodes[ch].nextSibling)
+            children.push_back(ch);
+        for (auto ch = children.rbegin(); ch != children.rend(); ++ch)
+            stack.push_back(Item{ *ch, path.size() });
+    }
+}
+
+void CKKSTrie::Duplicates(const std::wstring& prefix,
+    std::vector<std::pair<std::wstring, std::vector<uint32_t>>>& out) const
+{
+    std::wstring path;
+    uint32_t start = Locate(prefix, path);
+    if (start == kNone)
+        return;
+
+    struct Item
+    {
+        uint32_t node;
+        size_t depth;
+    };
+    std::vector<Item> stack(1, Item{ start, path.size() });
+    std::vector<uint32_t> children;
+    bool first = true;
+    while (!stack.empty())
+    {
+        Item it = stack.back();
+        stack.pop_back();
+        const Node& n = m_nodes[it.node];
+        if (!first)
+        {
+            path.resize(it.depth);
+            path.append(&m_pool[n.labelOff], n.labelLen);
+        }
+        first = false;
+
+        if (n.firstValue != kNone && m_valueNext[n.firstValue] != kNone)
+        {
+            std::vector<uint32_t> values;
+            for (uint32_t v = n.firstValue; v != kNone; v = m_valueNext[v])
+                values.push_back(m_values[v]);
+            std::reverse(values.begin(), values.end()); // в порядке добавления
+            out.emplace_back(path, std::move(values));
+        }
+        children.clear();
+        for (uint32_t ch = n.firstChild; ch != kNone; ch = m_nodes[ch].nextSibling)
+            children.push_back(ch);
+        for (auto ch = children.rbegin(); ch != children.rend(); ++ch)
+            stack.push_back(Item{ *ch, path.size() });
+    }
+}
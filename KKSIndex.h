@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Разобранный код KKS.
+// Пример: "10LBA10AA001KA01"
+//   уровень 0 (блок/установка):      "1"
+//   уровень 1 (система, F0 F1F2F3 FN): "0LBA10"   -> префикс "10LBA10"
+//   уровень 2 (агрегат, A1A2 AN A3):   "AA001"    -> префикс "10LBA10AA001"
+//   уровень 3 (элемент, B1B2 BN):      "KA01"     -> префикс "10LBA10AA001KA01"
+// Разделители (пробелы, '.', '-', '_', ведущий '=') отбрасываются, буквы приводятся к верхнему регистру.
+struct KKSCode
+{
+    static const int kLevels = 4;
+
+    std::wstring normalized;
+    int levelCount = 0;                 // сколько уровней удалось распознать
+    size_t levelEnd[kLevels] = { 0 };   // длина префикса normalized, включающего уровень
+
+    // Префикс кода до уровня level включительно (пусто, если уровень не распознан)
+    std::wstring Prefix(int level) const
+    {
+        return level < levelCount ? normalized.substr(0, levelEnd[level]) : std::wstring();
+    }
+};
+
+// Нормализация кода/префикса для сравнения
+std::wstring NormalizeKKS(const std::wstring& raw);
+
+// Разбор кода по уровням; false — код пустой или не начинается с системного кода
+bool ParseKKS(const std::wstring& raw, KKSCode& out);
+
+// Сжатое префиксное дерево (radix tree) по нормализованным кодам KKS.
+// Каждый узел хранит число кодов в поддереве, поэтому подсчёт по префиксу — O(длина префикса),
+// а границы уровней отмечены в узлах — счётчики по системам/агрегатам и дубликаты
+// получаются одним обходом.
+class CKKSTrie
+{
+public:
+    CKKSTrie();
+
+    void Clear();
+
+    // Добавить код; value — произвольный индекс вызывающей стороны (например, номер записи)
+    void Insert(const KKSCode& code, uint32_t value);
+
+    size_t GetCodeCount() const { return m_nodes[0].count; }
+    size_t GetNodeCount() const { return m_nodes.size(); }
+
+    // Число кодов с данным префиксом (префикс нормализуется)
+    size_t CountPrefix(const std::wstring& prefix) const;
+
+    // Все value кодов с данным префиксом
+    void FindPrefix(const std::wstring& prefix, std::vector<uint32_t>& out) const;
+
+    // Счётчики по уровню (1 — системы, 2 — агрегаты...) внутри префикса
+    void LevelCounts(int level, const std::wstring& prefix,
+        std::vector<std::pair<std::wstring, size_t>>& out) const;
+
+    // Полные коды, встречающиеся более одного раза, внутри префикса
+    void Duplicates(const std::wstring& prefix,
+        std::vector<std::pair<std::wstring, std::vector<uint32_t>>>& out) const;
+
+private:
+    static const uint32_t kNone = 0xFFFFFFFFu;
+
+    struct Node
+    {
+        uint32_t labelOff = 0;      // метка ребра от родителя: m_pool[labelOff, labelOff + labelLen)
+        uint32_t labelLen = 0;
+        uint32_t firstChild = kNone;
+        uint32_t nextSibling = kNone;
+        uint32_t count = 0;         // кодов в поддереве
+        uint32_t firstValue = kNone; // список value кодов, заканчивающихся в узле
+        uint8_t levelMask = 0;      // узел — граница уровня (бит = номер уровня)
+    };
+
+    uint32_t NewNode(uint32_t labelOff, uint32_t labelLen);
+    uint32_t FindChild(uint32_t node, wchar_t c) const;
+    void AddChild(uint32_t parent, uint32_t child);
+    // Разрезать ребро к узлу node после first символов метки; возвращает новый промежуточный узел
+    uint32_t SplitEdge(uint32_t parent, uint32_t node, uint32_t first);
+    // Найти узел, покрывающий префикс; path — накопленная строка до узла
+    uint32_t Locate(const std::wstring& prefix, std::wstring& path) const;
+    void Collect(uint32_t node, std::vector<uint32_t>& out) const;
+
+    std::vector<Node> m_nodes;
+    std::vector<wchar_t> m_pool;
+    std::vector<uint32_t> m_values;
+    std::vector<uint32_t> m_valueNext;
+};
@@ -0,0 +1,138 @@
+#include "stdafx.h"
+#include "MemAccounting.h"
+#include <atomic>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+namespace
+{
+struct PhaseCounters
+{
+    std::atomic<uint64_t> allocBytes{ 0 };
+    std::atomic<uint64_t> allocCount{ 0 };
+    std::atomic<int64_t> liveBytes{ 0 };
+    std::atomic<int64_t> peakLiveBytes{ 0 };
+    std::atomic<int64_t> processDelta{ 0 };
+    std::atomic<uint64_t> processPeak{ 0 };
+};
+
+PhaseCounters g_phases[(size_t)MemPhase::Count];
+std::atomic<int64_t> g_totalLive{ 0 };
+std::atomic<int64_t> g_totalPeak{ 0 };
+thread_local MemPhase t_current = MemPhase::Other;
+
+template <typename T>
+void RaiseTo(std::atomic<T>& peak, T value)
+{
+    T prev = peak.load(std::memory_order_relaxed);
+    while (prev < value && !peak.compare_exchange_weak(prev, value, std::memory_order_relaxed))
+    {
+    }
+}
+} // namespace
+
+const wchar_t* MemPhaseName(MemPhase phase)
+{
+    switch (phase)
+    {
+    case MemPhase::Other: return L"other";
+    case MemPhase::Parse: return L"parse";
+    case MemPhase::Merge: return L"merge";
+    case MemPhase::Chaining: return L"chaining";
+    case MemPhase::PipeCreation: return L"pipes";
+    case MemPhase::Placement: return L"placement";
+    default: return L"?";
+    }
+}
+
+void CMemAccounting::OnAlloc(MemPhase phase, size_t bytes)
+{
+    PhaseCounters& c = g_phases[(size_t)phase];
+    c.allocBytes.fetch_add(bytes, std::memory_order_relaxed);
+    c.allocCount.fetch_add(1, std::memory_order_relaxed);
+    RaiseTo(c.peakLiveBytes, c.liveBytes.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes);
+    RaiseTo(g_totalPeak, g_totalLive.fetch_add((int64_t)bytes, std::memory_order_relaxed) + (int64_t)bytes);
+}
+
+void CMemAccounting::OnFree(MemPhase phase, size_t bytes)
+{
+    g_phases[(size_t)phase].liveBytes.fetch_sub((int64_t)bytes, std::memory_order_relaxed);
+    g_totalLive.fetch_sub((int64_t)bytes, std::memory_order_relaxed);
+}
+
+MemPhase CMemAccounting::Current()
+{
+    return t_current;
+}
+
+void CMemAccounting::SetCurrent(MemPhase phase)
+{
+    t_current = phase;
+}
+
+void CMemAccounting::Reset()
+{
+    for (PhaseCounters& c : g_phases)
+    {
+        c.allocBytes = 0;
+        c.allocCount = 0;
+        c.peakLiveBytes = c.liveBytes.load();
+        c.processDelta = 0;
+        c.processPeak = 0;
+    }
+    g_totalPeak = g_totalLive.load();
+}
+
+MemPhaseStats CMemAccounting::Get(MemPhase phase)
+{
+    const PhaseCounters& c = g_phases[(size_t)phase];
+    MemPhaseStats s;
+    s.allocBytes = c.allocBytes.load();
+    s.allocCount = c.allocCount.load();
+    s.liveBytes = c.liveBytes.load();
+    s.peakLiveBytes = c.peakLiveBytes.load();
+    s.processDelta = c.processDelta.load();
+    s.processPeak = c.processPeak.load();
+    return s;
+}
+
+int64_t CMemAccounting::GetPeakLiveBytes()
+{
+    return g_totalPeak.load();
+}
+
+uint64_t CMemAccounting::ProcessPrivateBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX pmc = {};
+    pmc.cb = sizeof(pmc);
+    if (GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&pmc), sizeof(pmc)))
+        return pmc.PrivateUsage;
+#endif
+    return 0;
+}
+
+void CMemAccounting::AddProcessSample(MemPhase phase, int64_t delta, uint64_t privateBytes)
+{
+    PhaseCounters& c = g_phases[(size_t)phase];
+    c.processDelta.fetch_add(delta, std::memory_order_relaxed);
+    RaiseTo(c.processPeak, privateBytes);
+}
+
+CMemScope::CMemScope(MemPhase phase)
+    : m_phase(phase)
+    , m_previous(CMemAccounting::Current())
+    , m_privateStart(CMemAccounting::ProcessPrivateBytes())
+{
+    CMemAccounting::SetCurrent(phase);
+}
+
+CMemScope::~CMemScope()
+{
+    const uint64_t privateEnd = CMemAccounting::ProcessPrivateBytes();
+    CMemAccounting::AddProcessSample(m_phase, (int64_t)privateEnd - (int64_t)m_privateStart, privateEnd);
+    CMemAccounting::SetCurrent(m_previous);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <new>
+
+// Учёт памяти импорта по фазам (без зависимости от SDK).
+// Крупные контейнеры импорта (данные разбора, склейка, цепочки) используют
+// CCountingAllocator: каждое выделение относится к фазе текущего CMemScope
+// потока и считается точно — байты, число выделений, живые байты и их пик.
+// Память nanoCAD (тела труб, объекты DragManager) так не видна, поэтому
+// CMemScope дополнительно снимает прирост закрытой памяти процесса за фазу.
+
+enum class MemPhase : uint8_t
+{
+    Other,
+    Parse,
+    Merge,
+    Chaining,
+    PipeCreation,
+    Placement,
+
+    Count
+};
+
+const wchar_t* MemPhaseName(MemPhase phase);
+
+struct MemPhaseStats
+{
+    uint64_t allocBytes = 0;
+    uint64_t allocCount = 0;
+    int64_t liveBytes = 0;          // выделено в фазе и ещё не освобождено
+    int64_t peakLiveBytes = 0;
+    int64_t processDelta = 0;       // прирост закрытой памяти процесса за время фазы (с вложенными)
+    uint64_t processPeak = 0;       // закрытая память процесса в конце фазы, максимум
+};
+
+class CMemAccounting
+{
+public:
+    static void OnAlloc(MemPhase phase, size_t bytes);
+    static void OnFree(MemPhase phase, size_t bytes);
+
+    // Фаза потока (CMemScope); вне областей — Other
+    static MemPhase Current();
+
+    // Обнулить счётчики выделений; живые байты остаются, пик — от текущего уровня
+    static void Reset();
+    static MemPhaseStats Get(MemPhase phase);
+    // Общий пик живых байт по всем фазам с последнего Reset
+    static int64_t GetPeakLiveBytes();
+
+    // Закрытая (private) память процесса; 0, если недоступно
+    static uint64_t ProcessPrivateBytes();
+
+private:
+    friend class CMemScope;
+    static void SetCurrent(MemPhase phase);
+    static void AddProcessSample(MemPhase phase, int64_t delta, uint64_t privateBytes);
+};
+
+// Область фазы: выделения потока до выхода из области относятся к phase
+class CMemScope
+{
+public:
+    explicit CMemScope(MemPhase phase);
+    ~CMemScope();
+
+    CMemScope(const CMemScope&) = delete;
+    CMemScope& operator=(const CMemScope&) = delete;
+
+private:
+    MemPhase m_phase;
+    MemPhase m_previous;
+    uint64_t m_privateStart;
+};
+
+// Аллокатор с учётом: перед блоком хранится фаза выделения, поэтому
+// освобождение в другой фазе уменьшает живые байты той фазы, что выделила
+template <typename T>
+class CCountingAllocator
+{
+public:
+    typedef T value_type;
+
+    CCountingAllocator() noexcept {}
+    template <typename U>
+    CCountingAllocator(const CCountingAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n)
+    {
+        if (n > (SIZE_MAX - kHeader) / sizeof(T))
+            throw std::bad_array_new_length();
+        const size_t bytes = n * sizeof(T);
+        char* p = static_cast<char*>(::operator new(bytes + kHeader));
+        const MemPhase phase = CMemAccounting::Current();
+        *reinterpret_cast<MemPhase*>(p) = phase;
+        CMemAccounting::OnAlloc(phase, bytes);
+        return reinterpret_cast<T*>(p + kHeader);
+    }
+
+    void deallocate(T* ptr, size_t n) noexcept
+    {
+        char* p = reinterpret_cast<char*>(ptr) - kHeader;
+        CMemAccounting::OnFree(*reinterpret_cast<MemPhase*>(p), n * sizeof(T));
+        ::operator delete(p);
+    }
+
+    template <typename U>
+    bool operator==(const CCountingAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const CCountingAllocator<U>&) const noexcept { return false; }
+
+private:
+    // Заголовок сохраняет выравнивание блока operator new
+    static const size_t kHeader = alignof(std::max_align_t) > alignof(T) ? alignof(std::max_align_t) : alignof(T);
+};
+
+template <typename T>
+using CountedVector = std::vector<T, CCountingAllocator<T>>;
@@ -0,0 +1,161 @@
+#include "stdafx.h"
+#include "MemBudget.h"
+#include "PointWeld.h"
+#include "NTLParser.h"
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <fstream>
+#include <filesystem>
+
+namespace
+{
+// Бюджет пика живых байт на сегмент по фазам: замер 10k–1M сегментов с запасом
+// на перевыделение вектора (старый и новый буфер живут одновременно).
+// Превышение означает новую копию данных в фазе. fixedBytes — расход на файл,
+// не зависящий от числа сегментов (блок арены разбора).
+struct PhaseBudget
+{
+    MemPhase phase;
+    double bytesPerSegment;
+    double fixedBytes;
+};
+
+const PhaseBudget kBudgets[] = {
+    { MemPhase::Parse, 40.0, (double)CParseArena::kChunkSize },   // ~10 байт компактной геометрии, пик при росте потока до x3
+    { MemPhase::Merge, 400.0, 0.0 },    // сварка ~200, SoA и буферы склейки ~100, CPreparedNTLSegments
+    { MemPhase::Chaining, 16.0, 0.0 },  // NTLChain по 40 байт, цепочка не короче трёх сегментов
+};
+
+const double kTotalBudgetPerSegment = 600.0;
+
+// Синтетическая модель в формате NTL: ветка — строки SEG и PIPE, сегмент — строка RUN
+// с приращением от последней точки. Направление меняется в начале ветки и в 30% сегментов,
+// остальные продолжают предыдущий и склеиваются.
+bool WriteMemBudgetNTL(const std::filesystem::path& path, size_t segments, size_t branchLength)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+    double p[3] = { 0.0, 0.0, 0.0 };
+    double d[3] = { 1.0, 0.0, 0.0 };
+    char line[160];
+    for (size_t i = 0; i < segments; ++i)
+    {
+        if (i % branchLength == 0)
+        {
+            const size_t branch = i / branchLength;
+            int n = std::snprintf(line, sizeof(line), "SEG S%zu B%zu %.3f %.3f %.3f\nPIPE 219.100 8.000\n",
+                branch, branch, p[0], p[1], p[2]);
+            out.write(line, n);
+        }
+        if (i % branchLength == 0 || share(rng) >= 0.7)
+        {
+            d[0] = unit(rng);
+            d[1] = unit(rng);
+            d[2] = unit(rng) * 0.2;
+        }
+        double len = 100.0 + 900.0 * share(rng);
+        double l = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]) + 1e-9;
+        double s[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            s[k] = d[k] / l * len;
+            p[k] += s[k];
+        }
+        int n = std::snprintf(line, sizeof(line), "RUN R %.3f %.3f %.3f\n", s[0], s[1], s[2]);
+        out.write(line, n);
+    }
+    return (bool)out.flush();
+}
+} // namespace
+
+MemBudgetResult RunMemoryBudget(size_t segments, size_t branchLength)
+{
+    MemBudgetResult result;
+    result.segments = segments;
+    if (branchLength == 0)
+        branchLength = 1;
+
+    // Файл пишется до сброса счётчиков: в фазы попадает только импорт
+    std::error_code ec;
+    const std::filesystem::path path = std::filesystem::temp_directory_path(ec) / L"HNRX_MemBudget.ntl";
+    if (ec || !WriteMemBudgetNTL(path, segments, branchLength))
+    {
+        result.ok = false;
+        return result;
+    }
+    CMemAccounting::Reset();
+
+    CNTLParser parser;
+    {
+        // Разбор тем же CNTLParser, что и IMPORTNTL (ReadNTLFile)
+        CMemScope scope(MemPhase::Parse);
+        result.parsed = parser.ReadFile(CString(path.wstring().c_str()));
+    }
+    std::filesystem::remove(path, ec);
+    const CCompactNTLSegments& parsed = parser.GetSegments();
+    result.segments = parsed.size();
+    if (!result.parsed || parsed.empty())
+    {
+        result.ok = false;
+        return result;
+    }
+
+    // Склейка и цепочки — тот же BuildNTLChains, что и в PrepareNTLChains;
+    // области Merge и Chaining открывает он сам
+    NTLPrepared prepared;
+    NTLPrepareStats stats;
+    BuildNTLChains(parsed, kDefaultWeldTolerance, 0.0, prepared, stats);
+
+    const double n = (double)result.segments;
+    double fixedBytes = 0.0;
+    for (const PhaseBudget& budget : kBudgets)
+    {
+        MemBudgetPhase ph;
+        ph.phase = budget.phase;
+        ph.stats = CMemAccounting::Get(budget.phase);
+        ph.bytesPerSegment = ph.stats.peakLiveBytes / n;
+        ph.budgetPerSegment = budget.bytesPerSegment + budget.fixedBytes / n;
+        ph.ok = ph.bytesPerSegment <= ph.budgetPerSegment;
+        result.ok = result.ok && ph.ok;
+        result.phases.push_back(ph);
+        fixedBytes += budget.fixedBytes;
+    }
+    result.peakPerSegment = CMemAccounting::GetPeakLiveBytes() / n;
+    result.ok = result.ok && result.peakPerSegment <= kTotalBudgetPerSegment + fixedBytes / n;
+    return result;
+}
+
+#ifdef MEMBUDGET_MAIN
+#include <cstdio>
+
+int main()
+{
+    bool ok = true;
+    const size_t sizes[] = { 10000, 100000, 1000000 };
+    for (size_t segments : sizes)
+    {
+        MemBudgetResult r = RunMemoryBudget(segments);
+        if (!r.parsed)
+        {
+            std::printf("segments %zu: NTL file not written or not parsed\n", segments);
+            ok = false;
+            continue;
+        }
+        std::printf("segments %zu: peak %.1f B/seg%s\n", r.segments, r.peakPerSegment, r.ok ? "" : "  OVER BUDGET");
+        for (const MemBudgetPhase& ph : r.phases)
+        {
+            std::printf("  %-10ls alloc %12llu B  count %8llu  peak %7.1f B/seg  budget %7.1f  %s\n",
+                MemPhaseName(ph.phase), (unsigned long long)ph.stats.allocBytes,
+                (unsigned long long)ph.stats.allocCount, ph.bytesPerSegment, ph.budgetPerSegment,
+                ph.ok ? "ok" : "OVER");
+        }
+        ok = ok && r.ok;
+    }
+    return ok ? 0 : 1;
+}
+#endif
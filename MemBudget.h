@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "MemAccounting.h"
+
+// Бюджеты памяти импорта: синтетические ветки пишутся во временный NTL-файл
+// (%TEMP%\HNRX_MemBudget.ntl) и проходят разбор CNTLParser и BuildNTLChains —
+// тот же код, что и IMPORTNTL. Пик живых байт фазы, делённый на число
+// сегментов разбора, сравнивается с бюджетом на сегмент.
+//
+// Проверка — -DMEMBUDGET_MAIN; собирается с SDK, как CNTLParser (README, «Проверки без nanoCAD»).
+
+struct MemBudgetPhase
+{
+    MemPhase phase;
+    MemPhaseStats stats;
+    double bytesPerSegment = 0.0;   // пик живых байт фазы на сегмент
+    double budgetPerSegment = 0.0;  // с долей постоянного расхода фазы на файл
+    bool ok = true;
+};
+
+struct MemBudgetResult
+{
+    size_t segments = 0;            // сегментов разбора
+    bool parsed = false;            // временный файл записан и прочитан
+    std::vector<MemBudgetPhase> phases;
+    double peakPerSegment = 0.0;    // общий пик живых байт на сегмент
+    bool ok = true;
+};
+
+MemBudgetResult RunMemoryBudget(size_t segments, size_t branchLength = 200);
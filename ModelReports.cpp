@@ -0,0 +1,371 @@
+#include "stdafx.h"
+#include "ModelReports.h"
+#include "PipingUtils.h"
+#include "NTLChainTag.h"
+#include <algorithm>
+#include <cmath>
+#include "dbcurve.h"
+#include "vCSSegment.h"
+
+bool WriteArmatureCsv(const std::wstring& path, const std::vector<const PipingEntry*>& rows)
+{
+    CReportWriter out;
+    if (!out.Open(path))
+        return false;
+    out.Bom();
+    out.Raw("KKS_PART;X;Y;Z;ClassName;Dummy\n");
+    for (const auto* a : rows)
+    {
+        out.CsvField(a->kksPart);
+        out.Char(';');
+        out.Double(a->center.x);
+        out.Char(';');
+        out.Double(a->center.y);
+        out.Char(';');
+        out.Double(a->center.z);
+        out.Char(';');
+        out.CsvField(a->className);
+        out.Raw(a->isDummy ? ";1\n" : ";0\n", 3);
+    }
+    return out.Close();
+}
+
+// ---- Арматура ----
+
+unsigned CArmatureReport::GetClassMask() const
+{
+    return pcf_Armature;
+}
+
+bool CArmatureReport::Begin()
+{
+    m_entries.clear();
+    m_exported = 0;
+    return true;
+}
+
+void CArmatureReport::Visit(CScannedEntity& entity)
+{
+    bool hasKks = false;
+    const std::wstring& kks = entity.KKSPart(hasKks);
+    if (!hasKks)
+        return; // параметра нет совсем — пропускаем
+    PipingEntry e;
+    if (!entity.Center(e.center))
+        return;
+    e.id = entity.Id();
+    e.kind = PipingKind::Armature;
+    e.className = entity.ClassName();
+    e.kksPart = kks;
+    e.hasKks = true;
+    e.isDummy = (entity.Flags() & pcf_Dummy) != 0;
+    m_entries.push_back(e);
+}
+
+bool CArmatureReport::End()
+{
+    // Если есть dummy, используем только их; иначе все
+    bool hasDummy = std::any_of(m_entries.begin(), m_entries.end(), [](const PipingEntry& e) { return e.isDummy; });
+    std::vector<const PipingEntry*> rows;
+    rows.reserve(m_entries.size());
+    for (const PipingEntry& e : m_entries)
+    {
+        if (!hasDummy || e.isDummy)
+            rows.push_back(&e);
+    }
+    m_exported = (int)rows.size();
+    return WriteArmatureCsv(m_path, rows);
+}
+
+// ---- Опоры ----
+
+unsigned CSupportsReport::GetClassMask() const
+{
+    return pcf_Support;
+}
+
+bool CSupportsReport::Begin()
+{
+    m_count = 0;
+    if (!m_out.Open(m_path))
+        return false;
+    m_out.Bom();
+    m_out.Raw("Handle;KKS_PART;X;Y;Z;ClassName;Dummy\n");
+    return true;
+}
+
+void CSupportsReport::Visit(CScannedEntity& entity)
+{
+    AcGePoint3d c;
+    if (!entity.Center(c))
+        return;
+    bool hasKks = false;
+    const std::wstring& kks = entity.KKSPart(hasKks);
+    m_out.Hex(HandleToUInt64(entity.Id().handle()));
+    m_out.Char(';');
+    m_out.CsvField(kks);
+    m_out.Char(';');
+    m_out.Double(c.x);
+    m_out.Char(';');
+    m_out.Double(c.y);
+    m_out.Char(';');
+    m_out.Double(c.z);
+    m_out.Char(';');
+    m_out.CsvField(entity.ClassName());
+    m_out.Raw((entity.Flags() & pcf_Dummy) ? ";1\n" : ";0\n", 3);
+    ++m_count;
+}
+
+bool CSupportsReport::End()
+{
+    return m_out.Close();
+}
+
+// ---- Оси труб ----
+
+unsigned CPipeAxisReport::GetClassMask() const
+{
+    return pcf_PipeSegment;
+}
+
+bool CPipeAxisReport::Begin()
+{
+    m_axes.clear();
+    m_order.clear();
+    m_lastAxisId = AcDbObjectId::kNull;
+    return true;
+}
+
+void CPipeAxisReport::Visit(CScannedEntity& entity)
+{
+    vCSSegment2* pSeg = vCSSegment2::cast(entity.Entity());
+    if (!pSeg)
+        return;
+    AcDbObjectId axisId = pSeg->GetOIdAxis();
+    if (axisId.isNull())
+        return;
+    m_lastAxisId = axisId;
+
+    auto it = m_axes.find(axisId);
+    if (it == m_axes.end())
+    {
+        it = m_axes.emplace(axisId, AxisInfo()).first;
+        m_order.push_back(axisId);
+    }
+    AxisInfo& info = it->second;
+    info.segments++;
+
+    if (AcDbCurve* pCurve = AcDbCurve::cast(entity.Entity()))
+    {
+        double endParam = 0.0, len = 0.0;
+        if (pCurve->getEndParam(endParam) == Acad::eOk && pCurve->getDistAtParam(endParam, len) == Acad::eOk)
+            info.length += len;
+    }
+
+    AcDbExtents ext;
+    if (entity.Extents(ext))
+    {
+        if (info.hasExtents)
+            info.extents.addExt(ext);
+        else
+            info.extents = ext;
+        info.hasExtents = true;
+    }
+}
+
+bool CPipeAxisReport::End()
+{
+    if (m_path.empty())
+        return true;
+
+    CReportWriter out(1 << 16);
+    if (!out.Open(m_path))
+        return false;
+    out.Bom();
+    out.Raw("AxisHandle;Segments;Length;MinX;MinY;MinZ;MaxX;MaxY;MaxZ\n");
+    for (const AcDbObjectId& id : m_order)
+    {
+        const AxisInfo& info = m_axes[id];
+        out.Hex(HandleToUInt64(id.handle()));
+        out.Char(';');
+        out.Int(info.segments);
+        out.Char(';');
+        out.Double(info.length);
+        if (info.hasExtents)
+        {
+            const AcGePoint3d& mn = info.extents.minPoint();
+            const AcGePoint3d& mx = info.extents.maxPoint();
+            const double v[6] = { mn.x, mn.y, mn.z, mx.x, mx.y, mx.z };
+            for (double d : v)
+            {
+                out.Char(';');
+                out.Double(d);
+            }
+            out.Char('\n');
+        }
+        else
+        {
+            out.Raw(";;;;;;\n");
+        }
+    }
+    return out.Close();
+}
+
+// ---- Занятые коды KKS ----
+
+unsigned CKKSCodeCollector::GetClassMask() const
+{
+    return pcf_All;
+}
+
+void CKKSCodeCollector::Visit(CScannedEntity& entity)
+{
+    bool hasKks = false;
+    const std::wstring& kks = entity.KKSPart(hasKks);
+    if (kks.empty())
+        return;
+    m_allocator.AddExisting(kks);
+    ++m_codes;
+}
+
+// ---- Сверка с NTL ----
+
+unsigned CReconcileCollector::GetClassMask() const
+{
+    return pcf_PipeSegment | pcf_Support | pcf_Armature | pcf_Fitting;
+}
+
+bool CReconcileCollector::Begin()
+{
+    m_model.Clear();
+    m_axes.clear();
+    m_order.clear();
+    return true;
+}
+
+void CReconcileCollector::Visit(CScannedEntity& entity)
+{
+    const unsigned flags = entity.Flags();
+    if (flags & pcf_Dummy)
+        return;
+    if (flags & pcf_PipeSegment)
+    {
+        VisitSegment(entity);
+        return;
+    }
+
+    // Из фасонных деталей в NTL есть только переходы и тройники, отводы не сверяются
+    ReconcileItemKind kind = ReconcileItemKind::Support;
+    if (!(flags & pcf_Support))
+    {
+        const std::wstring& cls = entity.ClassName();
+        if (IsReducerClass(cls))
+            kind = ReconcileItemKind::Reducer;
+        else if (IsTeeClass(cls))
+            kind = ReconcileItemKind::Tee;
+        else if (flags & pcf_Armature)
+            kind = ReconcileItemKind::Inline;
+        else
+            return;
+    }
+    AcGePoint3d c;
+    if (!entity.Center(c))
+        return;
+    bool hasKks = false;
+    const std::wstring& kks = entity.KKSPart(hasKks);
+    const double pos[3] = { c.x, c.y, c.z };
+
+    // Элемент импорта сверяется по имени из NTL и несёт источник (повторный импорт удаляет
+    // только такие). У остальных имя — KKS_PART: с именами NTL он не совпадает, и пара
+    // находится по положению.
+    std::wstring tagName;
+    std::wstring tagSource;
+    const bool tagged = ReadNTLItemTag(entity.Entity(), tagName, tagSource);
+    m_model.AddItem(kind, tagged ? tagName : kks, HandleToUInt64(entity.Id().handle()), pos);
+    m_model.items.back().source = tagSource;
+}
+
+void CReconcileCollector::VisitSegment(CScannedEntity& entity)
+{
+    vCSSegment2* pSeg = vCSSegment2::cast(entity.Entity());
+    AcDbCurve* pCurve = AcDbCurve::cast(entity.Entity());
+    if (!pSeg || !pCurve)
+        return;
+    AcDbObjectId axisId = pSeg->GetOIdAxis();
+    if (axisId.isNull())
+        return;
+    AcGePoint3d a, b;
+    if (pCurve->getStartPoint(a) != Acad::eOk || pCurve->getEndPoint(b) != Acad::eOk)
+        return;
+
+    auto it = m_axes.find(axisId);
+    if (it == m_axes.end())
+    {
+        it = m_axes.emplace(axisId, Axis()).first;
+        m_order.push_back(axisId);
+    }
+    Axis& axis = it->second;
+    ReconcileSegment s = { { a.x, a.y, a.z }, { b.x, b.y, b.z } };
+    axis.segments.push_back(s);
+
+    if (axis.name.empty())
+    {
+        bool hasKks = false;
+        axis.name = entity.KKSPart(hasKks);
+    }
+
+    // OD по экстентам: у цилиндра радиуса r вдоль единичного d полуразмер по оси k
+    // равен |d_k| * L / 2 + r * sqrt(1 - d_k^2). Ось без тела (экстенты = отрезок) — OD неизвестен.
+    AcDbExtents ext;
+    if (axis.od <= 0.0 && entity.Extents(ext))
+    {
+        const AcGeVector3d v = b - a;
+        const double len = v.length();
+        if (len > 1e-9)
+        {
+            const double span[3] = {
+                ext.maxPoint().x - ext.minPoint().x,
+                ext.maxPoint().y - ext.minPoint().y,
+                ext.maxPoint().z - ext.minPoint().z };
+            const double d[3] = { v.x / len, v.y / len, v.z / len };
+            int k = 0;
+            for (int i = 1; i < 3; ++i)
+            {
+                if (fabs(d[i]) < fabs(d[k]))
+                    k = i;
+            }
+            const double across = sqrt(1.0 - d[k] * d[k]);
+            const double r = (span[k] - fabs(d[k]) * len) / (2.0 * across);
+            if (r > 1e-3)
+                axis.od = floor(2.0 * r * 1000.0 + 0.5) / 1000.0;
+        }
+    }
+}
+
+bool CReconcileCollector::End()
+{
+    for (const AcDbObjectId& id : m_order)
+    {
+        Axis& axis = m_axes[id];
+        std::wstring tagName;
+        std::wstring tagSource;
+        uint64_t fingerprint = 0;
+        bool complete = false;
+        AcDbObject* pAxis = nullptr;
+        if (acdbOpenObject(pAxis, id, AcDb::kForRead) == Acad::eOk && pAxis)
+        {
+            ReadNTLChainTag(pAxis, tagName, tagSource, fingerprint, complete);
+            pAxis->close();
+        }
+        ReconcileChain& ch = m_model.BeginChain(tagName.empty() ? axis.name : tagName, HandleToUInt64(id.handle()),
+            axis.od, 0.0);
+        ch.fingerprint = fingerprint;
+        ch.source = tagSource;
+        ch.pending = fingerprint != 0 && !complete;
+        for (const ReconcileSegment& s : axis.segments)
+            m_model.AddSegment(s.start, s.end);
+        axis.segments.clear();
+        axis.segments.shrink_to_fit();
+    }
+    return true;
+}
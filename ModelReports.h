@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "ModelScanner.h"
+#include "PipingIndex.h"
+#include "ReportWriter.h"
+#include "NTLReconcile.h"
+#include "KKSAssign.h"
+
+// Таблица арматуры: KKS_PART;X;Y;Z;ClassName;Dummy (UTF-8 с BOM)
+bool WriteArmatureCsv(const std::wstring& path, const std::vector<const PipingEntry*>& rows);
+
+// Отчёт "таблица арматуры" — тот же файл, что и EXPORTARMATURE в режиме CSV
+// (если в модели есть dummy, выгружаются только они).
+class CArmatureReport : public IModelReportVisitor
+{
+public:
+    explicit CArmatureReport(const std::wstring& path) : m_path(path) {}
+
+    unsigned GetClassMask() const override;
+    bool Begin() override;
+    void Visit(CScannedEntity& entity) override;
+    bool End() override;
+
+    int GetExportedCount() const { return m_exported; }
+
+private:
+    std::wstring m_path;
+    std::vector<PipingEntry> m_entries;
+    int m_exported = 0;
+};
+
+// Отчёт "опоры": Handle;KKS_PART;X;Y;Z;ClassName;Dummy, строки пишутся по ходу обхода
+class CSupportsReport : public IModelReportVisitor
+{
+public:
+    explicit CSupportsReport(const std::wstring& path) : m_path(path), m_out(1 << 16) {}
+
+    unsigned GetClassMask() const override;
+    bool Begin() override;
+    void Visit(CScannedEntity& entity) override;
+    bool End() override;
+
+    int GetCount() const { return m_count; }
+
+private:
+    std::wstring m_path;
+    CReportWriter m_out;
+    int m_count = 0;
+};
+
+// Инвентаризация осей труб по сегментам:
+// AxisHandle;Segments;Length;MinX;MinY;MinZ;MaxX;MaxY;MaxZ.
+// Пустой путь — только сбор (без файла).
+class CPipeAxisReport : public IModelReportVisitor
+{
+public:
+    explicit CPipeAxisReport(const std::wstring& path = std::wstring()) : m_path(path) {}
+
+    unsigned GetClassMask() const override;
+    bool Begin() override;
+    void Visit(CScannedEntity& entity) override;
+    bool End() override;
+
+    struct AxisInfo
+    {
+        int segments = 0;
+        double length = 0.0;    // сумма длин сегментов-кривых
+        AcDbExtents extents;
+        bool hasExtents = false;
+    };
+
+    size_t GetAxisCount() const { return m_order.size(); }
+    // Ось последнего встреченного сегмента (в порядке обхода модели)
+    AcDbObjectId GetLastAxisId() const { return m_lastAxisId; }
+
+private:
+    std::wstring m_path;
+    std::map<AcDbObjectId, AxisInfo> m_axes;
+    std::vector<AcDbObjectId> m_order;      // порядок первого появления
+    AcDbObjectId m_lastAxisId;
+};
+
+// Занятые коды KKS: KKS_PART всех сущностей модели, а не только трубопроводных
+// (оборудование, здания и т.п. тоже носят коды и не должны получить повторный)
+class CKKSCodeCollector : public IModelReportVisitor
+{
+public:
+    explicit CKKSCodeCollector(CKKSCodeAllocator& allocator) : m_allocator(allocator) {}
+
+    unsigned GetClassMask() const override;
+    void Visit(CScannedEntity& entity) override;
+
+    int GetCodeCount() const { return m_codes; }
+
+private:
+    CKKSCodeAllocator& m_allocator;
+    int m_codes = 0;
+};
+
+// Сторона чертежа для сверки с NTL (NTLReconcile.h): оси труб — цепочки из сегментов
+// (handle оси, KKS_PART первого сегмента с кодом, OD по экстентам тела сегмента),
+// опоры и инлайны — элементы (центр экстентов; имя из метки импорта, иначе KKS_PART).
+// Dummy не участвуют.
+// У осей, созданных IMPORTNTL, имя, отпечаток и источник берутся из метки, у опор
+// и инлайнов импорта — источник из метки элемента (NTLChainTag.h).
+class CReconcileCollector : public IModelReportVisitor
+{
+public:
+    explicit CReconcileCollector(ReconcileModel& model) : m_model(model) {}
+
+    unsigned GetClassMask() const override;
+    bool Begin() override;
+    void Visit(CScannedEntity& entity) override;
+    bool End() override;
+
+private:
+    struct Axis
+    {
+        std::vector<ReconcileSegment> segments;
+        std::wstring name;
+        double od = 0.0;
+    };
+
+    void VisitSegment(CScannedEntity& entity);
+
+    ReconcileModel& m_model;
+    std::map<AcDbObjectId, Axis> m_axes;
+    std::vector<AcDbObjectId> m_order;      // порядок первого появления = номер цепочки
+};
@@ -0,0 +1,118 @@
+#include "stdafx.h"
+#include "ModelScanner.h"
+#include <algorithm>
+#include "PipingUtils.h"
+
+CScannedEntity::CScannedEntity(AcDbEntity* pEnt, const AcDbObjectId& id, unsigned flags, CParamCache* pParams)
+    : m_pEnt(pEnt)
+    , m_id(id)
+    , m_flags(flags)
+    , m_pParams(pParams)
+{
+}
+
+const std::wstring& CScannedEntity::ClassName()
+{
+    if (!m_classRead)
+    {
+        m_classRead = true;
+        m_className = m_pEnt->isA() ? m_pEnt->isA()->name() : L"";
+    }
+    return m_className;
+}
+
+const std::wstring& CScannedEntity::KKSPart(bool& hasParam)
+{
+    if (!m_kksRead)
+    {
+        m_kksRead = true;
+        if (m_pParams)
+        {
+            const ParamValue& v = m_pParams->Get(HandleToUInt64(m_id.handle()), kParamKksPart);
+            m_hasKks = v.exists;
+            m_kks = v.value;
+        }
+        else
+        {
+            m_kks = GetKKSPart(m_pEnt, m_hasKks);
+        }
+    }
+    hasParam = m_hasKks;
+    return m_kks;
+}
+
+bool CScannedEntity::Extents(AcDbExtents& ext)
+{
+    if (!m_extRead)
+    {
+        m_extRead = true;
+        m_hasExt = m_pEnt->getGeomExtents(m_ext) == Acad::eOk;
+    }
+    if (m_hasExt)
+        ext = m_ext;
+    return m_hasExt;
+}
+
+bool CScannedEntity::Center(AcGePoint3d& center)
+{
+    AcDbExtents ext;
+    if (!Extents(ext))
+        return false;
+    center.set(
+        (ext.minPoint().x + ext.maxPoint().x) * 0.5,
+        (ext.minPoint().y + ext.maxPoint().y) * 0.5,
+        (ext.minPoint().z + ext.maxPoint().z) * 0.5);
+    return true;
+}
+
+bool CModelScanner::Run(AcDbDatabase* pDb, std::vector<int>* failedVisitors)
+{
+    m_opened = 0;
+    if (failedVisitors)
+        failedVisitors->clear();
+
+    // Участвуют только отчёты, согласившиеся в Begin(); отказ — ошибка отчёта
+    std::vector<IModelReportVisitor*> active;
+    std::vector<unsigned> masks;
+    std::vector<int> activeIndex;
+    unsigned mask = 0;
+    for (size_t i = 0; i < m_visitors.size(); ++i)
+    {
+        if (!m_visitors[i]->Begin())
+        {
+            if (failedVisitors)
+                failedVisitors->push_back((int)i);
+            continue;
+        }
+        active.push_back(m_visitors[i]);
+        masks.push_back(m_visitors[i]->GetClassMask());
+        activeIndex.push_back((int)i);
+        mask |= masks.back();
+    }
+    if (active.empty())
+        return true;
+
+    bool ok = ForEachModelSpaceEntity(pDb, mask,
+        [&](AcDbEntity* pEnt, unsigned flags)
+        {
+            ++m_opened;
+            CScannedEntity entity(pEnt, pEnt->objectId(), flags, m_pParams);
+            for (size_t i = 0; i < active.size(); ++i)
+            {
+                if (flags & masks[i])
+                    active[i]->Visit(entity);
+            }
+            return true;
+        });
+    if (!ok)
+        return false;
+
+    for (size_t i = 0; i < active.size(); ++i)
+    {
+        if (!active[i]->End() && failedVisitors)
+            failedVisitors->push_back(activeIndex[i]);
+    }
+    if (failedVisitors)
+        std::sort(failedVisitors->begin(), failedVisitors->end());
+    return ok;
+}
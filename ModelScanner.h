@@ -0,0 +1,82 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "acdb.h"
+#include "dbmain.h"
+#include "gepnt3d.h"
+#include "ParamCache.h"
+
+// Сущность текущего шага обхода. Объект открыт один раз на весь проход;
+// класс, KKS_PART и экстенты читаются при первом обращении и дальше берутся из кэша,
+// сколько бы отчётов их ни запросило.
+class CScannedEntity
+{
+public:
+    // pParams — кэш параметров документа (может быть nullptr — тогда прямое чтение)
+    CScannedEntity(AcDbEntity* pEnt, const AcDbObjectId& id, unsigned flags, CParamCache* pParams = nullptr);
+
+    AcDbEntity* Entity() const { return m_pEnt; }
+    const AcDbObjectId& Id() const { return m_id; }
+    unsigned Flags() const { return m_flags; }   // PipingClassFlags
+
+    const std::wstring& ClassName();
+    // KKS_PART; hasParam = параметр существует (может быть пустым)
+    const std::wstring& KKSPart(bool& hasParam);
+    // Геометрические экстенты в WCS; false — у сущности их нет
+    bool Extents(AcDbExtents& ext);
+    bool Center(AcGePoint3d& center);
+
+private:
+    AcDbEntity* m_pEnt;
+    AcDbObjectId m_id;
+    unsigned m_flags;
+    CParamCache* m_pParams;
+
+    bool m_classRead = false;
+    bool m_kksRead = false;
+    bool m_hasKks = false;
+    bool m_extRead = false;
+    bool m_hasExt = false;
+    std::wstring m_className;
+    std::wstring m_kks;
+    AcDbExtents m_ext;
+};
+
+// Отчёт, получающий сущности от общего прохода по модели
+class IModelReportVisitor
+{
+public:
+    virtual ~IModelReportVisitor() {}
+
+    // Какие сущности нужны отчёту (маска PipingClassFlags)
+    virtual unsigned GetClassMask() const = 0;
+    // Перед проходом; false — отчёт не участвует
+    virtual bool Begin() { return true; }
+    virtual void Visit(CScannedEntity& entity) = 0;
+    // После прохода (запись файла и т.п.); false — ошибка отчёта
+    virtual bool End() { return true; }
+};
+
+// Один проход по пространству модели на любое число отчётов.
+// Классы, не нужные ни одному отчёту, отсеиваются до открытия объекта.
+class CModelScanner
+{
+public:
+    void AddVisitor(IModelReportVisitor* pVisitor) { m_visitors.push_back(pVisitor); }
+
+    // Параметры брать из кэша документа (повторные отчёты не перечитывают неизменённые объекты)
+    void SetParamCache(CParamCache* pParams) { m_pParams = pParams; }
+
+    // Обход; false — пространство модели недоступно. Ошибки Begin() и End() отдельных
+    // отчётов возвращаются в failedVisitors (индексы в порядке добавления).
+    bool Run(AcDbDatabase* pDb, std::vector<int>* failedVisitors = nullptr);
+
+    // Статистика последнего прохода
+    int GetOpenedCount() const { return m_opened; }
+
+private:
+    std::vector<IModelReportVisitor*> m_visitors;
+    CParamCache* m_pParams = nullptr;
+    int m_opened = 0;
+};
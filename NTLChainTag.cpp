@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include "NTLChainTag.h"
+#include <cwchar>
+#include <cwctype>
+#include "aced.h"
+
+const wchar_t* const kNTLChainTagApp = L"HNRX_NTL";
+const wchar_t* const kNTLItemTagApp = L"HNRX_NTLI";
+
+bool WriteNTLChainTag(const AcDbObjectId& axisId, const std::wstring& name, const std::wstring& source,
+    uint64_t fingerprint, bool complete)
+{
+    // Регистрация приложения в таблице RegApp документа (повторная — без изменений)
+    if (acdbRegApp(kNTLChainTagApp) != RTNORM)
+        return false;
+
+    // XData: имя приложения, имя цепочки, отпечаток шестнадцатеричной строкой, признак завершения,
+    // источник (после признака — старые метки без него читаются как прежде)
+    wchar_t hex[17] = { 0 };
+    swprintf_s(hex, L"%016llx", (unsigned long long)fingerprint);
+    const std::wstring shortName = name.size() > 255 ? name.substr(0, 255) : name;
+    const std::wstring shortSource = source.size() > 255 ? source.substr(0, 255) : source;
+    resbuf* pRb = acutBuildList(AcDb::kDxfRegAppName, kNTLChainTagApp,
+        AcDb::kDxfXdAsciiString, shortName.c_str(),
+        AcDb::kDxfXdAsciiString, hex,
+        AcDb::kDxfXdInteger16, complete ? 1 : 0,
+        AcDb::kDxfXdAsciiString, shortSource.c_str(),
+        RTNONE);
+    if (!pRb)
+        return false;
+
+    AcDbObject* pObj = nullptr;
+    bool ok = false;
+    if (acdbOpenObject(pObj, axisId, AcDb::kForWrite) == Acad::eOk && pObj)
+    {
+        ok = pObj->setXData(pRb) == Acad::eOk;
+        pObj->close();
+    }
+    acutRelRb(pRb);
+    return ok;
+}
+
+bool ReadNTLChainTag(const AcDbObject* pObj, std::wstring& name, std::wstring& source, uint64_t& fingerprint,
+    bool& complete)
+{
+    name.clear();
+    source.clear();
+    fingerprint = 0;
+    complete = false;
+    if (!pObj)
+        return false;
+    resbuf* pRb = pObj->xData(kNTLChainTagApp);
+    if (!pRb)
+        return false;
+
+    // Первая строка — имя, вторая — отпечаток, третья — источник
+    int field = 0;
+    for (resbuf* p = pRb->rbnext; p; p = p->rbnext)
+    {
+        if (p->restype == AcDb::kDxfXdInteger16)
+            complete = p->resval.rint != 0;
+        if (p->restype != AcDb::kDxfXdAsciiString || !p->resval.rstring)
+            continue;
+        if (field == 0)
+            name = p->resval.rstring;
+        else if (field == 1)
+            fingerprint = wcstoull(p->resval.rstring, nullptr, 16);
+        else if (field == 2)
+            source = p->resval.rstring;
+        ++field;
+    }
+    acutRelRb(pRb);
+    return fingerprint != 0;
+}
+
+bool WriteNTLItemTag(const AcDbObjectId& itemId, const std::wstring& name, const std::wstring& source)
+{
+    if (acdbRegApp(kNTLItemTagApp) != RTNORM)
+        return false;
+
+    // XData: имя приложения, имя элемента, источник
+    const std::wstring shortName = name.size() > 255 ? name.substr(0, 255) : name;
+    const std::wstring shortSource = source.size() > 255 ? source.substr(0, 255) : source;
+    resbuf* pRb = acutBuildList(AcDb::kDxfRegAppName, kNTLItemTagApp,
+        AcDb::kDxfXdAsciiString, shortName.c_str(),
+        AcDb::kDxfXdAsciiString, shortSource.c_str(),
+        RTNONE);
+    if (!pRb)
+        return false;
+
+    AcDbObject* pObj = nullptr;
+    bool ok = false;
+    if (acdbOpenObject(pObj, itemId, AcDb::kForWrite) == Acad::eOk && pObj)
+    {
+        ok = pObj->setXData(pRb) == Acad::eOk;
+        pObj->close();
+    }
+    acutRelRb(pRb);
+    return ok;
+}
+
+bool ReadNTLItemTag(const AcDbObject* pObj, std::wstring& name, std::wstring& source)
+{
+    name.clear();
+    source.clear();
+    if (!pObj)
+        return false;
+    resbuf* pRb = pObj->xData(kNTLItemTagApp);
+    if (!pRb)
+        return false;
+
+    int field = 0;
+    for (resbuf* p = pRb->rbnext; p; p = p->rbnext)
+    {
+        if (p->restype != AcDb::kDxfXdAsciiString || !p->resval.rstring)
+            continue;
+        if (field == 0)
+            name = p->resval.rstring;
+        else if (field == 1)
+            source = p->resval.rstring;
+        ++field;
+    }
+    acutRelRb(pRb);
+    return true;
+}
+
+std::wstring NTLChainTagSource(const wchar_t* path)
+{
+    std::wstring source(path ? path : L"");
+    const size_t slash = source.find_last_of(L"\\/");
+    if (slash != std::wstring::npos)
+        source.erase(0, slash + 1);
+    for (wchar_t& ch : source)
+        ch = (wchar_t)towlower(ch);
+    return source;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "acdb.h"
+#include "dbmain.h"
+
+// Метка оси, созданной импортом NTL: имя цепочки (ветка), отпечаток цепочки
+// (CChainFingerprint, NTLReconcile.h) и источник (имя файла NTL) в XData приложения HNRX_NTL.
+// По отпечатку повторный импорт узнаёт неизменённые цепочки и не пересоздаёт их;
+// устаревшими считаются только оси того же источника.
+extern const wchar_t* const kNTLChainTagApp;
+
+// Метка опоры или инлайна, созданных импортом NTL: имя из NTL и источник — в XData
+// приложения HNRX_NTLI. Повторный импорт удаляет со старой оси только размеченные элементы.
+extern const wchar_t* const kNTLItemTagApp;
+
+// Записать метку (объект не должен быть открыт); имя и источник обрезаются до 255 символов.
+// complete = false — опоры/инлайны плана ещё не расставлены (поэтапный или прерванный импорт).
+bool WriteNTLChainTag(const AcDbObjectId& axisId, const std::wstring& name, const std::wstring& source,
+    uint64_t fingerprint, bool complete);
+
+// Прочитать метку открытого объекта; false — метки нет.
+// У меток, записанных до появления источника, source пуст.
+bool ReadNTLChainTag(const AcDbObject* pObj, std::wstring& name, std::wstring& source, uint64_t& fingerprint,
+    bool& complete);
+
+// Метка элемента (объект не должен быть открыт); строки обрезаются до 255 символов
+bool WriteNTLItemTag(const AcDbObjectId& itemId, const std::wstring& name, const std::wstring& source);
+
+// Прочитать метку элемента открытого объекта; false — метки нет
+bool ReadNTLItemTag(const AcDbObject* pObj, std::wstring& name, std::wstring& source);
+
+// Источник метки для файла импорта: имя файла без каталога в нижнем регистре
+std::wstring NTLChainTagSource(const wchar_t* path);
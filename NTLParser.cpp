@@ -1,16 +1,47 @@
 #include "stdafx.h"
 #include "NTLParser.h"
+#include "PointWeld.h"
+#include "SegmentMerge.h"
 #include <fstream>
 #include <sstream>
 #include <algorithm>
 #include "geassign.h"
 #include <atlstr.h>
 #include <cctype>
+#include <cwctype>
+#include <cwchar>
 #include "acdb.h"
 #include "gepnt3d.h"
 #include <afx.h>
 #include <afxwin.h>
 
+namespace
+{
+// Последнее положительное число строки "***  Pipe OD 8.625"
+double LastPositiveNumber(const NTLTokens& tokens)
+{
+    double lastNum = 0.0;
+    for (std::wstring_view s : tokens)
+    {
+        double v = NTLFieldToDouble(s);
+        if (v > 0.0)
+            lastNum = v;
+    }
+    return lastNum;
+}
+
+// Есть ли в tokens подряд слова first second (без учёта регистра)
+bool HasWords(const NTLTokens& tokens, const char* first, const char* second)
+{
+    for (size_t i = 1; i + 1 < tokens.size(); ++i)
+    {
+        if (NTLEqualsLiteral(tokens[i], first) && NTLEqualsLiteral(tokens[i + 1], second))
+            return true;
+    }
+    return false;
+}
+} // namespace
+
 CNTLParser::CNTLParser()
     : m_currentDistance(0.0)
     , m_lastPoint(0.0, 0.0, 0.0)
@@ -20,6 +51,7 @@ CNTLParser::CNTLParser()
     , m_currentPipeName()
     , m_lastSegName()
     , m_currentSegmentId()
+    , m_currentBranch(kNoBranch)
 {
 }
 
@@ -34,32 +66,54 @@ void CNTLParser::Clear()
     m_inlines.clear();
     m_supports.clear();
     m_operations.clear();
+    m_inputCodec = InputCodec::Plain;
+    m_inputBytes = 0;
+    m_outputBytes = 0;
+    m_inputError.clear();
+    m_malformedRecords = 0;
     m_currentDistance = 0.0;
     m_lastPoint = AcGePoint3d(0.0, 0.0, 0.0);
     m_currentDiameter = 0.0;
     m_currentWallThickness = 0.0;
     m_currentOD = 0.0;
-    m_currentPipeName.Empty();
-    m_lastSegName.Empty();
-    m_currentSegmentId.Empty();
+    m_currentPipeName = CArenaString();
+    m_lastSegName = CArenaString();
+    m_currentSegmentId = CArenaString();
+    m_currentBranch = kNoBranch;
+    // Ключи индекса веток ссылаются на арену — очищаются раньше неё
+    m_branches.Clear();
+    // Строки записей больше не нужны: блоки арены уходят в пул
+    m_arena.Reset();
 }
 
 bool CNTLParser::ReadFile(const CString& filePath)
 {
     Clear();
 
+    // Номер строки файла — для сообщения об ошибке разбора
+    size_t lineNumber = 0;
     try
     {
-        // Используем CStdioFile для работы с Unicode путями
-        CStdioFile file;
-        if (!file.Open(filePath, CFile::modeRead | CFile::typeText))
+        // Чтение и распаковка — в отдельном потоке блоками; строки приходят байтами
+        // и переводятся в Unicode по кодовой странице ANSI, как в текстовом режиме CStdioFile
+        CBlockInput input;
+        const bool opened = input.Open(filePath.GetString());
+        m_inputCodec = input.GetCodec();
+        if (!opened)
         {
+            m_inputError = input.GetError();
             return false;
         }
 
         CString line;
-        while (file.ReadString(line))
+        std::string_view bytes;
+        while (input.ReadLine(bytes))
         {
+            ++lineNumber;
+            const int length = (int)bytes.size();
+            const int wide = length > 0
+                ? MultiByteToWideChar(CP_ACP, 0, bytes.data(), length, line.GetBuffer(length), length) : 0;
+            line.ReleaseBuffer(wide);
             line.TrimLeft();
             line.TrimRight();
             
@@ -69,212 +123,216 @@ bool CNTLParser::ReadFile(const CString& filePath)
                 continue;
             }
 
-            // Определяем тип строки по первому слову
-            CString firstWord = line.SpanExcluding(_T(" \t"));
-            firstWord.MakeUpper();
+            // Строка режется на токены один раз; разборщики получают токены,
+            // в арену копируются только сохраняемые имена
+            Tokenize(line, m_tokens);
+            if (m_tokens.empty())
+                continue;
 
-            if (firstWord == _T("SEG"))
-            {
-                ParseSegment(line);
-            }
-        else if (firstWord == _T("PIPE"))
-        {
-            // Строка PIPE может идти отдельной строкой после SEG
-            ParsePipe(line);
-        }
-            else if (firstWord == _T("SPRG"))
-            {
-                ParseSupport(line);
-            }
-            else if (firstWord == _T("OPER"))
+            // Тип строки — по совершенному хэшу первого слова (NTLSchema.h),
+            // поля — по таблице схемы записи за один проход
+            NTLRecordValues values;
+            switch (FindNTLRecord(m_tokens[0]))
             {
-                ParseOperation(line);
-            }
-            else if (firstWord == _T("RUN"))
-            {
-        ParseRun(line);
-            }
-            else if (firstWord == _T("BEND"))
-            {
-                ParseBend(line);
-            }
-            else if (firstWord == _T("VALV"))
-            {
-                ParseInlineValv(line);
-            }
-            else if (firstWord == _T("FLA") || firstWord == _T("FLAA"))
-            {
-                ParseInlineFla(line);
-            }
-            else if (firstWord == _T("RED"))
-            {
-                ParseInlineRed(line);
-            }
-            else if (firstWord == _T("TEE"))
-            {
-                ParseInlineTee(line);
-            }
-        else if (firstWord == _T("***"))
-        {
-            // Линии типа "***  Pipe OD 8.625" или "***  Wall Thickness 0.322"
-            CString rest = line.Mid(3);
-            rest.TrimLeft();
-            rest.MakeUpper();
-            if (rest.Find(_T("PIPE OD")) >= 0)
-            {
-                // Читаем последнее число в строке
-                std::vector<CString> t = Tokenize(line);
-                double lastNum = 0.0;
-                for (const auto& s : t)
+            case NTLRecord::Seg:
+                if (ExtractNTLRecord<NTLRecord::Seg>(m_tokens, values))
+                    ParseSegment(values);
+                break;
+            case NTLRecord::Pipe:
+                // Строка PIPE может идти отдельной строкой после SEG
+                if (ExtractNTLRecord<NTLRecord::Pipe>(m_tokens, values))
+                    ParsePipe(values);
+                break;
+            case NTLRecord::Sprg:
+                // Другой порядок полей или расстояние вне пределов — прежний поиск по строке
+                if (!ExtractNTLRecord<NTLRecord::Sprg>(m_tokens, values) || !ParseSupport(values))
+                    ParseSupportFallback(m_tokens);
+                break;
+            case NTLRecord::Oper:
+                if (ExtractNTLRecord<NTLRecord::Oper>(m_tokens, values))
+                    ParseOperation(values);
+                break;
+            case NTLRecord::Run:
+            case NTLRecord::Bend:
+            case NTLRecord::Elbo:
+                if (ExtractNTLRecord<NTLRecord::Run>(m_tokens, values))
+                    ParseRun(values);
+                break;
+            case NTLRecord::Valv:
+                if (ExtractNTLRecord<NTLRecord::Valv>(m_tokens, values))
+                    ParseInline(values, NTLInline::Type::Inline);
+                break;
+            case NTLRecord::Red:
+                if (ExtractNTLRecord<NTLRecord::Red>(m_tokens, values))
+                    ParseInline(values, NTLInline::Type::Reducer);
+                break;
+            case NTLRecord::Tee:
+                if (ExtractNTLRecord<NTLRecord::Tee>(m_tokens, values))
+                    ParseInline(values, NTLInline::Type::Tee);
+                break;
+            case NTLRecord::Rest:
+            case NTLRecord::Anch:
+                if (ExtractNTLRecord<NTLRecord::Rest>(m_tokens, values))
+                    ParseRestraint(values, m_tokens[0]);
+                break;
+            case NTLRecord::Fla:
+            case NTLRecord::Flaa:
+                // Фланцы не создаём как отдельные inline-элементы, пропускаем
+                break;
+            default:
+                if (m_tokens[0] == L"***")
                 {
-                    double v = StringToDouble(s);
-                    if (v > 0.0)
-                        lastNum = v;
-                }
-                if (lastNum > 0.0)
+                    // Линии типа "***  Pipe OD 8.625" или "***  Wall Thickness 0.322"
+                    if (HasWords(m_tokens, "PIPE", "OD"))
                     {
-                        m_currentOD = lastNum;
-                        // OD переопределяет текущий диаметр
-                        m_currentDiameter = m_currentOD;
+                        // Читаем последнее число в строке
+                        double lastNum = LastPositiveNumber(m_tokens);
+                        if (lastNum > 0.0)
+                        {
+                            m_currentOD = lastNum;
+                            // OD переопределяет текущий диаметр
+                            m_currentDiameter = m_currentOD;
+                        }
+                    }
+                    else if (HasWords(m_tokens, "WALL", "THICKNESS"))
+                    {
+                        double lastNum = LastPositiveNumber(m_tokens);
+                        if (lastNum > 0.0)
+                            m_currentWallThickness = lastNum;
                     }
-            }
-            else if (rest.Find(_T("WALL THICKNESS")) >= 0)
-            {
-                std::vector<CString> t = Tokenize(line);
-                double lastNum = 0.0;
-                for (const auto& s : t)
-                {
-                    double v = StringToDouble(s);
-                    if (v > 0.0)
-                        lastNum = v;
                 }
-                if (lastNum > 0.0)
-                    m_currentWallThickness = lastNum;
+                break;
             }
         }
-        }
 
-        file.Close();
+        input.Close();
+        m_inputBytes = input.GetInputBytes();
+        m_outputBytes = input.GetOutputBytes();
+        if (!input.GetError().empty())
+        {
+            // Обрезанный или повреждённый архив: неполная модель не импортируется
+            m_inputError = input.GetError();
+            return false;
+        }
+        IndexBranches();
+        m_segments.shrink_to_fit();
         return true;
     }
+    catch (const std::exception& ex)
+    {
+        // Например, координата вне диапазона компактной геометрии (CCompactGeometry::Quantize)
+        m_inputError = "line " + std::to_string(lineNumber) + ": " + ex.what();
+        return false;
+    }
     catch (...)
     {
+        m_inputError = "line " + std::to_string(lineNumber) + ": unknown error";
         return false;
     }
 }
 
-bool CNTLParser::ParseSegment(const CString& line)
+bool CNTLParser::ParseSegment(const NTLRecordValues& values)
 {
     // Формат может быть в две строки:
     //  SEG A00 A 0.000 0.000 0.000
     //  PIPE 123 N -123.000 12.000 0.000 1.5000 N
     // Поэтому здесь читаем только имя и стартовые координаты (если есть).
     // Диаметр и конец сегмента будут считаны в ParsePipe.
-    
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)  // Нужны хотя бы "SEG" и имя
-    {
-        return false;
-    }
+    typedef NTLRecordSchema<NTLRecord::Seg> Schema;
 
-    NTLSegment seg;
-    
-    // Имя сегмента (токен 1)
-    seg.name = tokens[1];
-    m_lastSegName = seg.name;
-    // Идентификатор ветки (токен 2, если есть)
-    if (tokens.size() > 2)
+    // Имя сегмента: одна копия в арене на все сегменты до следующего SEG
+    m_lastSegName = m_arena.Copy(values.text[Schema::Name]);
+    // Идентификатор ветки (если есть)
+    if (values.HasText(Schema::Branch))
     {
-        CString newSegId = tokens[2];
-        bool isNewBranch = newSegId.CompareNoCase(m_currentSegmentId) != 0;
-        seg.segmentId = newSegId;
-        m_currentSegmentId = newSegId;
+        const std::wstring_view newSegId = values.text[Schema::Branch];
+        bool isNewBranch = CArenaString(newSegId.data(), newSegId.size()).CompareNoCase(m_currentSegmentId) != 0;
+        // Та же ветка — строка в арене уже есть, сегменты ветки делят её
+        if (newSegId != m_currentSegmentId.View())
+            m_currentSegmentId = m_arena.Copy(newSegId);
         // При переходе на новую ветку сбрасываем накопленную длину
         if (isNewBranch)
             m_currentDistance = 0.0;
     }
     else
     {
-        seg.segmentId.Empty();
-        m_currentSegmentId.Empty();
+        m_currentSegmentId = CArenaString();
     }
+    m_currentBranch = m_branches.Intern(m_currentSegmentId);
     
-    // Начальная точка (формат: SEG <name> <type> <x> <y> <z>)
-    // Индексы координат: 3,4,5
-    int coordIdx = 3;
-    if ((int)tokens.size() > coordIdx)
-        seg.startPoint.x = StringToDouble(tokens[coordIdx]);
-    if ((int)tokens.size() > coordIdx + 1)
-        seg.startPoint.y = StringToDouble(tokens[coordIdx + 1]);
-    if ((int)tokens.size() > coordIdx + 2)
-        seg.startPoint.z = StringToDouble(tokens[coordIdx + 2]);
-    // Если координаты не указаны, используем последнюю известную точку
-    if ((int)tokens.size() <= coordIdx)
-        seg.startPoint = m_lastPoint;
-
-    // По умолчанию конец совпадает со стартом, пока не придет PIPE
-    seg.endPoint = seg.startPoint;
+    // Начальная точка; если координаты не указаны, используем последнюю известную точку
+    AcGePoint3d startPoint;
+    if (values.HasReal(Schema::X))
+        startPoint.x = values.real[Schema::X];
+    else
+        startPoint = m_lastPoint;
+    if (values.HasReal(Schema::Y))
+        startPoint.y = values.real[Schema::Y];
+    if (values.HasReal(Schema::Z))
+        startPoint.z = values.real[Schema::Z];
 
     // Имя трубы
-    seg.pipeName = seg.name + _T("_PIPE");
-    m_currentPipeName = seg.pipeName;
+    m_currentPipeName = m_arena.Concat(m_lastSegName.View(), L"_PIPE");
 
     // Сохраняем последнюю точку для следующих операций
-    m_lastPoint = seg.startPoint;
+    m_lastPoint = startPoint;
     
     // Пока не добавляем сегмент, сегменты создаем по RUN/BEND
     return true;
 }
 
-bool CNTLParser::ParsePipe(const CString& line)
+bool CNTLParser::ParsePipe(const NTLRecordValues& values)
 {
     // Обрабатываем строку PIPE, обновляем текущие параметры трубы (без создания сегмента).
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)
-        return false;
+    typedef NTLRecordSchema<NTLRecord::Pipe> Schema;
 
     // Имя трубы (может быть текстовым идентификатором) — если не число
-    CString token1 = tokens[1];
-    token1.Trim();
-    if (!token1.IsEmpty() && !isdigit(static_cast<unsigned char>(token1[0])))
-        m_currentPipeName = token1;
+    const std::wstring_view name = values.text[Schema::Name];
+    if (!name.empty() && !std::iswdigit(name[0]))
+        m_currentPipeName = m_arena.Copy(name);
 
     // Сбрасываем текущий OD, если пришла новая труба, будем переопределять
     m_currentOD = 0.0;
 
     // Диаметр/толщина: первое число после PIPE — OD/номинал, второе число — толщина (если есть)
-    double diameter = 0.0;
-    double thickness = 0.0;
-    for (size_t i = 1; i < tokens.size(); ++i)
-    {
-        double val = StringToDouble(tokens[i]);
-        if (val > 0.0 && diameter <= 0.0)
-        {
-            diameter = val;
-            continue;
-        }
-        if (val > 0.0 && diameter > 0.0 && thickness <= 0.0)
-        {
-            thickness = val;
-            break;
-        }
-    }
-
-    if (diameter > 0.0)
-        m_currentDiameter = diameter;
-    if (thickness > 0.0)
-        m_currentWallThickness = thickness;
+    if (values.HasReal(Schema::Diameter))
+        m_currentDiameter = values.real[Schema::Diameter];
+    if (values.HasReal(Schema::Thickness))
+        m_currentWallThickness = values.real[Schema::Thickness];
 
     // Если позже придёт "*** Pipe OD ..." — перезапишет m_currentOD; иначе используем m_currentDiameter.
     return true;
 }
 
-bool CNTLParser::ParseSupport(const CString& line)
+bool CNTLParser::ParseSupport(const NTLRecordValues& values)
 {
     // Формат из Test.NTL: SPRG A01 Y1 H * N 1000.00 * 0.250 0.000 0.000 BPOP None None None 1 N N N 1.000 1.000
+    // SPRG <name> <type> <orientation> * N <distance> * <coordinates> ...
+    typedef NTLRecordSchema<NTLRecord::Sprg> Schema;
+
+    const double distance = values.real[Schema::Distance];
+    if (!(distance > 0.0 && distance < 100000.0)) // Разумные пределы для расстояния в мм
+        return false;
+    // Раскладка совпала, но координаты не числа — запись битая, не ставим опору в 0,0,0
+    if (values.IsBadReal(Schema::X) || values.IsBadReal(Schema::Y) || values.IsBadReal(Schema::Z))
+    {
+        ++m_malformedRecords;
+        return true;
+    }
+
+    NTLSupport support;
+    support.name = m_arena.Copy(values.text[Schema::Name]);
+    support.supportType = m_arena.Copy(values.text[Schema::Type]);
+    support.distance = distance;
+    support.position.set(values.real[Schema::X], values.real[Schema::Y], values.real[Schema::Z]);
+    support.branch = CurrentBranch();
+    m_supports.push_back(support);
+    return true;
+}
+
+bool CNTLParser::ParseSupportFallback(const NTLTokens& tokens)
+{
     // SPRG <name> <type> <orientation> ... <distance> ... <coordinates> ...
-    
-    std::vector<CString> tokens = Tokenize(line);
     if (tokens.size() < 2)
     {
         return false;
@@ -283,21 +341,17 @@ bool CNTLParser::ParseSupport(const CString& line)
     NTLSupport support;
     
     // Имя опоры (токен 1)
-    if (tokens.size() > 1)
-        support.name = tokens[1];
+    support.name = m_arena.Copy(tokens[1]);
     
     // Тип опоры (токен 2, например "Y1")
     if (tokens.size() > 2)
-        support.supportType = tokens[2];
+        support.supportType = m_arena.Copy(tokens[2]);
     
     // Расстояние - ищем числовое значение после "N"
-    // В примере: 1000.00 - это расстояние от начала
     bool foundN = false;
     for (size_t i = 3; i < tokens.size(); i++)
     {
-        CString token = tokens[i];
-        token.MakeUpper();
-        if (token == _T("N"))
+        if (NTLEqualsLiteral(tokens[i], "N"))
         {
             foundN = true;
             continue;
@@ -315,12 +369,11 @@ bool CNTLParser::ParseSupport(const CString& line)
     }
     
     // Координаты опоры - ищем три последовательных числа после второго "*"
-    // В примере: 0.250 0.000 0.000 - это могут быть координаты
     int starCount = 0;
     int coordStart = -1;
     for (size_t i = 3; i < tokens.size(); i++)
     {
-        if (tokens[i] == _T("*"))
+        if (tokens[i] == L"*")
         {
             starCount++;
             if (starCount >= 2) // Второй "*"
@@ -333,9 +386,13 @@ bool CNTLParser::ParseSupport(const CString& line)
     
     if (coordStart >= 0 && coordStart + 2 < (int)tokens.size())
     {
-        support.position.x = StringToDouble(tokens[coordStart]);
-        support.position.y = StringToDouble(tokens[coordStart + 1]);
-        support.position.z = StringToDouble(tokens[coordStart + 2]);
+        if (!NTLFieldToDouble(tokens[coordStart], support.position.x) ||
+            !NTLFieldToDouble(tokens[coordStart + 1], support.position.y) ||
+            !NTLFieldToDouble(tokens[coordStart + 2], support.position.z))
+        {
+            ++m_malformedRecords;
+            return false;
+        }
     }
     else
     {
@@ -343,225 +400,176 @@ bool CNTLParser::ParseSupport(const CString& line)
         support.position = m_lastPoint;
     }
     
+    support.branch = CurrentBranch();
     m_supports.push_back(support);
     
     return true;
 }
 
-bool CNTLParser::ParseOperation(const CString& line)
+bool CNTLParser::ParseRestraint(const NTLRecordValues& values, std::wstring_view keyword)
+{
+    // REST/ANCH <name> [<type>]: опора в последней точке, смещение — пройденная длина ветки
+    typedef NTLRecordSchema<NTLRecord::Rest> Schema;
+
+    NTLSupport support;
+    support.name = m_arena.Copy(values.text[Schema::Name]);
+    support.supportType = m_arena.Copy(values.HasText(Schema::Type) ? values.text[Schema::Type] : keyword);
+    support.position = m_lastPoint;
+    support.distance = m_currentDistance;
+    support.branch = CurrentBranch();
+    m_supports.push_back(support);
+    return true;
+}
+
+bool CNTLParser::ParseOperation(const NTLRecordValues& values)
 {
     // Формат: OPER A00 1 70.000 0.000 29.5 * 12000.000
     // OPER <name> <param1> <temperature> <pressure> <param2> ...
-    
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)
-    {
-        return false;
-    }
+    typedef NTLRecordSchema<NTLRecord::Oper> Schema;
 
     NTLOperation oper;
-    
-    // Имя операции (токен 1)
-    if (tokens.size() > 1)
-        oper.name = tokens[1];
-    
-    // Температура (токен 3, обычно)
-    if (tokens.size() > 3)
-    {
-        oper.temperature = StringToDouble(tokens[3]);
-    }
-    
-    // Давление (токен 4, обычно)
-    if (tokens.size() > 4)
-    {
-        oper.pressure = StringToDouble(tokens[4]);
-    }
-    
+    oper.name = m_arena.Copy(values.text[Schema::Name]);
+    if (values.HasReal(Schema::Temperature))
+        oper.temperature = values.real[Schema::Temperature];
+    if (values.HasReal(Schema::Pressure))
+        oper.pressure = values.real[Schema::Pressure];
     m_operations.push_back(oper);
-    
     return true;
 }
 
-bool CNTLParser::ParseRun(const CString& line)
+bool CNTLParser::ParseRun(const NTLRecordValues& values)
 {
     // Формат: RUN A01 2222.000 0.000 0.000 *** Global Coordinates 2222.000 0.000 0.000
-    // RUN <name> <x> <y> <z> ...
-    
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 5)
-    {
-        return false;
-    }
-
-    // Трактуем RUN как приращение координат (dx,dy,dz) от последней точки
-    AcGeVector3d delta(
-        StringToDouble(tokens[2]),
-        StringToDouble(tokens[3]),
-        StringToDouble(tokens[4]));
+    // RUN/BEND/ELBO <name> <dx> <dy> <dz> ...
+    // Трактуем как приращение координат (dx,dy,dz) от последней точки
+    typedef NTLRecordSchema<NTLRecord::Run> Schema;
 
+    AcGeVector3d delta(values.real[Schema::DX], values.real[Schema::DY], values.real[Schema::DZ]);
     AcGePoint3d newPoint = m_lastPoint + delta;
     return CreateSegmentTo(newPoint);
 }
 
-bool CNTLParser::ParseBend(const CString& line)
+bool CNTLParser::ParseInline(const NTLRecordValues& values, NTLInline::Type type)
 {
-    // Формат: BEND <name> dx dy dz ...
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 5)
-    {
-        return false;
-    }
-    AcGeVector3d delta(
-        StringToDouble(tokens[2]),
-        StringToDouble(tokens[3]),
-        StringToDouble(tokens[4]));
-    AcGePoint3d newPoint = m_lastPoint + delta;
-    return CreateSegmentTo(newPoint);
-}
+    // VALV/RED/TEE <name> dx dy dz ...
+    typedef NTLRecordSchema<NTLRecord::Valv> Schema;
 
-bool CNTLParser::ParseInlineValv(const CString& line)
-{
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)
-        return false;
     NTLInline il;
-    il.type = NTLInline::Type::Inline;
-    il.name = tokens[1];
+    il.type = type;
+    il.name = m_arena.Copy(values.text[Schema::Name]);
     il.segmentId = m_currentSegmentId;
+    il.branch = CurrentBranch();
     AcGeVector3d delta(0, 0, 0);
-    if (tokens.size() > 4)
-    {
-        delta.set(
-            StringToDouble(tokens[2]),
-            StringToDouble(tokens[3]),
-            StringToDouble(tokens[4]));
-    }
+    if (values.HasReal(Schema::DZ))
+        delta.set(values.real[Schema::DX], values.real[Schema::DY], values.real[Schema::DZ]);
     il.position = m_lastPoint + delta;
     il.distance = m_currentDistance + delta.length();
     m_inlines.push_back(il);
     return true;
 }
 
-bool CNTLParser::ParseInlineFla(const CString& line)
+void CNTLParser::Tokenize(const CString& line, NTLTokens& tokens) const
 {
-    // Фланцы не создаём как отдельные inline-элементы, пропускаем
-    return true;
+    // Вектор переиспользуется между строками — ёмкость сохраняется
+    tokens.clear();
+    const wchar_t* p = line.GetString();
+    const wchar_t* end = p + line.GetLength();
+    while (p < end)
+    {
+        while (p < end && std::iswspace(*p))
+            ++p;
+        const wchar_t* start = p;
+        while (p < end && !std::iswspace(*p))
+            ++p;
+        if (p > start)
+            tokens.emplace_back(start, (size_t)(p - start));
+    }
 }
 
-bool CNTLParser::ParseInlineRed(const CString& line)
+double CNTLParser::StringToDouble(std::wstring_view str) const
 {
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)
-        return false;
-    NTLInline il;
-    il.type = NTLInline::Type::Reducer;
-    il.name = tokens[1];
-    il.segmentId = m_currentSegmentId;
-    AcGeVector3d delta(0, 0, 0);
-    if (tokens.size() > 4)
-    {
-        delta.set(
-            StringToDouble(tokens[2]),
-            StringToDouble(tokens[3]),
-            StringToDouble(tokens[4]));
-    }
-    il.position = m_lastPoint + delta;
-    il.distance = m_currentDistance + delta.length();
-    m_inlines.push_back(il);
-    return true;
+    return NTLFieldToDouble(str);
 }
 
-bool CNTLParser::ParseInlineTee(const CString& line)
+int CNTLParser::StringToInt(std::wstring_view str) const
 {
-    std::vector<CString> tokens = Tokenize(line);
-    if (tokens.size() < 2)
-        return false;
-    NTLInline il;
-    il.type = NTLInline::Type::Tee;
-    il.name = tokens[1];
-    il.segmentId = m_currentSegmentId;
-    AcGeVector3d delta(0, 0, 0);
-    if (tokens.size() > 4)
-    {
-        delta.set(
-            StringToDouble(tokens[2]),
-            StringToDouble(tokens[3]),
-            StringToDouble(tokens[4]));
-    }
-    il.position = m_lastPoint + delta;
-    il.distance = m_currentDistance + delta.length();
-    m_inlines.push_back(il);
-    return true;
+    return (int)NTLFieldToDouble(str);
 }
 
-std::vector<CString> CNTLParser::Tokenize(const CString& line) const
+uint32_t CNTLParser::CurrentBranch()
 {
-    std::vector<CString> tokens;
-    CString str = line;
-    str.TrimLeft();
-    str.TrimRight();
-    
-    int pos = 0;
-    CString token = str.Tokenize(_T(" \t"), pos);
-    while (!token.IsEmpty() || pos >= 0)
+    if (m_currentBranch == kNoBranch)
+        m_currentBranch = m_branches.Intern(m_currentSegmentId);
+    return m_currentBranch;
+}
+
+void CNTLParser::IndexBranches()
+{
+    // Ветка, продолженная после другой (A, B, A), переставляется к своему началу;
+    // порядок внутри ветки сохраняется. Обычно файл уже упорядочен и копий нет.
+    auto byBranch = [](const auto& a, const auto& b) { return a.branch < b.branch; };
+    if (!m_segments.IsSortedByBranch())
     {
-        token.TrimLeft();
-        token.TrimRight();
-        if (!token.IsEmpty())
-        {
-            tokens.push_back(token);
-        }
-        if (pos < 0)
-            break;
-        token = str.Tokenize(_T(" \t"), pos);
+        NTLSegmentList segments;
+        segments.reserve(m_segments.size());
+        for (const NTLSegment& seg : m_segments)
+            segments.push_back(seg);
+        std::stable_sort(segments.begin(), segments.end(), byBranch);
+        m_segments.clear();
+        for (const NTLSegment& seg : segments)
+            m_segments.push_back(seg);
     }
-    
-    return tokens;
+    if (!std::is_sorted(m_supports.begin(), m_supports.end(), byBranch))
+        std::stable_sort(m_supports.begin(), m_supports.end(), byBranch);
+    if (!std::is_sorted(m_inlines.begin(), m_inlines.end(), byBranch))
+        std::stable_sort(m_inlines.begin(), m_inlines.end(), byBranch);
+
+    const size_t branchCount = m_branches.GetBranchCount();
+    CountedVector<uint32_t> counts(branchCount, 0);
+    for (CCompactGeometry::CCursor c(m_segments.GetGeometry(), 0); c.IsValid(); c.Next())
+        ++counts[c.Get().branch];
+    m_branches.BuildOffsets(CNTLBranchIndex::Segments, counts);
+
+    counts.assign(branchCount, 0);
+    for (const NTLSupport& support : m_supports)
+        ++counts[support.branch];
+    m_branches.BuildOffsets(CNTLBranchIndex::Supports, counts);
+
+    counts.assign(branchCount, 0);
+    for (const NTLInline& il : m_inlines)
+        ++counts[il.branch];
+    m_branches.BuildOffsets(CNTLBranchIndex::Inlines, counts);
 }
 
-double CNTLParser::StringToDouble(const CString& str) const
+NTLSpan<NTLSupport> CNTLParser::GetBranchSupports(uint32_t branch) const
 {
-    if (str.IsEmpty())
-        return 0.0;
-    
-    CString cleanStr = str;
-    cleanStr.Remove(_T('*'));
-    cleanStr.TrimLeft();
-    cleanStr.TrimRight();
-    
-    if (cleanStr.IsEmpty())
-        return 0.0;
-    
-    return _ttof(cleanStr);
+    const NTLSupport* first = m_supports.data();
+    return NTLSpan<NTLSupport>(first + m_branches.GetBegin(CNTLBranchIndex::Supports, branch),
+        first + m_branches.GetEnd(CNTLBranchIndex::Supports, branch));
 }
 
-int CNTLParser::StringToInt(const CString& str) const
+NTLSpan<NTLInline> CNTLParser::GetBranchInlines(uint32_t branch) const
 {
-    if (str.IsEmpty())
-        return 0;
-    
-    CString cleanStr = str;
-    cleanStr.Remove(_T('*'));
-    cleanStr.TrimLeft();
-    cleanStr.TrimRight();
-    
-    if (cleanStr.IsEmpty())
-        return 0;
-    
-    return _ttoi(cleanStr);
+    const NTLInline* first = m_inlines.data();
+    return NTLSpan<NTLInline>(first + m_branches.GetBegin(CNTLBranchIndex::Inlines, branch),
+        first + m_branches.GetEnd(CNTLBranchIndex::Inlines, branch));
 }
 
 bool CNTLParser::CreateSegmentTo(const AcGePoint3d& newPoint)
 {
     NTLSegment seg;
     seg.name = m_lastSegName;
-    seg.pipeName = m_currentPipeName.IsEmpty() ? (m_lastSegName + _T("_PIPE")) : m_currentPipeName;
+    // Имя трубы и ветка — общие строки арены, сегмент их не копирует
+    if (m_currentPipeName.IsEmpty())
+        m_currentPipeName = m_arena.Concat(m_lastSegName.View(), L"_PIPE");
+    seg.pipeName = m_currentPipeName;
     seg.startPoint = m_lastPoint;
     seg.endPoint = newPoint;
     seg.length = seg.startPoint.distanceTo(seg.endPoint);
     seg.diameter = (m_currentOD > 0.0) ? m_currentOD : m_currentDiameter;
     seg.wallThickness = m_currentWallThickness;
     seg.segmentId = m_currentSegmentId;
+    seg.branch = CurrentBranch();
     if (seg.wallThickness <= 0.0 && seg.diameter > 0.0)
     {
         seg.wallThickness = seg.diameter * 0.1;
@@ -572,3 +580,352 @@ bool CNTLParser::CreateSegmentTo(const AcGePoint3d& newPoint)
     m_currentDistance += seg.length;
     return true;
 }
+
+size_t CNTLBranchIndex::NoCaseHash::operator()(std::wstring_view s) const
+{
+    // FNV-1a по символам в верхнем регистре
+    size_t h = 2166136261u;
+    for (wchar_t c : s)
+    {
+        h ^= (size_t)std::towupper(c);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+bool CNTLBranchIndex::NoCaseEqual::operator()(std::wstring_view a, std::wstring_view b) const
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        if (std::towupper(a[i]) != std::towupper(b[i]))
+            return false;
+    }
+    return true;
+}
+
+uint32_t CNTLBranchIndex::Intern(const CArenaString& segmentId)
+{
+    auto it = m_ids.find(segmentId.View());
+    if (it != m_ids.end())
+        return it->second;
+    const uint32_t branch = (uint32_t)m_names.size();
+    m_names.push_back(segmentId);
+    m_ids.emplace(segmentId.View(), branch);
+    return branch;
+}
+
+void CNTLBranchIndex::BuildOffsets(Records kind, const CountedVector<uint32_t>& counts)
+{
+    CountedVector<size_t>& offsets = m_offsets[kind];
+    offsets.resize(counts.size() + 1);
+    offsets[0] = 0;
+    for (size_t b = 0; b < counts.size(); ++b)
+        offsets[b + 1] = offsets[b] + counts[b];
+}
+
+void CNTLBranchIndex::Clear()
+{
+    m_names.clear();
+    m_ids.clear();
+    for (CountedVector<size_t>& offsets : m_offsets)
+        offsets.clear();
+}
+
+void CCompactNTLSegments::push_back(const NTLSegment& seg)
+{
+    // Новая запись атрибутов только при смене имени, трубы, ветки или профиля
+    if (m_attrs.empty() ||
+        m_attrs.back().name != seg.name ||
+        m_attrs.back().segmentId != seg.segmentId ||
+        m_attrs.back().pipeName != seg.pipeName ||
+        m_attrs.back().branch != seg.branch ||
+        m_attrs.back().diameter != seg.diameter ||
+        m_attrs.back().wallThickness != seg.wallThickness)
+    {
+        if (!m_attrs.empty() && seg.branch < m_attrs.back().branch)
+            m_sortedByBranch = false;
+        NTLSegmentAttr attr;
+        attr.name = seg.name;
+        attr.segmentId = seg.segmentId;
+        attr.pipeName = seg.pipeName;
+        attr.branch = seg.branch;
+        attr.diameter = seg.diameter;
+        attr.wallThickness = seg.wallThickness;
+        m_attrs.push_back(attr);
+    }
+
+    const double start[3] = { seg.startPoint.x, seg.startPoint.y, seg.startPoint.z };
+    const double end[3] = { seg.endPoint.x, seg.endPoint.y, seg.endPoint.z };
+    m_geometry.Append(seg.branch, start, end, (uint32_t)(m_attrs.size() - 1));
+}
+
+void CCompactNTLSegments::clear()
+{
+    m_geometry.Clear();
+    m_attrs.clear();
+    m_sortedByBranch = true;
+}
+
+void CCompactNTLSegments::shrink_to_fit()
+{
+    m_geometry.ShrinkToFit();
+    m_attrs.shrink_to_fit();
+}
+
+size_t CCompactNTLSegments::GetEncodedBytes() const
+{
+    return m_geometry.GetEncodedBytes() + m_attrs.size() * sizeof(NTLSegmentAttr);
+}
+
+NTLSegment CCompactNTLSegments::operator[](size_t index) const
+{
+    return Decode(m_geometry.Get(index));
+}
+
+NTLSegment CCompactNTLSegments::Decode(const CompactSegment& cs) const
+{
+    const NTLSegmentAttr& attr = m_attrs[cs.tag];
+    NTLSegment seg;
+    seg.name = attr.name;
+    seg.segmentId = attr.segmentId;
+    seg.pipeName = attr.pipeName;
+    seg.branch = cs.branch;
+    seg.startPoint.set(cs.start[0], cs.start[1], cs.start[2]);
+    seg.endPoint.set(cs.end[0], cs.end[1], cs.end[2]);
+    seg.diameter = attr.diameter;
+    seg.wallThickness = attr.wallThickness;
+    seg.length = seg.startPoint.distanceTo(seg.endPoint);
+    return seg;
+}
+
+CCompactNTLSegments::const_iterator::const_iterator(const CCompactNTLSegments& owner, size_t index)
+    : m_owner(&owner)
+    , m_cursor(owner.m_geometry, index)
+{
+    Load();
+}
+
+CCompactNTLSegments::const_iterator& CCompactNTLSegments::const_iterator::operator++()
+{
+    m_cursor.Next();
+    Load();
+    return *this;
+}
+
+void CCompactNTLSegments::const_iterator::Load()
+{
+    if (m_cursor.IsValid())
+        m_segment = m_owner->Decode(m_cursor.Get());
+}
+
+void CPreparedNTLSegments::Reset(const CCompactNTLSegments& source, CountedVector<double>&& xyz)
+{
+    m_source = &source;
+    m_vertices = std::move(xyz);
+    m_items.clear();
+}
+
+void CPreparedNTLSegments::push_back(uint32_t startVertex, uint32_t endVertex, uint32_t attr, double length)
+{
+    Item item;
+    item.start = startVertex;
+    item.end = endVertex;
+    item.attr = attr;
+    item.length = length;
+    m_items.push_back(item);
+}
+
+void CPreparedNTLSegments::clear()
+{
+    m_source = nullptr;
+    m_vertices.clear();
+    m_items.clear();
+}
+
+size_t CPreparedNTLSegments::GetEncodedBytes() const
+{
+    return m_vertices.size() * sizeof(double) + m_items.size() * sizeof(Item);
+}
+
+NTLSegment CPreparedNTLSegments::operator[](size_t index) const
+{
+    const Item& item = m_items[index];
+    const NTLSegmentAttr& attr = m_source->GetAttr(item.attr);
+    NTLSegment seg;
+    seg.name = attr.name;
+    seg.segmentId = attr.segmentId;
+    seg.pipeName = attr.pipeName;
+    seg.branch = attr.branch;
+    seg.diameter = attr.diameter;
+    seg.wallThickness = attr.wallThickness;
+    seg.startVertex = (int)item.start;
+    seg.endVertex = (int)item.end;
+    const double* a = &m_vertices[(size_t)item.start * 3];
+    const double* b = &m_vertices[(size_t)item.end * 3];
+    seg.startPoint.set(a[0], a[1], a[2]);
+    seg.endPoint.set(b[0], b[1], b[2]);
+    seg.length = item.length;
+    return seg;
+}
+
+CPreparedNTLSegments::const_iterator::const_iterator(const CPreparedNTLSegments* owner, size_t index, size_t last)
+    : m_owner(owner)
+    , m_index(index)
+    , m_last(last)
+{
+    if (m_index < m_last)
+        m_segment = (*m_owner)[m_index];
+}
+
+CPreparedNTLSegments::const_iterator& CPreparedNTLSegments::const_iterator::operator++()
+{
+    ++m_index;
+    if (m_index < m_last)
+        m_segment = (*m_owner)[m_index];
+    return *this;
+}
+
+size_t WeldNTLSegments(const CCompactNTLSegments& segments, double tolerance,
+    CountedVector<uint32_t>& endpoints, CountedVector<double>& xyz)
+{
+    CPointWelder welder(tolerance);
+    welder.Reserve(segments.size() * 2);
+    for (CCompactGeometry::CCursor c(segments.GetGeometry(), 0); c.IsValid(); c.Next())
+    {
+        const CompactSegment& cs = c.Get();
+        welder.AddPoint(cs.start[0], cs.start[1], cs.start[2]);
+        welder.AddPoint(cs.end[0], cs.end[1], cs.end[2]);
+    }
+    welder.Weld();
+
+    endpoints.resize(welder.GetPointCount());
+    for (size_t i = 0; i < endpoints.size(); ++i)
+        endpoints[i] = welder.GetVertexId((uint32_t)i);
+    xyz.resize(welder.GetVertexCount() * 3);
+    for (size_t v = 0; v < welder.GetVertexCount(); ++v)
+    {
+        const double* p = welder.GetVertex((uint32_t)v);
+        xyz[v * 3] = p[0];
+        xyz[v * 3 + 1] = p[1];
+        xyz[v * 3 + 2] = p[2];
+    }
+    return welder.GetVertexCount();
+}
+
+void BuildNTLChains(const CCompactNTLSegments& parsed, double weldTolerance, double simplifyAngleDeg,
+    NTLPrepared& prepared, NTLPrepareStats& stats)
+{
+    CMemScope memScope(MemPhase::Merge);
+    CPreparedNTLSegments& segments = prepared.segments;
+    CountedVector<NTLChain>& chains = prepared.chains;
+    segments.clear();
+    chains.clear();
+    stats = NTLPrepareStats();
+
+    // Склейка концов: точки в пределах допуска становятся одной вершиной,
+    // дальше непрерывность и нулевые отрезки проверяются по номерам вершин.
+    // Точки читаются из компактных сегментов разбора — сегменты не копируются
+    CountedVector<uint32_t> endpoints;
+    CountedVector<double> vertices;
+    stats.vertices = WeldNTLSegments(parsed, weldTolerance, endpoints, vertices);
+    stats.endpoints = endpoints.size();
+
+    // Предобработка: удаляем нулевые и склеиваем коллинеарные последовательные отрезки с одинаковым OD/WT/segmentId.
+    // У сегмента остаются номера вершин и запись атрибутов разбора; координаты вершин уходят
+    // в SoA-массивы (SegmentMerge.h)
+    struct WeldedSegment
+    {
+        uint32_t start;
+        uint32_t end;
+        uint32_t attr;
+    };
+    CountedVector<WeldedSegment> welded;
+    welded.reserve(parsed.size());
+    for (CCompactGeometry::CCursor c(parsed.GetGeometry(), 0); c.IsValid(); c.Next())
+    {
+        const size_t i = c.GetIndex();
+        const WeldedSegment w = { endpoints[i * 2], endpoints[i * 2 + 1], c.Get().tag };
+        if (w.start != w.end)
+            welded.push_back(w);
+    }
+    endpoints.clear();
+    endpoints.shrink_to_fit();
+    stats.zeroLength = parsed.size() - welded.size();
+
+    SegmentMergeInput mergeInput;
+    mergeInput.Resize(welded.size());
+    for (size_t i = 0; i < welded.size(); ++i)
+    {
+        const WeldedSegment& s = welded[i];
+        const double* a = &vertices[s.start * 3];
+        const double* b = &vertices[s.end * 3];
+        mergeInput.sx[i] = a[0];
+        mergeInput.sy[i] = a[1];
+        mergeInput.sz[i] = a[2];
+        mergeInput.ex[i] = b[0];
+        mergeInput.ey[i] = b[1];
+        mergeInput.ez[i] = b[2];
+        if (i == 0 || welded[i - 1].end != s.start)
+        {
+            mergeInput.joinPrev[i] = 0;
+            continue;
+        }
+        const NTLSegmentAttr& pa = parsed.GetAttr(welded[i - 1].attr);
+        const NTLSegmentAttr& sa = parsed.GetAttr(s.attr);
+        mergeInput.joinPrev[i] = pa.branch == sa.branch &&
+            fabs(pa.diameter - sa.diameter) < 1e-6 &&
+            fabs(pa.wallThickness - sa.wallThickness) < 1e-6;
+    }
+
+    SegmentMergeOptions mergeOptions;
+    mergeOptions.simplifyAngleDeg = simplifyAngleDeg;
+    std::vector<SegmentRun> runs;
+    MergeCollinearSegments(mergeInput, mergeOptions, runs);
+    mergeInput = SegmentMergeInput();
+
+    // Сегмент склейки: атрибуты первого сегмента серии, конец — последнего.
+    // Результат остаётся компактным: номера вершин, запись атрибутов и длина
+    segments.Reset(parsed, std::move(vertices));
+    for (const SegmentRun& run : runs)
+    {
+        const WeldedSegment& first = welded[run.first];
+        segments.push_back(first.start, welded[run.last].end, first.attr, run.length);
+    }
+    stats.merged = welded.size() - segments.size();
+
+    // Группируем непрерывные отрезки с одинаковыми OD/WT/pipeName в цепочки, как и
+    // до индекса веток: смежные ветки одной трубы остаются одной осью. Сегменты
+    // упорядочены по веткам (CNTLBranchIndex), цепочка — диапазон segments.
+    auto samePipe = [](const NTLSegmentAttr& a, const NTLSegmentAttr& b)
+    {
+        return fabs(a.diameter - b.diameter) < 1e-6 &&
+            fabs(a.wallThickness - b.wallThickness) < 1e-6 &&
+            a.pipeName == b.pipeName;
+    };
+
+    CMemScope chainScope(MemPhase::Chaining);
+    size_t first = 0;
+    double totalLen = 0.0;
+    for (size_t i = 0; i < segments.size(); ++i)
+    {
+        totalLen += segments.GetLength(i);
+        const bool last = i + 1 == segments.size();
+        if (!last)
+        {
+            const NTLSegmentAttr& seg = segments.GetAttr(i);
+            const NTLSegmentAttr& next = segments.GetAttr(i + 1);
+            if (segments.GetEndVertex(i) == segments.GetStartVertex(i + 1) && samePipe(seg, next))
+                continue;
+        }
+        NTLChain chain;
+        chain.segs = CPreparedNTLSegments::CSpan(segments, first, i + 1);
+        chain.branch = segments.GetAttr(first).branch;
+        chain.lastBranch = segments.GetAttr(i).branch;
+        chain.totalLen = totalLen;
+        chains.push_back(chain);
+        first = i + 1;
+        totalLen = 0.0;
+    }
+}
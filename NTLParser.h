@@ -8,18 +8,31 @@
 #include "acdb.h"
 #include "gepnt3d.h"
 #include "geassign.h"
+#include "MemAccounting.h"
+#include "ParseArena.h"
+#include "CompactGeometry.h"
+#include "NTLSchema.h"
+#include "BlockInput.h"
+#include <iterator>
+#include <unordered_map>
+
+// Строки записей разбора лежат в арене парсера (CArenaString) и действительны,
+// пока жив CNTLParser и не вызван Clear(). Сегменты одной трубы разделяют строки.
 
 // Структура для данных сегмента трубы из NTL
 struct NTLSegment
 {
-    CString name;              // Имя сегмента (например, "A00")
-    CString segmentId;         // Идентификатор ветки (вторая колонка SEG, например "A")
+    CArenaString name;         // Имя сегмента (например, "A00")
+    CArenaString segmentId;    // Идентификатор ветки (вторая колонка SEG, например "A")
     AcGePoint3d startPoint;    // Начальная точка
     AcGePoint3d endPoint;      // Конечная точка
     double diameter;           // Диаметр трубы
     double wallThickness;      // Толщина стенки
     double length;             // Длина трубы
-    CString pipeName;          // Имя трубы
+    CArenaString pipeName;     // Имя трубы
+    uint32_t branch = 0;       // Номер ветки в CNTLBranchIndex
+    int startVertex = -1;      // Вершины после склейки (WeldNTLSegments), -1 — не склеено
+    int endVertex = -1;
 };
 
 // Структура для инлайновых элементов (арматура/переходы/тройники)
@@ -32,8 +45,9 @@ struct NTLInline
         Tee         // TEE
     };
     Type type;
-    CString name;          // Имя точки/элемента
-    CString segmentId;     // Ветка (из SEG)
+    CArenaString name;     // Имя точки/элемента
+    CArenaString segmentId; // Ветка (из SEG)
+    uint32_t branch = 0;   // Номер ветки в CNTLBranchIndex
     AcGePoint3d position;  // Абсолютная позиция (рассчитанная, опционально)
     double distance = 0.0; // Смещение вдоль ветки (от начала сегмента/цепи)
 };
@@ -41,18 +55,251 @@ struct NTLInline
 // Структура для данных опоры из NTL
 struct NTLSupport
 {
-    CString name;              // Имя опоры (например, "A01")
+    CArenaString name;         // Имя опоры (например, "A01")
     AcGePoint3d position;      // Позиция опоры
-    CString supportType;       // Тип опоры (например, "Y1")
-    double distance;           // Расстояние от начала
+    CArenaString supportType;  // Тип опоры (например, "Y1")
+    double distance = 0.0;     // Расстояние от начала (0 — нет, ставится по проекции позиции)
+    uint32_t branch = 0;       // Ветка, в которой записана опора (CNTLBranchIndex)
 };
 
 // Структура для данных операции из NTL
 struct NTLOperation
 {
-    CString name;              // Имя операции (например, "A00")
-    double temperature;        // Температура
-    double pressure;           // Давление
+    CArenaString name;         // Имя операции (например, "A00")
+    double temperature = 0.0;  // Температура
+    double pressure = 0.0;     // Давление
+};
+
+// Данные разбора — в контейнерах с учётом памяти (MemAccounting.h)
+typedef CountedVector<NTLSegment> NTLSegmentList;
+typedef CountedVector<NTLInline> NTLInlineList;
+typedef CountedVector<NTLSupport> NTLSupportList;
+
+// Непрерывный диапазон записей (ветка, цепочка) без копирования
+template <typename T>
+class NTLSpan
+{
+public:
+    NTLSpan() : m_first(nullptr), m_last(nullptr) {}
+    NTLSpan(const T* first, const T* last) : m_first(first), m_last(last) {}
+
+    const T* begin() const { return m_first; }
+    const T* end() const { return m_last; }
+    size_t size() const { return (size_t)(m_last - m_first); }
+    bool empty() const { return m_first == m_last; }
+    const T& front() const { return *m_first; }
+    const T& back() const { return *(m_last - 1); }
+    const T& operator[](size_t i) const { return m_first[i]; }
+
+private:
+    const T* m_first;
+    const T* m_last;
+};
+
+const uint32_t kNoBranch = 0xFFFFFFFFu;
+
+// Индекс веток NTL (segmentId). Номер ветки выдаётся при разборе по имени без учёта
+// регистра в порядке появления; записи несут номер вместо сравнения строк.
+// После ReadFile сегменты, опоры и инлайны упорядочены по веткам (устойчиво, обычно
+// это уже порядок файла), записи вида kind ветки b — [GetBegin(kind, b), GetEnd(kind, b)).
+class CNTLBranchIndex
+{
+public:
+    enum Records
+    {
+        Segments,
+        Supports,
+        Inlines,
+
+        RecordKinds
+    };
+
+    // Номер ветки; новое имя получает следующий номер. Строка должна жить в арене парсера.
+    uint32_t Intern(const CArenaString& segmentId);
+
+    size_t GetBranchCount() const { return m_names.size(); }
+    const CArenaString& GetName(uint32_t branch) const { return m_names[branch]; }
+
+    size_t GetBegin(Records kind, uint32_t branch) const { return m_offsets[kind][branch]; }
+    size_t GetEnd(Records kind, uint32_t branch) const { return m_offsets[kind][branch + 1]; }
+
+    // Смещения CSR по числу записей каждой ветки (counts — по номерам веток)
+    void BuildOffsets(Records kind, const CountedVector<uint32_t>& counts);
+    void Clear();
+
+private:
+    struct NoCaseHash
+    {
+        size_t operator()(std::wstring_view s) const;
+    };
+    struct NoCaseEqual
+    {
+        bool operator()(std::wstring_view a, std::wstring_view b) const;
+    };
+
+    CountedVector<CArenaString> m_names;
+    std::unordered_map<std::wstring_view, uint32_t, NoCaseHash, NoCaseEqual> m_ids;
+    CountedVector<size_t> m_offsets[RecordKinds];
+};
+
+// Атрибуты сегментов от строки SEG/PIPE до следующей смены имени, ветки или профиля
+struct NTLSegmentAttr
+{
+    CArenaString name;
+    CArenaString segmentId;
+    CArenaString pipeName;
+    uint32_t branch = 0;        // номер ветки в CNTLBranchIndex
+    double diameter = 0.0;
+    double wallThickness = 0.0;
+};
+
+// Сегменты разбора в компактном виде (CompactGeometry.h): геометрия — целые шаги
+// 0,001 мм от начала ветки с общими вершинами, атрибуты — общая запись на строку
+// SEG/PIPE. Интерфейс как у NTLSegmentList для чтения: size/empty/begin/end/[];
+// элементы — декодированные копии NTLSegment (startVertex/endVertex = -1).
+// Последовательный обход декодирует на лету; [] — поиск серии и до 256 шагов.
+class CCompactNTLSegments
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef NTLSegment value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const NTLSegment* pointer;
+        typedef const NTLSegment& reference;
+
+        const_iterator(const CCompactNTLSegments& owner, size_t index);
+
+        reference operator*() const { return m_segment; }
+        pointer operator->() const { return &m_segment; }
+        const_iterator& operator++();
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        bool operator==(const const_iterator& other) const { return m_cursor.GetIndex() == other.m_cursor.GetIndex(); }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        void Load();
+
+        const CCompactNTLSegments* m_owner;
+        CCompactGeometry::CCursor m_cursor;
+        NTLSegment m_segment;
+    };
+
+    // Сегменты пишутся только в конец
+    void push_back(const NTLSegment& seg);
+    void clear();
+    void shrink_to_fit();
+
+    size_t size() const { return m_geometry.GetSegmentCount(); }
+    bool empty() const { return size() == 0; }
+    NTLSegment operator[](size_t index) const;
+
+    const_iterator begin() const { return const_iterator(*this, 0); }
+    const_iterator end() const { return const_iterator(*this, size()); }
+
+    const CCompactGeometry& GetGeometry() const { return m_geometry; }
+    const NTLSegmentAttr& GetAttr(uint32_t index) const { return m_attrs[index]; }
+    // Геометрия и атрибуты (строки — в арене парсера)
+    size_t GetEncodedBytes() const;
+    // Номера веток сегментов не убывают
+    bool IsSortedByBranch() const { return m_sortedByBranch; }
+
+private:
+    NTLSegment Decode(const CompactSegment& cs) const;
+
+    CCompactGeometry m_geometry;
+    CountedVector<NTLSegmentAttr> m_attrs;
+    bool m_sortedByBranch = true;
+};
+
+// Сегменты после склейки и слияния коллинеарных (подготовка импорта). Вершины склейки
+// общие (24 Б на вершину), на сегмент — номера вершин, запись атрибутов разбора
+// (CCompactNTLSegments::GetAttr) и длина: 24 Б вместо ~130 Б у NTLSegment.
+// Элементы — декодированные копии NTLSegment; источник атрибутов должен жить дольше.
+class CPreparedNTLSegments
+{
+public:
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef NTLSegment value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const NTLSegment* pointer;
+        typedef const NTLSegment& reference;
+
+        // Декодируются только сегменты до last (конец диапазона)
+        const_iterator(const CPreparedNTLSegments* owner, size_t index, size_t last);
+
+        reference operator*() const { return m_segment; }
+        pointer operator->() const { return &m_segment; }
+        const_iterator& operator++();
+        bool operator==(const const_iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const const_iterator& other) const { return m_index != other.m_index; }
+
+    private:
+        const CPreparedNTLSegments* m_owner;
+        size_t m_index;
+        size_t m_last;
+        NTLSegment m_segment;
+    };
+
+    // Непрерывный диапазон сегментов (цепочка)
+    class CSpan
+    {
+    public:
+        CSpan() : m_owner(nullptr), m_first(0), m_last(0) {}
+        CSpan(const CPreparedNTLSegments& owner, size_t first, size_t last)
+            : m_owner(&owner), m_first(first), m_last(last) {}
+
+        const_iterator begin() const { return const_iterator(m_owner, m_first, m_last); }
+        const_iterator end() const { return const_iterator(m_owner, m_last, m_last); }
+        size_t size() const { return m_last - m_first; }
+        bool empty() const { return m_first == m_last; }
+        NTLSegment front() const { return (*m_owner)[m_first]; }
+        NTLSegment back() const { return (*m_owner)[m_last - 1]; }
+        NTLSegment operator[](size_t i) const { return (*m_owner)[m_first + i]; }
+
+    private:
+        const CPreparedNTLSegments* m_owner;
+        size_t m_first;
+        size_t m_last;
+    };
+
+    // Начать заново: атрибуты — из source, xyz — вершины склейки подряд
+    void Reset(const CCompactNTLSegments& source, CountedVector<double>&& xyz);
+    void push_back(uint32_t startVertex, uint32_t endVertex, uint32_t attr, double length);
+    void clear();
+
+    size_t size() const { return m_items.size(); }
+    bool empty() const { return m_items.empty(); }
+    NTLSegment operator[](size_t index) const;
+    const_iterator begin() const { return const_iterator(this, 0, size()); }
+    const_iterator end() const { return const_iterator(this, size(), size()); }
+
+    // Без декодирования: вершины, атрибуты и длина сегмента
+    uint32_t GetStartVertex(size_t index) const { return m_items[index].start; }
+    uint32_t GetEndVertex(size_t index) const { return m_items[index].end; }
+    const NTLSegmentAttr& GetAttr(size_t index) const { return m_source->GetAttr(m_items[index].attr); }
+    double GetLength(size_t index) const { return m_items[index].length; }
+
+    size_t GetVertexCount() const { return m_vertices.size() / 3; }
+    size_t GetEncodedBytes() const;
+
+private:
+    struct Item
+    {
+        uint32_t start;
+        uint32_t end;
+        uint32_t attr;
+        double length;
+    };
+
+    const CCompactNTLSegments* m_source = nullptr;
+    CountedVector<double> m_vertices;
+    CountedVector<Item> m_items;
 };
 
 // Класс для парсинга NTL файлов
@@ -62,59 +309,89 @@ public:
     CNTLParser();
     virtual ~CNTLParser();
 
-    // Открыть и прочитать NTL файл
+    // Открыть и прочитать NTL файл (обычный, .gz или .zst — по сигнатуре, BlockInput.h)
     bool ReadFile(const CString& filePath);
+
+    // Входной файл последнего ReadFile: формат, байт в файле и после распаковки, ошибка чтения
+    // или разбора (с номером строки: "line N: ...")
+    InputCodec GetInputCodec() const { return m_inputCodec; }
+    uint64_t GetInputBytes() const { return m_inputBytes; }
+    uint64_t GetOutputBytes() const { return m_outputBytes; }
+    const std::string& GetInputError() const { return m_inputError; }
+    // Отброшено битых записей (SPRG с нечисловыми координатами)
+    size_t GetMalformedRecordCount() const { return m_malformedRecords; }
     
-    // Получить все сегменты
-    const std::vector<NTLSegment>& GetSegments() const { return m_segments; }
+    // Получить все сегменты (компактный вид, см. CCompactNTLSegments)
+    const CCompactNTLSegments& GetSegments() const { return m_segments; }
     
     // Получить все опоры
-    const std::vector<NTLSupport>& GetSupports() const { return m_supports; }
+    const NTLSupportList& GetSupports() const { return m_supports; }
     
     // Получить все инлайны (арматура/переходы/тройники)
-    const std::vector<NTLInline>& GetInlines() const { return m_inlines; }
+    const NTLInlineList& GetInlines() const { return m_inlines; }
     
     // Получить все операции
     const std::vector<NTLOperation>& GetOperations() const { return m_operations; }
+
+    // Индекс веток и записи одной ветки (см. CNTLBranchIndex)
+    const CNTLBranchIndex& GetBranches() const { return m_branches; }
+    NTLSpan<NTLSupport> GetBranchSupports(uint32_t branch) const;
+    NTLSpan<NTLInline> GetBranchInlines(uint32_t branch) const;
     
-    // Очистить данные
+    // Очистить данные (и строки в арене)
     void Clear();
 
+    // Байт строк в арене разбора
+    size_t GetArenaBytes() const { return m_arena.GetBytesUsed(); }
+
 protected:
+    // Записи по схеме (NTLSchema.h): values — поля строки, разобранные ExtractNTLRecord
     // Парсинг строки SEG (сегмент)
-    bool ParseSegment(const CString& line);
+    bool ParseSegment(const NTLRecordValues& values);
     // Парсинг строки PIPE (продолжение SEG на новой строке)
-    bool ParsePipe(const CString& line);
+    bool ParsePipe(const NTLRecordValues& values);
     
-    // Парсинг строки SPRG (опора)
-    bool ParseSupport(const CString& line);
+    // Парсинг строки SPRG (опора); false — расстояние вне пределов, нужен ParseSupportFallback
+    bool ParseSupport(const NTLRecordValues& values);
+    // SPRG с другим порядком полей: поиск расстояния после "N" и координат после второго "*"
+    bool ParseSupportFallback(const NTLTokens& tokens);
+    // Парсинг REST/ANCH (опора в последней точке)
+    bool ParseRestraint(const NTLRecordValues& values, std::wstring_view keyword);
     
     // Парсинг строки OPER (операция)
-    bool ParseOperation(const CString& line);
+    bool ParseOperation(const NTLRecordValues& values);
     
-    // Парсинг строки RUN (участок)
-    bool ParseRun(const CString& line);
-    // Парсинг строки BEND (как RUN, но сохраняем сегмент)
-    bool ParseBend(const CString& line);
-    // Парсинг VALV/FLA/RED/TEE
-    bool ParseInlineValv(const CString& line);
-    bool ParseInlineFla(const CString& line);
-    bool ParseInlineRed(const CString& line);
-    bool ParseInlineTee(const CString& line);
+    // Парсинг строки RUN/BEND/ELBO (участок)
+    bool ParseRun(const NTLRecordValues& values);
+    // Парсинг VALV/RED/TEE
+    bool ParseInline(const NTLRecordValues& values, NTLInline::Type type);
     
-    // Разбор строки на токены (разделитель - пробел)
-    std::vector<CString> Tokenize(const CString& line) const;
+    // Разбор строки на токены (разделитель - пробел); токены ссылаются на line
+    void Tokenize(const CString& line, NTLTokens& tokens) const;
     
     // Преобразование строки в число
-    double StringToDouble(const CString& str) const;
+    double StringToDouble(std::wstring_view str) const;
     
     // Преобразование строки в int
-    int StringToInt(const CString& str) const;
+    int StringToInt(std::wstring_view str) const;
+
+    // Номер текущей ветки (до первой SEG — ветка без имени)
+    uint32_t CurrentBranch();
+    // Упорядочить записи по веткам и построить смещения индекса
+    void IndexBranches();
 
 private:
-    std::vector<NTLSegment> m_segments;
-    std::vector<NTLInline> m_inlines;
-    std::vector<NTLSupport> m_supports;
+    CParseArena m_arena;
+    NTLTokens m_tokens;
+    InputCodec m_inputCodec = InputCodec::Plain;
+    uint64_t m_inputBytes = 0;
+    uint64_t m_outputBytes = 0;
+    std::string m_inputError;
+    size_t m_malformedRecords = 0;
+    CNTLBranchIndex m_branches;
+    CCompactNTLSegments m_segments;
+    NTLInlineList m_inlines;
+    NTLSupportList m_supports;
     std::vector<NTLOperation> m_operations;
     
     // Текущая позиция для расчета опор (аккумулируемая длина)
@@ -125,10 +402,51 @@ private:
     double m_currentDiameter;
     double m_currentWallThickness;
     double m_currentOD;
-    CString m_currentPipeName;
-    CString m_lastSegName;
-    CString m_currentSegmentId;
+    CArenaString m_currentPipeName;
+    CArenaString m_lastSegName;
+    CArenaString m_currentSegmentId;
+    uint32_t m_currentBranch;
 
     // Создать сегмент от m_lastPoint до newPoint с текущими параметрами трубы
     bool CreateSegmentTo(const AcGePoint3d& newPoint);
 };
+
+// Склейка концов сегментов разбора в общие вершины с допуском tolerance (см. CPointWelder).
+// Точки читаются обходом компактных сегментов, копии сегментов нет:
+// endpoints[2i], endpoints[2i + 1] — вершины начала и конца сегмента i,
+// xyz — канонические положения вершин подряд. Возвращает число вершин.
+size_t WeldNTLSegments(const CCompactNTLSegments& segments, double tolerance,
+    CountedVector<uint32_t>& endpoints, CountedVector<double>& xyz);
+
+// Непрерывная труба: цепочка сегментов с одинаковыми OD/WT/pipeName —
+// диапазон NTLPrepared::segments
+struct NTLChain
+{
+    CPreparedNTLSegments::CSpan segs;
+    uint32_t branch = kNoBranch;        // ветки первого и последнего сегмента; сегменты
+    uint32_t lastBranch = kNoBranch;    // упорядочены по веткам, между ними — ветки цепочки
+    double totalLen = 0.0;
+};
+
+// Сегменты после склейки и цепочки по ним. Цепочки ссылаются на segments, сегменты —
+// на атрибуты разбора: структуру не копировать, парсер должен жить дольше.
+struct NTLPrepared
+{
+    CPreparedNTLSegments segments;
+    CountedVector<NTLChain> chains;
+};
+
+// Счётчики подготовки для журнала
+struct NTLPrepareStats
+{
+    size_t endpoints = 0;
+    size_t vertices = 0;
+    size_t zeroLength = 0;      // отброшено нулевых сегментов
+    size_t merged = 0;          // сегментов ушло в склейку коллинеарных
+};
+
+// Подготовка импорта без SDK: склейка концов (WeldNTLSegments), слияние коллинеарных
+// (MergeCollinearSegments) под MemPhase::Merge и группировка в цепочки под
+// MemPhase::Chaining. Общая для IMPORTNTL/PREVIEWNTL и бюджета памяти (MemBudget.h).
+void BuildNTLChains(const CCompactNTLSegments& parsed, double weldTolerance, double simplifyAngleDeg,
+    NTLPrepared& prepared, NTLPrepareStats& stats);
@@ -0,0 +1,756 @@
+#include "stdafx.h"
+#include "NTLReconcile.h"
+#include <cmath>
+#include <unordered_map>
+
+namespace
+{
+// splitmix64: перемешивание ключа, чтобы сумма по вершинам не зависела от порядка
+// и не вырождалась на соседних целых
+uint64_t Mix(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+uint64_t CellKey(int64_t x, int64_t y, int64_t z)
+{
+    return Mix(Mix(Mix((uint64_t)x) ^ (uint64_t)y) ^ (uint64_t)z);
+}
+
+// Вершина цепочки при построении формы: степень и направления первых двух сегментов
+struct ShapeVertex
+{
+    uint32_t degree = 0;
+    double dir[2][3];
+};
+
+// Ключ -> значения в порядке добавления (цепочка next по массиву)
+class CKeyIndex
+{
+public:
+    void Reserve(size_t n)
+    {
+        m_heads.reserve(n);
+        m_next.reserve(n);
+    }
+
+    void Add(uint64_t key, uint32_t value)
+    {
+        const uint32_t slot = (uint32_t)m_next.size();
+        m_next.push_back(kReconcileNone);
+        m_values.push_back(value);
+        auto it = m_heads.find(key);
+        if (it == m_heads.end())
+        {
+            m_heads.emplace(key, Range{ slot, slot });
+            return;
+        }
+        m_next[it->second.last] = slot;
+        it->second.last = slot;
+    }
+
+    // f(value) для значений ключа по порядку; f вернул true — обход прекращается
+    template <typename F>
+    void ForEach(uint64_t key, F f) const
+    {
+        auto it = m_heads.find(key);
+        if (it == m_heads.end())
+            return;
+        for (uint32_t slot = it->second.first; slot != kReconcileNone; slot = m_next[slot])
+        {
+            if (f(m_values[slot]))
+                return;
+        }
+    }
+
+private:
+    struct Range
+    {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    std::unordered_map<uint64_t, Range> m_heads;
+    std::vector<uint32_t> m_next;
+    std::vector<uint32_t> m_values;
+};
+
+// Имя -> индекс, если имя на стороне единственное; повторы исключаются
+void IndexUniqueNames(const std::vector<std::wstring>& names, std::unordered_map<std::wstring, uint32_t>& index)
+{
+    index.clear();
+    index.reserve(names.size());
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+        if (names[i].empty())
+            continue;
+        auto res = index.emplace(names[i], (uint32_t)i);
+        if (!res.second)
+            res.first->second = kReconcileNone;
+    }
+}
+
+bool SameProfile(const ReconcileChain& a, const ReconcileChain& b, double tolerance)
+{
+    if (a.od <= 0.0 || b.od <= 0.0)
+        return true;
+    if (std::fabs(a.od - b.od) > tolerance)
+        return false;
+    return a.wt <= 0.0 || b.wt <= 0.0 || std::fabs(a.wt - b.wt) <= tolerance;
+}
+
+// Опоры сопоставляются только с опорами, инлайны — с инлайнами любого типа
+bool SameGroup(ReconcileItemKind a, ReconcileItemKind b)
+{
+    return (a == ReconcileItemKind::Support) == (b == ReconcileItemKind::Support);
+}
+
+double Distance2(const double a[3], const double b[3])
+{
+    const double dx = a[0] - b[0];
+    const double dy = a[1] - b[1];
+    const double dz = a[2] - b[2];
+    return dx * dx + dy * dy + dz * dz;
+}
+
+void MatchChains(const ReconcileModel& drawing, const ReconcileModel& ntl, const ReconcileOptions& options,
+    ReconcileResult& result)
+{
+    const size_t nd = drawing.chains.size();
+    const size_t nn = ntl.chains.size();
+    std::vector<ReconcileShape> dShape(nd);
+    std::vector<ReconcileShape> nShape(nn);
+    for (size_t i = 0; i < nd; ++i)
+        ComputeReconcileShape(drawing, drawing.chains[i], options.quantum, dShape[i]);
+    for (size_t i = 0; i < nn; ++i)
+        ComputeReconcileShape(ntl, ntl.chains[i], options.quantum, nShape[i]);
+
+    std::vector<uint32_t> dPair(nd, kReconcileNone);
+    std::vector<uint32_t> nPair(nn, kReconcileNone);
+    std::vector<ReconcileStatus> nStatus(nn, ReconcileStatus::Added);
+    auto pair = [&](uint32_t d, uint32_t n)
+    {
+        dPair[d] = n;
+        nPair[n] = d;
+        const ReconcileChain& dc = drawing.chains[d];
+        const ReconcileChain& nc = ntl.chains[n];
+        if (dShape[d].cornerCount == 0 || dShape[d].hash != nShape[n].hash)
+            nStatus[n] = ReconcileStatus::Moved;
+        else
+            nStatus[n] = SameProfile(dc, nc, options.profileTolerance) ? ReconcileStatus::Unchanged : ReconcileStatus::Resized;
+    };
+
+    // 1) Форма; при нескольких кандидатах — с тем же профилем
+    CKeyIndex byShape;
+    byShape.Reserve(nd);
+    for (size_t i = 0; i < nd; ++i)
+    {
+        if (dShape[i].cornerCount > 0)
+            byShape.Add(dShape[i].hash, (uint32_t)i);
+    }
+    for (size_t n = 0; n < nn; ++n)
+    {
+        if (nShape[n].cornerCount == 0)
+            continue;
+        uint32_t best = kReconcileNone;
+        byShape.ForEach(nShape[n].hash, [&](uint32_t d)
+        {
+            if (dPair[d] != kReconcileNone)
+                return false;
+            if (best == kReconcileNone)
+                best = d;
+            if (SameProfile(drawing.chains[d], ntl.chains[n], options.profileTolerance))
+            {
+                best = d;
+                return true;
+            }
+            return false;
+        });
+        if (best != kReconcileNone)
+            pair(best, (uint32_t)n);
+    }
+
+    // 2) Имя, единственное с обеих сторон
+    std::vector<std::wstring> names;
+    std::unordered_map<std::wstring, uint32_t> dNames;
+    std::unordered_map<std::wstring, uint32_t> nNames;
+    names.reserve(nd > nn ? nd : nn);
+    for (const ReconcileChain& c : drawing.chains)
+        names.push_back(c.name);
+    IndexUniqueNames(names, dNames);
+    names.clear();
+    for (const ReconcileChain& c : ntl.chains)
+        names.push_back(c.name);
+    IndexUniqueNames(names, nNames);
+    for (size_t n = 0; n < nn; ++n)
+    {
+        if (nPair[n] != kReconcileNone || ntl.chains[n].name.empty())
+            continue;
+        auto own = nNames.find(ntl.chains[n].name);
+        auto it = dNames.find(ntl.chains[n].name);
+        if (own == nNames.end() || own->second == kReconcileNone || it == dNames.end() || it->second == kReconcileNone)
+            continue;
+        if (dPair[it->second] == kReconcileNone)
+            pair(it->second, (uint32_t)n);
+    }
+
+    // 3) Общий конец
+    CKeyIndex byEnd;
+    byEnd.Reserve(nd * 2);
+    for (size_t i = 0; i < nd; ++i)
+    {
+        if (dPair[i] != kReconcileNone)
+            continue;
+        for (uint32_t e = 0; e < dShape[i].endCount; ++e)
+            byEnd.Add(dShape[i].ends[e], (uint32_t)i);
+    }
+    for (size_t n = 0; n < nn; ++n)
+    {
+        if (nPair[n] != kReconcileNone)
+            continue;
+        for (uint32_t e = 0; e < nShape[n].endCount && nPair[n] == kReconcileNone; ++e)
+        {
+            byEnd.ForEach(nShape[n].ends[e], [&](uint32_t d)
+            {
+                if (dPair[d] != kReconcileNone)
+                    return false;
+                pair(d, (uint32_t)n);
+                return true;
+            });
+        }
+    }
+
+    result.chains.reserve(nn + nd);
+    for (size_t n = 0; n < nn; ++n)
+        result.chains.push_back({ nStatus[n], nPair[n], (uint32_t)n });
+    for (size_t d = 0; d < nd; ++d)
+    {
+        if (dPair[d] == kReconcileNone)
+            result.chains.push_back({ ReconcileStatus::Removed, (uint32_t)d, kReconcileNone });
+    }
+}
+
+void MatchItems(const ReconcileModel& drawing, const ReconcileModel& ntl, const ReconcileOptions& options,
+    ReconcileResult& result)
+{
+    const std::vector<ReconcileItem>& dItems = drawing.items;
+    const std::vector<ReconcileItem>& nItems = ntl.items;
+    const size_t nd = dItems.size();
+    const size_t nn = nItems.size();
+    std::vector<uint32_t> dPair(nd, kReconcileNone);
+    std::vector<uint32_t> nPair(nn, kReconcileNone);
+    std::vector<ReconcileStatus> nStatus(nn, ReconcileStatus::Added);
+    const double tolerance = options.itemTolerance > 0.0 ? options.itemTolerance : 1.0;
+    const double tolerance2 = tolerance * tolerance;
+    auto pair = [&](uint32_t d, uint32_t n)
+    {
+        dPair[d] = n;
+        nPair[n] = d;
+        if (Distance2(dItems[d].pos, nItems[n].pos) > tolerance2)
+            nStatus[n] = ReconcileStatus::Moved;
+        else
+            nStatus[n] = dItems[d].kind == nItems[n].kind ? ReconcileStatus::Unchanged : ReconcileStatus::Resized;
+    };
+
+    // 1) Имя, единственное с обеих сторон, в той же группе (опора/инлайн)
+    std::vector<std::wstring> names;
+    std::unordered_map<std::wstring, uint32_t> dNames;
+    std::unordered_map<std::wstring, uint32_t> nNames;
+    names.reserve(nd > nn ? nd : nn);
+    for (const ReconcileItem& it : dItems)
+        names.push_back(it.name);
+    IndexUniqueNames(names, dNames);
+    names.clear();
+    for (const ReconcileItem& it : nItems)
+        names.push_back(it.name);
+    IndexUniqueNames(names, nNames);
+    for (size_t n = 0; n < nn; ++n)
+    {
+        if (nItems[n].name.empty())
+            continue;
+        auto own = nNames.find(nItems[n].name);
+        auto it = dNames.find(nItems[n].name);
+        if (own == nNames.end() || own->second == kReconcileNone || it == dNames.end() || it->second == kReconcileNone)
+            continue;
+        if (dPair[it->second] == kReconcileNone && SameGroup(dItems[it->second].kind, nItems[n].kind))
+            pair(it->second, (uint32_t)n);
+    }
+
+    // 2) Положение: ячейка сетки с шагом допуска и 26 соседних, ближайший в допуске
+    auto cellOf = [tolerance](const double p[3], int64_t c[3])
+    {
+        for (int k = 0; k < 3; ++k)
+            c[k] = (int64_t)std::floor(p[k] / tolerance);
+    };
+    CKeyIndex byCell;
+    byCell.Reserve(nd);
+    for (size_t i = 0; i < nd; ++i)
+    {
+        if (dPair[i] != kReconcileNone)
+            continue;
+        int64_t c[3];
+        cellOf(dItems[i].pos, c);
+        byCell.Add(CellKey(c[0], c[1], c[2]), (uint32_t)i);
+    }
+    for (size_t n = 0; n < nn; ++n)
+    {
+        if (nPair[n] != kReconcileNone)
+            continue;
+        const ReconcileItem& item = nItems[n];
+        int64_t c[3];
+        cellOf(item.pos, c);
+        uint32_t best = kReconcileNone;
+        double bestDist2 = tolerance2;
+        for (int dx = -1; dx <= 1; ++dx)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                for (int dz = -1; dz <= 1; ++dz)
+                {
+                    byCell.ForEach(CellKey(c[0] + dx, c[1] + dy, c[2] + dz), [&](uint32_t d)
+                    {
+                        if (dPair[d] != kReconcileNone || !SameGroup(dItems[d].kind, item.kind))
+                            return false;
+                        const double d2 = Distance2(dItems[d].pos, item.pos);
+                        if (d2 <= bestDist2)
+                        {
+                            bestDist2 = d2;
+                            best = d;
+                        }
+                        return false;
+                    });
+                }
+            }
+        }
+        if (best != kReconcileNone)
+            pair(best, (uint32_t)n);
+    }
+
+    result.items.reserve(nn + nd);
+    for (size_t n = 0; n < nn; ++n)
+        result.items.push_back({ nStatus[n], nPair[n], (uint32_t)n });
+    for (size_t d = 0; d < nd; ++d)
+    {
+        if (dPair[d] == kReconcileNone)
+            result.items.push_back({ ReconcileStatus::Removed, (uint32_t)d, kReconcileNone });
+    }
+}
+} // namespace
+
+const wchar_t* ReconcileStatusName(ReconcileStatus status)
+{
+    switch (status)
+    {
+    case ReconcileStatus::Unchanged: return L"Unchanged";
+    case ReconcileStatus::Moved: return L"Moved";
+    case ReconcileStatus::Resized: return L"Resized";
+    case ReconcileStatus::Added: return L"Added";
+    case ReconcileStatus::Removed: return L"Removed";
+    default: return L"?";
+    }
+}
+
+const wchar_t* ReconcileItemKindName(ReconcileItemKind kind)
+{
+    switch (kind)
+    {
+    case ReconcileItemKind::Support: return L"Support";
+    case ReconcileItemKind::Inline: return L"Inline";
+    case ReconcileItemKind::Reducer: return L"Reducer";
+    case ReconcileItemKind::Tee: return L"Tee";
+    default: return L"?";
+    }
+}
+
+ReconcileChain& ReconcileModel::BeginChain(const std::wstring& name, uint64_t handle, double od, double wt)
+{
+    ReconcileChain chain;
+    chain.name = name;
+    chain.handle = handle;
+    chain.od = od;
+    chain.wt = wt;
+    chain.firstSegment = (uint32_t)segments.size();
+    chains.push_back(chain);
+    return chains.back();
+}
+
+void ReconcileModel::AddSegment(const double start[3], const double end[3])
+{
+    ReconcileSegment s;
+    for (int k = 0; k < 3; ++k)
+    {
+        s.start[k] = start[k];
+        s.end[k] = end[k];
+    }
+    segments.push_back(s);
+    ++chains.back().segmentCount;
+}
+
+void ReconcileModel::AddItem(ReconcileItemKind kind, const std::wstring& name, uint64_t handle, const double pos[3])
+{
+    ReconcileItem item;
+    item.kind = kind;
+    item.name = name;
+    item.handle = handle;
+    item.pos[0] = pos[0];
+    item.pos[1] = pos[1];
+    item.pos[2] = pos[2];
+    items.push_back(item);
+}
+
+void ReconcileModel::Clear()
+{
+    chains.clear();
+    segments.clear();
+    items.clear();
+}
+
+void ReconcileResult::Clear()
+{
+    chains.clear();
+    items.clear();
+    for (size_t i = 0; i < (size_t)ReconcileStatus::Count; ++i)
+    {
+        chainCounts[i] = 0;
+        itemCounts[i] = 0;
+    }
+}
+
+void ComputeReconcileShape(const ReconcileModel& model, const ReconcileChain& chain, double quantum,
+    ReconcileShape& shape)
+{
+    shape = ReconcileShape();
+    if (quantum <= 0.0)
+        quantum = 1e-3;
+
+    std::unordered_map<uint64_t, ShapeVertex> vertices;
+    vertices.reserve((size_t)chain.segmentCount * 2);
+    auto addEnd = [&vertices](uint64_t key, const double dir[3])
+    {
+        ShapeVertex& v = vertices[key];
+        if (v.degree < 2)
+        {
+            for (int k = 0; k < 3; ++k)
+                v.dir[v.degree][k] = dir[k];
+        }
+        ++v.degree;
+    };
+
+    for (uint32_t i = 0; i < chain.segmentCount; ++i)
+    {
+        const ReconcileSegment& s = model.segments[chain.firstSegment + i];
+        int64_t qs[3];
+        int64_t qe[3];
+        double dir[3];
+        double len2 = 0.0;
+        for (int k = 0; k < 3; ++k)
+        {
+            qs[k] = (int64_t)std::llround(s.start[k] / quantum);
+            qe[k] = (int64_t)std::llround(s.end[k] / quantum);
+            dir[k] = (double)(qe[k] - qs[k]);
+            len2 += dir[k] * dir[k];
+        }
+        if (len2 == 0.0)
+            continue;   // нулевой сегмент
+        const double inv = 1.0 / std::sqrt(len2);
+        double back[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            dir[k] *= inv;
+            back[k] = -dir[k];
+        }
+        addEnd(CellKey(qs[0], qs[1], qs[2]), dir);
+        addEnd(CellKey(qe[0], qe[1], qe[2]), back);
+    }
+
+    // Прямая вершина степени 2: направления от неё противоположны
+    const double kStraightCos = 1.0 - 1e-9;
+    uint64_t sum = 0;
+    for (const auto& kv : vertices)
+    {
+        const ShapeVertex& v = kv.second;
+        if (v.degree == 2)
+        {
+            const double dot = v.dir[0][0] * v.dir[1][0] + v.dir[0][1] * v.dir[1][1] + v.dir[0][2] * v.dir[1][2];
+            if (dot <= -kStraightCos)
+                continue;
+        }
+        if (v.degree == 1 && shape.endCount < 2)
+            shape.ends[shape.endCount++] = kv.first;
+        sum += Mix(kv.first ^ ((uint64_t)v.degree << 56));
+        ++shape.cornerCount;
+    }
+    if (shape.endCount == 2 && shape.ends[1] < shape.ends[0])
+    {
+        const uint64_t t = shape.ends[0];
+        shape.ends[0] = shape.ends[1];
+        shape.ends[1] = t;
+    }
+    shape.hash = Mix(sum ^ shape.cornerCount);
+}
+
+void ReconcileModels(const ReconcileModel& drawing, const ReconcileModel& ntl, const ReconcileOptions& options,
+    ReconcileResult& result)
+{
+    result.Clear();
+    MatchChains(drawing, ntl, options, result);
+    MatchItems(drawing, ntl, options, result);
+    for (const ReconcileMatch& m : result.chains)
+        ++result.chainCounts[(size_t)m.status];
+    for (const ReconcileMatch& m : result.items)
+        ++result.itemCounts[(size_t)m.status];
+}
+
+CChainFingerprint::CChainFingerprint(const ReconcileShape& shape, double od, double wt)
+{
+    m_head = Mix(Mix(shape.hash) ^ (uint64_t)std::llround(od * 1000.0)) ^ (uint64_t)std::llround(wt * 1000.0);
+}
+
+void CChainFingerprint::AddItem(bool support, int type, int segIndex, double offset)
+{
+    const uint64_t kind = support ? 0xFF : (uint64_t)(type & 0x7F);
+    m_items += Mix(CellKey((int64_t)kind, (int64_t)segIndex, (int64_t)std::llround(offset * 1000.0)));
+    ++m_count;
+}
+
+uint64_t CChainFingerprint::Get() const
+{
+    const uint64_t h = Mix(m_head ^ Mix(m_items ^ m_count));
+    return h != 0 ? h : 1;
+}
+
+void MatchChainFingerprints(const ReconcileModel& drawing, const std::wstring& source,
+    const std::vector<uint64_t>& fingerprints, std::vector<uint32_t>& keep, std::vector<uint32_t>& stale)
+{
+    const size_t nd = drawing.chains.size();
+    keep.assign(fingerprints.size(), kReconcileNone);
+    stale.clear();
+
+    // Оси других источников в сверке не участвуют: ни пары, ни удаления
+    std::vector<uint8_t> own(nd, 0);
+    CKeyIndex byPrint;
+    byPrint.Reserve(nd);
+    for (size_t i = 0; i < nd; ++i)
+    {
+        const ReconcileChain& ch = drawing.chains[i];
+        own[i] = ch.fingerprint != 0 && !ch.source.empty() && ch.source == source;
+        if (own[i] && !ch.pending)
+            byPrint.Add(ch.fingerprint, (uint32_t)i);
+    }
+    std::vector<uint8_t> used(nd, 0);
+    for (size_t n = 0; n < fingerprints.size(); ++n)
+    {
+        byPrint.ForEach(fingerprints[n], [&](uint32_t d)
+        {
+            if (used[d])
+                return false;
+            used[d] = 1;
+            keep[n] = d;
+            return true;
+        });
+    }
+    for (size_t i = 0; i < nd; ++i)
+    {
+        if (!used[i] && own[i])
+            stale.push_back((uint32_t)i);
+    }
+}
+
+#ifdef NTLRECONCILE_MAIN
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <random>
+#include <string>
+
+// Модель из ортогональных цепочек с опорами и инлайнами. Чертёж — та же модель:
+// сегменты в обратном порядке и разрезаны пополам, без профиля и имён цепочек.
+// Имя из NTL у опоры чертежа — только у размеченных импортом (чётные цепочки),
+// у остальных — KKS_PART, как после KKSASSIGN; он с именем NTL не совпадает.
+// В NTL вносятся правки каждого вида; сверка должна найти их все.
+int main(int argc, char** argv)
+{
+    const size_t chainCount = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 50000;
+    const size_t edits = chainCount / 100 > 0 ? chainCount / 100 : 1;
+    std::mt19937 rng(12345);
+    std::uniform_int_distribution<int> axis(0, 2);
+    std::uniform_int_distribution<int> steps(2, 8);
+    std::uniform_int_distribution<int> length(1, 20);
+
+    struct Path
+    {
+        std::vector<double> xyz;
+        double od;
+    };
+    std::vector<Path> paths(chainCount);
+    for (size_t c = 0; c < chainCount; ++c)
+    {
+        Path& p = paths[c];
+        double pt[3] = { (double)(c % 500) * 10000.0, (double)(c / 500) * 10000.0, 0.0 };
+        p.xyz.assign(pt, pt + 3);
+        int lastAxis = -1;
+        const int n = steps(rng);
+        for (int i = 0; i < n; ++i)
+        {
+            int a = axis(rng);
+            if (a == lastAxis)
+                a = (a + 1) % 3;
+            lastAxis = a;
+            pt[a] += length(rng) * 100.0;
+            p.xyz.insert(p.xyz.end(), pt, pt + 3);
+        }
+        p.od = 57.0 + (double)(c % 5) * 50.0;
+    }
+
+    ReconcileModel drawing;
+    for (size_t c = 0; c < chainCount; ++c)
+    {
+        const Path& p = paths[c];
+        drawing.BeginChain(std::wstring(), c + 1, c % 2 ? p.od : 0.0, 0.0);
+        for (size_t v = p.xyz.size() / 3 - 1; v > 0; --v)
+        {
+            const double* a = &p.xyz[v * 3];
+            const double* b = &p.xyz[(v - 1) * 3];
+            const double mid[3] = { (a[0] + b[0]) * 0.5, (a[1] + b[1]) * 0.5, (a[2] + b[2]) * 0.5 };
+            drawing.AddSegment(a, mid);
+            drawing.AddSegment(mid, b);
+        }
+        const double* s = &p.xyz[3];
+        const std::wstring name = c % 2 ? L"10LBA" + std::to_wstring(c) + L"BQ001" : L"S" + std::to_wstring(c);
+        drawing.AddItem(ReconcileItemKind::Support, name, c + 1, s);
+        drawing.AddItem(ReconcileItemKind::Inline, std::wstring(), c + 1, &p.xyz[6]);
+    }
+
+    // Правки: [0, e) — сдвиг средней вершины, [e, 2e) — другой OD, [2e, 3e) — удалены,
+    // [3e, 4e) — сдвиг опоры (по имени — только чётные), [4e, 5e) — тип инлайна; плюс e новых цепочек
+    ReconcileModel ntl;
+    for (size_t c = 0; c < chainCount; ++c)
+    {
+        if (c >= 2 * edits && c < 3 * edits)
+            continue;
+        Path p = paths[c];
+        if (c < edits)
+            p.xyz[3 + 2] += 300.0;
+        if (c >= edits && c < 2 * edits)
+            p.od += 1.0;
+        ntl.BeginChain(L"B" + std::to_wstring(c), 0, p.od, 3.0);
+        for (size_t v = 0; v + 1 < p.xyz.size() / 3; ++v)
+            ntl.AddSegment(&p.xyz[v * 3], &p.xyz[(v + 1) * 3]);
+        double s[3] = { paths[c].xyz[3], paths[c].xyz[4], paths[c].xyz[5] };
+        if (c >= 3 * edits && c < 4 * edits)
+            s[2] += 1000.0;
+        ntl.AddItem(ReconcileItemKind::Support, L"S" + std::to_wstring(c), 0, s);
+        const ReconcileItemKind kind = c >= 4 * edits && c < 5 * edits ? ReconcileItemKind::Reducer : ReconcileItemKind::Inline;
+        ntl.AddItem(kind, std::wstring(), 0, &paths[c].xyz[6]);
+    }
+    for (size_t c = 0; c < edits; ++c)
+    {
+        const double a[3] = { -1e6 - c * 1000.0, 0.0, 0.0 };
+        const double b[3] = { -1e6 - c * 1000.0, 500.0, 0.0 };
+        ntl.BeginChain(L"N" + std::to_wstring(c), 0, 57.0, 3.0);
+        ntl.AddSegment(a, b);
+    }
+
+    ReconcileOptions options;
+    ReconcileResult result;
+    auto t0 = std::chrono::steady_clock::now();
+    ReconcileModels(drawing, ntl, options, result);
+    auto t1 = std::chrono::steady_clock::now();
+
+    const size_t* cc = result.chainCounts;
+    const size_t* ic = result.itemCounts;
+    std::printf("chains %zu segments %zu items %zu, %.0f ms\n", ntl.chains.size(), drawing.segments.size(),
+        drawing.items.size(), std::chrono::duration<double, std::milli>(t1 - t0).count());
+    for (size_t s = 0; s < (size_t)ReconcileStatus::Count; ++s)
+        std::printf("  %-10ls chains %7zu  items %7zu\n", ReconcileStatusName((ReconcileStatus)s), cc[s], ic[s]);
+
+    // Половина правок OD приходится на оси без профиля — они остаются Unchanged.
+    // Сдвинутая опора без имени из NTL даёт пару Removed + Added.
+    size_t resizedVisible = 0;
+    for (size_t c = edits; c < 2 * edits; ++c)
+        resizedVisible += c % 2;
+    size_t movedUnnamed = 0;
+    for (size_t c = 3 * edits; c < 4 * edits; ++c)
+        movedUnnamed += c % 2;
+    const bool ok =
+        cc[(size_t)ReconcileStatus::Moved] == edits &&
+        cc[(size_t)ReconcileStatus::Added] == edits &&
+        cc[(size_t)ReconcileStatus::Removed] == edits &&
+        cc[(size_t)ReconcileStatus::Resized] == resizedVisible &&
+        ic[(size_t)ReconcileStatus::Moved] == edits - movedUnnamed &&
+        ic[(size_t)ReconcileStatus::Resized] == edits &&
+        ic[(size_t)ReconcileStatus::Removed] == 2 * edits + movedUnnamed &&
+        ic[(size_t)ReconcileStatus::Added] == movedUnnamed;
+
+    // Повторный импорт: отпечатки исходной модели на осях, правки — пересоздание
+    ReconcileModel source;
+    for (size_t c = 0; c < chainCount; ++c)
+    {
+        const Path& p = paths[c];
+        source.BeginChain(std::wstring(), 0, p.od, 3.0);
+        for (size_t v = 0; v + 1 < p.xyz.size() / 3; ++v)
+            source.AddSegment(&p.xyz[v * 3], &p.xyz[(v + 1) * 3]);
+    }
+    auto fingerprintOf = [&options](const ReconcileModel& model, const ReconcileChain& ch)
+    {
+        ReconcileShape shape;
+        ComputeReconcileShape(model, ch, options.quantum, shape);
+        return CChainFingerprint(shape, ch.od, ch.wt).Get();
+    };
+    for (size_t c = 0; c < chainCount; ++c)
+    {
+        drawing.chains[c].fingerprint = fingerprintOf(source, source.chains[c]);
+        drawing.chains[c].source = L"model.ntl";
+    }
+
+    // Второй источник в том же чертеже: его оси не пара и не устаревшие для model.ntl
+    const size_t otherCount = edits;
+    ReconcileModel other;
+    for (size_t c = 0; c < otherCount; ++c)
+    {
+        const double a[3] = { 0.0, -1e6 - c * 1000.0, 0.0 };
+        const double b[3] = { 600.0, -1e6 - c * 1000.0, 0.0 };
+        other.BeginChain(std::wstring(), 0, 108.0, 4.0);
+        other.AddSegment(a, b);
+        ReconcileChain& ch = drawing.BeginChain(std::wstring(), chainCount + c + 1, 108.0, 0.0);
+        drawing.AddSegment(b, a);
+        ch.fingerprint = fingerprintOf(other, other.chains[c]);
+        ch.source = L"other.ntl";
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+    std::vector<uint64_t> fingerprints;
+    fingerprints.reserve(ntl.chains.size());
+    for (const ReconcileChain& ch : ntl.chains)
+        fingerprints.push_back(fingerprintOf(ntl, ch));
+    std::vector<uint32_t> keep;
+    std::vector<uint32_t> stale;
+    MatchChainFingerprints(drawing, L"model.ntl", fingerprints, keep, stale);
+    size_t recreate = 0;
+    for (uint32_t k : keep)
+        recreate += k == kReconcileNone;
+    auto t3 = std::chrono::steady_clock::now();
+    std::printf("incremental: create %zu, erase %zu, %.0f ms\n", recreate, stale.size(),
+        std::chrono::duration<double, std::milli>(t3 - t2).count());
+    bool incrementalOk = recreate == 3 * edits && stale.size() == 3 * edits;
+    for (uint32_t d : stale)
+        incrementalOk = incrementalOk && drawing.chains[d].source == L"model.ntl";
+
+    // Повторный импорт other.ntl без первой цепочки: устаревает только её ось
+    std::vector<uint64_t> otherPrints;
+    for (size_t c = 1; c < otherCount; ++c)
+        otherPrints.push_back(fingerprintOf(other, other.chains[c]));
+    MatchChainFingerprints(drawing, L"other.ntl", otherPrints, keep, stale);
+    size_t otherKept = 0;
+    for (uint32_t k : keep)
+        otherKept += k != kReconcileNone && drawing.chains[k].source == L"other.ntl";
+    std::printf("second source: kept %zu of %zu, erase %zu\n", otherKept, otherPrints.size(), stale.size());
+    const bool sourcesOk = otherKept == otherPrints.size() && stale.size() == 1 && stale[0] == chainCount;
+
+    std::printf("%s\n", ok && incrementalOk && sourcesOk ? "ok" : "MISMATCH");
+    return ok && incrementalOk && sourcesOk ? 0 : 1;
+}
+#endif
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Сверка нового NTL с чертежом (без зависимости от SDK).
+// Обе стороны приводятся к одной модели: цепочки (ломаная оси, профиль, имя)
+// и элементы (опоры и инлайны с положением и именем). Сопоставление — хеш-соединение
+// за O(n) в три шага для цепочек:
+//   1) форма: множество вершин-углов и концов ломаной (квантованных), без учёта
+//      порядка и направления сегментов и разбиения прямых участков;
+//   2) имя, если оно единственное с обеих сторон;
+//   3) общий конец цепочки.
+// Элементы: имя (единственное с обеих сторон), затем положение в хеш-сетке с шагом
+// допуска. Итог по каждой паре — ReconcileStatus.
+//
+// Проверка без nanoCAD — -DNTLRECONCILE_MAIN (README, «Проверки без nanoCAD»).
+
+const uint32_t kReconcileNone = 0xFFFFFFFFu;
+
+enum class ReconcileStatus : uint8_t
+{
+    Unchanged,  // та же форма и профиль / то же место и тип
+    Moved,      // цепочка сопоставлена по имени или концу, форма другая; элемент сдвинут
+    Resized,    // форма та же, другой OD/WT; элемент на месте, другой тип
+    Added,      // только в NTL
+    Removed,    // только в чертеже
+
+    Count
+};
+
+const wchar_t* ReconcileStatusName(ReconcileStatus status);
+
+enum class ReconcileItemKind : uint8_t
+{
+    Support,
+    Inline,
+    Reducer,
+    Tee
+};
+
+const wchar_t* ReconcileItemKindName(ReconcileItemKind kind);
+
+struct ReconcileSegment
+{
+    double start[3];
+    double end[3];
+};
+
+// Цепочка: сегменты [firstSegment, firstSegment + segmentCount) модели
+struct ReconcileChain
+{
+    std::wstring name;          // пусто — без имени
+    uint64_t handle = 0;        // ось чертежа (handle), у NTL — 0
+    double od = 0.0;            // 0 — профиль неизвестен
+    double wt = 0.0;
+    uint64_t fingerprint = 0;   // отпечаток импорта на оси (CChainFingerprint), 0 — ось не из IMPORTNTL
+    std::wstring source;        // источник импорта из метки оси (NTLChainTagSource), пусто — неизвестен
+    bool pending = false;       // опоры/инлайны импорта на оси ещё не расставлены
+    uint32_t firstSegment = 0;
+    uint32_t segmentCount = 0;
+};
+
+struct ReconcileItem
+{
+    ReconcileItemKind kind = ReconcileItemKind::Support;
+    std::wstring name;
+    uint64_t handle = 0;
+    std::wstring source;        // источник из метки элемента (NTLChainTag.h), пусто — не из импорта
+    double pos[3];
+};
+
+// Одна сторона сверки
+struct ReconcileModel
+{
+    std::vector<ReconcileChain> chains;
+    std::vector<ReconcileSegment> segments;
+    std::vector<ReconcileItem> items;
+
+    // Новая цепочка; AddSegment добавляет сегменты в последнюю цепочку
+    ReconcileChain& BeginChain(const std::wstring& name, uint64_t handle, double od, double wt);
+    void AddSegment(const double start[3], const double end[3]);
+    void AddItem(ReconcileItemKind kind, const std::wstring& name, uint64_t handle, const double pos[3]);
+    void Clear();
+};
+
+struct ReconcileOptions
+{
+    double quantum = 1e-3;          // вершины ближе шага — одна вершина (мм)
+    double profileTolerance = 0.01; // OD/WT различаются больше — Resized
+    double itemTolerance = 100.0;   // элементы на таком расстоянии — то же место (мм)
+};
+
+// Пара сопоставления: индексы в моделях чертежа и NTL (kReconcileNone — нет пары)
+struct ReconcileMatch
+{
+    ReconcileStatus status;
+    uint32_t drawing;
+    uint32_t ntl;
+};
+
+struct ReconcileResult
+{
+    std::vector<ReconcileMatch> chains;
+    std::vector<ReconcileMatch> items;
+    size_t chainCounts[(size_t)ReconcileStatus::Count];
+    size_t itemCounts[(size_t)ReconcileStatus::Count];
+
+    void Clear();
+};
+
+// Форма цепочки: хеш множества вершин-углов (степень не 2 или излом) и до двух концов.
+// Прямые вершины степени 2 не входят, поэтому разбиение участка на сегменты
+// (например, ось, разрезанная инлайном) форму не меняет.
+struct ReconcileShape
+{
+    uint64_t hash = 0;
+    uint64_t ends[2] = { 0, 0 };    // ключи концевых вершин
+    uint32_t endCount = 0;
+    uint32_t cornerCount = 0;
+};
+
+void ComputeReconcileShape(const ReconcileModel& model, const ReconcileChain& chain, double quantum,
+    ReconcileShape& shape);
+
+// Сопоставление сторон. Пары идут в порядке NTL, затем удалённые — в порядке чертежа.
+void ReconcileModels(const ReconcileModel& drawing, const ReconcileModel& ntl, const ReconcileOptions& options,
+    ReconcileResult& result);
+
+// Отпечаток цепочки для повторного импорта: форма, профиль и план опор/инлайнов
+// (сегмент оси, смещение, тип). Порядок элементов не важен; значение не бывает 0.
+class CChainFingerprint
+{
+public:
+    CChainFingerprint(const ReconcileShape& shape, double od, double wt);
+
+    // type — тип инлайна (у опоры не учитывается)
+    void AddItem(bool support, int type, int segIndex, double offset);
+    uint64_t Get() const;
+
+private:
+    uint64_t m_head;
+    uint64_t m_items = 0;
+    uint32_t m_count = 0;
+};
+
+// Повторный импорт источника source: ось чертежа того же источника с тем же отпечатком,
+// что у цепочки NTL, остаётся. keep[n] — ось для цепочки n или kReconcileNone (создать заново);
+// stale — размеченные оси источника без пары и с нерасставленным планом (удалить).
+// Оси без отпечатка и оси других источников (в том числе неизвестного) не трогаются.
+void MatchChainFingerprints(const ReconcileModel& drawing, const std::wstring& source,
+    const std::vector<uint64_t>& fingerprints, std::vector<uint32_t>& keep, std::vector<uint32_t>& stale);
@@ -0,0 +1,47 @@
+#include "stdafx.h"
+#include "NTLSchema.h"
+#include <cwchar>
+#include <cwctype>
+#include <cmath>
+
+namespace
+{
+// Поле без '*' и пробелов во временный буфер на стеке; длиннее буфера — не число
+size_t CleanField(std::wstring_view str, wchar_t* buf, size_t bufSize)
+{
+    size_t n = 0;
+    for (wchar_t c : str)
+    {
+        if (c == L'*' || std::iswspace(c))
+            continue;
+        if (n + 1 >= bufSize)
+            return 0;
+        buf[n++] = c;
+    }
+    buf[n] = L'\0';
+    return n;
+}
+}
+
+double NTLFieldToDouble(std::wstring_view str)
+{
+    wchar_t buf[64];
+    if (CleanField(str, buf, sizeof(buf) / sizeof(buf[0])) == 0)
+        return 0.0;
+    return wcstod(buf, nullptr);
+}
+
+bool NTLFieldToDouble(std::wstring_view str, double& value)
+{
+    wchar_t buf[64];
+    const size_t n = CleanField(str, buf, sizeof(buf) / sizeof(buf[0]));
+    value = 0.0;
+    if (n == 0)
+        return false;
+    wchar_t* end = nullptr;
+    const double v = wcstod(buf, &end);
+    if (end != buf + n || !std::isfinite(v))
+        return false;
+    value = v;
+    return true;
+}
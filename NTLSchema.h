@@ -0,0 +1,324 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <cstdint>
+#include <cstddef>
+
+// Схема записей NTL (без зависимости от SDK).
+// Ключевое слово строки переводится в NTLRecord по совершенному хэшу:
+// таблица строится при компиляции, отсутствие коллизий проверяет static_assert.
+// Поля записи описаны таблицей NTLRecordSchema<R>::kFields — позиция токена,
+// тип и слот в NTLRecordValues; ExtractNTLRecord<R> разбирает строку за один
+// проход по таблице. Чтобы добавить ключевое слово или диалект: значение
+// NTLRecord, строка в kNTLKeywords, специализация NTLRecordSchema и обработчик
+// в CNTLParser::ReadFile.
+
+// Токены строки — указатели в текущую строку файла
+typedef std::vector<std::wstring_view> NTLTokens;
+
+enum class NTLRecord : uint8_t
+{
+    Unknown,
+    Seg,
+    Pipe,
+    Sprg,
+    Oper,
+    Run,
+    Bend,
+    Elbo,
+    Valv,
+    Fla,
+    Flaa,
+    Red,
+    Tee,
+    Rest,
+    Anch,
+
+    Count
+};
+
+struct NTLKeyword
+{
+    const char* text;
+    NTLRecord record;
+};
+
+constexpr NTLKeyword kNTLKeywords[] = {
+    { "SEG", NTLRecord::Seg },
+    { "PIPE", NTLRecord::Pipe },
+    { "SPRG", NTLRecord::Sprg },
+    { "OPER", NTLRecord::Oper },
+    { "RUN", NTLRecord::Run },
+    { "BEND", NTLRecord::Bend },
+    { "ELBO", NTLRecord::Elbo },
+    { "VALV", NTLRecord::Valv },
+    { "FLA", NTLRecord::Fla },
+    { "FLAA", NTLRecord::Flaa },
+    { "RED", NTLRecord::Red },
+    { "TEE", NTLRecord::Tee },
+    { "REST", NTLRecord::Rest },
+    { "ANCH", NTLRecord::Anch },
+};
+
+namespace NTLSchemaDetail
+{
+const size_t kHashSize = 32;
+const size_t kMinKeyword = 3;
+const size_t kMaxKeyword = 4;
+
+constexpr size_t Length(const char* s)
+{
+    size_t n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+constexpr unsigned Upper(unsigned c)
+{
+    return c >= 'a' && c <= 'z' ? c - ('a' - 'A') : c;
+}
+
+// Длина, первые два и последний символ в верхнем регистре
+constexpr size_t Hash(size_t length, unsigned c0, unsigned c1, unsigned cLast)
+{
+    return (length + Upper(c0) + 2 * Upper(c1) + 4 * Upper(cLast)) % kHashSize;
+}
+
+struct HashTable
+{
+    NTLRecord slots[kHashSize];
+    uint8_t keyword[kHashSize];     // номер в kNTLKeywords
+    bool collision;
+};
+
+constexpr HashTable BuildHashTable()
+{
+    HashTable table = {};
+    for (size_t i = 0; i < sizeof(kNTLKeywords) / sizeof(kNTLKeywords[0]); ++i)
+    {
+        const char* s = kNTLKeywords[i].text;
+        const size_t n = Length(s);
+        if (n < kMinKeyword || n > kMaxKeyword)
+            table.collision = true;
+        const size_t h = Hash(n, (unsigned char)s[0], (unsigned char)s[1], (unsigned char)s[n - 1]);
+        if (table.slots[h] != NTLRecord::Unknown)
+            table.collision = true;
+        table.slots[h] = kNTLKeywords[i].record;
+        table.keyword[h] = (uint8_t)i;
+    }
+    return table;
+}
+
+constexpr HashTable kHashTable = BuildHashTable();
+static_assert(!kHashTable.collision, "NTL keyword hash: collision or keyword length out of range");
+} // namespace NTLSchemaDetail
+
+// Запись по ключевому слову (без учёта регистра); Unknown — не ключевое слово
+inline NTLRecord FindNTLRecord(std::wstring_view word)
+{
+    using namespace NTLSchemaDetail;
+    const size_t n = word.size();
+    if (n < kMinKeyword || n > kMaxKeyword)
+        return NTLRecord::Unknown;
+    const size_t h = Hash(n, (unsigned)word[0], (unsigned)word[1], (unsigned)word[n - 1]);
+    const NTLRecord record = kHashTable.slots[h];
+    if (record == NTLRecord::Unknown)
+        return NTLRecord::Unknown;
+    const char* s = kNTLKeywords[kHashTable.keyword[h]].text;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (s[i] == 0 || Upper((unsigned)word[i]) != (unsigned char)s[i])
+            return NTLRecord::Unknown;
+    }
+    return s[n] == 0 ? record : NTLRecord::Unknown;
+}
+
+// Число из поля NTL: '*' и пробелы отбрасываются, пустое поле — 0
+double NTLFieldToDouble(std::wstring_view str);
+// То же со строгой проверкой: false — поле пустое или не число целиком (value = 0)
+bool NTLFieldToDouble(std::wstring_view str, double& value);
+
+enum class NTLFieldKind : uint8_t
+{
+    Text,       // токен pos в текстовый слот
+    Real,       // число из токена pos в числовой слот
+    Literal,    // токен pos равен literal (без учёта регистра), иначе строка не по схеме
+    Positives   // первые count положительных чисел начиная с pos в слоты slot..slot+count-1
+};
+
+struct NTLField
+{
+    NTLFieldKind kind;
+    uint8_t pos;
+    uint8_t slot;
+    uint8_t count;
+    const char* literal;
+};
+
+constexpr NTLField NTLText(uint8_t pos, uint8_t slot) { return { NTLFieldKind::Text, pos, slot, 1, nullptr }; }
+constexpr NTLField NTLReal(uint8_t pos, uint8_t slot) { return { NTLFieldKind::Real, pos, slot, 1, nullptr }; }
+constexpr NTLField NTLLiteral(uint8_t pos, const char* literal) { return { NTLFieldKind::Literal, pos, 0, 0, literal }; }
+constexpr NTLField NTLPositives(uint8_t pos, uint8_t slot, uint8_t count) { return { NTLFieldKind::Positives, pos, slot, count, nullptr }; }
+
+// Значения полей записи; бит слота в маске — поле есть в строке
+struct NTLRecordValues
+{
+    static const size_t kTextSlots = 4;
+    static const size_t kRealSlots = 8;
+
+    std::wstring_view text[kTextSlots];
+    double real[kRealSlots];
+    uint32_t textMask;
+    uint32_t realMask;
+    uint32_t badMask;       // поле Real есть, но не число (в слоте 0)
+
+    bool HasText(size_t slot) const { return (textMask >> slot) & 1; }
+    bool HasReal(size_t slot) const { return (realMask >> slot) & 1; }
+    bool IsBadReal(size_t slot) const { return (badMask >> slot) & 1; }
+};
+
+// Схемы записей. kMinTokens — меньше токенов означает, что запись не разбирается;
+// поля дальше конца строки отсутствуют (бит маски не ставится).
+template <NTLRecord R>
+struct NTLRecordSchema;
+
+// SEG <name> <branch> <x> <y> <z>
+template <>
+struct NTLRecordSchema<NTLRecord::Seg>
+{
+    enum Text { Name, Branch };
+    enum Real { X, Y, Z };
+    static const size_t kMinTokens = 2;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLText(2, Branch), NTLReal(3, X), NTLReal(4, Y), NTLReal(5, Z) };
+};
+
+// PIPE <name|od> ...: первое положительное число — OD/номинал, второе — толщина
+template <>
+struct NTLRecordSchema<NTLRecord::Pipe>
+{
+    enum Text { Name };
+    enum Real { Diameter, Thickness };
+    static const size_t kMinTokens = 2;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLPositives(1, Diameter, 2) };
+};
+
+// SPRG <name> <type> <orient> * N <distance> * <x> <y> <z> ...
+template <>
+struct NTLRecordSchema<NTLRecord::Sprg>
+{
+    enum Text { Name, Type };
+    enum Real { Distance, X, Y, Z };
+    static const size_t kMinTokens = 11;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLText(2, Type), NTLLiteral(4, "*"), NTLLiteral(5, "N"),
+        NTLReal(6, Distance), NTLLiteral(7, "*"), NTLReal(8, X), NTLReal(9, Y), NTLReal(10, Z) };
+};
+
+// OPER <name> <param> <temperature> <pressure> ...
+template <>
+struct NTLRecordSchema<NTLRecord::Oper>
+{
+    enum Text { Name };
+    enum Real { Temperature, Pressure };
+    static const size_t kMinTokens = 2;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLReal(3, Temperature), NTLReal(4, Pressure) };
+};
+
+// RUN/BEND/ELBO <name> <dx> <dy> <dz> — участок от последней точки
+template <>
+struct NTLRecordSchema<NTLRecord::Run>
+{
+    enum Text { Name };
+    enum Real { DX, DY, DZ };
+    static const size_t kMinTokens = 5;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLReal(2, DX), NTLReal(3, DY), NTLReal(4, DZ) };
+};
+
+// VALV/RED/TEE <name> [<dx> <dy> <dz>] — точка от последней точки
+template <>
+struct NTLRecordSchema<NTLRecord::Valv>
+{
+    enum Text { Name };
+    enum Real { DX, DY, DZ };
+    static const size_t kMinTokens = 2;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLReal(2, DX), NTLReal(3, DY), NTLReal(4, DZ) };
+};
+
+// REST/ANCH <name> [<type>] — опора в последней точке
+template <>
+struct NTLRecordSchema<NTLRecord::Rest>
+{
+    enum Text { Name, Type };
+    enum Real {};
+    static const size_t kMinTokens = 2;
+    static constexpr NTLField kFields[] = { NTLText(1, Name), NTLText(2, Type) };
+};
+
+// Записи с той же схемой
+template <> struct NTLRecordSchema<NTLRecord::Bend> : NTLRecordSchema<NTLRecord::Run> {};
+template <> struct NTLRecordSchema<NTLRecord::Elbo> : NTLRecordSchema<NTLRecord::Run> {};
+template <> struct NTLRecordSchema<NTLRecord::Red> : NTLRecordSchema<NTLRecord::Valv> {};
+template <> struct NTLRecordSchema<NTLRecord::Tee> : NTLRecordSchema<NTLRecord::Valv> {};
+template <> struct NTLRecordSchema<NTLRecord::Anch> : NTLRecordSchema<NTLRecord::Rest> {};
+
+inline bool NTLEqualsLiteral(std::wstring_view token, const char* literal)
+{
+    size_t i = 0;
+    for (; i < token.size(); ++i)
+    {
+        if (literal[i] == 0 || NTLSchemaDetail::Upper((unsigned)token[i]) != (unsigned char)literal[i])
+            return false;
+    }
+    return literal[i] == 0;
+}
+
+// Разбор строки по схеме R; false — строка короче kMinTokens или не совпал литерал
+template <NTLRecord R>
+bool ExtractNTLRecord(const NTLTokens& tokens, NTLRecordValues& values)
+{
+    typedef NTLRecordSchema<R> Schema;
+    values.textMask = 0;
+    values.realMask = 0;
+    values.badMask = 0;
+    const size_t n = tokens.size();
+    if (n < Schema::kMinTokens)
+        return false;
+    for (const NTLField& field : Schema::kFields)
+    {
+        if (field.pos >= n)
+            continue;
+        switch (field.kind)
+        {
+        case NTLFieldKind::Text:
+            values.text[field.slot] = tokens[field.pos];
+            values.textMask |= 1u << field.slot;
+            break;
+        case NTLFieldKind::Real:
+            if (!NTLFieldToDouble(tokens[field.pos], values.real[field.slot]))
+                values.badMask |= 1u << field.slot;
+            values.realMask |= 1u << field.slot;
+            break;
+        case NTLFieldKind::Literal:
+            if (!NTLEqualsLiteral(tokens[field.pos], field.literal))
+                return false;
+            break;
+        case NTLFieldKind::Positives:
+        {
+            uint8_t found = 0;
+            for (size_t i = field.pos; i < n && found < field.count; ++i)
+            {
+                const double v = NTLFieldToDouble(tokens[i]);
+                if (v > 0.0)
+                {
+                    values.real[field.slot + found] = v;
+                    values.realMask |= 1u << (field.slot + found);
+                    ++found;
+                }
+            }
+            break;
+        }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,104 @@
+#include "stdafx.h"
+#include "NTLStagedImport.h"
+#include <algorithm>
+
+namespace
+{
+std::map<const AcDbDatabase*, std::unique_ptr<CNTLStagedImport>>& Plans()
+{
+    static std::map<const AcDbDatabase*, std::unique_ptr<CNTLStagedImport>> plans;
+    return plans;
+}
+
+// Реактор базы данных: план закрываемого документа удаляется вместе с ним
+class CNTLStagedImportReactor : public AcDbDatabaseReactor
+{
+public:
+    void databaseToBeDestroyed(AcDbDatabase* pDb) override
+    {
+        auto it = Plans().find(pDb);
+        if (it == Plans().end())
+            return;
+        pDb->removeReactor(this);
+        Plans().erase(it);
+    }
+};
+
+CNTLStagedImportReactor& Reactor()
+{
+    static CNTLStagedImportReactor reactor;
+    return reactor;
+}
+} // namespace
+
+CNTLStagedImport* CNTLStagedImport::ForDatabase(AcDbDatabase* pDb, bool create)
+{
+    if (!pDb)
+        return nullptr;
+    auto it = Plans().find(pDb);
+    if (it != Plans().end())
+        return it->second.get();
+    if (!create)
+        return nullptr;
+
+    std::unique_ptr<CNTLStagedImport> plan(new CNTLStagedImport());
+    CNTLStagedImport* pPlan = plan.get();
+    Plans()[pDb] = std::move(plan);
+    pDb->addReactor(&Reactor());
+    return pPlan;
+}
+
+void CNTLStagedImport::Release(AcDbDatabase* pDb)
+{
+    auto it = Plans().find(pDb);
+    if (it == Plans().end())
+        return;
+    pDb->removeReactor(&Reactor());
+    Plans().erase(it);
+}
+
+void CNTLStagedImport::ReleaseAll()
+{
+    for (auto& item : Plans())
+        const_cast<AcDbDatabase*>(item.first)->removeReactor(&Reactor());
+    Plans().clear();
+}
+
+size_t CNTLStagedImport::GetPendingChains() const
+{
+    size_t count = 0;
+    for (const NTLChainPlan& chain : m_chains)
+    {
+        if (!chain.IsComplete())
+            ++count;
+    }
+    return count;
+}
+
+size_t CNTLStagedImport::GetPendingItems() const
+{
+    size_t count = 0;
+    for (const NTLChainPlan& chain : m_chains)
+    {
+        if (!chain.IsComplete())
+            count += chain.items.size() - chain.done;
+    }
+    return count;
+}
+
+void CNTLStagedImport::Append(std::vector<NTLChainPlan>& chains, const CString& sourceFile)
+{
+    m_chains.erase(std::remove_if(m_chains.begin(), m_chains.end(),
+        [](const NTLChainPlan& chain) { return chain.IsComplete(); }), m_chains.end());
+    const bool keepSource = !m_chains.empty();
+    for (NTLChainPlan& chain : chains)
+    {
+        if (!chain.IsComplete())
+            m_chains.push_back(std::move(chain));
+    }
+    chains.clear();
+    if (!keepSource)
+        m_sourceFile = sourceFile;
+    else if (m_sourceFile.Find(sourceFile) < 0)
+        m_sourceFile += L"; " + sourceFile;
+}
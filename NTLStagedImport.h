@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <memory>
+#include "acdb.h"
+#include "dbmain.h"
+#include "NTLParser.h"
+
+// Опора или инлайн, рассчитанные по данным NTL до обращения к DragManager
+struct NTLPlacement
+{
+    bool support = false;                               // опора; иначе инлайн типа inlineType
+    NTLInline::Type inlineType = NTLInline::Type::Inline;
+    CString name;
+    int segIndex = 0;                                   // сегмент оси
+    double offset = 0.0;                                // смещение от начала сегмента
+};
+
+// План цепочки: ось и её элементы; done — сколько элементов уже обработано
+struct NTLChainPlan
+{
+    AcDbObjectId axisId;
+    uint32_t chain = 0;         // номер цепочки разбора (для журнала)
+    CountedVector<NTLPlacement> items;
+    size_t done = 0;
+    bool failed = false;        // ось недоступна — остаток цепочки пропущен
+    // Метка оси для повторного импорта (NTLChainTag.h): пишется при создании оси
+    // и ещё раз, когда план выполнен (tagged)
+    CString tagName;
+    CString tagSource;          // NTLChainTagSource файла импорта
+    uint64_t fingerprint = 0;
+    bool tagged = false;
+
+    bool IsComplete() const { return failed || done >= items.size(); }
+};
+
+// Поэтапный импорт документа: после создания осей здесь лежит план расстановки
+// опор и инлайнов, который NTLFITTINGS выполняет порциями. Прогресс хранится
+// по цепочкам, поэтому прерванное выполнение продолжается с места остановки.
+// План живёт до закрытия документа (реактор базы данных) или до выполнения.
+class CNTLStagedImport
+{
+public:
+    // План документа; create — создать пустой, если его нет
+    static CNTLStagedImport* ForDatabase(AcDbDatabase* pDb, bool create);
+    static void Release(AcDbDatabase* pDb);
+    static void ReleaseAll();
+
+    std::vector<NTLChainPlan>& GetChains() { return m_chains; }
+    const CString& GetSourceFile() const { return m_sourceFile; }
+    void SetSourceFile(const CString& path) { m_sourceFile = path; }
+
+    size_t GetPendingChains() const;
+    size_t GetPendingItems() const;
+
+    // Дописать невыполненные цепочки нового импорта за невыполненным остатком плана
+    // (выполненные цепочки убираются); источник — список файлов через "; "
+    void Append(std::vector<NTLChainPlan>& chains, const CString& sourceFile);
+
+private:
+    std::vector<NTLChainPlan> m_chains;
+    CString m_sourceFile;
+};
@@ -0,0 +1,215 @@
+#include "stdafx.h"
+#include "ParamCache.h"
+
+// ---- CMemoryParamBackend ----
+
+void CMemoryParamBackend::Set(ParamObjectKey key, const std::wstring& name, const std::wstring& value)
+{
+    m_objects[key][name] = value;
+}
+
+void CMemoryParamBackend::Erase(ParamObjectKey key)
+{
+    m_objects.erase(key);
+}
+
+void CMemoryParamBackend::Fetch(const std::vector<ParamObjectKey>& keys, const std::vector<std::wstring>& names,
+    std::vector<ParamValue>& out)
+{
+    ++m_fetchCalls;
+    out.assign(keys.size() * names.size(), ParamValue());
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        ++m_objectReads;
+        // Имитация полного чтения параметров объекта
+        volatile unsigned sink = 0;
+        for (unsigned c = 0; c < m_costPerObject; ++c)
+            sink = sink + c;
+
+        auto it = m_objects.find(keys[i]);
+        if (it == m_objects.end())
+            continue;
+        for (size_t j = 0; j < names.size(); ++j)
+        {
+            auto p = it->second.find(names[j]);
+            if (p == it->second.end())
+                continue;
+            ParamValue& v = out[i * names.size() + j];
+            v.exists = true;
+            v.value = p->second;
+        }
+    }
+}
+
+// ---- CParamCache ----
+
+CParamCache::CParamCache(IParamBackend* pBackend, const std::vector<std::wstring>& names)
+    : m_pBackend(pBackend)
+    , m_names(names)
+{
+}
+
+size_t CParamCache::AllocSlot(ParamObjectKey key)
+{
+    size_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        slot = m_values.size() / m_names.size();
+        m_values.resize(m_values.size() + m_names.size());
+    }
+    m_slots[key] = slot;
+    return slot;
+}
+
+void CParamCache::Prefetch(const std::vector<ParamObjectKey>& keys)
+{
+    if (m_names.empty())
+        return;
+
+    m_batchKeys.clear();
+    for (ParamObjectKey key : keys)
+    {
+        if (m_slots.find(key) == m_slots.end())
+            m_batchKeys.push_back(key);
+    }
+    if (m_batchKeys.empty())
+        return;
+
+    m_misses += m_batchKeys.size();
+    m_pBackend->Fetch(m_batchKeys, m_names, m_batchValues);
+    for (size_t i = 0; i < m_batchKeys.size(); ++i)
+    {
+        // Ключ мог повториться в списке — слот уже выделен
+        auto it = m_slots.find(m_batchKeys[i]);
+        size_t slot = it != m_slots.end() ? it->second : AllocSlot(m_batchKeys[i]);
+        for (size_t j = 0; j < m_names.size(); ++j)
+            m_values[slot * m_names.size() + j] = std::move(m_batchValues[i * m_names.size() + j]);
+    }
+}
+
+const ParamValue& CParamCache::Get(ParamObjectKey key, size_t nameIndex)
+{
+    static const ParamValue kMissing;
+    if (nameIndex >= m_names.size())
+        return kMissing;
+
+    auto it = m_slots.find(key);
+    if (it != m_slots.end())
+    {
+        ++m_hits;
+        return m_values[it->second * m_names.size() + nameIndex];
+    }
+
+    Prefetch(std::vector<ParamObjectKey>(1, key));
+    it = m_slots.find(key);
+    return it != m_slots.end() ? m_values[it->second * m_names.size() + nameIndex] : kMissing;
+}
+
+void CParamCache::Invalidate(ParamObjectKey key)
+{
+    auto it = m_slots.find(key);
+    if (it == m_slots.end())
+        return;
+    size_t slot = it->second;
+    for (size_t j = 0; j < m_names.size(); ++j)
+        m_values[slot * m_names.size() + j] = ParamValue();
+    m_freeSlots.push_back(slot);
+    m_slots.erase(it);
+}
+
+void CParamCache::Clear()
+{
+    m_slots.clear();
+    m_values.clear();
+    m_freeSlots.clear();
+}
+
+#ifdef PARAMCACHE_MAIN
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+// Попадание, промах и сброс записи на CMemoryParamBackend: сколько раз кэш обращается
+// к источнику и что возвращает после изменения объекта
+int main(int argc, char** argv)
+{
+    const size_t objects = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 100000;
+    const std::vector<std::wstring> names = { L"KKS_PART", L"NAME" };
+    CMemoryParamBackend backend(200);
+    std::vector<ParamObjectKey> keys;
+    keys.reserve(objects);
+    for (size_t i = 0; i < objects; ++i)
+    {
+        const ParamObjectKey key = 0x100 + i;
+        keys.push_back(key);
+        // У каждого десятого объекта KKS_PART нет вовсе
+        if (i % 10 != 0)
+            backend.Set(key, L"KKS_PART", L"10LBA10AA" + std::to_wstring(i));
+    }
+    CParamCache cache(&backend, names);
+    bool ok = true;
+    auto check = [&ok](bool cond, const char* what)
+    {
+        if (!cond)
+        {
+            std::printf("FAIL: %s\n", what);
+            ok = false;
+        }
+    };
+
+    // Промах: весь список — один вызов источника
+    auto t0 = std::chrono::steady_clock::now();
+    cache.Prefetch(keys);
+    auto t1 = std::chrono::steady_clock::now();
+    check(backend.GetFetchCalls() == 1 && backend.GetObjectReads() == objects, "prefetch is one batch");
+    check(cache.GetMisses() == objects && cache.GetCachedCount() == objects, "prefetch misses");
+
+    // Попадание: повторные чтения не доходят до источника
+    size_t withKks = 0;
+    for (ParamObjectKey key : keys)
+        withKks += cache.Get(key, 0).exists;
+    cache.Prefetch(keys);
+    auto t2 = std::chrono::steady_clock::now();
+    check(backend.GetFetchCalls() == 1, "hits do not fetch");
+    check(cache.GetHits() == objects && withKks == objects - (objects + 9) / 10, "hit values");
+    check(!cache.Get(keys[1], 1).exists, "missing name");
+    check(cache.Get(keys[1], 0).value == L"10LBA10AA1", "cached value");
+
+    // Объект вне кэша: промах на одно чтение
+    const ParamObjectKey unknown = 0x100 + objects;
+    check(!cache.Get(unknown, 0).exists && backend.GetFetchCalls() == 2 && backend.GetObjectReads() == objects + 1,
+        "single miss");
+
+    // Изменение без сброса не видно; после Invalidate читается заново только этот объект
+    backend.Set(keys[1], L"KKS_PART", L"10LBA20AA001");
+    backend.Erase(keys[2]);
+    check(cache.Get(keys[1], 0).value == L"10LBA10AA1", "stale until invalidated");
+    cache.Invalidate(keys[1]);
+    cache.Invalidate(keys[2]);
+    check(cache.GetCachedCount() == objects - 1, "invalidate frees slots");
+    cache.Prefetch(keys);
+    check(backend.GetFetchCalls() == 3 && backend.GetObjectReads() == objects + 3, "refetch invalidated only");
+    check(cache.Get(keys[1], 0).value == L"10LBA20AA001", "new value after invalidate");
+    check(!cache.Get(keys[2], 0).exists, "erased object after invalidate");
+    check(cache.GetCachedCount() == objects + 1, "freed slots reused");
+
+    // Clear: всё снова промах
+    cache.Clear();
+    const size_t reads = backend.GetObjectReads();
+    cache.Prefetch(keys);
+    check(backend.GetObjectReads() == reads + objects, "clear drops everything");
+
+    std::printf("objects %zu  fetch calls %zu  reads %zu  hits %zu  misses %zu\n", objects, backend.GetFetchCalls(),
+        backend.GetObjectReads(), cache.GetHits(), cache.GetMisses());
+    std::printf("cold prefetch %.1f ms  warm gets %.1f ms\n",
+        std::chrono::duration<double, std::milli>(t1 - t0).count(),
+        std::chrono::duration<double, std::milli>(t2 - t1).count());
+    std::printf("%s\n", ok ? "ok" : "MISMATCH");
+    return ok ? 0 : 1;
+}
+#endif
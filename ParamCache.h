@@ -0,0 +1,92 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// Слой доступа к параметрам объектов (KKS_PART и т.п.) без зависимости от SDK:
+// источник параметров подключается через IParamBackend, поэтому кэш проверяется
+// и замеряется вне nanoCAD на CMemoryParamBackend.
+//
+// Проверка без nanoCAD — -DPARAMCACHE_MAIN (README, «Проверки без nanoCAD»).
+
+// Ключ объекта — handle (стабилен между сессиями)
+typedef unsigned long long ParamObjectKey;
+
+struct ParamValue
+{
+    bool exists = false;    // параметр у объекта есть (может быть пустым)
+    std::wstring value;
+};
+
+// Источник параметров
+class IParamBackend
+{
+public:
+    virtual ~IParamBackend() {}
+
+    // Прочитать параметры names для всех keys за один вызов.
+    // out заполняется построчно: out[i * names.size() + j] — параметр names[j] объекта keys[i].
+    virtual void Fetch(const std::vector<ParamObjectKey>& keys, const std::vector<std::wstring>& names,
+        std::vector<ParamValue>& out) = 0;
+};
+
+// Источник в памяти: замена ursGetObjectParameters для проверок и замеров вне CAD.
+// costPerObject — холостая работа на каждый объект в Fetch, имитирующая цену полного CElement.
+class CMemoryParamBackend : public IParamBackend
+{
+public:
+    explicit CMemoryParamBackend(unsigned costPerObject = 0) : m_costPerObject(costPerObject) {}
+
+    void Set(ParamObjectKey key, const std::wstring& name, const std::wstring& value);
+    void Erase(ParamObjectKey key);
+
+    void Fetch(const std::vector<ParamObjectKey>& keys, const std::vector<std::wstring>& names,
+        std::vector<ParamValue>& out) override;
+
+    // Статистика: вызовы Fetch и прочитанные объекты
+    size_t GetFetchCalls() const { return m_fetchCalls; }
+    size_t GetObjectReads() const { return m_objectReads; }
+
+private:
+    std::unordered_map<ParamObjectKey, std::unordered_map<std::wstring, std::wstring>> m_objects;
+    unsigned m_costPerObject;
+    size_t m_fetchCalls = 0;
+    size_t m_objectReads = 0;
+};
+
+// Кэш параметров: набор имён фиксирован при создании, значения хранятся подряд
+// (names.size() на объект). Отсутствующие в кэше объекты добираются одним
+// пакетным Fetch; запись объекта сбрасывается Invalidate() при его изменении.
+class CParamCache
+{
+public:
+    CParamCache(IParamBackend* pBackend, const std::vector<std::wstring>& names);
+
+    // Дочитать в кэш все объекты списка, которых там нет (один вызов источника)
+    void Prefetch(const std::vector<ParamObjectKey>& keys);
+
+    // Значение параметра names[nameIndex]; при промахе объект читается отдельно
+    const ParamValue& Get(ParamObjectKey key, size_t nameIndex);
+
+    void Invalidate(ParamObjectKey key);
+    void Clear();
+
+    size_t GetCachedCount() const { return m_slots.size(); }
+    size_t GetHits() const { return m_hits; }
+    size_t GetMisses() const { return m_misses; }
+
+private:
+    // Слот объекта в m_values (выделяется при необходимости)
+    size_t AllocSlot(ParamObjectKey key);
+
+    IParamBackend* m_pBackend;
+    std::vector<std::wstring> m_names;
+    std::unordered_map<ParamObjectKey, size_t> m_slots;     // ключ -> номер слота
+    std::vector<ParamValue> m_values;                       // слот * names.size()
+    std::vector<size_t> m_freeSlots;
+    std::vector<ParamObjectKey> m_batchKeys;                // переиспользуемые буферы Prefetch
+    std::vector<ParamValue> m_batchValues;
+    size_t m_hits = 0;
+    size_t m_misses = 0;
+};
@@ -0,0 +1,137 @@
+#include "stdafx.h"
+#include "ParseArena.h"
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <mutex>
+
+namespace
+{
+// Пул свободных блоков стандартного размера на весь процесс: до 16 МБ
+const size_t kMaxPooledChunks = 64;
+
+std::mutex& PoolMutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+std::vector<char*>& Pool()
+{
+    static std::vector<char*> pool;
+    return pool;
+}
+} // namespace
+
+int CArenaString::CompareNoCase(const CArenaString& other) const
+{
+    const size_t n = m_length < other.m_length ? m_length : other.m_length;
+    for (size_t i = 0; i < n; ++i)
+    {
+        wint_t a = std::towlower(m_data[i]);
+        wint_t b = std::towlower(other.m_data[i]);
+        if (a != b)
+            return a < b ? -1 : 1;
+    }
+    if (m_length == other.m_length)
+        return 0;
+    return m_length < other.m_length ? -1 : 1;
+}
+
+int CArenaString::Find(const CArenaString& sub) const
+{
+    size_t pos = View().find(sub.View());
+    return pos == std::wstring_view::npos ? -1 : (int)pos;
+}
+
+CParseArena::~CParseArena()
+{
+    Reset();
+}
+
+void* CParseArena::Allocate(size_t bytes, size_t align)
+{
+    uintptr_t p = ((uintptr_t)m_pos + (align - 1)) & ~(uintptr_t)(align - 1);
+    if (!m_pos || p + bytes > (uintptr_t)m_end)
+    {
+        NewChunk(bytes + align);
+        p = ((uintptr_t)m_pos + (align - 1)) & ~(uintptr_t)(align - 1);
+    }
+    m_pos = (char*)(p + bytes);
+    m_bytesUsed += bytes;
+    return (void*)p;
+}
+
+CArenaString CParseArena::Copy(std::wstring_view s)
+{
+    if (s.empty())
+        return CArenaString();
+    wchar_t* p = static_cast<wchar_t*>(Allocate((s.size() + 1) * sizeof(wchar_t), alignof(wchar_t)));
+    std::memcpy(p, s.data(), s.size() * sizeof(wchar_t));
+    p[s.size()] = L'\0';
+    return CArenaString(p, s.size());
+}
+
+CArenaString CParseArena::Concat(std::wstring_view a, std::wstring_view b)
+{
+    const size_t n = a.size() + b.size();
+    if (n == 0)
+        return CArenaString();
+    wchar_t* p = static_cast<wchar_t*>(Allocate((n + 1) * sizeof(wchar_t), alignof(wchar_t)));
+    std::memcpy(p, a.data(), a.size() * sizeof(wchar_t));
+    std::memcpy(p + a.size(), b.data(), b.size() * sizeof(wchar_t));
+    p[n] = L'\0';
+    return CArenaString(p, n);
+}
+
+void CParseArena::NewChunk(size_t minBytes)
+{
+    Chunk chunk;
+    chunk.size = minBytes > kChunkSize ? minBytes : kChunkSize;
+    chunk.data = nullptr;
+    chunk.phase = CMemAccounting::Current();
+    if (chunk.size == kChunkSize)
+    {
+        std::lock_guard<std::mutex> lock(PoolMutex());
+        if (!Pool().empty())
+        {
+            chunk.data = Pool().back();
+            Pool().pop_back();
+        }
+    }
+    if (!chunk.data)
+        chunk.data = static_cast<char*>(::operator new(chunk.size));
+    CMemAccounting::OnAlloc(chunk.phase, chunk.size);
+
+    m_chunks.push_back(chunk);
+    m_pos = chunk.data;
+    m_end = chunk.data + chunk.size;
+}
+
+void CParseArena::Reset()
+{
+    for (const Chunk& chunk : m_chunks)
+    {
+        CMemAccounting::OnFree(chunk.phase, chunk.size);
+        if (chunk.size == kChunkSize)
+        {
+            std::lock_guard<std::mutex> lock(PoolMutex());
+            if (Pool().size() < kMaxPooledChunks)
+            {
+                Pool().push_back(chunk.data);
+                continue;
+            }
+        }
+        ::operator delete(chunk.data);
+    }
+    m_chunks.clear();
+    m_pos = nullptr;
+    m_end = nullptr;
+    m_bytesUsed = 0;
+}
+
+size_t CParseArena::GetPooledChunks()
+{
+    std::lock_guard<std::mutex> lock(PoolMutex());
+    return Pool().size();
+}
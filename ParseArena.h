@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+#include <cstddef>
+#include <cwchar>
+#include "MemAccounting.h"
+
+// Строка в арене разбора: NUL-терминированные данные и длина, без владения.
+// Действительна, пока арена не сброшена. Методы — подмножество CString,
+// которым пользуется импорт, чтобы записи разбора читались как раньше.
+class CArenaString
+{
+public:
+    CArenaString() : m_data(L""), m_length(0) {}
+    CArenaString(const wchar_t* data, size_t length) : m_data(data), m_length(length) {}
+
+    const wchar_t* GetString() const { return m_data; }
+    int GetLength() const { return (int)m_length; }
+    bool IsEmpty() const { return m_length == 0; }
+    std::wstring_view View() const { return std::wstring_view(m_data, m_length); }
+
+    int CompareNoCase(const CArenaString& other) const;
+    // Позиция подстроки или -1
+    int Find(const CArenaString& sub) const;
+
+    bool operator==(const CArenaString& other) const { return View() == other.View(); }
+    bool operator!=(const CArenaString& other) const { return !(*this == other); }
+
+private:
+    const wchar_t* m_data;
+    size_t m_length;
+};
+
+// Монотонная арена сессии разбора: строки записей NTL выделяются сдвигом
+// указателя в крупных блоках и освобождаются все сразу — Reset() или деструктор.
+// Блоки стандартного размера возвращаются в общий пул и берутся следующим
+// разбором, поэтому повторный импорт не обращается к куче процесса.
+class CParseArena
+{
+public:
+    static const size_t kChunkSize = 256 << 10;
+
+    CParseArena() {}
+    ~CParseArena();
+
+    CParseArena(const CParseArena&) = delete;
+    CParseArena& operator=(const CParseArena&) = delete;
+
+    void* Allocate(size_t bytes, size_t align = alignof(std::max_align_t));
+
+    // Копия строки в арене
+    CArenaString Copy(std::wstring_view s);
+    // a + b одной строкой
+    CArenaString Concat(std::wstring_view a, std::wstring_view b);
+
+    // Освободить всё выделенное; блоки уходят в пул
+    void Reset();
+
+    size_t GetBytesUsed() const { return m_bytesUsed; }
+    size_t GetChunkCount() const { return m_chunks.size(); }
+
+    // Сколько блоков ждёт в пуле (для журнала)
+    static size_t GetPooledChunks();
+
+private:
+    struct Chunk
+    {
+        char* data;
+        size_t size;
+        MemPhase phase;     // фаза, в которой блок взят (учёт MemAccounting)
+    };
+
+    void NewChunk(size_t minBytes);
+
+    std::vector<Chunk> m_chunks;
+    char* m_pos = nullptr;
+    char* m_end = nullptr;
+    size_t m_bytesUsed = 0;
+};
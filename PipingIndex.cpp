@@ -0,0 +1,319 @@
+#include "stdafx.h"
+#include "PipingIndex.h"
+#include "PipingUtils.h"
+#include <memory>
+#include "dbapserv.h"
+#include "dbtable.h"
+
+namespace
+{
+std::map<const AcDbDatabase*, std::unique_ptr<CPipingIndex>>& Indexes()
+{
+    static std::map<const AcDbDatabase*, std::unique_ptr<CPipingIndex>> indexes;
+    return indexes;
+}
+
+CPipingIndex* FindIndex(const AcDbDatabase* pDb)
+{
+    auto it = Indexes().find(pDb);
+    return it != Indexes().end() ? it->second.get() : nullptr;
+}
+
+// Реактор базы данных: переводит события добавления/изменения/удаления в пометки индекса.
+// Сами объекты в обработчиках не перечитываются — только помечаются "грязными".
+class CPipingIndexReactor : public AcDbDatabaseReactor
+{
+public:
+    void objectAppended(const AcDbDatabase* pDb, const AcDbObject* pObj) override
+    {
+        if (CPipingIndex* pIndex = FindIndex(pDb))
+            pIndex->OnObjectChanged(pObj);
+    }
+
+    void objectReAppended(const AcDbDatabase* pDb, const AcDbObject* pObj) override
+    {
+        if (CPipingIndex* pIndex = FindIndex(pDb))
+            pIndex->OnObjectChanged(pObj);
+    }
+
+    void objectModified(const AcDbDatabase* pDb, const AcDbObject* pObj) override
+    {
+        if (CPipingIndex* pIndex = FindIndex(pDb))
+            pIndex->OnObjectChanged(pObj);
+    }
+
+    void objectUnAppended(const AcDbDatabase* pDb, const AcDbObject* pObj) override
+    {
+        if (CPipingIndex* pIndex = FindIndex(pDb))
+            pIndex->OnObjectRemoved(pObj);
+    }
+
+    void objectErased(const AcDbDatabase* pDb, const AcDbObject* pObj, Adesk::Boolean pErased) override
+    {
+        CPipingIndex* pIndex = FindIndex(pDb);
+        if (!pIndex)
+            return;
+        if (pErased)
+            pIndex->OnObjectRemoved(pObj);
+        else
+            pIndex->OnObjectChanged(pObj); // отмена удаления
+    }
+
+    void databaseToBeDestroyed(AcDbDatabase* pDb) override
+    {
+        auto it = Indexes().find(pDb);
+        if (it == Indexes().end())
+            return;
+        pDb->removeReactor(this);
+        Indexes().erase(it);
+    }
+};
+
+CPipingIndexReactor& Reactor()
+{
+    static CPipingIndexReactor reactor;
+    return reactor;
+}
+} // namespace
+
+CPipingIndex* CPipingIndex::ForDatabase(AcDbDatabase* pDb)
+{
+    if (!pDb)
+        return nullptr;
+    if (CPipingIndex* pIndex = FindIndex(pDb))
+        return pIndex;
+
+    std::unique_ptr<CPipingIndex> pIndex(new CPipingIndex(pDb));
+    CPipingIndex* pRaw = pIndex.get();
+    Indexes()[pDb] = std::move(pIndex);
+    pDb->addReactor(&Reactor());
+    return pRaw;
+}
+
+void CPipingIndex::ReleaseAll()
+{
+    for (auto& kv : Indexes())
+        const_cast<AcDbDatabase*>(kv.first)->removeReactor(&Reactor());
+    Indexes().clear();
+}
+
+CPipingIndex::CPipingIndex(AcDbDatabase* pDb)
+    : m_pDb(pDb)
+    , m_modelSpaceId()
+    , m_built(false)
+    , m_journalTag(0)
+    , m_journalValid(false)
+    , m_paramBackend(pDb)
+    , m_params(&m_paramBackend, PipingParamNames())
+    , m_version(0)
+    , m_spatialVersion(~0u)
+{
+}
+
+void CPipingIndex::Invalidate()
+{
+    m_built = false;
+    m_entries.clear();
+    m_dirty.clear();
+    m_params.Clear();
+    ResetJournal();
+    Touch();
+}
+
+void CPipingIndex::StartChangeJournal(uint64_t tag)
+{
+    m_journal.clear();
+    m_journalTag = tag;
+    m_journalValid = m_built;
+}
+
+bool CPipingIndex::GetChangeJournal(uint64_t tag, std::vector<AcDbObjectId>& changed) const
+{
+    changed.clear();
+    if (!m_built || !m_journalValid || m_journalTag != tag)
+        return false;
+    changed.assign(m_journal.begin(), m_journal.end());
+    return true;
+}
+
+bool CPipingIndex::Update(int* outRefreshed)
+{
+    if (outRefreshed)
+        *outRefreshed = 0;
+
+    if (!m_built)
+        return Build();
+
+    // Забираем набор целиком: пометки, пришедшие во время обновления, попадут в следующий Update
+    std::set<AcDbObjectId> dirty;
+    dirty.swap(m_dirty);
+    for (const AcDbObjectId& id : dirty)
+        RefreshOne(id);
+    if (!dirty.empty())
+        Touch();
+    if (outRefreshed)
+        *outRefreshed = (int)dirty.size();
+    return true;
+}
+
+bool CPipingIndex::Build()
+{
+    m_entries.clear();
+    m_dirty.clear();
+    ResetJournal();
+    Touch();
+
+    AcDbBlockTable* pBT = nullptr;
+    if (m_pDb->getBlockTable(pBT, AcDb::kForRead) != Acad::eOk || !pBT)
+        return false;
+    Acad::ErrorStatus es = pBT->getAt(ACDB_MODEL_SPACE, m_modelSpaceId);
+    pBT->close();
+    if (es != Acad::eOk)
+        return false;
+
+    // Неарматурные сущности отсеиваются по классу без открытия;
+    // параметры не читаются по одному, а собираются в один пакет после обхода
+    std::vector<ParamObjectKey> keys;
+    bool ok = ForEachModelSpaceEntity(m_pDb, pcf_Armature | pcf_Support,
+        [this, &keys](AcDbEntity* pEnt, unsigned flags)
+        {
+            PipingEntry entry;
+            if (ReadEntry(pEnt, flags, entry, false))
+            {
+                keys.push_back(HandleToUInt64(entry.id.handle()));
+                m_entries[entry.id] = entry;
+            }
+            return true;
+        });
+    if (ok)
+    {
+        m_params.Prefetch(keys);
+        for (auto& kv : m_entries)
+            FillParams(kv.second);
+    }
+    m_built = ok;
+    return ok;
+}
+
+void CPipingIndex::FillParams(PipingEntry& entry)
+{
+    const ParamValue& kks = m_params.Get(HandleToUInt64(entry.id.handle()), kParamKksPart);
+    entry.hasKks = kks.exists;
+    entry.kksPart = kks.value;
+}
+
+bool CPipingIndex::ReadEntry(AcDbEntity* pEnt, unsigned flags, PipingEntry& entry, bool readParams)
+{
+    if ((flags & (pcf_Armature | pcf_Support)) == 0)
+        return false;
+
+    bool ok = false;
+    AcDbExtents ext;
+    AcGePoint3d center = GetEntityCenter(pEnt, ok, &ext);
+    if (!ok)
+        return false;
+
+    entry.id = pEnt->objectId();
+    entry.kind = (flags & pcf_Armature) ? PipingKind::Armature : PipingKind::Support;
+    entry.className = pEnt->isA() ? pEnt->isA()->name() : L"";
+    entry.isDummy = (flags & pcf_Dummy) != 0;
+    entry.center = center;
+    entry.extMin = ext.minPoint();
+    entry.extMax = ext.maxPoint();
+    if (readParams)
+        FillParams(entry);
+    return true;
+}
+
+void CPipingIndex::RefreshOne(const AcDbObjectId& id)
+{
+    if (m_journalValid)
+        m_journal.insert(id);
+    AcDbEntity* pEnt = nullptr;
+    if (acdbOpenObject(pEnt, id, AcDb::kForRead) != Acad::eOk || !pEnt)
+    {
+        m_entries.erase(id);
+        return;
+    }
+
+    PipingEntry entry;
+    if (pEnt->blockId() == m_modelSpaceId && ReadEntry(pEnt, ClassifyClass(pEnt->isA()), entry, true))
+        m_entries[id] = entry;
+    else
+        m_entries.erase(id);
+    pEnt->close();
+}
+
+void CPipingIndex::OnObjectChanged(const AcDbObject* pObj)
+{
+    if (!pObj)
+        return;
+    // Кэш параметров мог заполниться и без индекса (отчёты), поэтому сбрасывается всегда
+    m_params.Invalidate(HandleToUInt64(pObj->objectId().handle()));
+
+    // До первого построения события не нужны — Build() прочитает всё сам
+    if (!m_built)
+        return;
+    const AcDbEntity* pEnt = AcDbEntity::cast(pObj);
+    if (!pEnt)
+        return;
+
+    AcDbObjectId id = pObj->objectId();
+    if (m_entries.find(id) == m_entries.end())
+    {
+        // Новые объекты интересуют только если это арматура/опора в пространстве модели
+        AcDbObjectId blockId = pEnt->blockId();
+        if (!blockId.isNull() && blockId != m_modelSpaceId)
+            return;
+        if ((ClassifyClass(pObj->isA()) & (pcf_Armature | pcf_Support)) == 0)
+            return;
+    }
+    m_dirty.insert(id);
+}
+
+void CPipingIndex::OnObjectRemoved(const AcDbObject* pObj)
+{
+    if (!pObj)
+        return;
+    AcDbObjectId id = pObj->objectId();
+    m_params.Invalidate(HandleToUInt64(id.handle()));
+    if (!m_built)
+        return;
+    if (m_entries.erase(id))
+    {
+        Touch();
+        if (m_journalValid)
+            m_journal.insert(id);
+    }
+    m_dirty.erase(id);
+}
+
+void CPipingIndex::QueryBox(const SpatialBox& box, std::vector<const PipingEntry*>& out)
+{
+    if (m_spatialVersion != m_version)
+    {
+        // Записи map не перемещаются, но удалённые записи делают указатели недействительными —
+        // поэтому после любого изменения индекса дерево строится заново
+        std::vector<CSpatialRTree::Item> items;
+        items.reserve(m_entries.size());
+        m_spatialEntries.clear();
+        m_spatialEntries.reserve(m_entries.size());
+        for (const auto& kv : m_entries)
+        {
+            const PipingEntry& e = kv.second;
+            CSpatialRTree::Item item;
+            item.box = SpatialBox{ { e.extMin.x, e.extMin.y, e.extMin.z }, { e.extMax.x, e.extMax.y, e.extMax.z } };
+            item.value = (uint32_t)m_spatialEntries.size();
+            items.push_back(item);
+            m_spatialEntries.push_back(&e);
+        }
+        m_spatial.Build(std::move(items));
+        m_spatialVersion = m_version;
+    }
+
+    std::vector<uint32_t> hits;
+    m_spatial.Query(box, hits);
+    out.reserve(out.size() + hits.size());
+    for (uint32_t i : hits)
+        out.push_back(m_spatialEntries[i]);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <set>
+#include "acdb.h"
+#include "dbmain.h"
+#include "gepnt3d.h"
+#include "PipingUtils.h"
+#include "SpatialIndex.h"
+
+// Вид трубопроводной сущности в индексе
+enum class PipingKind
+{
+    Armature,   // inline/valve/armatur (в т.ч. переходы и тройники)
+    Support     // опоры
+};
+
+// Запись индекса: всё, что нужно экспорту, без повторного открытия объекта
+struct PipingEntry
+{
+    AcDbObjectId id;
+    PipingKind kind = PipingKind::Armature;
+    std::wstring className;
+    std::wstring kksPart;
+    bool hasKks = false;       // параметр KKS_PART существует (может быть пустым)
+    bool isDummy = false;      // ссылочный объект
+    AcGePoint3d center;        // центр геометрических экстентов в WCS
+    AcGePoint3d extMin;        // геометрические экстенты в WCS
+    AcGePoint3d extMax;
+};
+
+// Индекс арматуры/опор пространства модели одного документа.
+// Строится одним проходом при первом обращении, далее поддерживается
+// реактором базы данных: добавленные/изменённые объекты помечаются "грязными"
+// и перечитываются только при следующем Update().
+class CPipingIndex
+{
+public:
+    // Индекс для базы данных (создаётся при первом обращении, реактор подключается сразу)
+    static CPipingIndex* ForDatabase(AcDbDatabase* pDb);
+
+    // Отключить реакторы и удалить все индексы (выгрузка приложения)
+    static void ReleaseAll();
+
+    // Гарантирует, что индекс построен и актуален. Возвращает false, если модель недоступна.
+    // outRefreshed — сколько "грязных" объектов было перечитано.
+    bool Update(int* outRefreshed = nullptr);
+
+    // Все записи индекса (после Update)
+    const std::map<AcDbObjectId, PipingEntry>& GetEntries() const { return m_entries; }
+
+    // Записи, чьи экстенты пересекают box (после Update). R-дерево по экстентам
+    // строится при первом запросе и перестраивается только после изменений индекса.
+    void QueryBox(const SpatialBox& box, std::vector<const PipingEntry*>& out);
+
+    // Кэш параметров объектов документа; записи сбрасываются реактором при изменении объекта
+    CParamCache& GetParamCache() { return m_params; }
+
+    bool IsBuilt() const { return m_built; }
+    size_t GetDirtyCount() const { return m_dirty.size(); }
+
+    // Сбросить индекс (следующий Update выполнит полный проход)
+    void Invalidate();
+
+    // Журнал изменений для инкрементальных выгрузок: с момента StartChangeJournal(tag)
+    // копит id записей, перечитанных или удалённых. GetChangeJournal вернёт false, если
+    // журнал начат с другой меткой или прерван полным перестроением индекса.
+    void StartChangeJournal(uint64_t tag);
+    bool GetChangeJournal(uint64_t tag, std::vector<AcDbObjectId>& changed) const;
+
+    // Обработчики событий реактора
+    void OnObjectChanged(const AcDbObject* pObj);
+    void OnObjectRemoved(const AcDbObject* pObj);
+
+private:
+    explicit CPipingIndex(AcDbDatabase* pDb);
+
+    bool Build();
+    // Перечитать одну сущность; false — объект не относится к индексу.
+    // readParams = false — KKS_PART не читается (Build добирает его пакетом).
+    bool ReadEntry(AcDbEntity* pEnt, unsigned flags, PipingEntry& entry, bool readParams);
+    void FillParams(PipingEntry& entry);
+    void Touch() { ++m_version; }
+    void RefreshOne(const AcDbObjectId& id);
+    void ResetJournal() { m_journal.clear(); m_journalValid = false; }
+
+    AcDbDatabase* m_pDb;
+    AcDbObjectId m_modelSpaceId;
+    bool m_built;
+    std::map<AcDbObjectId, PipingEntry> m_entries;
+    std::set<AcDbObjectId> m_dirty;
+    std::set<AcDbObjectId> m_journal;               // изменения с StartChangeJournal(m_journalTag)
+    uint64_t m_journalTag;
+    bool m_journalValid;
+    CUrsParamBackend m_paramBackend;
+    CParamCache m_params;
+
+    unsigned m_version;                             // растёт при любом изменении m_entries
+    unsigned m_spatialVersion;                      // версия, по которой построено дерево
+    CSpatialRTree m_spatial;
+    std::vector<const PipingEntry*> m_spatialEntries;   // value элемента дерева -> запись
+};
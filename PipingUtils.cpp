@@ -0,0 +1,241 @@
+#include "stdafx.h"
+#include "PipingUtils.h"
+#include <algorithm>
+#include <cwctype>
+#include <unordered_map>
+#include "dbents.h"
+#include "dbtable.h"
+#include "ursUtils.h"
+#include "vCSSegment.h"
+
+bool ContainsNoCase(const std::wstring& haystack, const std::wstring& needle)
+{
+    if (needle.empty())
+        return true;
+    auto toLower = [](wchar_t c) { return (wchar_t)std::towlower(c); };
+    std::wstring h, n;
+    h.resize(haystack.size());
+    n.resize(needle.size());
+    std::transform(haystack.begin(), haystack.end(), h.begin(), toLower);
+    std::transform(needle.begin(), needle.end(), n.begin(), toLower);
+    return h.find(n) != std::wstring::npos;
+}
+
+bool IsDummyClass(const std::wstring& className)
+{
+    return ContainsNoCase(className, L"dummy");
+}
+
+bool IsArmatureClass(const std::wstring& className)
+{
+    return ContainsNoCase(className, L"inline") ||
+        ContainsNoCase(className, L"valve") ||
+        ContainsNoCase(className, L"armatur");
+}
+
+bool IsSupportClass(const std::wstring& className)
+{
+    return ContainsNoCase(className, L"support");
+}
+
+bool ContainsWordNoCase(const std::wstring& name, const std::wstring& word)
+{
+    const size_t n = name.size();
+    size_t begin = 0;
+    while (begin < n)
+    {
+        if (!std::iswalpha(name[begin]))
+        {
+            ++begin;
+            continue;
+        }
+        // Конец слова: небуква, переход строчная -> прописная или последняя прописная
+        // перед прописной + строчной (аббревиатура перед словом: "CSTee" -> CS, Tee)
+        size_t end = begin + 1;
+        while (end < n && std::iswalpha(name[end]))
+        {
+            const bool upper = std::iswupper(name[end]) != 0;
+            if (upper && std::iswlower(name[end - 1]))
+                break;
+            if (upper && std::iswupper(name[end - 1]) && end + 1 < n && std::iswlower(name[end + 1]))
+                break;
+            ++end;
+        }
+        if (end - begin == word.size())
+        {
+            size_t i = 0;
+            while (i < word.size() && std::towlower(name[begin + i]) == std::towlower(word[i]))
+                ++i;
+            if (i == word.size())
+                return true;
+        }
+        begin = end;
+    }
+    return false;
+}
+
+bool IsReducerClass(const std::wstring& className)
+{
+    return ContainsWordNoCase(className, L"reducer");
+}
+
+bool IsTeeClass(const std::wstring& className)
+{
+    return ContainsWordNoCase(className, L"tee");
+}
+
+bool IsFittingClass(const std::wstring& className)
+{
+    return IsReducerClass(className) ||
+        IsTeeClass(className) ||
+        ContainsWordNoCase(className, L"elbow") ||
+        ContainsWordNoCase(className, L"bend");
+}
+
+std::wstring GetKKSPart(AcDbEntity* pEnt, bool& hasParam)
+{
+    hasParam = false;
+    if (!pEnt)
+        return L"";
+
+    CElement params;
+    if (!ursGetObjectParameters(pEnt->objectId(), params))
+        return L"";
+
+    CString kks;
+    hasParam = params.GetValue(L"KKS_PART", kks);
+    if (!hasParam)
+        return L"";
+    return std::wstring(kks.GetString());
+}
+
+bool SetKKSPart(const AcDbObjectId& id, const std::wstring& kks)
+{
+    CElement params;
+    if (!ursGetObjectParameters(id, params))
+        return false;
+    if (!params.SetValue(L"KKS_PART", CString(kks.c_str())))
+        return false;
+    return ursSetObjectParameters(id, params);
+}
+
+std::vector<std::wstring> PipingParamNames()
+{
+    return std::vector<std::wstring>(1, L"KKS_PART");
+}
+
+void CUrsParamBackend::Fetch(const std::vector<ParamObjectKey>& keys, const std::vector<std::wstring>& names,
+    std::vector<ParamValue>& out)
+{
+    out.assign(keys.size() * names.size(), ParamValue());
+    CString value;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        AcDbObjectId id;
+        if (!m_pDb || m_pDb->getAcDbObjectId(id, false, UInt64ToHandle(keys[i])) != Acad::eOk)
+            continue;
+        CElement params;
+        if (!ursGetObjectParameters(id, params))
+            continue;
+        for (size_t j = 0; j < names.size(); ++j)
+        {
+            ParamValue& v = out[i * names.size() + j];
+            v.exists = params.GetValue(names[j].c_str(), value);
+            if (v.exists)
+                v.value.assign(value.GetString(), value.GetLength());
+        }
+    }
+}
+
+AcGePoint3d GetEntityCenter(AcDbEntity* pEnt, bool& ok, AcDbExtents* pExtents)
+{
+    ok = false;
+    if (!pEnt)
+        return AcGePoint3d::kOrigin;
+    AcDbExtents ext;
+    if (pEnt->getGeomExtents(ext) != Acad::eOk)
+        return AcGePoint3d::kOrigin;
+    ok = true;
+    if (pExtents)
+        *pExtents = ext;
+    return AcGePoint3d(
+        (ext.minPoint().x + ext.maxPoint().x) * 0.5,
+        (ext.minPoint().y + ext.maxPoint().y) * 0.5,
+        (ext.minPoint().z + ext.maxPoint().z) * 0.5);
+}
+
+unsigned ClassifyClass(const AcRxClass* pClass)
+{
+    if (!pClass)
+        return pcf_None;
+
+    static std::unordered_map<const AcRxClass*, unsigned> memo;
+    auto it = memo.find(pClass);
+    if (it != memo.end())
+        return it->second;
+
+    std::wstring cls = pClass->name() ? pClass->name() : L"";
+    unsigned flags = pcf_None;
+    if (IsArmatureClass(cls))
+        flags |= pcf_Armature;
+    if (IsSupportClass(cls))
+        flags |= pcf_Support;
+    if (IsDummyClass(cls))
+        flags |= pcf_Dummy;
+    if (IsFittingClass(cls))
+        flags |= pcf_Fitting;
+    if (pClass->isDerivedFrom(vCSSegment2::desc()))
+        flags |= pcf_PipeSegment;
+    if (flags == pcf_None)
+        flags = pcf_Other;
+
+    memo.emplace(pClass, flags);
+    return flags;
+}
+
+bool ForEachModelSpaceEntity(AcDbDatabase* pDb, unsigned mask,
+    const std::function<bool(AcDbEntity* pEnt, unsigned flags)>& fn)
+{
+    if (!pDb)
+        return false;
+
+    AcDbBlockTable* pBT = nullptr;
+    if (pDb->getBlockTable(pBT, AcDb::kForRead) != Acad::eOk || !pBT)
+        return false;
+
+    AcDbBlockTableRecord* pMS = nullptr;
+    if (pBT->getAt(ACDB_MODEL_SPACE, pMS, AcDb::kForRead) != Acad::eOk || !pMS)
+    {
+        pBT->close();
+        return false;
+    }
+
+    AcDbBlockTableRecordIterator* pIter = nullptr;
+    if (pMS->newIterator(pIter) == Acad::eOk && pIter)
+    {
+        for (pIter->start(); !pIter->done(); pIter->step())
+        {
+            AcDbObjectId id;
+            if (pIter->getEntityId(id) != Acad::eOk)
+                continue;
+
+            // Отсев по классу без открытия объекта
+            unsigned flags = ClassifyClass(id.objectClass());
+            if ((flags & mask) == 0)
+                continue;
+
+            AcDbEntity* pEnt = nullptr;
+            if (acdbOpenObject(pEnt, id, AcDb::kForRead) != Acad::eOk || !pEnt)
+                continue;
+            bool goOn = fn(pEnt, flags);
+            pEnt->close();
+            if (!goOn)
+                break;
+        }
+        delete pIter;
+    }
+
+    pMS->close();
+    pBT->close();
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include "acdb.h"
+#include "dbmain.h"
+#include "gepnt3d.h"
+#include "ParamCache.h"
+
+// Общие помощники для классификации и чтения параметров трубопроводных сущностей
+// (используются экспортом арматуры и индексом модели).
+
+// Поиск подстроки без учёта регистра
+bool ContainsNoCase(const std::wstring& haystack, const std::wstring& needle);
+
+// Определяем, похоже ли имя класса на dummy (ссылочный объект)
+bool IsDummyClass(const std::wstring& className);
+
+// Определяем, похоже ли на арматуру (inline/valve/armatur)
+bool IsArmatureClass(const std::wstring& className);
+
+// Определяем, похоже ли на опору (support)
+bool IsSupportClass(const std::wstring& className);
+
+// Слово в имени класса без учёта регистра. Слова разделяются небуквенными символами
+// и границами CamelCase ("vCSPipeTee" -> v, CS, Pipe, Tee), поэтому "tee" не находится
+// в "Steel", а "bend" — в "Bender"
+bool ContainsWordNoCase(const std::wstring& name, const std::wstring& word);
+
+// Переход и тройник — по слову reducer/tee в имени класса
+bool IsReducerClass(const std::wstring& className);
+bool IsTeeClass(const std::wstring& className);
+
+// Определяем, похоже ли на фасонную деталь (слова reducer/tee/elbow/bend)
+bool IsFittingClass(const std::wstring& className);
+
+// Пытаемся достать параметр KKS_PART через параметры объекта.
+// hasParam = true, если параметр существует (может быть пустым).
+std::wstring GetKKSPart(AcDbEntity* pEnt, bool& hasParam);
+
+// Записываем параметр KKS_PART через параметры объекта (объект не должен быть открыт).
+bool SetKKSPart(const AcDbObjectId& id, const std::wstring& kks);
+
+// Получаем центр геометрических экстентов в WCS (pExtents — сами экстенты, если нужны)
+AcGePoint3d GetEntityCenter(AcDbEntity* pEnt, bool& ok, AcDbExtents* pExtents = nullptr);
+
+// Handle объекта как 64-битное число (стабилен между сессиями, в отличие от AcDbObjectId)
+inline unsigned long long HandleToUInt64(const AcDbHandle& h)
+{
+    return ((unsigned long long)h.high() << 32) | (unsigned long long)h.low();
+}
+
+// Обратное преобразование (ключ кэша параметров -> handle)
+inline AcDbHandle UInt64ToHandle(unsigned long long v)
+{
+    return AcDbHandle((Adesk::UInt32)(v & 0xFFFFFFFFull), (Adesk::UInt32)(v >> 32));
+}
+
+// Параметры, которые читают индекс и отчёты (порядок = индекс в CParamCache::Get)
+const size_t kParamKksPart = 0;
+std::vector<std::wstring> PipingParamNames();
+
+// Источник параметров через ursGetObjectParameters: объект ищется по handle в pDb,
+// из CElement извлекаются только запрошенные имена.
+class CUrsParamBackend : public IParamBackend
+{
+public:
+    explicit CUrsParamBackend(AcDbDatabase* pDb) : m_pDb(pDb) {}
+
+    void Fetch(const std::vector<ParamObjectKey>& keys, const std::vector<std::wstring>& names,
+        std::vector<ParamValue>& out) override;
+
+private:
+    AcDbDatabase* m_pDb;
+};
+
+// Признаки класса сущности (битовая маска)
+enum PipingClassFlags : unsigned
+{
+    pcf_None        = 0,
+    pcf_Armature    = 1 << 0,   // IsArmatureClass
+    pcf_Support     = 1 << 1,   // IsSupportClass
+    pcf_Dummy       = 1 << 2,   // IsDummyClass
+    pcf_PipeSegment = 1 << 3,   // производный от vCSSegment2
+    pcf_Fitting     = 1 << 4,   // IsFittingClass
+    pcf_Other       = 1 << 5,   // ни одного признака выше (оборудование, примитивы и т.п.)
+
+    pcf_All         = pcf_Armature | pcf_Support | pcf_Dummy | pcf_PipeSegment | pcf_Fitting | pcf_Other,
+};
+
+// Классификация класса с кэшем: вычисляется один раз на AcRxClass* за сессию,
+// дальше — поиск в хеш-таблице без аллокаций.
+unsigned ClassifyClass(const AcRxClass* pClass);
+
+// Обход пространства модели с фильтром по классу до открытия объекта:
+// класс берётся из AcDbObjectId::objectClass(), открываются только сущности,
+// у которых ClassifyClass() пересекается с mask. Колбэк возвращает false для остановки.
+// Возвращает false, если пространство модели недоступно.
+bool ForEachModelSpaceEntity(AcDbDatabase* pDb, unsigned mask,
+    const std::function<bool(AcDbEntity* pEnt, unsigned flags)>& fn);
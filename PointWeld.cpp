@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "PointWeld.h"
+#include <cmath>
+
+namespace
+{
+const uint32_t kNone = 0xFFFFFFFFu;
+
+// Нулевой допуск превращает сетку в бесконечно мелкую — ограничиваем снизу
+const double kMinWeldTolerance = 1e-9;
+
+unsigned long long CellKey(long long ix, long long iy, long long iz)
+{
+    // Коллизии ключей безопасны: они лишь добавляют проверок расстояния
+    return (unsigned long long)ix * 73856093ull ^ (unsigned long long)iy * 19349663ull ^
+        (unsigned long long)iz * 83492791ull;
+}
+} // namespace
+
+CPointWelder::CPointWelder(double tolerance)
+    : m_tolerance(kDefaultWeldTolerance)
+{
+    SetTolerance(tolerance);
+}
+
+void CPointWelder::SetTolerance(double tolerance)
+{
+    m_tolerance = tolerance > kMinWeldTolerance ? tolerance : kMinWeldTolerance;
+}
+
+void CPointWelder::Clear()
+{
+    m_points.clear();
+    m_parent.clear();
+    m_next.clear();
+    m_cells.clear();
+    m_vertexOf.clear();
+    m_vertices.clear();
+}
+
+void CPointWelder::Reserve(size_t count)
+{
+    m_points.reserve(count * 3);
+    m_parent.reserve(count);
+    m_next.reserve(count);
+    m_vertexOf.reserve(count);
+}
+
+uint32_t CPointWelder::AddPoint(double x, double y, double z)
+{
+    const uint32_t index = (uint32_t)(m_points.size() / 3);
+    m_points.push_back(x);
+    m_points.push_back(y);
+    m_points.push_back(z);
+    return index;
+}
+
+long long CPointWelder::CellOf(double v) const
+{
+    return (long long)std::floor(v / m_tolerance);
+}
+
+uint32_t CPointWelder::Find(uint32_t i)
+{
+    while (m_parent[i] != i)
+    {
+        m_parent[i] = m_parent[m_parent[i]];
+        i = m_parent[i];
+    }
+    return i;
+}
+
+void CPointWelder::Union(uint32_t a, uint32_t b)
+{
+    a = Find(a);
+    b = Find(b);
+    // Корень — меньший индекс: нумерация вершин не зависит от порядка слияний
+    if (a < b)
+        m_parent[b] = a;
+    else if (b < a)
+        m_parent[a] = b;
+}
+
+void CPointWelder::Weld()
+{
+    const size_t n = GetPointCount();
+    const double tol2 = m_tolerance * m_tolerance;
+
+    m_parent.resize(n);
+    for (size_t i = 0; i < n; ++i)
+        m_parent[i] = (uint32_t)i;
+    m_next.assign(n, kNone);
+    m_cells.clear();
+    m_cells.reserve(n);
+
+    for (uint32_t i = 0; i < (uint32_t)n; ++i)
+    {
+        const double* p = &m_points[i * 3];
+        const long long cx = CellOf(p[0]);
+        const long long cy = CellOf(p[1]);
+        const long long cz = CellOf(p[2]);
+
+        // Точки в пределах допуска лежат не дальше соседней ячейки
+        for (long long dx = -1; dx <= 1; ++dx)
+        {
+            for (long long dy = -1; dy <= 1; ++dy)
+            {
+                for (long long dz = -1; dz <= 1; ++dz)
+                {
+                    auto it = m_cells.find(CellKey(cx + dx, cy + dy, cz + dz));
+                    if (it == m_cells.end())
+                        continue;
+                    for (uint32_t j = it->second; j != kNone; j = m_next[j])
+                    {
+                        const double* q = &m_points[j * 3];
+                        const double ex = p[0] - q[0];
+                        const double ey = p[1] - q[1];
+                        const double ez = p[2] - q[2];
+                        if (ex * ex + ey * ey + ez * ez < tol2)
+                            Union(i, j);
+                    }
+                }
+            }
+        }
+
+        auto ins = m_cells.insert(std::make_pair(CellKey(cx, cy, cz), i));
+        if (!ins.second)
+        {
+            m_next[i] = ins.first->second;
+            ins.first->second = i;
+        }
+    }
+
+    // Номера вершин и средние положения
+    m_vertexOf.assign(n, kNone);
+    m_vertices.clear();
+    std::vector<uint32_t> members;
+    for (uint32_t i = 0; i < (uint32_t)n; ++i)
+    {
+        const uint32_t root = Find(i);
+        if (m_vertexOf[root] == kNone)
+        {
+            m_vertexOf[root] = (uint32_t)members.size();
+            members.push_back(0);
+            m_vertices.push_back(0.0);
+            m_vertices.push_back(0.0);
+            m_vertices.push_back(0.0);
+        }
+        const uint32_t v = m_vertexOf[root];
+        m_vertexOf[i] = v;
+        ++members[v];
+        for (int k = 0; k < 3; ++k)
+            m_vertices[v * 3 + k] += m_points[i * 3 + k];
+    }
+    for (size_t v = 0; v < members.size(); ++v)
+    {
+        for (int k = 0; k < 3; ++k)
+            m_vertices[v * 3 + k] /= members[v];
+    }
+}
+
+#ifdef POINTWELD_MAIN
+#include <cstdio>
+
+namespace
+{
+bool Check(bool condition, const char* what)
+{
+    std::printf("%-60s %s\n", what, condition ? "ok" : "FAIL");
+    return condition;
+}
+} // namespace
+
+int main()
+{
+    bool ok = true;
+
+    // Точки на соседних узлах сетки разрешения NTL (0,001 мм) — разные вершины,
+    // в том числе вдали от нуля, где разность координат не равна шагу точно
+    {
+        CPointWelder welder;
+        for (int i = 0; i < 5; ++i)
+            welder.AddPoint(123456.789 + i * 1e-3, -98765.432, 10.0);
+        welder.Weld();
+        ok &= Check(welder.GetVertexCount() == 5, "one quantum apart: not welded, no transitive chain");
+    }
+
+    // Шум меньше половины шага — одна вершина, положение — среднее
+    {
+        CPointWelder welder;
+        welder.AddPoint(1000.0, 2000.0, 3000.0);
+        welder.AddPoint(1000.0 + 2e-4, 2000.0 - 1e-4, 3000.0);
+        welder.AddPoint(1000.0 - 1e-4, 2000.0, 3000.0 + 1e-4);
+        welder.Weld();
+        ok &= Check(welder.GetVertexCount() == 1, "rounding noise: one vertex");
+        ok &= Check(std::fabs(welder.GetVertex(0)[0] - (1000.0 + 1e-4 / 3)) < 1e-9, "vertex is the mean of its points");
+    }
+
+    // Расстояние ровно в допуск не склеивается (строгое сравнение)
+    {
+        CPointWelder pair(0.5);
+        pair.AddPoint(0.0, 0.0, 0.0);
+        pair.AddPoint(0.5, 0.0, 0.0);
+        pair.Weld();
+        ok &= Check(pair.GetVertexCount() == 2, "distance equal to tolerance: not welded");
+    }
+
+    // Номера вершин — в порядке первого появления
+    {
+        CPointWelder welder;
+        welder.AddPoint(5.0, 0.0, 0.0);
+        welder.AddPoint(0.0, 0.0, 0.0);
+        welder.AddPoint(5.0 + 1e-4, 0.0, 0.0);
+        welder.Weld();
+        ok &= Check(welder.GetVertexId(0) == 0 && welder.GetVertexId(1) == 1 && welder.GetVertexId(2) == 0,
+            "vertex ids in order of first appearance");
+    }
+
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include "MemAccounting.h"
+
+// Допуск склейки по умолчанию (мм) — половина разрешения NTL (0,001 мм): совпадающие
+// после округления точки склеиваются, соседние точки сетки разрешения — нет
+const double kDefaultWeldTolerance = 0.5e-3;
+
+// Склейка точек в вершины по допуску: точки строго ближе tolerance (и цепочки таких точек)
+// объединяются в одну вершину. Соседи ищутся по хэш-сетке с ячейкой tolerance
+// (27 соседних ячеек), классы — через union-find, поэтому результат не зависит
+// от порядка попарных сравнений, а время — O(n) при ограниченной плотности точек.
+//
+// Проверка без nanoCAD — -DPOINTWELD_MAIN (README, «Проверки без nanoCAD»).
+class CPointWelder
+{
+public:
+    explicit CPointWelder(double tolerance = kDefaultWeldTolerance);
+
+    void SetTolerance(double tolerance);
+    double GetTolerance() const { return m_tolerance; }
+
+    void Clear();
+    void Reserve(size_t count);
+
+    // Добавить точку; возвращает её индекс (порядок добавления)
+    uint32_t AddPoint(double x, double y, double z);
+
+    // Склеить все добавленные точки. Номера вершин выдаются в порядке первого
+    // появления точки класса, положение вершины — среднее её точек.
+    void Weld();
+
+    size_t GetPointCount() const { return m_points.size() / 3; }
+    size_t GetVertexCount() const { return m_vertices.size() / 3; }
+
+    // После Weld()
+    uint32_t GetVertexId(uint32_t pointIndex) const { return m_vertexOf[pointIndex]; }
+    const double* GetVertex(uint32_t vertexId) const { return &m_vertices[vertexId * 3]; }
+
+private:
+    uint32_t Find(uint32_t i);
+    void Union(uint32_t a, uint32_t b);
+    long long CellOf(double v) const;
+
+    double m_tolerance;
+    CountedVector<double> m_points;     // xyz подряд
+    CountedVector<uint32_t> m_parent;
+    CountedVector<uint32_t> m_next;     // следующая точка той же ячейки
+    std::unordered_map<unsigned long long, uint32_t, std::hash<unsigned long long>, std::equal_to<unsigned long long>,
+        CCountingAllocator<std::pair<const unsigned long long, uint32_t>>> m_cells;  // ключ ячейки -> первая точка
+    CountedVector<uint32_t> m_vertexOf; // точка -> вершина
+    CountedVector<double> m_vertices;   // xyz вершин подряд
+};
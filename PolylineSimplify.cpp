@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "PolylineSimplify.h"
+#include <queue>
+
+namespace
+{
+// Участок ломаной между оставленными вершинами a и b с самой далёкой вершиной far
+struct Span
+{
+    uint32_t a;
+    uint32_t b;
+    uint32_t far;
+    double dist2;
+
+    bool operator<(const Span& o) const { return dist2 < o.dist2; }
+};
+
+// Квадрат расстояния от p до отрезка ab
+double SegmentDist2(const double* p, const double* a, const double* b)
+{
+    double ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+    double len2 = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+    double t = len2 > 0.0 ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / len2 : 0.0;
+    if (t < 0.0)
+        t = 0.0;
+    else if (t > 1.0)
+        t = 1.0;
+    double d[3] = { ap[0] - ab[0] * t, ap[1] - ab[1] * t, ap[2] - ab[2] * t };
+    return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+// Участок с самой далёкой вершиной; false — внутри нет вершин
+bool MakeSpan(const std::vector<double>& xyz, uint32_t a, uint32_t b, Span& span)
+{
+    if (b <= a + 1)
+        return false;
+    span.a = a;
+    span.b = b;
+    span.far = a + 1;
+    span.dist2 = -1.0;
+    const double* pa = &xyz[a * 3];
+    const double* pb = &xyz[b * 3];
+    for (uint32_t i = a + 1; i < b; ++i)
+    {
+        double d2 = SegmentDist2(&xyz[i * 3], pa, pb);
+        if (d2 > span.dist2)
+        {
+            span.dist2 = d2;
+            span.far = i;
+        }
+    }
+    return true;
+}
+} // namespace
+
+size_t SimplifyPolylines(const std::vector<double>& xyz, const std::vector<uint32_t>& offsets,
+    size_t vertexBudget, double minDeviation, std::vector<uint8_t>& keep)
+{
+    const size_t n = xyz.size() / 3;
+    keep.assign(n, 0);
+    size_t kept = 0;
+    const double min2 = minDeviation * minDeviation;
+
+    std::priority_queue<Span> queue;
+    for (size_t k = 0; k + 1 < offsets.size(); ++k)
+    {
+        uint32_t a = offsets[k];
+        uint32_t b = offsets[k + 1];
+        if (b <= a)
+            continue;
+        keep[a] = 1;
+        keep[b - 1] = 1;
+        kept += (b - 1 > a) ? 2 : 1;
+        Span span;
+        if (MakeSpan(xyz, a, b - 1, span))
+            queue.push(span);
+    }
+
+    while (kept < vertexBudget && !queue.empty())
+    {
+        Span span = queue.top();
+        queue.pop();
+        if (span.dist2 < min2)
+            break;
+        keep[span.far] = 1;
+        ++kept;
+        Span part;
+        if (MakeSpan(xyz, span.a, span.far, part))
+            queue.push(part);
+        if (MakeSpan(xyz, span.far, span.b, part))
+            queue.push(part);
+    }
+    return kept;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Упрощение ломаных Дугласом–Пекером под общий бюджет вершин (без зависимости от SDK).
+// Вершины всех ломаных лежат подряд в xyz (по три координаты), ломаная k занимает
+// вершины [offsets[k], offsets[k + 1]). Концы ломаных сохраняются всегда; дальше
+// вершины добавляются по убыванию отклонения во всех ломаных сразу, пока не исчерпан
+// бюджет или отклонение не стало меньше minDeviation.
+// keep[i] = 1 — вершина i остаётся. Возвращает число оставленных вершин.
+size_t SimplifyPolylines(const std::vector<double>& xyz, const std::vector<uint32_t>& offsets,
+    size_t vertexBudget, double minDeviation, std::vector<uint8_t>& keep);
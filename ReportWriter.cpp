@@ -0,0 +1,229 @@
+#include "stdafx.h"
+#include "ReportWriter.h"
+#include <charconv>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define REPORTWRITER_SSE2
+#endif
+
+static_assert(sizeof(wchar_t) == 2, "CReportWriter expects UTF-16 wchar_t");
+
+size_t Utf16ToUtf8(const wchar_t* s, size_t n, char* out)
+{
+    char* p = out;
+    size_t i = 0;
+    while (i < n)
+    {
+#ifdef REPORTWRITER_SSE2
+        // Быстрый путь: 8 единиц подряд < 0x80 упаковываются в 8 байт одной командой
+        if (i + 8 <= n)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            __m128i high = _mm_and_si128(v, _mm_set1_epi16((short)0xFF80));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(high, _mm_setzero_si128())) == 0xFFFF)
+            {
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_packus_epi16(v, v));
+                p += 8;
+                i += 8;
+                continue;
+            }
+        }
+#endif
+        unsigned c = (unsigned short)s[i];
+        if (c < 0x80)
+        {
+            *p++ = (char)c;
+            ++i;
+        }
+        else if (c < 0x800)
+        {
+            *p++ = (char)(0xC0 | (c >> 6));
+            *p++ = (char)(0x80 | (c & 0x3F));
+            ++i;
+        }
+        else if (c >= 0xD800 && c <= 0xDBFF && i + 1 < n &&
+            (unsigned short)s[i + 1] >= 0xDC00 && (unsigned short)s[i + 1] <= 0xDFFF)
+        {
+            unsigned cp = 0x10000 + ((c - 0xD800) << 10) + ((unsigned short)s[i + 1] - 0xDC00);
+            *p++ = (char)(0xF0 | (cp >> 18));
+            *p++ = (char)(0x80 | ((cp >> 12) & 0x3F));
+            *p++ = (char)(0x80 | ((cp >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (cp & 0x3F));
+            i += 2;
+        }
+        else
+        {
+            if (c >= 0xD800 && c <= 0xDFFF)
+                c = 0xFFFD;
+            *p++ = (char)(0xE0 | (c >> 12));
+            *p++ = (char)(0x80 | ((c >> 6) & 0x3F));
+            *p++ = (char)(0x80 | (c & 0x3F));
+            ++i;
+        }
+    }
+    return (size_t)(p - out);
+}
+
+CReportWriter::CReportWriter(size_t bufferSize)
+    : m_hFile(INVALID_HANDLE_VALUE)
+    , m_buf(bufferSize < 4096 ? 4096 : bufferSize)
+    , m_used(0)
+    , m_written(0)
+    , m_ok(false)
+{
+}
+
+CReportWriter::~CReportWriter()
+{
+    Close();
+}
+
+bool CReportWriter::Open(const std::wstring& path)
+{
+    Close();
+    m_hFile = CreateFileW(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+        CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    m_used = 0;
+    m_written = 0;
+    m_ok = (m_hFile != INVALID_HANDLE_VALUE);
+    return m_ok;
+}
+
+bool CReportWriter::Close()
+{
+    if (m_hFile == INVALID_HANDLE_VALUE)
+        return m_ok;
+    Flush();
+    CloseHandle(m_hFile);
+    m_hFile = INVALID_HANDLE_VALUE;
+    return m_ok;
+}
+
+bool CReportWriter::Flush()
+{
+    const char* p = m_buf.data();
+    size_t left = m_used;
+    while (m_ok && left > 0)
+    {
+        DWORD chunk = left > 0x40000000u ? 0x40000000u : (DWORD)left;
+        DWORD done = 0;
+        if (!WriteFile(m_hFile, p, chunk, &done, nullptr) || done == 0)
+        {
+            m_ok = false;
+            break;
+        }
+        p += done;
+        left -= done;
+        m_written += done;
+    }
+    m_used = 0;
+    return m_ok;
+}
+
+char* CReportWriter::Reserve(size_t n)
+{
+    if (m_used + n > m_buf.size())
+    {
+        Flush();
+        if (n > m_buf.size())
+            m_buf.resize(n);
+    }
+    return m_buf.data() + m_used;
+}
+
+void CReportWriter::Bom()
+{
+    Raw("\xEF\xBB\xBF", 3);
+}
+
+void CReportWriter::Raw(const char* s, size_t n)
+{
+    char* p = Reserve(n);
+    memcpy(p, s, n);
+    m_used += n;
+}
+
+void CReportWriter::Raw(const char* s)
+{
+    Raw(s, strlen(s));
+}
+
+void CReportWriter::Char(char c)
+{
+    *Reserve(1) = c;
+    ++m_used;
+}
+
+void CReportWriter::Utf8(const wchar_t* s, size_t n)
+{
+    // Кусками, чтобы резерв под худший случай (3 байта на единицу UTF-16) был ограничен
+    const size_t kChunk = 16384;
+    while (n > 0)
+    {
+        size_t chunk = n < kChunk ? n : kChunk;
+        // Не разрываем суррогатную пару между кусками
+        if (chunk < n && s[chunk - 1] >= 0xD800 && s[chunk - 1] <= 0xDBFF)
+            --chunk;
+        m_used += Utf16ToUtf8(s, chunk, Reserve(chunk * 3));
+        s += chunk;
+        n -= chunk;
+    }
+}
+
+void CReportWriter::CsvField(const wchar_t* s, size_t n, wchar_t sep)
+{
+    bool needQuotes = false;
+    for (size_t i = 0; i < n && !needQuotes; ++i)
+    {
+        wchar_t c = s[i];
+        needQuotes = (c == sep || c == L'"' || c == L'\n' || c == L'\r');
+    }
+    if (!needQuotes)
+    {
+        Utf8(s, n);
+        return;
+    }
+
+    // RFC 4180: поле в кавычках, внутренние кавычки удваиваются
+    Char('"');
+    size_t runStart = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (s[i] == L'"')
+        {
+            Utf8(s + runStart, i - runStart);
+            Raw("\"\"", 2);
+            runStart = i + 1;
+        }
+    }
+    Utf8(s + runStart, n - runStart);
+    Char('"');
+}
+
+void CReportWriter::Double(double v)
+{
+    char* p = Reserve(32);
+    std::to_chars_result r = std::to_chars(p, p + 32, v);
+    m_used += (size_t)(r.ptr - p);
+}
+
+void CReportWriter::Int(long long v)
+{
+    char* p = Reserve(24);
+    std::to_chars_result r = std::to_chars(p, p + 24, v);
+    m_used += (size_t)(r.ptr - p);
+}
+
+void CReportWriter::Hex(unsigned long long v)
+{
+    char* p = Reserve(24);
+    std::to_chars_result r = std::to_chars(p, p + 24, v, 16);
+    // Как в AutoCAD: handle в верхнем регистре
+    for (char* c = p; c != r.ptr; ++c)
+    {
+        if (*c >= 'a' && *c <= 'f')
+            *c = (char)(*c - 'a' + 'A');
+    }
+    m_used += (size_t)(r.ptr - p);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// Перекодировка UTF-16 -> UTF-8 (быстрый путь для ASCII).
+// out должен вмещать 3 * n байт; возвращает число записанных байт.
+// Одиночные суррогаты заменяются на U+FFFD, как в WideCharToMultiByte.
+size_t Utf16ToUtf8(const wchar_t* s, size_t n, char* out);
+
+// Буферизованный писатель отчётов (CSV/UTF-8).
+// Всё форматируется в один большой переиспользуемый буфер, который сбрасывается
+// на диск крупными последовательными WriteFile. Строки UTF-16 перекодируются
+// в UTF-8 без промежуточных std::string (быстрый путь для ASCII),
+// числа double пишутся кратчайшим представлением с точным возвратом (std::to_chars).
+class CReportWriter
+{
+public:
+    explicit CReportWriter(size_t bufferSize = 4 << 20);
+    ~CReportWriter();
+
+    CReportWriter(const CReportWriter&) = delete;
+    CReportWriter& operator=(const CReportWriter&) = delete;
+
+    // Создать/перезаписать файл
+    bool Open(const std::wstring& path);
+    // Сбросить буфер и закрыть файл; false — была ошибка записи
+    bool Close();
+    bool IsOk() const { return m_ok; }
+
+    // UTF-8 BOM
+    void Bom();
+    // Сырые байты (ASCII/UTF-8)
+    void Raw(const char* s, size_t n);
+    void Raw(const char* s);
+    void Char(char c);
+    // UTF-16 -> UTF-8
+    void Utf8(const wchar_t* s, size_t n);
+    void Utf8(const std::wstring& s) { Utf8(s.c_str(), s.size()); }
+    // Поле CSV: берётся в кавычки, если содержит разделитель, кавычку или перевод строки
+    void CsvField(const wchar_t* s, size_t n, wchar_t sep = L';');
+    void CsvField(const std::wstring& s, wchar_t sep = L';') { CsvField(s.c_str(), s.size(), sep); }
+    // Число: кратчайшая запись, однозначно восстанавливающая значение
+    void Double(double v);
+    void Int(long long v);
+    // Беззнаковое число в шестнадцатеричном виде (handle объектов)
+    void Hex(unsigned long long v);
+
+    // Принудительно записать накопленное
+    bool Flush();
+
+    // Сколько байт записано в файл (с учётом буфера)
+    unsigned long long GetBytesWritten() const { return m_written + m_used; }
+
+private:
+    // Гарантирует n свободных байт в буфере и возвращает указатель на них
+    char* Reserve(size_t n);
+
+    HANDLE m_hFile;
+    std::vector<char> m_buf;
+    size_t m_used;
+    unsigned long long m_written;
+    bool m_ok;
+};
@@ -0,0 +1,322 @@
+#include "stdafx.h"
+#include "SegmentMerge.h"
+#include <cmath>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEGMENT_MERGE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+const double kMinLength = 1e-12;
+const double kPi = 3.14159265358979323846;
+
+// Прежний порог |cos - 1| < 1e-3 в виде квадрата синуса поворота
+const double kDefaultSin2 = 1.0 - 0.999 * 0.999;
+
+// Меньше стольких сегментов на поток параллелить невыгодно
+const size_t kMinSegmentsPerThread = 32768;
+
+struct MergeBuffers
+{
+    CountedVector<double> ux, uy, uz, len;
+    CountedVector<uint8_t> turnOk;    // поворот от i-1 к i в допуске и joinPrev
+};
+
+// Единичные направления и длины сегментов [b, e)
+void ComputeDirections(const SegmentMergeInput& in, size_t b, size_t e, MergeBuffers& buf)
+{
+    size_t i = b;
+#ifdef SEGMENT_MERGE_SSE2
+    const __m128d eps = _mm_set1_pd(kMinLength);
+    const __m128d one = _mm_set1_pd(1.0);
+    for (; i + 2 <= e; i += 2)
+    {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(&in.ex[i]), _mm_loadu_pd(&in.sx[i]));
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(&in.ey[i]), _mm_loadu_pd(&in.sy[i]));
+        __m128d dz = _mm_sub_pd(_mm_loadu_pd(&in.ez[i]), _mm_loadu_pd(&in.sz[i]));
+        __m128d l = _mm_sqrt_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz)));
+        // Вырожденный сегмент получает нулевое направление и ни с чем не склеивается
+        __m128d inv = _mm_and_pd(_mm_cmpgt_pd(l, eps), _mm_div_pd(one, _mm_max_pd(l, eps)));
+        _mm_storeu_pd(&buf.ux[i], _mm_mul_pd(dx, inv));
+        _mm_storeu_pd(&buf.uy[i], _mm_mul_pd(dy, inv));
+        _mm_storeu_pd(&buf.uz[i], _mm_mul_pd(dz, inv));
+        _mm_storeu_pd(&buf.len[i], l);
+    }
+#endif
+    for (; i < e; ++i)
+    {
+        double dx = in.ex[i] - in.sx[i];
+        double dy = in.ey[i] - in.sy[i];
+        double dz = in.ez[i] - in.sz[i];
+        double l = std::sqrt(dx * dx + dy * dy + dz * dz);
+        double inv = l > kMinLength ? 1.0 / l : 0.0;
+        buf.ux[i] = dx * inv;
+        buf.uy[i] = dy * inv;
+        buf.uz[i] = dz * inv;
+        buf.len[i] = l;
+    }
+}
+
+// Поворот между соседями: dot > 0 и |u(i-1) x u(i)|^2 <= sin2 — для i из [b, e)
+void ComputeTurns(const SegmentMergeInput& in, size_t b, size_t e, double sin2, MergeBuffers& buf)
+{
+    const double* ux = buf.ux.data();
+    const double* uy = buf.uy.data();
+    const double* uz = buf.uz.data();
+    size_t i = b;
+#ifdef SEGMENT_MERGE_SSE2
+    const __m128d tol = _mm_set1_pd(sin2);
+    const __m128d zero = _mm_setzero_pd();
+    for (; i + 2 <= e; i += 2)
+    {
+        __m128d ax = _mm_loadu_pd(ux + i - 1), ay = _mm_loadu_pd(uy + i - 1), az = _mm_loadu_pd(uz + i - 1);
+        __m128d bx = _mm_loadu_pd(ux + i), by = _mm_loadu_pd(uy + i), bz = _mm_loadu_pd(uz + i);
+        __m128d dot = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, bx), _mm_mul_pd(ay, by)), _mm_mul_pd(az, bz));
+        __m128d cx = _mm_sub_pd(_mm_mul_pd(ay, bz), _mm_mul_pd(az, by));
+        __m128d cy = _mm_sub_pd(_mm_mul_pd(az, bx), _mm_mul_pd(ax, bz));
+        __m128d cz = _mm_sub_pd(_mm_mul_pd(ax, by), _mm_mul_pd(ay, bx));
+        __m128d cross2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(cx, cx), _mm_mul_pd(cy, cy)), _mm_mul_pd(cz, cz));
+        int mask = _mm_movemask_pd(_mm_and_pd(_mm_cmpgt_pd(dot, zero), _mm_cmple_pd(cross2, tol)));
+        buf.turnOk[i] = (uint8_t)((mask & 1) && in.joinPrev[i]);
+        buf.turnOk[i + 1] = (uint8_t)((mask & 2) && in.joinPrev[i + 1]);
+    }
+#endif
+    for (; i < e; ++i)
+    {
+        double dot = ux[i - 1] * ux[i] + uy[i - 1] * uy[i] + uz[i - 1] * uz[i];
+        double cx = uy[i - 1] * uz[i] - uz[i - 1] * uy[i];
+        double cy = uz[i - 1] * ux[i] - ux[i - 1] * uz[i];
+        double cz = ux[i - 1] * uy[i] - uy[i - 1] * ux[i];
+        buf.turnOk[i] = (uint8_t)(dot > 0.0 && cx * cx + cy * cy + cz * cz <= sin2 && in.joinPrev[i]);
+    }
+}
+
+// Ветки [b, e): b — начало ветки (joinPrev[b] == 0 или b == 0)
+void MergeRange(const SegmentMergeInput& in, size_t b, size_t e, double sin2, MergeBuffers& buf,
+    CountedVector<SegmentRun>& out)
+{
+    if (b >= e)
+        return;
+    ComputeDirections(in, b, e, buf);
+    buf.turnOk[b] = 0;
+    ComputeTurns(in, b + 1, e, sin2, buf);
+
+    const double* ux = buf.ux.data();
+    const double* uy = buf.uy.data();
+    const double* uz = buf.uz.data();
+    SegmentRun run = { (uint32_t)b, (uint32_t)b, buf.len[b] };
+    for (size_t i = b + 1; i < e; ++i)
+    {
+        if (buf.turnOk[i])
+        {
+            // Отклонение от первого сегмента склейки
+            const size_t f = run.first;
+            double dot = ux[f] * ux[i] + uy[f] * uy[i] + uz[f] * uz[i];
+            double cx = uy[f] * uz[i] - uz[f] * uy[i];
+            double cy = uz[f] * ux[i] - ux[f] * uz[i];
+            double cz = ux[f] * uy[i] - uy[f] * ux[i];
+            if (dot > 0.0 && cx * cx + cy * cy + cz * cz <= sin2)
+            {
+                run.last = (uint32_t)i;
+                run.length += buf.len[i];
+                continue;
+            }
+        }
+        out.push_back(run);
+        run.first = run.last = (uint32_t)i;
+        run.length = buf.len[i];
+    }
+    out.push_back(run);
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+} // namespace
+
+void SegmentMergeInput::Resize(size_t count)
+{
+    sx.resize(count);
+    sy.resize(count);
+    sz.resize(count);
+    ex.resize(count);
+    ey.resize(count);
+    ez.resize(count);
+    joinPrev.resize(count);
+}
+
+void MergeCollinearSegments(const SegmentMergeInput& in, const SegmentMergeOptions& options,
+    std::vector<SegmentRun>& out)
+{
+    out.clear();
+    const size_t n = in.Size();
+    if (n == 0)
+        return;
+
+    double sin2 = kDefaultSin2;
+    if (options.simplifyAngleDeg > 0.0)
+    {
+        double s = std::sin(std::min(options.simplifyAngleDeg, 89.0) * kPi / 180.0);
+        sin2 = std::max(sin2, s * s);
+    }
+
+    MergeBuffers buf;
+    buf.ux.resize(n);
+    buf.uy.resize(n);
+    buf.uz.resize(n);
+    buf.len.resize(n);
+    buf.turnOk.resize(n);
+
+    unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(1, n / kMinSegmentsPerThread));
+
+    // Границы частей — по началам веток, чтобы склейка не переходила между потоками
+    std::vector<size_t> bounds(threads + 1, n);
+    bounds[0] = 0;
+    for (unsigned t = 1; t < threads; ++t)
+    {
+        size_t p = std::max(bounds[t - 1], n * t / threads);
+        while (p < n && in.joinPrev[p])
+            ++p;
+        bounds[t] = p;
+    }
+
+    // Память под результат выделяется заранее: в потоках нет аллокаций и исключений
+    std::vector<CountedVector<SegmentRun>> parts(threads);
+    for (unsigned t = 0; t < threads; ++t)
+        parts[t].reserve(bounds[t + 1] - bounds[t]);
+
+    std::vector<std::thread> workers;
+    workers.reserve(threads);
+    for (unsigned t = 1; t < threads; ++t)
+        workers.emplace_back([&, t]() { MergeRange(in, bounds[t], bounds[t + 1], sin2, buf, parts[t]); });
+    MergeRange(in, bounds[0], bounds[1], sin2, buf, parts[0]);
+    for (auto& w : workers)
+        w.join();
+
+    size_t total = 0;
+    for (const auto& part : parts)
+        total += part.size();
+    out.reserve(total);
+    for (const auto& part : parts)
+        out.insert(out.end(), part.begin(), part.end());
+}
+
+SegmentMergeBenchmark RunSegmentMergeBenchmark(size_t count, size_t branchLength, double collinearShare,
+    double simplifyAngleDeg)
+{
+    SegmentMergeBenchmark result;
+    result.segments = count;
+    if (branchLength == 0)
+        branchLength = 1;
+
+    // Синтетические ветки: случайное блуждание с прямыми участками и малым шумом
+    SegmentMergeInput in;
+    in.Resize(count);
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<double> unit(-1.0, 1.0);
+    std::uniform_real_distribution<double> share(0.0, 1.0);
+    double px = 0.0, py = 0.0, pz = 0.0;
+    double dx = 1.0, dy = 0.0, dz = 0.0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        bool branchStart = i % branchLength == 0;
+        if (branchStart || share(rng) >= collinearShare)
+        {
+            dx = unit(rng);
+            dy = unit(rng);
+            dz = unit(rng) * 0.2;
+        }
+        double len = 100.0 + 900.0 * share(rng);
+        double l = std::sqrt(dx * dx + dy * dy + dz * dz) + 1e-9;
+        in.sx[i] = px;
+        in.sy[i] = py;
+        in.sz[i] = pz;
+        px += dx / l * len + unit(rng) * 1e-4;
+        py += dy / l * len + unit(rng) * 1e-4;
+        pz += dz / l * len;
+        in.ex[i] = px;
+        in.ey[i] = py;
+        in.ez[i] = pz;
+        in.joinPrev[i] = branchStart ? 0 : 1;
+    }
+
+    // Прежний алгоритм: копии сегментов с тремя строками и нормировка обоих векторов на каждой паре
+    struct LegacySegment
+    {
+        std::wstring name, segmentId, pipeName;
+        double s[3], e[3];
+        double length;
+    };
+    std::vector<LegacySegment> legacy(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        LegacySegment& s = legacy[i];
+        s.name = L"SEG" + std::to_wstring(i);
+        s.segmentId = L"BRANCH" + std::to_wstring(i / branchLength);
+        s.pipeName = L"PIPE_" + s.segmentId;
+        s.s[0] = in.sx[i]; s.s[1] = in.sy[i]; s.s[2] = in.sz[i];
+        s.e[0] = in.ex[i]; s.e[1] = in.ey[i]; s.e[2] = in.ez[i];
+        s.length = 0.0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::vector<LegacySegment> merged;
+        merged.reserve(count);
+        for (const LegacySegment& s : legacy)
+        {
+            double d2[3] = { s.e[0] - s.s[0], s.e[1] - s.s[1], s.e[2] - s.s[2] };
+            double len = std::sqrt(d2[0] * d2[0] + d2[1] * d2[1] + d2[2] * d2[2]);
+            if (len < 1e-6)
+                continue;
+            if (!merged.empty())
+            {
+                LegacySegment& last = merged.back();
+                double gap[3] = { s.s[0] - last.e[0], s.s[1] - last.e[1], s.s[2] - last.e[2] };
+                if (last.segmentId == s.segmentId &&
+                    std::sqrt(gap[0] * gap[0] + gap[1] * gap[1] + gap[2] * gap[2]) < 1e-3)
+                {
+                    double d1[3] = { last.e[0] - last.s[0], last.e[1] - last.s[1], last.e[2] - last.s[2] };
+                    double la = std::sqrt(d1[0] * d1[0] + d1[1] * d1[1] + d1[2] * d1[2]);
+                    double dot = (d1[0] / la) * (d2[0] / len) + (d1[1] / la) * (d2[1] / len) + (d1[2] / la) * (d2[2] / len);
+                    if (std::fabs(dot - 1.0) < 1e-3)
+                    {
+                        last.e[0] = s.e[0]; last.e[1] = s.e[1]; last.e[2] = s.e[2];
+                        last.length += len;
+                        continue;
+                    }
+                }
+            }
+            merged.push_back(s);
+        }
+        result.runsScalar = merged.size();
+    }
+    result.scalarMs = ElapsedMs(start);
+
+    SegmentMergeOptions options;
+    options.simplifyAngleDeg = simplifyAngleDeg;
+    std::vector<SegmentRun> runs;
+
+    options.threads = 1;
+    start = std::chrono::steady_clock::now();
+    MergeCollinearSegments(in, options, runs);
+    result.singleThreadMs = ElapsedMs(start);
+
+    options.threads = 0;
+    result.threads = (unsigned)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+        std::max<size_t>(1, count / kMinSegmentsPerThread));
+    start = std::chrono::steady_clock::now();
+    MergeCollinearSegments(in, options, runs);
+    result.parallelMs = ElapsedMs(start);
+    result.runsMerged = runs.size();
+    return result;
+}
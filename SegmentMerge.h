@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "MemAccounting.h"
+
+// Склейка последовательных коллинеарных сегментов импорта (без зависимости от SDK).
+// Координаты лежат в отдельных массивах (SoA), направления и повороты между
+// соседями считаются SIMD-ядром, ветки обрабатываются параллельно.
+// Метаданные (имена, OD/WT) сюда не попадают: вызывающая сторона сама решает,
+// какие соседи совместимы (joinPrev), и переносит метаданные по результату.
+
+struct SegmentMergeInput
+{
+    CountedVector<double> sx, sy, sz;   // начала
+    CountedVector<double> ex, ey, ez;   // концы
+    CountedVector<uint8_t> joinPrev;      // 1 — сегмент i может продолжать i-1 (та же ветка/OD/WT, общая вершина)
+
+    void Resize(size_t count);
+    size_t Size() const { return sx.size(); }
+};
+
+// Результат: сегмент от начала first до конца last
+struct SegmentRun
+{
+    uint32_t first;
+    uint32_t last;
+    double length;      // сумма длин исходных сегментов
+};
+
+struct SegmentMergeOptions
+{
+    // Упрощение: убирать промежуточные вершины с поворотом не больше угла, град.
+    // 0 — только склейка «почти параллельных» (cos >= 0.999, как раньше).
+    double simplifyAngleDeg = 0.0;
+    // Потоков на ветки; 0 — по числу ядер. Мелкие входы считаются в одном потоке.
+    unsigned threads = 0;
+};
+
+// Склеить сегменты. Сегмент присоединяется к текущему, если joinPrev, поворот
+// относительно предыдущего и относительно первого сегмента склейки не больше допуска
+// (второе условие не даёт дуге малых поворотов накопить отклонение).
+void MergeCollinearSegments(const SegmentMergeInput& in, const SegmentMergeOptions& options,
+    std::vector<SegmentRun>& out);
+
+// Замер на синтетических ветках: count сегментов, ветки по branchLength,
+// доля коллинеарных продолжений collinearShare. Время — в миллисекундах.
+struct SegmentMergeBenchmark
+{
+    size_t segments = 0;
+    size_t runsScalar = 0;      // прежний попарный алгоритм
+    size_t runsMerged = 0;
+    double scalarMs = 0.0;
+    double singleThreadMs = 0.0;
+    double parallelMs = 0.0;
+    unsigned threads = 0;
+};
+
+SegmentMergeBenchmark RunSegmentMergeBenchmark(size_t count, size_t branchLength = 200,
+    double collinearShare = 0.7, double simplifyAngleDeg = 0.0);
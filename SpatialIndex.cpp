@@ -0,0 +1,129 @@
+#include "stdafx.h"
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+double Center(const SpatialBox& b, int axis)
+{
+    return (b.min[axis] + b.max[axis]) * 0.5;
+}
+
+// Упорядочить элементы для STR-упаковки по fanout в узел:
+// полосы по X, в них ленты по Y, в лентах — по Z
+template <class T, class BoxOf>
+void StrSort(std::vector<T>& v, size_t fanout, BoxOf boxOf)
+{
+    const size_t n = v.size();
+    if (n <= fanout)
+        return;
+    const size_t pages = (n + fanout - 1) / fanout;
+    const size_t slices = (size_t)std::ceil(std::cbrt((double)pages));
+    auto byAxis = [&boxOf](int axis)
+    {
+        return [&boxOf, axis](const T& a, const T& b) { return Center(boxOf(a), axis) < Center(boxOf(b), axis); };
+    };
+
+    std::sort(v.begin(), v.end(), byAxis(0));
+    const size_t slabSize = slices * slices * fanout;
+    const size_t stripSize = slices * fanout;
+    for (size_t s = 0; s < n; s += slabSize)
+    {
+        const size_t slabEnd = std::min(n, s + slabSize);
+        std::sort(v.begin() + s, v.begin() + slabEnd, byAxis(1));
+        for (size_t t = s; t < slabEnd; t += stripSize)
+            std::sort(v.begin() + t, v.begin() + std::min(slabEnd, t + stripSize), byAxis(2));
+    }
+}
+} // namespace
+
+void CSpatialRTree::Clear()
+{
+    m_nodes.clear();
+    m_items.clear();
+    m_root = 0;
+}
+
+void CSpatialRTree::Build(std::vector<Item> items)
+{
+    Clear();
+    m_items.swap(items);
+    if (m_items.empty())
+        return;
+
+    // Листья
+    StrSort(m_items, kFanout, [](const Item& it) -> const SpatialBox& { return it.box; });
+    std::vector<Node> level;
+    level.reserve((m_items.size() + kFanout - 1) / kFanout);
+    for (size_t i = 0; i < m_items.size(); i += kFanout)
+    {
+        Node node;
+        node.first = (uint32_t)i;
+        node.count = (uint32_t)std::min<size_t>(kFanout, m_items.size() - i);
+        node.leaf = true;
+        node.box = m_items[i].box;
+        for (uint32_t k = 1; k < node.count; ++k)
+            node.box.Expand(m_items[i + k].box);
+        level.push_back(node);
+    }
+
+    // Уровни выше: узлы уровня упорядочиваются так же и складываются в m_nodes подряд
+    for (;;)
+    {
+        StrSort(level, kFanout, [](const Node& n) -> const SpatialBox& { return n.box; });
+        const uint32_t base = (uint32_t)m_nodes.size();
+        m_nodes.insert(m_nodes.end(), level.begin(), level.end());
+        if (level.size() == 1)
+        {
+            m_root = base;
+            break;
+        }
+
+        std::vector<Node> parents;
+        parents.reserve((level.size() + kFanout - 1) / kFanout);
+        for (size_t i = 0; i < level.size(); i += kFanout)
+        {
+            Node node;
+            node.first = base + (uint32_t)i;
+            node.count = (uint32_t)std::min<size_t>(kFanout, level.size() - i);
+            node.leaf = false;
+            node.box = level[i].box;
+            for (uint32_t k = 1; k < node.count; ++k)
+                node.box.Expand(level[i + k].box);
+            parents.push_back(node);
+        }
+        level.swap(parents);
+    }
+}
+
+void CSpatialRTree::Query(const SpatialBox& box, std::vector<uint32_t>& out) const
+{
+    if (m_nodes.empty())
+        return;
+
+    // В стеке не больше (fanout - 1) узлов на уровень: для 2^32 объектов глубина 8 — 121 слот
+    uint32_t stack[256];
+    int top = 0;
+    stack[top++] = m_root;
+    while (top > 0)
+    {
+        const Node& node = m_nodes[stack[--top]];
+        if (!node.box.Intersects(box))
+            continue;
+        if (node.leaf)
+        {
+            for (uint32_t k = 0; k < node.count; ++k)
+            {
+                const Item& it = m_items[node.first + k];
+                if (it.box.Intersects(box))
+                    out.push_back(it.value);
+            }
+        }
+        else
+        {
+            for (uint32_t k = 0; k < node.count; ++k)
+                stack[top++] = node.first + k;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Осевой параллелепипед (WCS)
+struct SpatialBox
+{
+    double min[3];
+    double max[3];
+
+    bool Intersects(const SpatialBox& b) const
+    {
+        return min[0] <= b.max[0] && b.min[0] <= max[0] &&
+            min[1] <= b.max[1] && b.min[1] <= max[1] &&
+            min[2] <= b.max[2] && b.min[2] <= max[2];
+    }
+
+    void Expand(const SpatialBox& b)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            if (b.min[i] < min[i])
+                min[i] = b.min[i];
+            if (b.max[i] > max[i])
+                max[i] = b.max[i];
+        }
+    }
+};
+
+// Статическое R-дерево по экстентам объектов, упакованное методом STR
+// (Sort-Tile-Recursive): узлы заполнены полностью, дети узла лежат подряд.
+// Перестраивается целиком (O(n log n)); запрос по параллелепипеду — O(log n + k).
+class CSpatialRTree
+{
+public:
+    struct Item
+    {
+        SpatialBox box;
+        uint32_t value;     // индекс вызывающей стороны
+    };
+
+    void Clear();
+    void Build(std::vector<Item> items);
+
+    // value всех объектов, чьи экстенты пересекают box
+    void Query(const SpatialBox& box, std::vector<uint32_t>& out) const;
+
+    size_t GetItemCount() const { return m_items.size(); }
+    size_t GetNodeCount() const { return m_nodes.size(); }
+
+private:
+    static const uint32_t kFanout = 16;
+
+    struct Node
+    {
+        SpatialBox box;
+        uint32_t first;     // лист: индекс в m_items, иначе — в m_nodes
+        uint32_t count;
+        bool leaf;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<Item> m_items;
+    uint32_t m_root = 0;
+};
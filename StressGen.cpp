@@ -0,0 +1,106 @@
+#include "stdafx.h"
+#include "StressGen.h"
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+// Ряд профилей: OD / DN, мм
+const double kProfiles[][2] = {
+    { 57.0, 50.0 }, { 89.0, 80.0 }, { 108.0, 100.0 }, { 159.0, 150.0 }, { 219.0, 200.0 }, { 273.0, 250.0 },
+};
+
+// Отступ элементов от концов сегмента и друг от друга, мм
+const double kItemClearance = 300.0;
+} // namespace
+
+void GenerateStressModel(const StressParams& params, std::vector<StressPipe>& pipes)
+{
+    pipes.clear();
+    if (params.pipes <= 0 || params.verticesPerPipe < 2)
+        return;
+
+    std::mt19937 rng(params.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const int profileCount = (int)(sizeof(kProfiles) / sizeof(kProfiles[0]));
+
+    pipes.resize(params.pipes);
+    for (int p = 0; p < params.pipes; ++p)
+    {
+        StressPipe& pipe = pipes[p];
+        const double* profile = kProfiles[rng() % profileCount];
+        pipe.od = profile[0];
+        pipe.dn = profile[1];
+
+        // Ортогональная ломаная: каждый следующий участок поворачивает на 90 градусов
+        double pt[3] = { 0.0, p * params.pipeSpacing, 0.0 };
+        int lastAxis = -1;
+        pipe.xyz.insert(pipe.xyz.end(), pt, pt + 3);
+        for (int v = 1; v < params.verticesPerPipe; ++v)
+        {
+            int axis = lastAxis < 0 ? 0 : (lastAxis + 1 + (int)(rng() % 2)) % 3;
+            // По X трубы идут вперёд, по Y/Z — в обе стороны, но не дальше половины шага по Y
+            double len = params.segmentLength * (0.5 + unit(rng));
+            if (axis == 1)
+                len = std::min(len, params.pipeSpacing * 0.4);
+            double sign = (axis == 0 || (rng() % 2) == 0) ? 1.0 : -1.0;
+            if (axis == 1 && std::fabs(pt[1] + sign * len - p * params.pipeSpacing) > params.pipeSpacing * 0.45)
+                sign = -sign;
+            pt[axis] += sign * len;
+            pipe.xyz.insert(pipe.xyz.end(), pt, pt + 3);
+            lastAxis = axis;
+        }
+
+        // Элементы: число на сегмент — по плотности на метр с дробной частью по жребию
+        const int segCount = params.verticesPerPipe - 1;
+        for (int s = 0; s < segCount; ++s)
+        {
+            const double* a = &pipe.xyz[s * 3];
+            const double* b = &pipe.xyz[(s + 1) * 3];
+            double len = std::sqrt((b[0] - a[0]) * (b[0] - a[0]) + (b[1] - a[1]) * (b[1] - a[1]) + (b[2] - a[2]) * (b[2] - a[2]));
+            if (len <= 2.0 * kItemClearance)
+                continue;
+
+            auto countFor = [&](double perMeter)
+            {
+                double n = perMeter * len / 1000.0;
+                int whole = (int)n;
+                return whole + (unit(rng) < n - whole ? 1 : 0);
+            };
+            const int supports = countFor(params.supportsPerMeter);
+            const int inlines = countFor(params.inlinesPerMeter);
+
+            std::vector<StressItem> segItems;
+            for (int i = 0; i < supports + inlines; ++i)
+            {
+                StressItem item;
+                item.segIndex = s;
+                item.offset = kItemClearance + unit(rng) * (len - 2.0 * kItemClearance);
+                if (i < supports)
+                {
+                    item.kind = StressItem::Kind::Support;
+                }
+                else
+                {
+                    double r = unit(rng);
+                    item.kind = r < params.reducerShare ? StressItem::Kind::Reducer :
+                        (r < params.reducerShare + params.teeShare ? StressItem::Kind::Tee : StressItem::Kind::Valve);
+                }
+                segItems.push_back(item);
+            }
+
+            // По возрастанию смещения, слишком близкие — отбрасываются
+            std::sort(segItems.begin(), segItems.end(),
+                [](const StressItem& x, const StressItem& y) { return x.offset < y.offset; });
+            double lastOffset = -kItemClearance;
+            for (const StressItem& item : segItems)
+            {
+                if (item.offset - lastOffset < kItemClearance)
+                    continue;
+                pipe.items.push_back(item);
+                lastOffset = item.offset;
+            }
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Генератор нагрузочной модели для STRESSPIPES (без зависимости от SDK):
+// трубы — ортогональные ломаные со случайными длинами участков, профиль — из ряда
+// стандартных OD, опоры и инлайны — случайно по длине с заданной плотностью.
+// При одинаковом seed модель воспроизводится полностью.
+
+struct StressParams
+{
+    int pipes = 10;
+    int verticesPerPipe = 4;            // точек на трубу (сегментов на один меньше)
+    double supportsPerMeter = 0.2;
+    double inlinesPerMeter = 0.1;
+    double reducerShare = 0.1;          // доля переходов среди инлайнов
+    double teeShare = 0.1;              // доля тройников среди инлайнов
+    unsigned seed = 1;
+    double segmentLength = 6000.0;      // средняя длина участка, мм
+    double pipeSpacing = 3000.0;        // шаг труб по Y, мм
+};
+
+struct StressItem
+{
+    enum class Kind { Support, Valve, Reducer, Tee };
+    Kind kind;
+    int segIndex;
+    double offset;                      // от начала сегмента, мм
+};
+
+struct StressPipe
+{
+    std::vector<double> xyz;            // точки оси подряд
+    double od = 0.0;
+    double dn = 0.0;
+    std::vector<StressItem> items;      // по сегментам, по возрастанию смещения
+};
+
+void GenerateStressModel(const StressParams& params, std::vector<StressPipe>& pipes);
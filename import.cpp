@@ -20,6 +20,9 @@
 #include "rxregsvc.h"
 #include "acgi.h"
 #include "aced.h"
+#include "PointWeld.h"
+#include "ImportProgress.h"
+#include "BlockInput.h"
 
 // ViperCS / Model Studio
 #include "vCSCreatePipe.h"
@@ -36,9 +39,10 @@
 namespace {
 
     // --------- PCF structures ----------
-    struct PcfPipe { int id{}; AcGePoint3d p1{}, p2{}; double dia{ 0.0 }; };
-    struct PcfElbow { int id{}; AcGePoint3d p1{}, p2{}, center{}; double dia{ 0.0 }; double angleDeg{ 0.0 }; };
-    struct PcfValve { int id{}; AcGePoint3d p1{}, p2{}, center{}; double dia{ 0.0 }; };
+    // hasP1 — первая END-POINT уже прочитана (точка (0,0,0) допустима и признаком не служит)
+    struct PcfPipe { int id{}; AcGePoint3d p1{}, p2{}; bool hasP1{ false }; double dia{ 0.0 }; };
+    struct PcfElbow { int id{}; AcGePoint3d p1{}, p2{}, center{}; bool hasP1{ false }; double dia{ 0.0 }; double angleDeg{ 0.0 }; };
+    struct PcfValve { int id{}; AcGePoint3d p1{}, p2{}, center{}; bool hasP1{ false }; double dia{ 0.0 }; };
     struct PcfSupport { int id{}; AcGePoint3d pt{}; };
 
     struct PcfData {
@@ -65,14 +69,17 @@ namespace {
             std::stod(t[idx + 2]));
     }
 
+    // .pcf.gz / .pcf.zst распаковываются при чтении (BlockInput.h)
     static bool parsePcf(const std::wstring& file, PcfData& d) {
-        std::ifstream in(file);
-        if (!in) return false;
+        CBlockInput in;
+        if (!in.Open(file)) return false;
+        std::string_view bytes;
         std::string line;
         enum class Sec { None, Pipe, Elbow, Valve, Support } sec = Sec::None;
         PcfPipe curP; PcfElbow curE; PcfValve curV; PcfSupport curS;
 
-        while (std::getline(in, line)) {
+        while (in.ReadLine(bytes)) {
+            line.assign(bytes.data(), bytes.size());
             if (line.empty()) continue;
             auto t = split(line);
             if (t.empty()) continue;
@@ -84,7 +91,7 @@ namespace {
             if (sec == Sec::Pipe) {
                 if (t[0] == "COMPONENT-IDENTIFIER") curP.id = std::stoi(t[1]);
                 else if (t[0] == "END-POINT" && t.size() >= 5) {
-                    if (curP.p1 == AcGePoint3d()) curP.p1 = toPt(t, 1); else curP.p2 = toPt(t, 1);
+                    if (!curP.hasP1) { curP.p1 = toPt(t, 1); curP.hasP1 = true; } else curP.p2 = toPt(t, 1);
                 }
                 else if (t[0] == "COMPONENT-ATTRIBUTE3") curP.dia = std::stod(t[1]);
                 else if (t[0] == "ITEM-DESCRIPTION") {
@@ -94,7 +101,7 @@ namespace {
             else if (sec == Sec::Elbow) {
                 if (t[0] == "COMPONENT-IDENTIFIER") curE.id = std::stoi(t[1]);
                 else if (t[0] == "END-POINT" && t.size() >= 5) {
-                    if (curE.p1 == AcGePoint3d()) curE.p1 = toPt(t, 1); else curE.p2 = toPt(t, 1);
+                    if (!curE.hasP1) { curE.p1 = toPt(t, 1); curE.hasP1 = true; } else curE.p2 = toPt(t, 1);
                 }
                 else if (t[0] == "CENTRE-POINT" && t.size() >= 4) curE.center = toPt(t, 1);
                 else if (t[0] == "COMPONENT-ATTRIBUTE3") curE.dia = std::stod(t[1]);
@@ -104,7 +111,7 @@ namespace {
             else if (sec == Sec::Valve) {
                 if (t[0] == "COMPONENT-IDENTIFIER") curV.id = std::stoi(t[1]);
                 else if (t[0] == "END-POINT" && t.size() >= 5) {
-                    if (curV.p1 == AcGePoint3d()) curV.p1 = toPt(t, 1); else curV.p2 = toPt(t, 1);
+                    if (!curV.hasP1) { curV.p1 = toPt(t, 1); curV.hasP1 = true; } else curV.p2 = toPt(t, 1);
                 }
                 else if (t[0] == "CENTRE-POINT" && t.size() >= 4) curV.center = toPt(t, 1);
                 else if (t[0] == "COMPONENT-ATTRIBUTE3") curV.dia = std::stod(t[1]);
@@ -118,6 +125,8 @@ namespace {
                 }
             }
         }
+        // Обрезанный или повреждённый архив — неполные данные не импортируются
+        if (!in.GetError().empty()) return false;
         // default diameter from first non-zero
         for (auto& p : d.pipes) if (p.dia > 0) { d.defaultDia = p.dia; break; }
         for (auto& e : d.elbows) if (e.dia > 0) { d.defaultDia = e.dia; break; }
@@ -161,7 +170,7 @@ void importPcfCmd()
     // 1) запрос файла
     wchar_t pathBuf[MAX_PATH] = L"";
     struct resbuf result;
-    if (acedGetFileD(L"PCF файл", nullptr, L"pcf", 0, &result) != RTNORM) {
+    if (acedGetFileD(L"PCF файл", nullptr, L"pcf;gz;zst", 0, &result) != RTNORM) {
         acutPrintf(L"\nОтмена.");
         return;
     }
@@ -175,11 +184,29 @@ void importPcfCmd()
     PcfData pcf;
     if (!parsePcf(pathBuf, pcf)) { acutPrintf(L"\nНе удалось прочитать PCF."); return; }
 
-    // 2) собрать путь (упрощённо: по PIPE и ELBOW в порядке файла)
-    AcGePoint3dArray path;
+    // 2) собрать путь (упрощённо: по PIPE и ELBOW в порядке файла).
+    // Концы труб склеиваются по допуску: начало трубы, совпавшее с концом предыдущей,
+    // не дублируется, разрыв между трубами остаётся в пути явной точкой.
+    CPointWelder welder;
     for (auto& p : pcf.pipes) {
-        if (path.isEmpty()) path.append(p.p1);
-        path.append(p.p2);
+        welder.AddPoint(p.p1.x, p.p1.y, p.p1.z);
+        welder.AddPoint(p.p2.x, p.p2.y, p.p2.z);
+    }
+    welder.Weld();
+    auto vertexPt = [&welder](uint32_t v) {
+        const double* xyz = welder.GetVertex(v);
+        return AcGePoint3d(xyz[0], xyz[1], xyz[2]);
+    };
+
+    AcGePoint3dArray path;
+    uint32_t lastVertex = 0;
+    for (size_t i = 0; i < pcf.pipes.size(); ++i) {
+        uint32_t v1 = welder.GetVertexId((uint32_t)(i * 2));
+        uint32_t v2 = welder.GetVertexId((uint32_t)(i * 2 + 1));
+        if (v1 == v2) continue; // нулевая труба
+        if (path.isEmpty() || v1 != lastVertex) path.append(vertexPt(v1));
+        path.append(vertexPt(v2));
+        lastVertex = v2;
     }
     for (auto& e : pcf.elbows) {
         // добавим излом через точку центра
@@ -203,8 +230,16 @@ void importPcfCmd()
     // 5) вставка фитингов (valve) и опор
     vCSDragManagerSmart dms; auto* dm = dms.operator->();
 
+    // Прогресс по фазам; Esc прерывает между элементами, созданное фиксируется
+    CImportProgress progress(L"IMPORTPCF");
+    bool cancelled = false;
+    int valvesDone = 0, supportsDone = 0;
+
     // VALVE: вставляем inline (тип til_inline) в центре
+    progress.BeginPhase(L"valves", (int)pcf.valves.size());
     for (auto& v : pcf.valves) {
+        if (progress.IsCancelled()) { cancelled = true; break; }
+        progress.Step();
         vCS_DM_Seg* seg = nullptr; AcGePoint3d pc; const vCSProfileBase* prof = nullptr;
         if (!findSegByPoint(dm, axisId, v.center, seg, pc, prof)) {
             acutPrintf(L"\n⚠ Valve %d: не найден сегмент.", v.id);
@@ -216,10 +251,14 @@ void importPcfCmd()
         Acad::ErrorStatus es = dm->m_InLineCreate.ReCalculateModelMainInLineCreate(
             seg->OID(), prof, pc, nType, nullptr, false, nullptr);
         if (es != Acad::eOk) acutPrintf(L"\n⚠ Valve %d: ошибка %d", v.id, es);
+        else ++valvesDone;
     }
 
     // SUPPORT: ставим опору в точке
+    progress.BeginPhase(L"supports", cancelled ? 0 : (int)pcf.supports.size());
     for (auto& s : pcf.supports) {
+        if (cancelled || progress.IsCancelled()) { cancelled = true; break; }
+        progress.Step();
         vCS_DM_Seg* seg = nullptr; AcGePoint3d pc; const vCSProfileBase* prof = nullptr;
         if (!findSegByPoint(dm, axisId, s.pt, seg, pc, prof)) {
             acutPrintf(L"\n⚠ Support %d: не найден сегмент.", s.id);
@@ -234,10 +273,17 @@ void importPcfCmd()
             AcDbObjectId::kNull, nullptr,
             st_Support, true, false);
         if (es != Acad::eOk) acutPrintf(L"\n⚠ Support %d: ошибка %d", s.id, es);
+        else ++supportsDone;
     }
+    progress.EndPhase();
 
     dms.commit();
-    acutPrintf(L"\n✅ Импорт PCF завершён.");
+    if (cancelled)
+        acutPrintf(L"\nИмпорт PCF прерван: труба создана, арматура %d из %d, опоры %d из %d.",
+            valvesDone, (int)pcf.valves.size(), supportsDone, (int)pcf.supports.size());
+    else
+        acutPrintf(L"\n✅ Импорт PCF завершён: арматура %d из %d, опоры %d из %d.",
+            valvesDone, (int)pcf.valves.size(), supportsDone, (int)pcf.supports.size());
 }
 
 // ncrxEntryPoint реализована в HelloNRX.cpp
\ No newline at end of file